@@ -0,0 +1,46 @@
+#pragma once
+#include <Arduino.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include "resources/utils/timing.h"
+
+/**
+ * The device's key material, parsed once. OTACrypto and DeviceSecurity used
+ * to parse the embedded device certificate or private key PEM on every verify,
+ * decrypt and sign, tens of milliseconds each and a burst of heap churn. Here
+ * each one is parsed on first use into a context that lives until reboot (in
+ * PSRAM with BOARD_HAS_PSRAM, as far as the contexts themselves go; where
+ * mbedtls puts the key's numbers is up to CONFIG_MBEDTLS_EXTERNAL_MEM_ALLOC),
+ * next to one DRBG seeded once per boot.
+ *
+ * mbedtls contexts aren't safe to share between tasks, so every operation
+ * holds one mutex. Verify and sign times are kept in microseconds for the
+ * cloud variables.
+ */
+class CryptoCache
+{
+public:
+    // SHA-256 hash against the public key of the device certificate
+    static bool verify(const uint8_t *hash, size_t hashLen, const uint8_t *sig, size_t sigLen);
+    // SHA-256 hash with the device private key
+    static bool sign(const uint8_t *hash, size_t hashLen, uint8_t *sig, size_t cap, size_t &sigLen);
+    static bool decrypt(const uint8_t *in, size_t inLen, uint8_t *out, size_t cap, size_t &outLen);
+    static bool random(uint8_t *out, size_t n);
+    // NUL-terminated PEM of the CA, for setCACert
+    static const char *caCertificate();
+
+    static hyphen::timing::Latency signLatency;
+    static hyphen::timing::Latency verifyLatency;
+    // the last of each, for Hyphen.variable
+    static unsigned long signLatencyUs;
+    static unsigned long verifyLatencyUs;
+
+private:
+    static bool lock_();
+    static void unlock_();
+    static bool drbgReady_();
+    static bool certReady_();
+    static bool keyReady_();
+};
@@ -12,13 +12,21 @@
 extern const uint8_t _binary_src_certs_private_key_pem_start[] asm("_binary_src_certs_private_key_pem_start");
 extern const uint8_t _binary_src_certs_private_key_pem_end[] asm("_binary_src_certs_private_key_pem_end");
 
+extern const uint8_t _binary_src_certs_device_cert_pem_start[] asm("_binary_src_certs_device_cert_pem_start");
+extern const uint8_t _binary_src_certs_device_cert_pem_end[] asm("_binary_src_certs_device_cert_pem_end");
+
 extern const uint8_t _binary_src_certs_isrgrootx1_pem_start[] asm("_binary_src_certs_isrgrootx1_pem_start");
 extern const uint8_t _binary_src_certs_isrgrootx1_pem_end[] asm("_binary_src_certs_isrgrootx1_pem_end");
+// "p2_" + 16 base64url characters + NUL, see resources/utils/payload_id.h
+#define PAYLOAD_ID_SIZE 24
+
 class DeviceSecurity
 {
 public:
     // Signs a message using the embedded device private key (PEM).
     static String makePayloadId(const String &deviceId);
+    // Same id written into out; returns its length, 0 on failure.
+    static size_t makePayloadId(char *out, size_t cap);
     // Output is base64 signature.
     static bool signToBase64(const String &message, String &outSigB64);
     static const char *getCaCertificate();
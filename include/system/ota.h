@@ -13,6 +13,7 @@
 #include <Update.h>
 #include "Hyphen.h"
 #include "system/device-security.h"
+#include "system/crypto-cache.h"
 /**
  * @brief NEEDS TESTING. This class is used to update the firmware of the device
  *
@@ -22,13 +23,7 @@
 #define BUILD_ID_MAX_LEN 64
 // extern const uint8_t _binary_src_certs_isrgrootx1_pem_start[] asm("_binary_src_certs_isrgrootx1_pem_start");
 // extern const uint8_t _binary_src_certs_isrgrootx1_pem_end[] asm("_binary_src_certs_isrgrootx1_pem_end");
-// Externs for your embedded certs
-extern const uint8_t _binary_src_certs_device_cert_pem_start[] asm("_binary_src_certs_device_cert_pem_start");
-extern const uint8_t _binary_src_certs_device_cert_pem_end[] asm("_binary_src_certs_device_cert_pem_end");
-
-extern const uint8_t _binary_src_certs_private_key_pem_start[] asm("_binary_src_certs_private_key_pem_start");
-extern const uint8_t _binary_src_certs_private_key_pem_end[] asm("_binary_src_certs_private_key_pem_end");
-
+// The device certificate and key are parsed once, see system/crypto-cache.h
 class OTACrypto
 {
 public:
@@ -36,20 +31,6 @@ public:
     bool verifySignature(const String &payloadJson, const String &signatureBase64)
     {
         int ret;
-        mbedtls_x509_crt cert;
-        mbedtls_x509_crt_init(&cert);
-
-        const uint8_t *cert_start = _binary_src_certs_device_cert_pem_start;
-        size_t cert_len = _binary_src_certs_device_cert_pem_end - _binary_src_certs_device_cert_pem_start;
-
-        ret = mbedtls_x509_crt_parse(&cert, cert_start, cert_len);
-        if (ret != 0)
-        {
-            Serial.printf("❌ x509_crt_parse failed: -0x%04x\n", -ret);
-            mbedtls_x509_crt_free(&cert);
-            return false;
-        }
-
         // Hash the payload
         unsigned char hash[32];
         ret = mbedtls_sha256_ret((const unsigned char *)payloadJson.c_str(),
@@ -57,7 +38,6 @@ public:
         if (ret != 0)
         {
             Serial.printf("❌ sha256_ret failed: -0x%04x\n", -ret);
-            mbedtls_x509_crt_free(&cert);
             return false;
         }
 
@@ -70,23 +50,11 @@ public:
         if (ret != 0)
         {
             Serial.printf("❌ base64_decode failed: -0x%04x\n", -ret);
-            mbedtls_x509_crt_free(&cert);
             return false;
         }
 
         // Verify signature using public key inside the cert
-        ret = mbedtls_pk_verify(&cert.pk, MBEDTLS_MD_SHA256,
-                                hash, sizeof(hash),
-                                sig_buf, sig_len);
-        mbedtls_x509_crt_free(&cert);
-
-        if (ret != 0)
-        {
-            Serial.printf("❌ signature verify failed: -0x%04x\n", -ret);
-            return false;
-        }
-
-        return true;
+        return CryptoCache::verify(hash, sizeof(hash), sig_buf, sig_len);
     }
 
     // Decrypt payload: encryptedBase64 is the base64-encoded encrypted payload
@@ -95,22 +63,6 @@ public:
     bool decryptPayload(const String &encryptedBase64, String &outPayload)
     {
         int ret;
-        mbedtls_pk_context pk;
-        mbedtls_pk_init(&pk);
-
-        const uint8_t *priv_start = _binary_src_certs_private_key_pem_start;
-        size_t priv_len = _binary_src_certs_private_key_pem_end - _binary_src_certs_private_key_pem_start;
-
-        ret = mbedtls_pk_parse_key(&pk, priv_start, priv_len, NULL, 0);
-        if (ret != 0)
-        {
-            char buf[128];
-            mbedtls_strerror(ret, buf, sizeof(buf));
-            Serial.printf("❌ pk_parse_key failed: %s\n", buf);
-            mbedtls_pk_free(&pk);
-            return false;
-        }
-
         // Decode the base64-encoded encrypted data
         size_t enc_len = 0;
         size_t max_buf = 512; // adjust if needed
@@ -122,7 +74,6 @@ public:
             char buf[128];
             mbedtls_strerror(ret, buf, sizeof(buf));
             Serial.printf("❌ base64_decode (encrypted) failed: %s\n", buf);
-            mbedtls_pk_free(&pk);
             return false;
         }
 
@@ -130,23 +81,14 @@ public:
         unsigned char dec_buf[512];
         size_t dec_len = 0;
 
-        // RSA decryption: using pk context
-        ret = mbedtls_pk_decrypt(&pk, enc_buf, enc_len,
-                                 dec_buf, &dec_len, sizeof(dec_buf),
-                                 NULL, NULL);
-        if (ret != 0)
+        // RSA decryption with the cached private key
+        if (!CryptoCache::decrypt(enc_buf, enc_len, dec_buf, sizeof(dec_buf), dec_len))
         {
-            char buf[128];
-            mbedtls_strerror(ret, buf, sizeof(buf));
-            Serial.printf("❌ pk_decrypt failed: %s\n", buf);
-            mbedtls_pk_free(&pk);
             return false;
         }
 
         // Convert decrypted bytes into String
         outPayload = String((char *)dec_buf, dec_len);
-
-        mbedtls_pk_free(&pk);
         return true;
     }
 };
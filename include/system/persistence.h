@@ -2,18 +2,28 @@
 #define PERSISTENCE_H
 
 #include <Preferences.h>
+#include "resources/utils/kv_cache.h"
+
+// Dirty keys reach NVS this long after the first unflushed put at the latest,
+// see resources/utils/kv_cache.h
+#ifndef PERSIST_FLUSH_INTERVAL_MS
+#define PERSIST_FLUSH_INTERVAL_MS 30000
+#endif
 
 class Persistence
 {
 public:
     const String persistanceAddressBase = "address_key_";
     explicit Persistence(const char *namespaceName = "hyphen_storage");
-    ~Persistence() { end(); }
+    ~Persistence();
     bool begin();
     bool begin(const char *);
     void end();
     template <typename T>
     bool put(const char *key, const T &value);
+    // put and written to NVS before it returns; true once it is there
+    template <typename T>
+    bool putNow(const char *key, const T &value);
     template <typename T>
     bool get(const char *key, T &value);
     template <typename T>
@@ -21,43 +31,65 @@ public:
     template <typename T>
     bool get(uint16_t key, T &value);
     void clear();
+    // writes the dirty keys now
+    size_t flush();
+    // flushes once PERSIST_FLUSH_INTERVAL_MS passed, for every instance
+    static void loop();
+    // NVS writes per key since boot, for watching flash wear
+    uint32_t writes(const char *key);
+    unsigned long *writesVariable() { return &writeGauge; }
+    void printWrites();
 
 private:
+    // the Preferences calls behind the cache
+    class Nvs
+    {
+    public:
+        explicit Nvs(Persistence &owner) : owner(owner) {}
+        long length(const char *key);
+        size_t read(const char *key, void *out, size_t len);
+        bool write(const char *key, const void *data, size_t len);
+
+    private:
+        Persistence &owner;
+    };
     bool isOpen = false;
     Preferences preferences;
     const char *namespaceName;
+    Nvs nvs;
+    hyphen::kv::WriteBackCache<Nvs> cache;
+    SemaphoreHandle_t mutex = nullptr;
+    uint32_t dirtySince = 0;
+    unsigned long writeGauge = 0;
     String keyToString(uint16_t key);
     void openPreferences();
     void closePreferences();
+    bool putBytes(const char *key, const void *data, size_t len, bool now = false);
+    bool getBytes(const char *key, void *out, size_t len);
+    size_t flushLocked();
+    // every instance, flushed by loop() and before a restart
+    Persistence *nextInstance = nullptr;
+    static Persistence *instances;
+    static bool shutdownHandlerSet;
+    static void shutdownHandler();
 };
 
 template <typename T>
 bool Persistence::put(const char *key, const T &value)
 {
-    openPreferences();
-    size_t dataSize = sizeof(T);
-    size_t writtenSize = preferences.putBytes(key, &value, dataSize);
-    closePreferences();
-    return (writtenSize == dataSize);
+    return putBytes(key, &value, sizeof(T));
+}
+
+template <typename T>
+bool Persistence::putNow(const char *key, const T &value)
+{
+    return putBytes(key, &value, sizeof(T), true);
 }
 
 template <typename T>
 bool Persistence::get(const char *key, T &value)
 {
-    openPreferences();
-    size_t dataSize = sizeof(T);
-    Serial.printf("get %s is key %d \n", key, preferences.isKey(key));
-    if (!preferences.isKey(key))
-    {
-        return false; // Key not found
-    }
-    if (preferences.getBytesLength(key) != dataSize)
-    {
-        return false; // Size mismatch
-    }
-    size_t readSize = preferences.getBytes(key, &value, dataSize);
-    closePreferences();
-    return (readSize == dataSize);
+    return getBytes(key, &value, sizeof(T));
 }
 
 template <typename T>
@@ -74,4 +106,4 @@ bool Persistence::get(uint16_t key, T &value)
     return get(keyStr.c_str(), value);
 }
 
-#endif // PERSISTENCE_H
\ No newline at end of file
+#endif // PERSISTENCE_H
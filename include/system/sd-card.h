@@ -8,17 +8,42 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <Arduino.h>
+#include <freertos/queue.h>
+#include "system/sd-writer.h"
+#include "resources/utils/sd_jobs.h"
+#include "resources/utils/block_reader.h"
 
-struct SDJob
-{
-    char *path;
-    char *message;
-    uint64_t maxBytes;
-};
+#ifndef SD_JOB_QUEUE_LENGTH
+#define SD_JOB_QUEUE_LENGTH 16
+#endif
+
+// A queued SD operation, see resources/utils/sd_jobs.h
+typedef hyphen::sdjobs::Job SDJob;
+typedef hyphen::sdjobs::Result SDResult;
+typedef hyphen::sdjobs::Future SDFuture;
+typedef hyphen::sdjobs::Callback SDCallback;
 
 class SDCard
 {
 public:
+    /**
+     * SdFile-like handle for a reader that stays open between reads. It holds
+     * the SPI mutex only while it touches the card and settles the SDWriter's
+     * buffered appends to the file before each read.
+     */
+    class SharedFile
+    {
+    public:
+        bool open(const char *path, int flags);
+        int read(void *buf, size_t len);
+        bool seekSet(uint64_t pos);
+        bool close();
+
+    private:
+        SdFile file;
+        String path;
+    };
+
     SDCard();
     ~SDCard();
 
@@ -29,6 +54,7 @@ public:
     bool ready();
 
     // Read up to 'term' (default '\n') from 'path' starting at startPoint.
+    // For more than one line, use an SDReader instead.
     String read(const String &path, unsigned long &startPoint, char terminatingChar = '\n');
 
     // Overwrite entire file
@@ -37,6 +63,15 @@ public:
     // Append line synchronously
     uint64_t appendln(const String &path, const String &message);
 
+    // Append raw bytes synchronously. Returns the new file size (0 on failure)
+    uint64_t append(const String &path, const uint8_t *data, size_t len);
+
+    // Overwrite 'len' bytes at 'offset' in place, creating the file if needed
+    bool writeAt(const String &path, uint64_t offset, const uint8_t *data, size_t len);
+
+    // Read up to 'len' raw bytes at 'offset'. Returns the number of bytes read
+    size_t readBytes(const String &path, uint64_t offset, uint8_t *buf, size_t len);
+
     // Quick SPI wake-up (optional)
     void bridgeSpi();
 
@@ -50,8 +85,46 @@ public:
 
     uint64_t fileSize(const String &path);
     bool exists(const String &path);
+    bool remove(const String &path);
+
+    // Buffered appends to files kept open, see system/sd-writer.h
+    SDWriter &writer() { return sdWriter; }
+
+    // Asynchronous jobs, run in order on the SD worker task. They return
+    // false right away when the queue is full, they never block the caller.
+    bool appendAsync(const String &path, const uint8_t *data, size_t len, uint64_t maxBytes = 0,
+                     SDCallback callback = nullptr, void *context = nullptr, SDFuture *future = nullptr);
+    bool appendlnAsync(const String &path, const String &message, uint64_t maxBytes = 0);
+    bool readAsync(const String &path, uint64_t offset, size_t len,
+                   SDCallback callback, void *context = nullptr, SDFuture *future = nullptr);
+    bool overwriteAsync(const String &path, const String &content,
+                        SDCallback callback = nullptr, void *context = nullptr, SDFuture *future = nullptr);
+    bool removeAsync(const String &path);
+    // Commits the SDWriter's buffers on the worker
+    bool commitAsync();
+    uint32_t pendingJobs();
+    // True when no job is queued and the SPI bus comes free within waitMs
+    bool idle(uint32_t waitMs);
+    uint32_t droppedJobs() const { return jobsDropped; }
 
 private:
+    friend class SDWriter;
+    SDWriter sdWriter;
+
+    // The SD worker task and its job queue
+    static QueueHandle_t jobQueue;
+    static TaskHandle_t workerHandle;
+    static void workerTask(void *param);
+    bool startWorker();
+    bool enqueue(SDJob &job);
+    void runJob(SDJob &job);
+    std::atomic<bool> commitQueued{false};
+    volatile uint32_t jobsDropped = 0;
+
+    // Commits buffered appends when the system restarts
+    static void shutdownHandler();
+    bool shutdownHandlerSet = false;
+
     // Internal helper to lock SPI and call sd.begin()
     bool guardedBegin();
 
@@ -79,4 +152,7 @@ private:
     SDCard &operator=(const SDCard &) = delete;
 };
 
+// Streams a file through a 4 KB buffer, see resources/utils/block_reader.h
+typedef hyphen::io::BlockReader<SDCard::SharedFile> SDReader;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+// SDWriter.h
+
+#ifndef _SD_WRITER_H
+#define _SD_WRITER_H
+
+#include <SdFat.h>
+#include <Arduino.h>
+#include "resources/utils/write_policy.h"
+
+#ifndef SD_WRITER_BUFFER_SIZE
+#define SD_WRITER_BUFFER_SIZE 2048
+#endif
+// Durability policy, see resources/utils/write_policy.h
+#ifndef SD_COMMIT_MAX_RECORDS
+#define SD_COMMIT_MAX_RECORDS 16
+#endif
+#ifndef SD_COMMIT_MAX_AGE_MS
+#define SD_COMMIT_MAX_AGE_MS 5000
+#endif
+// How long an append from a caller with somewhere else to put the record
+// (the offline store's RAM ring) waits for the SPI bus
+#ifndef SD_APPEND_WAIT_MS
+#define SD_APPEND_WAIT_MS 50
+#endif
+
+class SDCard;
+
+/**
+ * Buffered appends to SD files that stay open between writes. Appends are
+ * gathered per file in a sector-aligned buffer and committed (written and
+ * synced) together according to the CommitPolicy, on commit(), or on a
+ * power-fail warning. Owned by SDCard, which settles a file here before any
+ * other access to it, so reads always see buffered appends.
+ */
+class SDWriter
+{
+public:
+    // Called after a commit with the durable size of each committed file.
+    // Runs without the SPI mutex held, so it may touch the card itself.
+    typedef void (*CommitHook)(void *context, const String &path, uint64_t durableSize);
+
+    explicit SDWriter(SDCard &card);
+    ~SDWriter();
+
+    void setPolicy(const hyphen::sdwriter::CommitPolicy &policy);
+    void onCommit(CommitHook hook, void *context);
+
+    // Buffered append. Returns the file size including buffered bytes (0 on
+    // failure, or when the SPI bus stayed busy for longer than wait)
+    uint64_t append(const String &path, const uint8_t *data, size_t len, TickType_t wait = portMAX_DELAY);
+    uint64_t appendln(const String &path, const String &line);
+    // Sets bits in the byte at offset, in place: in the buffer while it is
+    // still there, through the open handle otherwise. The file stays open and
+    // the change is synced with the next commit, like an append.
+    bool setBits(const String &path, uint64_t offset, uint8_t bits);
+
+    // Commits once the policy's record count or age limit is reached
+    void loop();
+    // Writes and syncs every buffered append now
+    bool commit();
+    // Commits and closes every file, the card may lose power any moment
+    void powerFail();
+
+    uint32_t bytesPerSecond();
+    const hyphen::sdwriter::WriteStats &stats() const { return writeStats; }
+
+private:
+    friend class SDCard;
+
+    struct HotFile
+    {
+        String path;
+        SdFile file;
+        uint8_t *buffer = nullptr;
+        size_t used = 0;
+        uint64_t size = 0; // on the card, excluding the buffer
+        uint32_t lastUse = 0;
+        bool open = false;
+        bool dirty = false;
+    };
+
+    static const uint8_t MAX_HOT_FILES = 2;
+    static const uint8_t MAX_HOOKS = 2;
+    static const uint8_t MAX_NOTIFY = MAX_HOT_FILES + 1;
+    const size_t bufferSize = hyphen::sdwriter::alignedCapacity(SD_WRITER_BUFFER_SIZE);
+
+    SDCard &card;
+    HotFile hot[MAX_HOT_FILES];
+    hyphen::sdwriter::CommitPolicy policy;
+    hyphen::sdwriter::GroupCommit group = hyphen::sdwriter::GroupCommit(policy);
+    hyphen::sdwriter::WriteStats writeStats;
+    CommitHook hooks[MAX_HOOKS] = {nullptr, nullptr};
+    void *hookContext[MAX_HOOKS] = {nullptr, nullptr};
+    // files synced since the hooks last ran
+    String notifyPath[MAX_NOTIFY];
+    uint64_t notifySize[MAX_NOTIFY];
+    uint8_t notifyCount = 0;
+
+    // everything below expects the SPI mutex to be held
+    HotFile *find(const String &path);
+    HotFile *acquire(const String &path);
+    bool writeBuffer(HotFile &hot);
+    bool syncFile(HotFile &hot);
+    void closeFile(HotFile &hot);
+    bool commitLocked();
+    // make buffered appends visible to another handle, keeping the file open
+    void settle(const String &path);
+    // commit and close, before the file is truncated, rewritten or removed
+    void release(const String &path);
+    // the card is gone, drop handles without touching it
+    void drop();
+    void queueNotify(const String &path, uint64_t size);
+    // runs the commit hooks, takes the mutex itself
+    void notify();
+
+    SDWriter(const SDWriter &) = delete;
+    SDWriter &operator=(const SDWriter &) = delete;
+};
+
+#endif
@@ -57,6 +57,7 @@ public:
     String format(String, const char *);
     String format(unsigned long, const char *);
     String format(const char *);
+    size_t format(unsigned long, const char *, char *, size_t);
     unsigned long now();
     bool init(Connection &);
     float tzOffset();
@@ -109,7 +109,13 @@ void Bootstrap::init()
 {
     setFunctions();
     setMetaAddresses();
-    pullRegistration();
+    if (!loadRegistrySnapshot())
+    {
+        // first boot with snapshots, or a damaged one: read every slot once
+        pullRegistration();
+        pullDeviceConfigs();
+        saveRegistrySnapshot();
+    }
     Hyphen.keepAlive(30);
     bootstrap();
     applyTimeZone();
@@ -145,7 +151,76 @@ void Bootstrap::storeDevice(String device, int index)
     }
     Utils::machineNameDirect(device, config.device);
     uint16_t address = deviceConfigAddresses[index];
+    deviceConfigs[index] = config;
+    // the slot key is kept up to date for firmware without snapshots
     Persist.put(address, config);
+    saveRegistrySnapshot();
+}
+
+/**
+ * @private
+ *
+ * loadRegistrySnapshot
+ *
+ * Reads the device meta, the registered devices and the slot configs
+ * from a single NVS blob
+ * @return bool - false when it is missing or not valid for this build
+ */
+bool Bootstrap::loadRegistrySnapshot()
+{
+    hyphen::snapshot::Sealed<DeviceRegistry> *snapshot = new hyphen::snapshot::Sealed<DeviceRegistry>();
+    bool loaded = Persist.get(REGISTRY_SNAPSHOT_KEY, *snapshot) &&
+                  hyphen::snapshot::valid(*snapshot, REGISTRY_SNAPSHOT_VERSION) &&
+                  Utils::validConfigIdentity(snapshot->body.meta.version);
+    if (loaded)
+    {
+        deviceMeta = snapshot->body.meta;
+        memcpy(devices, snapshot->body.devices, sizeof(devices));
+        memcpy(deviceConfigs, snapshot->body.configs, sizeof(deviceConfigs));
+    }
+    delete snapshot;
+    Utils::log("DEVICE_REGISTRY_SNAPSHOT", loaded ? String(deviceMeta.count) + " devices" : String("rebuilding"));
+    return loaded;
+}
+
+/**
+ * @private
+ *
+ * saveRegistrySnapshot
+ *
+ * Writes the registry blob. Called when addDevice, removeDevice,
+ * clearAllDevices or a new registration change the layout; Persist
+ * coalesces a burst of them into one NVS write.
+ * @return void
+ */
+void Bootstrap::saveRegistrySnapshot()
+{
+    hyphen::snapshot::Sealed<DeviceRegistry> *snapshot = new hyphen::snapshot::Sealed<DeviceRegistry>();
+    snapshot->body.meta = deviceMeta;
+    memcpy(snapshot->body.devices, devices, sizeof(devices));
+    memcpy(snapshot->body.configs, deviceConfigs, sizeof(deviceConfigs));
+    hyphen::snapshot::seal(*snapshot, REGISTRY_SNAPSHOT_VERSION);
+    Persist.put(REGISTRY_SNAPSHOT_KEY, *snapshot);
+    delete snapshot;
+}
+
+/**
+ * @private
+ *
+ * pullDeviceConfigs
+ *
+ * Reads each slot's device config key, for building the first snapshot
+ * @return void
+ */
+void Bootstrap::pullDeviceConfigs()
+{
+    for (uint8_t i = 0; i < MAX_DEVICES; i++)
+    {
+        if (!Persist.get(deviceConfigAddresses[i], deviceConfigs[i]))
+        {
+            deviceConfigs[i] = {255};
+        }
+    }
 }
 
 // void printHeapStats()
@@ -173,6 +248,7 @@ void Bootstrap::printMem()
     sprintf(buffer, "total %lu, current %lu, last %lu, delta %d", ESP.getHeapSize(), freemem, freememLast, delta);
     Utils::log("MEMORY CHANGE", String(buffer));
     freememLast = freemem;
+    Persist.printWrites();
     // Hyphen.hyConnect().printCore1StackUsage();
     // printHeapStats();
 }
@@ -190,14 +266,12 @@ void Bootstrap::strapDevices(String *devices)
 {
     for (uint8_t i = 0; i < MAX_DEVICES; i++)
     {
-        uint16_t address = deviceConfigAddresses[i];
-        DeviceConfig config;
-        if (!Persist.get(address, config) || !Utils::validConfigIdentity(config.version))
+        if (!Utils::validConfigIdentity(deviceConfigs[i].version))
         {
             devices[i] = "";
             continue;
         }
-        devices[i] = Utils::machineToReadableName(config.device);
+        devices[i] = Utils::machineToReadableName(deviceConfigs[i].device);
     }
 }
 
@@ -424,7 +498,6 @@ DeviceStruct Bootstrap::getDeviceByName(String name, uint16_t size)
     for (size_t i = 0; i < MAX_DEVICES && i < this->deviceMeta.count; i++)
     {
         DeviceStruct device = this->devices[i];
-        Utils::log("SEARCHING_FOR_REGISTERED_DEVICE", String(dName) + " " + String(device.name) + " " + String(dName == device.name));
         if (dName == device.name)
         {
             return device;
@@ -470,6 +543,7 @@ void Bootstrap::clearDeviceConfigArray()
         DeviceStruct d = {255, 0};
         devices[i] = d;
     }
+    saveRegistrySnapshot();
 }
 
 /**
@@ -595,6 +669,7 @@ void Bootstrap::addNewDeviceToStructure(DeviceStruct device)
     Persist.put(address, device);
     this->deviceMeta.count++;
     saveDeviceMetaDetails();
+    saveRegistrySnapshot();
 }
 
 /**
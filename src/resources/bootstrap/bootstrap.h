@@ -6,6 +6,7 @@
 #include "Hyphen.h"
 #include "resources/utils/battery.h"
 #include "resources/utils/utils.h"
+#include "resources/utils/snapshot.h"
 #define PRINT_MEMORY 1
 #define STORAGE_SIZE 8197
 static const int TIMEZONE = TIMEZONE_SET;
@@ -31,6 +32,15 @@ struct DeviceStruct
     uint16_t address;
 };
 
+// everything strapDevices and registerAddress need, read as one NVS blob at
+// boot, see resources/utils/snapshot.h
+struct DeviceRegistry
+{
+    DeviceMetaStruct meta;
+    DeviceStruct devices[MAX_DEVICES];
+    DeviceConfig configs[MAX_DEVICES];
+};
+
 struct EpromStruct
 {
     uint8_t version;
@@ -74,6 +84,13 @@ private:
 
     DeviceMetaStruct deviceMeta;
     DeviceStruct devices[MAX_DEVICES];
+    DeviceConfig deviceConfigs[MAX_DEVICES];
+    // bump when DeviceRegistry changes meaning without changing size
+    static const uint16_t REGISTRY_SNAPSHOT_VERSION = 1;
+    const char *REGISTRY_SNAPSHOT_KEY = "dev_registry";
+    bool loadRegistrySnapshot();
+    void saveRegistrySnapshot();
+    void pullDeviceConfigs();
     DeviceStruct getDeviceByName(String, uint16_t);
     void saveDeviceMetaDetails();
     uint16_t getNextDeviceAddress();
@@ -4,10 +4,9 @@
 #include <ArduinoJson.h>
 #include <math.h>
 
-// Constructor: initialize sample index and pass the Bootstrap pointer to the base class.
+// Constructor: pass the Bootstrap pointer to the base class.
 Accelerometer::Accelerometer(Bootstrap *boots) : Device(boots)
 {
-    sampleIndex = 0;
     readyToRead = false;
     boots = boots;
 }
@@ -47,8 +46,8 @@ void Accelerometer::init()
     // TEMP_CFG_REG: setting bits 7 and 6 (0xC0) enables the sensor.
     writeRegister(TEMP_CFG_REG, 0xC0);
 
-    // Reset the sample buffer.
-    sampleIndex = 0;
+    // Reset the sample buffers.
+    samples.clear();
     // applyCalibration();
 }
 
@@ -111,7 +110,8 @@ void Accelerometer::setFunction()
 void Accelerometer::read()
 {
 
-    if (!readyToRead || sampleIndex >= SAMPLE_BUFFER_SIZE)
+    AccelSamples &fresh = samples.fresh();
+    if (!readyToRead || fresh.count >= SAMPLE_BUFFER_SIZE)
     {
         return;
     }
@@ -121,31 +121,35 @@ void Accelerometer::read()
     Serial.println("READ");
     float temp = readTemperature();
     Serial.println("TEMP");
-    readings[sampleIndex].ax = x;
-    readings[sampleIndex].ay = y;
-    readings[sampleIndex].az = z;
-    readings[sampleIndex].temperature = temp;
+    fresh.readings[fresh.count].ax = x;
+    fresh.readings[fresh.count].ay = y;
+    fresh.readings[fresh.count].az = z;
+    fresh.readings[fresh.count].temperature = temp;
     Serial.println("APPLIED");
-    Serial.println(sampleIndex);
-    sampleIndex++;
+    Serial.println(fresh.count);
+    fresh.count++;
 }
 
-void Accelerometer::clearWriter(JsonObject &writer)
+void Accelerometer::clearWriter(PayloadWriter &writer)
 {
-    writer["avg_x"] = 0;
-    writer["avg_y"] = 0;
-    writer["avg_z"] = 0;
-    writer["avg_temp"] = 0;
-    writer["avg_mag"] = 0;
-    writer["max_mag"] = 0;
-    writer["min_mag"] = 0;
-    // writer["sample_count"] = 0;
+    writer.add("avg_x", 0);
+    writer.add("avg_y", 0);
+    writer.add("avg_z", 0);
+    writer.add("avg_temp", 0);
+    writer.add("avg_mag", 0);
+    writer.add("max_mag", 0);
+    writer.add("min_mag", 0);
+    // writer.add("sample_count", 0);
 }
 
 // publish() is called at the publish interval (1–15 minutes).
 // It aggregates the buffered data (e.g., averages, min/max values) and writes a JSON payload.
-void Accelerometer::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+// Reads carry on in the other buffer meanwhile.
+void Accelerometer::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
+    const AccelSamples &frozen = samples.swap();
+    const AccelReading *readings = frozen.readings;
+    const size_t sampleIndex = frozen.count;
     if (!readyToRead || sampleIndex == 0)
     {
         return clearWriter(writer);
@@ -182,17 +186,14 @@ void Accelerometer::publish(JsonObject &writer, uint8_t attempt_count, const Str
     float avg_temp = sum_temp / sampleIndex;
     float avg_mag = sum_mag / (float)sampleIndex;
 
-    writer["avg_x"] = avg_x;
-    writer["avg_y"] = avg_y;
-    writer["avg_z"] = avg_z;
-    writer["avg_temp"] = avg_temp;
-    writer["avg_mag"] = avg_mag;
-    writer["max_mag"] = max_mag;
-    writer["min_mag"] = min_mag;
-    // writer["sample_count"] = sampleIndex;
-
-    // After publishing, clear the sample buffer.
-    sampleIndex = 0;
+    writer.add("avg_x", avg_x);
+    writer.add("avg_y", avg_y);
+    writer.add("avg_z", avg_z);
+    writer.add("avg_temp", avg_temp);
+    writer.add("avg_mag", avg_mag);
+    writer.add("max_mag", max_mag);
+    writer.add("min_mag", min_mag);
+    // writer.add("sample_count", sampleIndex);
 }
 
 // loop() is called continuously; for this device no background loop processing is required.
@@ -201,17 +202,23 @@ void Accelerometer::loop()
     // You could add non-blocking tasks here if needed.
 }
 
-// clear() resets the sample buffer.
+// clear() resets the sample buffers.
 void Accelerometer::clear()
 {
-    sampleIndex = 0;
+    samples.clear();
+}
+
+// published() has nothing to reset: the swap in publish() gave reads an empty buffer.
+void Accelerometer::published()
+{
 }
 
 // print() outputs the current stored samples (for debugging purposes).
 void Accelerometer::print()
 {
     Serial.println("Accelerometer Sample Buffer:");
-    for (size_t i = 0; i < sampleIndex; i++)
+    const AccelReading *readings = samples.fresh().readings;
+    for (size_t i = 0; i < samples.fresh().count; i++)
     {
         float mag = sqrt((float)readings[i].ax * readings[i].ax +
                          (float)readings[i].ay * readings[i].ay +
@@ -2,6 +2,7 @@
 #define ACCELEROMETER_H
 
 #include "device.h"
+#include "resources/utils/ping_pong.h"
 #include <ArduinoJson.h>
 
 // Define the power pin (must be pulled high) per your requirement.
@@ -32,6 +33,17 @@ struct AccelReading
     float temperature;
 };
 
+// The readings of one publish interval.
+struct AccelSamples
+{
+    AccelReading readings[SAMPLE_BUFFER_SIZE];
+    size_t count;
+    void reset()
+    {
+        count = 0;
+    }
+};
+
 struct AccStruct
 {
     uint8_t version;
@@ -48,19 +60,19 @@ public:
     // Overridden Device functions:
     virtual void init();
     virtual void read();
-    virtual void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId);
+    virtual void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId);
     virtual void loop();
     virtual void clear();
+    virtual void published();
     virtual void print();
     virtual String name();
     virtual uint8_t paramCount();
 
 private:
-    // Buffer for sensor samples.
     Bootstrap *boots;
-    AccelReading readings[Constants::OVERFLOW_VAL];
+    // Buffers for sensor samples: read() fills one while publish() averages the other.
+    hyphen::sample::PingPong<AccelSamples> samples;
     bool readyToRead = false;
-    size_t sampleIndex;
     int tempOffset = 0;
     void setFunction();
     int setTemperatureOffset(String);
@@ -76,7 +88,7 @@ private:
     uint8_t readRegister(uint8_t reg);
     void readAccelData(int16_t &x, int16_t &y, int16_t &z);
     float readTemperature();
-    void clearWriter(JsonObject &);
+    void clearWriter(PayloadWriter &);
 };
 
 #endif // ACCELEROMETER_H
\ No newline at end of file
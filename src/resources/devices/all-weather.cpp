@@ -56,7 +56,7 @@ void AllWeather::init()
  *
  * @return void
  */
-void AllWeather::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void AllWeather::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
     return sdi->publish(writer, attempt_count);
 }
@@ -144,6 +144,20 @@ void AllWeather::clear()
     return sdi->clear();
 }
 
+/**
+ * @public
+ *
+ * published
+ *
+ * @brief Called once the payload is written
+ *
+ * @return void
+ */
+void AllWeather::published()
+{
+    return sdi->published();
+}
+
 /**
  * @public
  *
@@ -57,13 +57,13 @@ void Battery::restoreDefaults()
  *
  * @return void
  */
-void Battery::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void Battery::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
-    writer[percentname] = round(getNormalizedSoC());
-    writer[voltsname] = getAvgRead();
-    writer[pow] = FuelGauge.getPower_mW();
-    writer[current] = FuelGauge.getCurrent_mA();
-    writer[solarVolts] = FuelGauge.getSolarVCell();
+    writer.add(percentname, round(getNormalizedSoC()));
+    writer.add(voltsname, getAvgRead());
+    writer.add(pow, FuelGauge.getPower_mW());
+    writer.add(current, FuelGauge.getCurrent_mA());
+    writer.add(solarVolts, FuelGauge.getSolarVCell());
     clear();
 }
 
@@ -40,7 +40,7 @@ public:
     float getVCell();
     float getNormalizedSoC();
     inline float batteryCharge();
-    void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId);
+    void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId);
 };
 
 #endif
\ No newline at end of file
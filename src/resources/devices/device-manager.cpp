@@ -1,5 +1,8 @@
 #include "device-manager.h"
 #include "resources/utils/timing.h"
+#ifdef BOARD_HAS_PSRAM
+#include <esp_heap_caps.h>
+#endif
 /**
  * ~DeviceManager
  *
@@ -81,7 +84,6 @@ void DeviceManager::recommendMaintenance()
     unsigned int attempts = Hyphen.connectionAttempts();
     if (recommendRadioSilence(attempts))
     {
-        storedRecords = 0;
         Utils::log("Entering Low Power Mode for Radio Silence", String(LOW_POWER_MODE_CHECK_INTERVAL));
         powerSaveMode = true;
         return radioDown(LOW_POWER_MODE_CHECK_INTERVAL);
@@ -162,7 +164,6 @@ void DeviceManager::init()
     Serial.println("BootStrapping");
     boots.init();
     Log.noticeln("ITERATING DEVICES");
-    vTaskDelay(pdMS_TO_TICKS(2000));
     waitForTrue(&DeviceManager::isStrapped, this, 10000);
     // // if there are already default devices, let's process
     // // their init before we run the dynamic configuration
@@ -180,10 +181,92 @@ void DeviceManager::init()
     Log.noticeln("Clearing Array");
     // delay(2000);
     clearArray();
-    // need a new way to do this
-    storedRecords = Utils::storage.countEntries();
-    // vTaskDelay(pdMS_TO_TICKS(2000));
-    // Serial.println("Stored Records: " + String(storedRecords));
+    // loads the offline store superblock (and converts a legacy
+    // popStorage.txt) so the backlog count is known without a scan
+    Utils::storage.init();
+    Utils::log("STORED_RECORDS", String(Utils::storage.backlog()));
+    deviceId = Hyphen.deviceID();
+    payloadId.reserve(PAYLOAD_ID_SIZE);
+#ifdef COMPACT_PUBLISH
+    Persist.get(schemaKey, announcedSchema);
+#endif
+    if (!Persist.get(exceptionKey, exceptionSettings) || exceptionSettings.version != hyphen::rbe::kSettingsVersion)
+    {
+        exceptionSettings = hyphen::rbe::Settings();
+    }
+    if (!Persist.get(backlogOrderKey, backlogOrder) || backlogOrder > hyphen::lanes::OLDEST_FIRST)
+    {
+        backlogOrder = hyphen::lanes::NEWEST_FIRST;
+    }
+    attachPublishBuffer();
+    startPublisher();
+#ifdef LOW_POWER_SERIES
+    attachSeries();
+#endif
+}
+
+/**
+ * @private
+ *
+ * publishAlloc
+ *
+ * Allocates one of the buffers the publish path keeps for good, from PSRAM
+ * when the board has it
+ *
+ * @return uint8_t *
+ */
+static uint8_t *publishAlloc(size_t size)
+{
+#ifdef BOARD_HAS_PSRAM
+    return (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    return (uint8_t *)malloc(size);
+#endif
+}
+
+/**
+ * @private
+ *
+ * attachPublishBuffer
+ *
+ * Allocates the buffer every publish payload is written into, once
+ *
+ * @return bool
+ */
+bool DeviceManager::attachPublishBuffer()
+{
+    if (publishBuffer)
+    {
+        return true;
+    }
+    publishBuffer = publishAlloc(PUBLISH_BUFFER_SIZE);
+    if (!publishBuffer)
+    {
+        Log.errorln("No memory for the %d byte publish buffer", PUBLISH_BUFFER_SIZE);
+        return false;
+    }
+#ifdef COMPACT_PUBLISH
+    // the frame is far smaller than the JSON it expands to, which still has to
+    // fit PUBLISH_BUFFER_SIZE for the store and the archive
+    schemaDictionary = publishAlloc(SCHEMA_DICTIONARY_SIZE);
+    expandBuffer = (char *)publishAlloc(PUBLISH_BUFFER_SIZE);
+    if (!schemaDictionary || !expandBuffer)
+    {
+        Log.errorln("No memory for the compact publish buffers");
+        free(schemaDictionary);
+        free(expandBuffer);
+        free(publishBuffer);
+        schemaDictionary = nullptr;
+        expandBuffer = nullptr;
+        publishBuffer = nullptr;
+        return false;
+    }
+    publishWriter = PublishEncoder(publishBuffer, PUBLISH_BUFFER_SIZE, schemaDictionary, SCHEMA_DICTIONARY_SIZE);
+    expandWriter = hyphen::payload::JsonWriter(expandBuffer, PUBLISH_BUFFER_SIZE);
+#else
+    publishWriter = PublishEncoder(publishBuffer, PUBLISH_BUFFER_SIZE);
+#endif
+    return true;
 }
 
 /**
@@ -233,19 +316,6 @@ bool DeviceManager::isNotPublishing()
     return !publishBusy;
 }
 
-/**
- * @public
- *
- * isNotReading
- *
- * It is not currently in read mode
- * @return bool - true if a read event can proceed
- */
-bool DeviceManager::isNotReading()
-{
-    return !readBusy;
-}
-
 /**
  * @public
  *
@@ -285,6 +355,9 @@ void DeviceManager::loop()
     processTimers();
     iterateDevices(&DeviceManager::loopCallback, this);
     Blue.loop();
+    Storage.writer().loop();
+    Persistence::loop();
+    publisherEvents();
 }
 
 //////////////////////////////
@@ -374,14 +447,29 @@ void DeviceManager::runOfflineCheck()
 {
     boots.resetOfflineCheck();
     // Serial.printf("Checking offline data %d %d \n");
-    // it's not a perfect world, so we allow it to be negative
-    // if we didn't account for the correct number of records
-    if (lowPowerModeSet || storedRecords <= 0 || !isNotPublishing() || !processor->ready())
+    if (lowPowerModeSet || !isNotPublishing() || !processor->ready())
     {
         return;
     }
-    Utils::log("Popping offline data", "number of records=" + String(storedRecords));
-    popOfflineCollection();
+    if (Utils::archive.replaying())
+    {
+        Utils::archive.replayStep();
+    }
+    if (Utils::storage.backlog() == 0)
+    {
+        return;
+    }
+    // the live lane goes first
+    uint16_t budget = backlogBudget.take(outbox.pending());
+    if (budget == 0)
+    {
+        return;
+    }
+    Utils::log("Popping offline data", "number of records=" + String(Utils::storage.backlog()) +
+                                           ", budget=" + String(budget) + ", order=" + hyphen::lanes::orderName(backlogOrder));
+    uint32_t start = millis();
+    uint16_t sent = popOfflineCollection(budget);
+    backlogBudget.onBacklog(sent, hyphen::timing::elapsed(start, millis()));
 }
 
 /**
@@ -444,12 +532,33 @@ void DeviceManager::storePayload(String payload, String topic)
 {
     if (Utils::storage.push(topic, payload))
     {
-        storedRecords++;
-        return Utils::log("STORED_PAYLOAD", String(storedRecords));
+        return Utils::log("STORED_PAYLOAD", String(Utils::storage.backlog()));
     }
     Utils::log("ERROR_STORING_PAYLOAD", payload);
 }
 
+/**
+ * @private
+ *
+ * storePayload
+ *
+ * Stores a payload from the publish path, in the encoding it was written in
+ *
+ * @param bool packed - it is MessagePack
+ *
+ * @return void
+ */
+void DeviceManager::storePayload(const char *topic, const uint8_t *payload, size_t length, bool packed)
+{
+    bool stored = packed ? Utils::storage.pushPacked(topic, payload, length)
+                         : Utils::storage.push(topic, String((const char *)payload, length));
+    if (stored)
+    {
+        return Utils::log("STORED_PAYLOAD", String(Utils::storage.backlog()));
+    }
+    Log.errorln("ERROR_STORING_PAYLOAD of %d bytes", length);
+}
+
 /**
  * @private
  *
@@ -483,15 +592,13 @@ void DeviceManager::heartbeat()
  */
 void DeviceManager::read()
 {
-    waitForTrue(&DeviceManager::isNotPublishing, this, 10000);
-    readBusy = true;
+    // devices read into the buffer publish() didn't freeze, so no waiting
     iterateDevices(&DeviceManager::setReadCallback, this);
     read_count++;
     if (read_count >= MAX_SEND_TIME)
     {
         setReadCount(0);
     }
-    readBusy = false;
     Utils::log("READ_EVENT", "READCOUNT=" + String(read_count));
 }
 
@@ -518,9 +625,7 @@ void DeviceManager::publish()
     // (cloud/NTP-synced) time.
     Time.storeTimeToPersist();
 
-    waitForTrue(&DeviceManager::isNotReading, this, 10000);
     Utils::log("PUBLICATION_EVENT", "EVENT=" + processor->getPublishTopic(false));
-    // waitFor(DeviceManager::isNotReading, 10000);
     publisher();
     read_count = 0;
 }
@@ -530,13 +635,16 @@ void DeviceManager::publish()
  *
  * popOfflineCollection
  *
- * Asks the storage to pop off data stored while offline
- * @return void
+ * Asks the storage to pop off data stored while offline, in the backlog
+ * lane's order and budget
+ *
+ * @param uint16_t budget - records this offline check may send
+ *
+ * @return uint16_t - the records sent
  */
-void DeviceManager::popOfflineCollection()
+uint16_t DeviceManager::popOfflineCollection(uint16_t budget)
 {
-    uint8_t count = Utils::storage.popOneOffline();
-    storedRecords -= count;
+    return Utils::storage.drainLane(budget, backlogOrder);
 }
 
 /**
@@ -558,6 +666,36 @@ void DeviceManager::packagePayload(JsonDocument &writer)
     writer["__id"] = DeviceSecurity::makePayloadId(Hyphen.deviceID());
 }
 
+/**
+ * @private
+ *
+ * packagePayload
+ *
+ * Writes the payload details into the publish buffer. The payload id is
+ * kept in payloadId for the devices.
+ *
+ * @param PayloadWriter &writer
+ *
+ * @return void
+ */
+void DeviceManager::packagePayload(PayloadWriter &writer)
+{
+    char scratch[PAYLOAD_ID_SIZE > 32 ? PAYLOAD_ID_SIZE : 32];
+#ifdef COMPACT_PUBLISH
+    // the frame header carries the time, the session the device
+    writer.add("target", this->ROTATION);
+#else
+    writer.add("device", deviceId.c_str());
+    writer.add("target", this->ROTATION);
+    Time.format(Time.now(), TIME_FORMAT_ISO8601_FULL, scratch, sizeof(scratch));
+    writer.add("date", scratch);
+#endif
+    DeviceSecurity::makePayloadId(scratch, sizeof(scratch));
+    // the reserved capacity holds it, so this doesn't allocate
+    payloadId = scratch;
+    writer.add("__id", scratch);
+}
+
 /**
  * @private
  *
@@ -598,34 +736,82 @@ String DeviceManager::getTopic(bool maintenance)
  *
  * payloadWriter
  *
- * Wraps the json buffer into a string
+ * Writes the payload of every device into the publish buffer
  *
- * @return String
+ * @return bool - false when the payload didn't fit
  */
-String DeviceManager::payloadWriter(uint8_t &maintenanceCount)
+bool DeviceManager::payloadWriter(uint8_t &maintenanceCount)
 {
+    PayloadWriter &writer = publishWriter;
+#ifdef COMPACT_PUBLISH
+    publishWriter.begin(Time.now());
+#else
+    writer.reset();
+    writer.beginObject();
+#endif
+    packagePayload(writer);
+    bool keyframe = true;
+    if (exceptionSettings.enabled)
+    {
+        keyframe = exceptionTracker.keyframe(Time.now(), exceptionSettings.keyframeSeconds);
+        // without it the cloud can't tell a parameter left out from one lost
+        writer.add("keyframe", keyframe);
+    }
+    writeDevices(writer, maintenanceCount, keyframe);
+    writer.endObject();
+    Log.noticeln("MAINTENANCE_COUNT %d", maintenanceCount);
+    return writer.complete();
+}
 
-    // size_t bufferSize = getBufferSize();
-    JsonDocument doc;
-    packagePayload(doc);
-    String payloadId = doc["__id"] | "";
+/**
+ * @private
+ *
+ * writeDevices
+ *
+ * Writes one object per device slot ("payload", "payload-1", ...) with what
+ * its devices publish, and counts their maintenance. With report by
+ * exception on, the devices write through a filter that holds back the
+ * numbers that didn't move, unless this is a keyframe.
+ *
+ * @param bool keyframe - every parameter goes out
+ *
+ * @return void
+ */
+void DeviceManager::writeDevices(PayloadWriter &writer, uint8_t &maintenanceCount, bool keyframe)
+{
+#ifdef COMPACT_PUBLISH
+    // a frame's schema must not change with what moved
+    const bool placeholders = true;
+#else
+    const bool placeholders = false;
+#endif
+    uint32_t now = Time.now();
+    size_t held = 0;
+    size_t sent = 0;
+    char name[16];
     for (size_t i = 0; i < this->deviceCount; i++)
     {
-        String name = "payload" + (i > 0 ? "-" + String(i) : "");
-        JsonObject payload = doc[name].to<JsonObject>();
-        // payload.begin();
+        if (i > 0)
+            snprintf(name, sizeof(name), "payload-%u", (unsigned)i);
+        else
+            snprintf(name, sizeof(name), "payload");
+        writer.beginObject(name);
+        hyphen::rbe::Filter filter(writer, exceptionTracker, exceptionSettings, now, keyframe, name, placeholders);
+        PayloadWriter &sink = exceptionSettings.enabled ? (PayloadWriter &)filter : writer;
         size_t size = this->deviceAggregateCounts[i];
         for (size_t j = 0; j < size; j++)
         {
-            this->devices[i][j]->publish(payload, attempt_count, payloadId);
+            this->devices[i][j]->publish(sink, attempt_count, payloadId);
             maintenanceCount += this->devices[i][j]->maintenanceCount();
         }
-        // payload.end();
+        held += filter.held();
+        sent += filter.sent();
+        writer.endObject();
+    }
+    if (exceptionSettings.enabled)
+    {
+        Log.noticeln("REPORT_BY_EXCEPTION sent %d, held back %d%s", sent, held, keyframe ? " (keyframe)" : "");
     }
-    String output;
-    serializeJson(doc, output);
-    Utils::log("MAINTENANCE_COUNT", StringFormat("%s", String(maintenanceCount)));
-    return output;
 }
 
 void DeviceManager::toggleRadio(int lowPowerMode)
@@ -640,10 +826,9 @@ void DeviceManager::toggleRadio(int lowPowerMode)
         Utils::log("LOW_POWER_MODE", "radioUp");
         radioUp();
     }
-    else if (processor->ready() && !lowPowerModeSet && storedRecords <= 0 && lowPowerMode > 0)
+    else if (processor->ready() && !lowPowerModeSet && Utils::storage.backlog() == 0 && lowPowerMode > 0)
     {
         Utils::log("LOW_POWER_MODE", "radioDown");
-        storedRecords = 0;
         radioDown(lowPowerMode);
     }
 }
@@ -700,7 +885,7 @@ void DeviceManager::autoLowPowerMode()
 void DeviceManager::offlineModeCheck()
 {
     int lowPowerMode = boots.getLowPowerModeTime();
-    Utils::log("LOW_POWER_MODE", "TIME=" + String(lowPowerMode) + ", records=" + String(storedRecords) + ", powerSave=" + String(powerSaveMode) + ", offlineCheck=" + String(boots.lowPowerCheck()));
+    Utils::log("LOW_POWER_MODE", "TIME=" + String(lowPowerMode) + ", records=" + String(Utils::storage.backlog()) + ", powerSave=" + String(powerSaveMode) + ", offlineCheck=" + String(boots.lowPowerCheck()));
     // if we are in power save mode generally due to connectivity issues, check to see if we can exit
     if (powerSaveMode && boots.lowPowerCheck())
     {
@@ -727,56 +912,736 @@ void DeviceManager::offlineModeCheck()
  *
  * publisher
  *
- * Gathers all data and sends to the processor the returned content
+ * Gathers all data and hands the payload to the publisher task, or to the
+ * series while the radio is down
  * @return void
  */
 void DeviceManager::publisher()
 {
     // storage.bridgeSpi();
     publishBusy = true;
+#ifdef LOW_POWER_SERIES
+    if (lowPowerModeSet)
+    {
+        recordInterval();
+    }
+    else
+    {
+        publishInterval();
+    }
+#else
+    publishInterval();
+#endif
+    iterateDevices(&DeviceManager::publishedCallback, this);
+    ROTATION++;
+    offlineModeCheck();
+    publishBusy = false;
+}
+
+/**
+ * @private
+ *
+ * publishInterval
+ *
+ * Writes the payload of this interval and queues it
+ * @return void
+ */
+void DeviceManager::publishInterval()
+{
     // attempt_count = 0;
     uint8_t maintenanceCount = 0;
-    String result = payloadWriter(maintenanceCount);
+    bool written = payloadWriter(maintenanceCount);
     bool maintenance = checkMaintenance(maintenanceCount);
-    String topic = getTopic(maintenance);
-    bool success = false;
-    Utils::log("LOW POWER MODE", String(lowPowerModeSet));
+#ifdef COMPACT_PUBLISH
+    // the frame goes out; the payload it stands for is archived and stored
+    written = written && sealFrame(maintenance);
+#endif
+    Log.noticeln("LOW POWER MODE %d", lowPowerModeSet);
 
-    if (!lowPowerModeSet)
+    if (!written)
     {
-#ifdef COMPRESSED_PUBLISH
-        success = processor->compressPublish(topic, result);
-        Utils::log("PUBLISHING STATUS", String(success));
+        // never send or keep a half-written payload
+        Log.errorln("Payload didn't fit the %d byte publish buffer", PUBLISH_BUFFER_SIZE);
+        recommendMaintenance();
+    }
+    else
+    {
+        enqueuePayload(maintenance);
+    }
+}
+
+/**
+ * @private
+ *
+ * enqueuePayload
+ *
+ * Copies the payload out of the publish buffer into a free outbox slot for
+ * the publisher task. With every slot still on its way out the payload is
+ * archived and stored right here instead.
+ *
+ * @param bool maintenance
+ *
+ * @return bool - false when it couldn't be queued
+ */
+bool DeviceManager::enqueuePayload(bool maintenance)
+{
+    using hyphen::outbound::Outbound;
+    const char *topic = processor->publishTopic(maintenance);
+    bool send = !lowPowerModeSet;
+#ifdef COMPACT_PUBLISH
+    // a frame is only sent once its schema is announced, or queued ahead of it
+    send = send && queueAnnouncement();
+    const char *liveTopic = COMPACT_TOPIC;
+    const uint8_t *stored = expandWriter.data();
+    size_t storedLength = expandWriter.length();
+#else
+    const char *liveTopic = topic;
+    const uint8_t *stored = nullptr;
+    size_t storedLength = publishWriter.length();
+#endif
+    Outbound *slot = outbox.acquire();
+    if (!slot || !slot->fill(liveTopic, publishWriter.data(), publishWriter.length(), stored, stored ? storedLength : 0))
+    {
+        if (slot)
+        {
+            outbox.cancel(slot);
+        }
+        spill(topic, stored ? stored : publishWriter.data(), storedLength, PUBLISH_PACKED, maintenance);
+        return false;
+    }
+    slot->kind = hyphen::outbound::KIND_PAYLOAD;
+    slot->storeTopic = topic;
+    slot->packed = PUBLISH_PACKED;
+    slot->send = send;
+    slot->maintenance = maintenance;
+#ifdef COMPACT_PUBLISH
+    slot->schema = publishWriter.schema();
+#endif
+    submit(slot);
+    return true;
+}
+
+/**
+ * @private
+ *
+ * submit
+ *
+ * Hands a filled outbox slot to the publisher task
+ *
+ * @return void
+ */
+void DeviceManager::submit(hyphen::outbound::Outbound *slot)
+{
+    outbox.submit(slot, millis());
+    publishMetrics.enqueued(outbox.depth());
+    wakePublisher();
+}
+
+/**
+ * @private
+ *
+ * spill
+ *
+ * Archives and stores a payload on the main loop, for when every outbox
+ * slot is still on its way out
+ *
+ * @return void
+ */
+void DeviceManager::spill(const char *topic, const uint8_t *payload, size_t length, bool packed, bool maintenance)
+{
+    publishMetrics.overflowed();
+    Log.errorln("PUBLISH QUEUE FULL. Storing %d bytes", length);
+    Utils::archive.append(topic, payload, length, packed);
+    if (!maintenance)
+    {
+        storePayload(topic, payload, length, packed);
+    }
+}
+
+/**
+ * @private
+ *
+ * wakePublisher
+ *
+ * Tells the publisher task there is work. Without the task (a build without
+ * HYPHEN_THREADED, or it couldn't start) the outbox is drained right here,
+ * as the publisher always did.
+ *
+ * @return void
+ */
+void DeviceManager::wakePublisher()
+{
+    if (taskHandle)
+    {
+        xTaskNotifyGive(taskHandle);
+        return;
+    }
+    drainOutbox();
+}
+
+/**
+ * @private
+ *
+ * startPublisher
+ *
+ * Gives every outbox slot its buffer and, with HYPHEN_THREADED, starts the
+ * publisher task. The MQTT client only takes publishes from another task in
+ * the threaded build.
+ *
+ * @return bool - true when the task runs
+ */
+bool DeviceManager::startPublisher()
+{
+    for (size_t i = 0; i < PUBLISH_QUEUE_SLOTS; i++)
+    {
+        uint8_t *buffer = publishAlloc(PUBLISH_SLOT_SIZE);
+        if (!buffer)
+        {
+            Log.errorln("No memory for publish queue slot %d", i);
+            continue;
+        }
+        outbox.attach(i, buffer, PUBLISH_SLOT_SIZE);
+    }
+#ifdef HYPHEN_THREADED
+    if (taskHandle)
+    {
+        return true;
+    }
+    if (xTaskCreatePinnedToCore(
+            DeviceManager::publisherTask,
+            "Publisher",
+            publisherThreadTask,
+            this,
+            tskIDLE_PRIORITY + 1,
+            &taskHandle,
+            1 // APP CPU core
+            ) != pdPASS)
+    {
+        taskHandle = nullptr;
+        Log.errorln("Publisher task didn't start, publishing on the main loop");
+        return false;
+    }
+    return true;
 #else
-        success = processor->publish(topic, Utils::storage.sanitize(result));
-        Utils::log("PUBLISHING STATUS", String(success));
+    return false;
+#endif
+}
+
+/**
+ * @private
+ *
+ * publisherTask
+ *
+ * Sleeps until the main loop queues a payload, then delivers everything in
+ * the outbox
+ *
+ * @return void
+ */
+void DeviceManager::publisherTask(void *param)
+{
+    DeviceManager *manager = static_cast<DeviceManager *>(param);
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        manager->drainOutbox();
+    }
+}
+
+/**
+ * @private
+ *
+ * drainOutbox
+ *
+ * Delivers the queued payloads, oldest first
+ *
+ * @return void
+ */
+void DeviceManager::drainOutbox()
+{
+    hyphen::outbound::Outbound *slot;
+    while ((slot = outbox.next()) != nullptr)
+    {
+        deliver(*slot);
+        outbox.release(slot);
+    }
+}
+
+/**
+ * @private
+ *
+ * deliver
+ *
+ * Publishes one queued payload, retrying with backoff while the connection
+ * is up, then archives it and stores it when it couldn't be delivered. Runs
+ * on the publisher task, so nothing here may touch the main loop's state:
+ * maintenance is only flagged for publisherEvents.
+ *
+ * @param Outbound &slot
+ *
+ * @return void
+ */
+void DeviceManager::deliver(hyphen::outbound::Outbound &slot)
+{
+    using namespace hyphen::outbound;
+    const char *topic = slot.storeTopic;
+    // retries would stall the main loop when it delivers itself
+    RetryPolicy policy = retryPolicy;
+    if (!taskHandle)
+    {
+        policy.attempts = 1;
+    }
+    bool success = false;
+    bool publishable = slot.send;
+#ifdef COMPACT_PUBLISH
+    // frames of a schema whose announcement failed are undecodable; a series
+    // (schema 0) describes itself
+    publishable = publishable && (slot.kind == KIND_ANNOUNCE || slot.schema == 0 || slot.schema != refusedSchema);
 #endif
+    if (publishable)
+    {
+        // already in its wire encoding: escaped JSON, MessagePack with
+        // COMPRESSED_PUBLISH or a compact frame, so nothing is parsed on the way out
+        uint32_t start = millis();
+        for (uint8_t attempts = 1;; attempts++)
+        {
+            success = processor->publish(slot.topic, slot.data, slot.length);
+            if (success || !shouldRetry(policy, attempts, processor->isConnected()))
+            {
+                break;
+            }
+            publishMetrics.retried();
+            vTaskDelay(pdMS_TO_TICKS(backoffMs(policy, attempts, esp_random())));
+        }
+        // the backoff included: the backlog lane stays off the link meanwhile
+        backlogBudget.onLive(hyphen::timing::elapsed(start, millis()));
+        Log.noticeln("PUBLISHING STATUS %d", success);
     }
 
     if (success)
     {
+        publishMetrics.acked(slot.enqueuedMs, millis());
         // End-to-end progress: refresh the watchdog's productivity backstop so a
         // healthy device is never power-cycled by it.
         Watchdog.productive();
     }
 
-    Utils::log("SENDING_EVENT_READY " + topic, String(((success == false || lowPowerModeSet) && !maintenance) ? "TRUE" : "FALSE"));
+#ifdef COMPACT_PUBLISH
+    if (slot.kind == KIND_ANNOUNCE)
+    {
+        if (success)
+        {
+            refusedSchema = 0;
+            ackedSchema.store(slot.schema);
+        }
+        else
+        {
+            refusedSchema = slot.schema;
+            announceFailed.store(true);
+        }
+        return;
+    }
+#endif
+
+    Log.noticeln("SENDING_EVENT_READY %s %s", topic, (!success && !slot.maintenance) ? "TRUE" : "FALSE");
 
-    if (!maintenance && (success == false || lowPowerModeSet))
+    // everything produced is archived for replayArchive, sent or not
+    Utils::archive.append(topic, slot.storedData(), slot.storedLength, slot.packed);
+
+    if (!slot.maintenance && !success)
     {
-        Utils::log("SENDING PAYLOAD FAILED. Storing", result);
-        storePayload(result, topic);
-        if (!lowPowerModeSet)
+        Log.noticeln("SENDING PAYLOAD FAILED. Storing %d bytes", slot.storedLength);
+        publishMetrics.spilled();
+        storePayload(topic, slot.storedData(), slot.storedLength, slot.packed);
+        if (slot.send)
         {
-            recommendMaintenance();
+            maintenanceDue.store(true);
         }
     }
-    clearArray();
-    ROTATION++;
-    offlineModeCheck();
-    publishBusy = false;
 }
 
+/**
+ * @private
+ *
+ * publisherEvents
+ *
+ * Picks up on the main loop what the publisher task reported: a maintenance
+ * recommendation, an acknowledged schema, and the queue gauges
+ *
+ * @return void
+ */
+void DeviceManager::publisherEvents()
+{
+    if (maintenanceDue.exchange(false))
+    {
+        recommendMaintenance();
+    }
+    publishQueueGauge = outbox.depth();
+    publishLatencyGauge = publishMetrics.lastLatencyMs();
+#ifdef LOW_POWER_SERIES
+    // the radio is back: what was recorded while it was down goes out as one
+    if (!lowPowerModeSet && series && !series->empty() && processor->ready())
+    {
+        flushSeries();
+    }
+#endif
+#ifdef COMPACT_PUBLISH
+    unsigned long acked = ackedSchema.load();
+    if (acked != 0 && acked != announcedSchema)
+    {
+        Log.noticeln("SCHEMA ANNOUNCED %x", acked);
+        announcedSchema = acked;
+        Persist.put(schemaKey, announcedSchema);
+    }
+    if (announceFailed.exchange(false))
+    {
+        // announced again ahead of the next frame
+        announcingSchema = 0;
+    }
+#endif
+}
+
+#ifdef COMPACT_PUBLISH
+/**
+ * @private
+ *
+ * deviceListCrc
+ *
+ * CRC-32 of the configured device list, the salt of the schema id
+ *
+ * @return uint32_t
+ */
+uint32_t DeviceManager::deviceListCrc()
+{
+    uint32_t crc = 0;
+    for (size_t i = 0; i < MAX_DEVICES; i++)
+    {
+        // the NUL keeps "a","bc" apart from "ab","c"
+        crc = hyphen::records::crc32((const uint8_t *)devicesString[i].c_str(), devicesString[i].length() + 1, crc);
+    }
+    return crc;
+}
+
+/**
+ * @private
+ *
+ * sealFrame
+ *
+ * Stamps the schema id on the compact frame and expands it into the JSON
+ * payload the store and the archive keep
+ *
+ * @param bool maintenance
+ *
+ * @return bool - false when the frame or its expansion didn't fit
+ */
+bool DeviceManager::sealFrame(bool maintenance)
+{
+    if (!publishWriter.seal(deviceListCrc(), maintenance ? hyphen::telemetry::FLAG_MAINTENANCE : 0))
+    {
+        Log.errorln("The schema dictionary is full at %d bytes", SCHEMA_DICTIONARY_SIZE);
+        return false;
+    }
+    hyphen::telemetry::Frame frame;
+    hyphen::telemetry::parse(publishWriter.data(), publishWriter.length(), frame);
+    char date[32];
+    Time.format(frame.timestamp, TIME_FORMAT_ISO8601_FULL, date, sizeof(date));
+    expandWriter.reset();
+    expandWriter.beginObject();
+    expandWriter.add("device", deviceId.c_str());
+    expandWriter.add("date", date);
+    hyphen::telemetry::expand(frame, publishWriter.dictionary(), publishWriter.dictionaryLength(), expandWriter);
+    expandWriter.endObject();
+    return expandWriter.complete();
+}
+
+/**
+ * @private
+ *
+ * queueAnnouncement
+ *
+ * Queues the dictionary of the sealed frame for SCHEMA_TOPIC, ahead of the
+ * frame, unless the cloud already has it or it is on its way. Happens once
+ * per configuration (or firmware) change.
+ *
+ * @return bool - false when the announcement couldn't be queued
+ */
+bool DeviceManager::queueAnnouncement()
+{
+    uint32_t schema = publishWriter.schema();
+    if (schema == announcedSchema || schema == announcingSchema)
+    {
+        return true;
+    }
+    // a short key costs three dictionary bytes and up to ten described ones
+    const size_t size = 4 * SCHEMA_DICTIONARY_SIZE;
+    char *text = (char *)malloc(size);
+    if (!text)
+    {
+        return false;
+    }
+    hyphen::payload::JsonWriter dictionary(text, size);
+    dictionary.beginObject();
+    hyphen::telemetry::describe(publishWriter.dictionary(), publishWriter.dictionaryLength(), dictionary);
+    dictionary.endObject();
+    JsonDocument doc;
+    doc["device"] = deviceId;
+    doc["schema"] = schema;
+    doc["version"] = hyphen::telemetry::kVersion;
+    JsonArray list = doc["devices"].to<JsonArray>();
+    for (size_t i = 0; i < MAX_DEVICES; i++)
+    {
+        if (!devicesString[i].isEmpty())
+        {
+            list.add(devicesString[i]);
+        }
+    }
+    doc["dictionary"] = serialized(dictionary.c_str(), dictionary.length());
+    String announcement;
+    if (dictionary.complete())
+    {
+        serializeJson(doc, announcement);
+    }
+    free(text);
+    hyphen::outbound::Outbound *slot = announcement.isEmpty() ? nullptr : outbox.acquire();
+    if (!slot)
+    {
+        return false;
+    }
+    if (!slot->fill(SCHEMA_TOPIC, (const uint8_t *)announcement.c_str(), announcement.length()))
+    {
+        Log.errorln("Schema %x doesn't fit a publish queue slot", schema);
+        outbox.cancel(slot);
+        return false;
+    }
+    slot->kind = hyphen::outbound::KIND_ANNOUNCE;
+    slot->storeTopic = SCHEMA_TOPIC;
+    slot->schema = schema;
+    slot->send = true;
+    // never stored: a lost announcement is simply made again
+    slot->maintenance = true;
+    submit(slot);
+    announcingSchema = schema;
+    return true;
+}
+#endif
+
+#ifdef LOW_POWER_SERIES
+DeviceManager *DeviceManager::seriesOwner = nullptr;
+
+/**
+ * @private
+ *
+ * attachSeries
+ *
+ * Allocates what the low-power series needs, once
+ *
+ * @return bool
+ */
+bool DeviceManager::attachSeries()
+{
+    if (series)
+    {
+        return true;
+    }
+    const size_t cellCount = SERIES_ROWS * hyphen::series::kMaxColumns;
+    rowBuffer = publishAlloc(PUBLISH_BUFFER_SIZE);
+    rowDictionary = publishAlloc(SERIES_DICTIONARY_SIZE);
+    seriesDictionary = publishAlloc(SERIES_DICTIONARY_SIZE);
+    seriesCells = (int64_t *)publishAlloc(cellCount * sizeof(int64_t));
+    if (!rowBuffer || !rowDictionary || !seriesDictionary || !seriesCells)
+    {
+        Log.errorln("No memory for the low-power series, storing every interval");
+        free(rowBuffer);
+        free(rowDictionary);
+        free(seriesDictionary);
+        free(seriesCells);
+        rowBuffer = rowDictionary = seriesDictionary = nullptr;
+        seriesCells = nullptr;
+        return false;
+    }
+    rowWriter = hyphen::telemetry::CompactWriter(rowBuffer, PUBLISH_BUFFER_SIZE, rowDictionary, SERIES_DICTIONARY_SIZE);
+    series = new hyphen::series::Series(seriesCells, cellCount, seriesDictionary, SERIES_DICTIONARY_SIZE);
+    seriesOwner = this;
+    if (!Utils::storage.onShutdown(&DeviceManager::seriesShutdown))
+    {
+        Log.errorln("No shutdown handler for the low-power series, a reboot loses its unstored rows");
+    }
+    return true;
+}
+
+/**
+ * @private
+ *
+ * seriesShutdown
+ *
+ * Runs on a planned reboot (esp_restart, which Utils::reboot ends in),
+ * as the store's shutdown hook, so with the store locked and before its RAM
+ * ring is spilled: the rows recorded since the last checkpoint are stored
+ * rather than lost with the RAM they live in
+ *
+ * @return void
+ */
+void DeviceManager::seriesShutdown()
+{
+    if (seriesOwner)
+    {
+        seriesOwner->flushSeries(true);
+    }
+}
+
+/**
+ * @private
+ *
+ * recordInterval
+ *
+ * While the radio is down, records this interval as a row of the series.
+ * One the series can't hold (a maintenance payload, a string value, no
+ * memory) is written and stored on its own, as publishInterval would,
+ * after the series before it. Every SERIES_CHECKPOINT_ROWS rows the series
+ * is stored as it stands, so a watchdog reset, brownout or panic (which
+ * run no shutdown handler) loses fewer intervals than that.
+ *
+ * @return void
+ */
+void DeviceManager::recordInterval()
+{
+    using namespace hyphen::series;
+    if (!series)
+    {
+        return publishInterval();
+    }
+    char id[PAYLOAD_ID_SIZE];
+    DeviceSecurity::makePayloadId(id, sizeof(id));
+    payloadId = id;
+    uint8_t maintenanceCount = 0;
+    rowWriter.begin(Time.now());
+    // a series is already delta-encoded: every row is complete
+    writeDevices(rowWriter, maintenanceCount, true);
+    rowWriter.endObject();
+    Log.noticeln("MAINTENANCE_COUNT %d", maintenanceCount);
+    bool maintenance = checkMaintenance(maintenanceCount);
+    hyphen::telemetry::Frame frame;
+    if (!rowWriter.seal(0, 0) || !hyphen::telemetry::parse(rowWriter.data(), rowWriter.length(), frame))
+    {
+        Log.errorln("Interval didn't fit the %d byte row buffer", PUBLISH_BUFFER_SIZE);
+        return recommendMaintenance();
+    }
+
+    Result result = UNBATCHABLE;
+    if (!maintenance)
+    {
+        result = series->append(frame, rowWriter.dictionary(), rowWriter.dictionaryLength(), rowWriter.schema());
+        if (result == SHAPE_CHANGED || result == FULL)
+        {
+            flushSeries();
+            result = series->append(frame, rowWriter.dictionary(), rowWriter.dictionaryLength(), rowWriter.schema());
+        }
+    }
+    if (result == APPENDED)
+    {
+        if (series->rows() == 1)
+        {
+            seriesTarget = ROTATION;
+            memcpy(seriesId, id, sizeof(seriesId));
+        }
+        Log.noticeln("SERIES ROW %d", series->rows());
+        if (series->rows() >= SERIES_CHECKPOINT_ROWS)
+        {
+            flushSeries();
+        }
+        return;
+    }
+
+    // rows of a series have consecutive targets
+    flushSeries();
+#ifdef COMPACT_PUBLISH
+    publishWriter.begin(frame.timestamp);
+#else
+    publishWriter.reset();
+    publishWriter.beginObject();
+#endif
+    packagePayload(publishWriter);
+    hyphen::telemetry::expand(frame, rowWriter.dictionary(), rowWriter.dictionaryLength(), publishWriter);
+    publishWriter.endObject();
+    bool written = publishWriter.complete();
+#ifdef COMPACT_PUBLISH
+    written = written && sealFrame(maintenance);
+#endif
+    if (!written)
+    {
+        Log.errorln("Payload didn't fit the %d byte publish buffer", PUBLISH_BUFFER_SIZE);
+        return;
+    }
+    enqueuePayload(maintenance);
+}
+
+/**
+ * @private
+ *
+ * flushSeries
+ *
+ * Writes the series into the publish buffer and queues it as one message
+ * on SERIES_TOPIC, sent right away when the radio is up and stored as one
+ * record otherwise. On shutdown it is stored right here, the publisher task
+ * won't get to it. Nothing there waits unbounded: the id was made with the
+ * first row, the store's lock is already held, its card append gives up
+ * for the RAM ring, and the archive copy (whose SD wait isn't bounded) is
+ * skipped.
+ *
+ * @param bool shutdown
+ *
+ * @return void
+ */
+void DeviceManager::flushSeries(bool shutdown)
+{
+    if (!series || series->empty())
+    {
+        return;
+    }
+    size_t rows = series->rows();
+    SeriesEncoder writer(publishBuffer, publishBuffer ? PUBLISH_BUFFER_SIZE : 0);
+    writer.beginObject();
+    writer.add("device", deviceId.c_str());
+    writer.add("__id", seriesId);
+    writer.add("target", seriesTarget);
+    series->write(writer);
+    writer.endObject();
+    series->clear();
+    if (!writer.complete())
+    {
+        Log.errorln("Series of %d rows didn't fit the %d byte publish buffer", rows, PUBLISH_BUFFER_SIZE);
+        return;
+    }
+    Log.noticeln("SERIES OF %d ROWS, %d bytes", rows, writer.length());
+    if (shutdown)
+    {
+        bool stored = SERIES_PACKED ? Utils::storage.pushPacked(SERIES_TOPIC, writer.data(), writer.length())
+                                    : Utils::storage.push(SERIES_TOPIC, String((const char *)writer.data(), writer.length()));
+        if (!stored)
+        {
+            Log.errorln("Series of %d rows not stored at shutdown", rows);
+        }
+        return;
+    }
+
+    hyphen::outbound::Outbound *slot = outbox.acquire();
+    if (!slot || !slot->fill(SERIES_TOPIC, writer.data(), writer.length()))
+    {
+        if (slot)
+        {
+            outbox.cancel(slot);
+        }
+        return spill(SERIES_TOPIC, writer.data(), writer.length(), SERIES_PACKED, false);
+    }
+    slot->kind = hyphen::outbound::KIND_PAYLOAD;
+    slot->storeTopic = SERIES_TOPIC;
+    slot->packed = SERIES_PACKED;
+    slot->schema = 0;
+    slot->send = !lowPowerModeSet;
+    slot->maintenance = false;
+    submit(slot);
+}
+#endif
+
 /**
  * @private
  *
@@ -868,6 +1733,21 @@ void DeviceManager::clearArrayCallback(Device *device)
     device->clear();
 }
 
+/**
+ * @private
+ *
+ * publishedCallback
+ *
+ * Tells the device its payload was written during the iteration loop
+ *
+ * @return void
+ *
+ */
+void DeviceManager::publishedCallback(Device *device)
+{
+    device->published();
+}
+
 /**
  * @private
  *
@@ -974,6 +1854,88 @@ void DeviceManager::setCloudFunctions()
     Hyphen.function("setApn", &DeviceManager::setApn, this);
     Hyphen.function("setSimPin", &DeviceManager::setSimPin, this);
     Hyphen.function("setWifi", &DeviceManager::setWifi, this);
+    Hyphen.function("replayArchive", &DeviceManager::replayArchive, this);
+    Hyphen.function("setReportByException", &DeviceManager::setReportByException, this);
+    Hyphen.function("setBacklogOrder", &DeviceManager::setBacklogOrder, this);
+    Hyphen.variable("offlineBacklog", Utils::storage.backlogVariable());
+    Hyphen.variable("nvsWrites", Persist.writesVariable());
+    Hyphen.variable("publishQueue", &publishQueueGauge);
+    Hyphen.variable("publishLatency", &publishLatencyGauge);
+    // microseconds of the last signature / verify, see system/crypto-cache.h
+    Hyphen.variable("signLatency", &CryptoCache::signLatencyUs);
+    Hyphen.variable("verifyLatency", &CryptoCache::verifyLatencyUs);
+}
+
+/**
+ * @private
+ *
+ * setReportByException
+ *
+ * Cloud function for report by exception: "on", "off", "clear",
+ * "keyframe,SECONDS", "KEY,DEADBAND[,MAX_SILENCE]" or "KEY,-" (see
+ * resources/utils/report_by_exception.h). The next payload is a keyframe.
+ *
+ * @param String value
+ * @return int - 1 when the command was applied
+ */
+int DeviceManager::setReportByException(String value)
+{
+    if (!hyphen::rbe::apply(exceptionSettings, value.c_str()))
+    {
+        Utils::log("REPORT_BY_EXCEPTION_INVALID", value);
+        return 0;
+    }
+    Persist.put(exceptionKey, exceptionSettings);
+    exceptionTracker.forceKeyframe();
+    Utils::log("REPORT_BY_EXCEPTION", value);
+    return 1;
+}
+
+/**
+ * @private
+ *
+ * setBacklogOrder
+ *
+ * Cloud function for the order the backlog lane drains the offline store
+ * in: "newest" (the default) or "oldest"
+ *
+ * @param String value
+ * @return int - 1 when the order was set
+ */
+int DeviceManager::setBacklogOrder(String value)
+{
+    if (!hyphen::lanes::parseOrder(value.c_str(), backlogOrder))
+    {
+        Utils::log("BACKLOG_ORDER_INVALID", value);
+        return 0;
+    }
+    Persist.put(backlogOrderKey, backlogOrder);
+    Utils::log("BACKLOG_ORDER", value);
+    return 1;
+}
+
+/**
+ * @private
+ *
+ * replayArchive
+ *
+ * Cloud function that streams the archived payloads stamped between two
+ * unix times, "t1,t2", to ARCHIVE_REPLAY_TOPIC in batches
+ *
+ * @param String value
+ * @return int - 1 when the replay started
+ */
+int DeviceManager::replayArchive(String value)
+{
+    uint32_t from = 0;
+    uint32_t to = 0;
+    if (!hyphen::archive::parseRange(value.c_str(), from, to))
+    {
+        Utils::log("ARCHIVE_REPLAY_INVALID_RANGE", value);
+        return 0;
+    }
+    Utils::log("ARCHIVE_REPLAY_REQUESTED", value);
+    return Utils::archive.requestReplay(from, to) ? 1 : 0;
 }
 
 int DeviceManager::setWifi(String value)
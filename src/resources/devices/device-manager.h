@@ -1,6 +1,7 @@
 #include "Hyphen.h"
 #include "string.h"
 #include <stdint.h>
+#include <atomic>
 #include "resources/bootstrap/bootstrap.h"
 #include "resources/processors/LocalProcessor.h"
 #include "resources/utils/utils.h"
@@ -8,8 +9,14 @@
 #include "resources/utils/configurator.h"
 #include "resources/heartbeat/heartbeat.h"
 #include "device.h"
+#include "resources/utils/publish_queue.h"
+#include "resources/utils/series.h"
+#include "resources/utils/report_by_exception.h"
+#include "resources/utils/delivery_lanes.h"
 #include "system/ota.h"
 #include "system/device-security.h"
+#include "system/crypto-cache.h"
+#include "resources/utils/telemetry.h"
 
 #define ONE 1
 #define TWO 2
@@ -40,6 +47,68 @@
 #ifndef AUTO_LOW_POWER_MODE_INTERVAL
 #define AUTO_LOW_POWER_MODE_INTERVAL 20
 #endif
+// the publish payload is written into one buffer of this size, allocated at
+// boot (in PSRAM when the board has it), see resources/utils/payload_writer.h
+#ifndef PUBLISH_BUFFER_SIZE
+#define PUBLISH_BUFFER_SIZE 4096
+#endif
+// payloads waiting for the publisher task (resources/utils/publish_queue.h);
+// a power of two
+#ifndef PUBLISH_QUEUE_SLOTS
+#define PUBLISH_QUEUE_SLOTS 4
+#endif
+// -D COMPACT_PUBLISH sends dictionary-coded frames (resources/utils/telemetry.h)
+// to COMPACT_TOPIC, announcing each new schema on SCHEMA_TOPIC first
+#ifndef COMPACT_TOPIC
+#define COMPACT_TOPIC "Hy/Post/Compact"
+#endif
+#ifndef SCHEMA_TOPIC
+#define SCHEMA_TOPIC "Hy/Post/Schema"
+#endif
+#ifndef SCHEMA_DICTIONARY_SIZE
+#define SCHEMA_DICTIONARY_SIZE 1024
+#endif
+// what the devices' PayloadWriter encodes to: compact frames, MessagePack for
+// the COMPRESSED_PUBLISH topic (Hy/Post/Gold) or JSON for Hy/Post/Black.
+// PUBLISH_PACKED says whether what is stored and archived is MessagePack.
+#if defined(COMPACT_PUBLISH)
+typedef hyphen::telemetry::CompactWriter PublishEncoder;
+#define PUBLISH_PACKED false
+// a queued frame travels with its expansion
+#define PUBLISH_SLOT_SIZE (2 * PUBLISH_BUFFER_SIZE)
+#elif defined(COMPRESSED_PUBLISH)
+typedef hyphen::payload::MsgPackWriter PublishEncoder;
+#define PUBLISH_PACKED true
+#define PUBLISH_SLOT_SIZE PUBLISH_BUFFER_SIZE
+#else
+typedef hyphen::payload::JsonWriter PublishEncoder;
+#define PUBLISH_PACKED false
+#define PUBLISH_SLOT_SIZE PUBLISH_BUFFER_SIZE
+#endif
+
+// -D LOW_POWER_SERIES sends the intervals recorded while the radio was down
+// as one delta-encoded message (resources/utils/series.h) on SERIES_TOPIC
+#ifndef SERIES_TOPIC
+#define SERIES_TOPIC "Hy/Post/Series"
+#endif
+#ifndef SERIES_ROWS
+#define SERIES_ROWS 24
+#endif
+#ifndef SERIES_DICTIONARY_SIZE
+#define SERIES_DICTIONARY_SIZE 1024
+#endif
+// rows held in RAM at most before the series is stored as it stands; a
+// reset that isn't a planned reboot loses fewer intervals than this
+#ifndef SERIES_CHECKPOINT_ROWS
+#define SERIES_CHECKPOINT_ROWS 6
+#endif
+#ifdef COMPRESSED_PUBLISH
+typedef hyphen::payload::MsgPackWriter SeriesEncoder;
+#define SERIES_PACKED true
+#else
+typedef hyphen::payload::JsonWriter SeriesEncoder;
+#define SERIES_PACKED false
+#endif
 
 const size_t DEVICE_COUNT = 5;
 const size_t DEVICE_AGGR_COUNT = SEVEN;
@@ -50,12 +119,10 @@ private:
     // PayloadStore storage;
     OTAUpdate ota;
     bool publishBusy = false;
-    bool readBusy = false;
     bool rebootEvent = false;
     int lowPowerMode = 0;
     bool lowPowerModeSet = false;
     bool powerSaveMode = false;
-    int storedRecords = 0;
     const unsigned int CONNECTION_MAX_ATTEMPT_THRESHOLD = 20;
     const unsigned int CONNECTION_MIN_ATTEMPT_THRESHOLD = 10;
     const int LOW_POWER_MODE_CHECK_INTERVAL = 15; // minutes
@@ -68,8 +135,55 @@ private:
     const uint8_t VOLTAGE_CHECK = 3; // seconds
     float solarPower();
     float batteryPower();
-    int publisherThreadTask = 4096;
+    // stack of the publisher task: a TLS write and a store spill
+    int publisherThreadTask = 8192;
     TaskHandle_t taskHandle = nullptr;
+    hyphen::outbound::Outbox<PUBLISH_QUEUE_SLOTS> outbox;
+    hyphen::outbound::RetryPolicy retryPolicy;
+    hyphen::outbound::Metrics publishMetrics;
+    std::atomic<bool> maintenanceDue{false};
+    unsigned long publishQueueGauge = 0;
+    unsigned long publishLatencyGauge = 0;
+    bool startPublisher();
+    static void publisherTask(void *param);
+    bool enqueuePayload(bool maintenance);
+    void submit(hyphen::outbound::Outbound *slot);
+    void spill(const char *topic, const uint8_t *payload, size_t length, bool packed, bool maintenance);
+    void publishInterval();
+    void writeDevices(PayloadWriter &writer, uint8_t &maintenanceCount, bool keyframe);
+    // report by exception, see resources/utils/report_by_exception.h
+    hyphen::rbe::Settings exceptionSettings;
+    hyphen::rbe::Tracker exceptionTracker;
+    const char *exceptionKey = "rbe_settings";
+    // live payloads first, the backlog in the link time they leave, see
+    // resources/utils/delivery_lanes.h
+    hyphen::lanes::BacklogBudget backlogBudget{Constants::OFFLINE_CHECK_INTERVAL, OFFLINE_LANE_SHARE_PERCENT,
+                                               OFFLINE_LANE_MAX_RECORDS};
+    hyphen::lanes::Order backlogOrder = hyphen::lanes::NEWEST_FIRST;
+    const char *backlogOrderKey = "backlog_order";
+#ifdef LOW_POWER_SERIES
+    // intervals recorded while the radio is down, see resources/utils/series.h
+    uint8_t *rowBuffer = nullptr;
+    uint8_t *rowDictionary = nullptr;
+    uint8_t *seriesDictionary = nullptr;
+    int64_t *seriesCells = nullptr;
+    hyphen::telemetry::CompactWriter rowWriter = hyphen::telemetry::CompactWriter(nullptr, 0);
+    hyphen::series::Series *series = nullptr;
+    unsigned int seriesTarget = 0;
+    // the first row's payload id, made while the row was recorded; the
+    // series goes out under it, so storing it on a reboot leases nothing
+    char seriesId[PAYLOAD_ID_SIZE] = {0};
+    bool attachSeries();
+    void recordInterval();
+    void flushSeries(bool shutdown = false);
+    // stores the series on a planned reboot, from the store's shutdown hook
+    static DeviceManager *seriesOwner;
+    static void seriesShutdown();
+#endif
+    void wakePublisher();
+    void drainOutbox();
+    void deliver(hyphen::outbound::Outbound &slot);
+    void publisherEvents();
     const char *AI_DEVICE_LIST_EVENT = "Hy/Get/Devices";
     unsigned int read_count = 0;
     uint8_t attempt_count = 0;
@@ -93,10 +207,11 @@ private:
     const uint8_t POP_COUNT_VALUE = 5;
     void resetDeviceIndex(size_t index);
     void storePayload(String payload, String topic);
+    void storePayload(const char *topic, const uint8_t *payload, size_t length, bool packed);
     void nullifyPayload(const char *key);
     void shuffleLoad(String payloadString);
     void placePayload(String payload);
-    void popOfflineCollection();
+    uint16_t popOfflineCollection(uint16_t budget);
     void confirmationExpiredCheck();
     void read();
     void publish();
@@ -105,10 +220,34 @@ private:
     void heartbeat();
     void processTimers();
     void packagePayload(JsonDocument &writer);
+    void packagePayload(PayloadWriter &writer);
+    uint8_t *publishBuffer = nullptr;
+    PublishEncoder publishWriter = PublishEncoder(publishBuffer, 0);
+    // kept from init so the publish cycle doesn't rebuild them
+    String deviceId;
+    String payloadId;
+    bool attachPublishBuffer();
+#ifdef COMPACT_PUBLISH
+    // keys of the current frame, and the frame expanded for store and archive
+    uint8_t *schemaDictionary = nullptr;
+    char *expandBuffer = nullptr;
+    hyphen::payload::JsonWriter expandWriter = hyphen::payload::JsonWriter(expandBuffer, 0);
+    unsigned long announcedSchema = 0;
+    uint32_t announcingSchema = 0;
+    // written by the publisher task, picked up by publisherEvents
+    std::atomic<uint32_t> ackedSchema{0};
+    std::atomic<bool> announceFailed{false};
+    // publisher task only
+    uint32_t refusedSchema = 0;
+    const char *schemaKey = "schema_id";
+    uint32_t deviceListCrc();
+    bool sealFrame(bool maintenance);
+    bool queueAnnouncement();
+#endif
     String devicesString[MAX_DEVICES];
     Device *devices[DEVICE_COUNT][DEVICE_AGGR_COUNT];
     String getTopic(bool maintenance);
-    String payloadWriter(uint8_t &maintenanceCount);
+    bool payloadWriter(uint8_t &maintenanceCount);
     bool checkMaintenance(uint8_t maintenanceCount);
     void copyDevicesFromIndex(int index);
     void loopCallback(Device *device);
@@ -116,13 +255,13 @@ private:
     void restoreDefaultsCallback(Device *device);
     void initCallback(Device *device);
     void clearArrayCallback(Device *device);
+    void publishedCallback(Device *device);
     void setReadCallback(Device *device);
     void buildSendInterval(int interval);
     int restoreDefaults(String read);
     void processRestoreDefaults();
     int rebootRequest(String f);
     bool isNotPublishing();
-    bool isNotReading();
     bool isStrapped();
     void setCloudFunctions();
     // for device configuration
@@ -137,6 +276,9 @@ private:
     int setWifi(String value);
     int setApn(String value);
     int setSimPin(String value);
+    int replayArchive(String value);
+    int setReportByException(String value);
+    int setBacklogOrder(String value);
     bool recommendReboot(unsigned int);
     bool recommendRadioSilence(unsigned int);
     void recommendMaintenance();
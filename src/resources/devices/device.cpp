@@ -37,7 +37,7 @@ Device::Device()
  *
  * @return void
  */
-void Device::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void Device::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
 }
 
@@ -134,6 +134,22 @@ void Device::clear()
 {
 }
 
+/**
+ * @public
+ *
+ * published
+ *
+ * Called once the interval's payload is written. Devices with a single
+ * sample buffer drop it here; double-buffered ones already handed reads a
+ * fresh buffer when publish() swapped, so they keep what came in since
+ *
+ * @return void
+ */
+void Device::published()
+{
+    clear();
+}
+
 /**
  * @public
  *
@@ -3,9 +3,14 @@
 #include <stdint.h>
 #include "resources/bootstrap/bootstrap.h"
 #include "resources/processors/LocalProcessor.h"
+#include "resources/utils/payload_writer.h"
 #ifndef device_h
 #define device_h
 
+// devices write their readings straight into the publish buffer, in
+// whichever encoding the publisher chose
+typedef hyphen::payload::PayloadSink PayloadWriter;
+
 class Device
 {
 private:
@@ -21,11 +26,12 @@ public:
     virtual uint8_t maintenanceCount();
     virtual uint8_t paramCount();
     virtual void clear();
+    virtual void published();
     virtual void print();
     virtual size_t buffSize();
     virtual void init();
     virtual void restoreDefaults();
-    virtual void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId);
+    virtual void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId);
 };
 
 #endif
\ No newline at end of file
@@ -52,19 +52,20 @@ void FlowMeter::init()
     configurePin();
 }
 
-void FlowMeter::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void FlowMeter::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
     // removeInterrupt();
+    char key[24];
     for (size_t i = 0; i < PARAM_LENGTH; i++)
     {
-        String param = getParamName(i);
+        paramKey(i, key, sizeof(key));
         switch (i)
         {
         case c_flow:
-            writer[utils.stringConvert(param)] = currentFlow;
+            writer.add(key, currentFlow);
             break;
         case t_flow:
-            writer[utils.stringConvert(param)] = totalMilliLitres;
+            writer.add(key, totalMilliLitres);
             break;
         }
     }
@@ -457,6 +458,20 @@ String FlowMeter::getParamName(size_t index)
     return param;
 }
 
+/**
+ * Same name as getParamName, written into a caller's buffer so the publish
+ * cycle doesn't build a String per parameter.
+ */
+void FlowMeter::paramKey(size_t index, char *out, size_t cap)
+{
+    if (this->hasSerialIdentity())
+    {
+        snprintf(out, cap, "%s_%d", valueMap[index].c_str(), sendIdentity);
+        return;
+    }
+    snprintf(out, cap, "%s", valueMap[index].c_str());
+}
+
 /**
  * @private
  *
@@ -73,6 +73,7 @@ private:
     Utils utils;
     bool hasSerialIdentity();
     String getParamName(size_t index);
+    void paramKey(size_t index, char *out, size_t cap);
     String uniqueName();
     String appendIdentity();
 
@@ -93,7 +94,7 @@ public:
     size_t buffSize();
     void init();
     void restoreDefaults();
-    void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId);
+    void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId);
 };
 
 #endif
\ No newline at end of file
@@ -28,7 +28,7 @@ public:
     size_t buffSize();
     void init();
     void restoreDefaults();
-    void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId);
+    void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId);
 };
 
 #endif
\ No newline at end of file
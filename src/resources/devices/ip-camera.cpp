@@ -162,7 +162,7 @@ void IPCamera::enqueueSnap(uint32_t timeoutMs, bool forced, const String &payloa
 
 // ---------- publish/loop ----------
 // publish = cadence scheduler only (do not run work here)
-void IPCamera::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void IPCamera::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
     (void)writer;
     (void)attempt_count;
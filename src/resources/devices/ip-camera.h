@@ -23,7 +23,7 @@ public:
 
     String name() override;
     void init() override;
-    void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId) override;
+    void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId) override;
 
     void loop() override;
     void read() override;
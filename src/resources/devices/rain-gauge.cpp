@@ -68,7 +68,7 @@ void RainGauge::read()
  *
  * @return void
  */
-void RainGauge::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void RainGauge::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
     errorCount = 0;
     double value = counts * perTipMultiple;
@@ -78,7 +78,7 @@ void RainGauge::publish(JsonObject &writer, uint8_t attempt_count, const String
         value = NO_VALUE;
     }
     counts = 0;
-    writer[valueMap[precipitation]] = value;
+    writer.add(valueMap[precipitation].c_str(), value);
 }
 
 /**
@@ -101,7 +101,7 @@ bool Relay::off()
  *
  * @return void
  */
-void Relay::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void Relay::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
 }
 
@@ -180,7 +180,7 @@ void SoilMoisture::init()
  *
  * @return void
  */
-void SoilMoisture::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void SoilMoisture::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
     return sdi->publish(writer, attempt_count);
 }
@@ -268,6 +268,20 @@ void SoilMoisture::clear()
     return sdi->clear();
 }
 
+/**
+ * @public
+ *
+ * published
+ *
+ * Called once the payload is written
+ *
+ * @return void
+ */
+void SoilMoisture::published()
+{
+    return sdi->published();
+}
+
 /**
  * @public
  *
@@ -165,13 +165,14 @@ public:
     void read();
     void loop();
     void clear();
+    void published();
     void print();
     void init();
     String name();
     uint8_t maintenanceCount();
     uint8_t paramCount();
     size_t buffSize();
-    void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId);
+    void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId);
     void restoreDefaults();
 };
 
@@ -38,7 +38,7 @@ VideoCapture::VideoCapture()
  *
  * @return void
  */
-void VideoCapture::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+void VideoCapture::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
 {
 
     if (readySend())
@@ -350,18 +350,34 @@ String WlDevice::getParamName(size_t index)
     return param;
 }
 
-void WlDevice::publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId)
+/**
+ * Same name as getParamName, written into a caller's buffer so the publish
+ * cycle doesn't build a String per parameter.
+ */
+void WlDevice::paramKey(size_t index, char *out, size_t cap)
 {
+    if (this->hasSerialIdentity())
+        snprintf(out, cap, "%s_%d", readParams[index].c_str(), sendIdentity);
+    else
+        snprintf(out, cap, "%s", readParams[index].c_str());
+}
+
+void WlDevice::publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId)
+{
+    char key[24];
+    // reads carry on in the other buffer while this one is written
+    WLSamples &frozen = VALUE_HOLD.swap();
     for (size_t i = 0; i < PARAM_LENGTH; i++)
     {
-        String param = getParamName(i);
-        int median = utils.getMedian(attempt_count, VALUE_HOLD[i]);
+        paramKey(i, key, sizeof(key));
+        const WLSamples::Ring &samples = frozen.values[i];
+        int median = samples.empty() ? NO_VALUE : samples.median();
 
         if (median == 0)
             maintenanceTick++;
 
-        writer[utils.stringConvert(param)] = median;
-        Log.info("Param=%s has median %d", utils.stringConvert(param), median);
+        writer.add(key, median);
+        Log.info("Param=%s has median %d", key, median);
     }
 }
 
@@ -391,7 +407,7 @@ void WlDevice::read()
 
     for (size_t i = 0; i < PARAM_LENGTH; i++)
     {
-        utils.insertValue((int)cm, VALUE_HOLD[i], boots->getMaxVal());
+        VALUE_HOLD.fresh().values[i].push((int)cm);
     }
 }
 
@@ -399,12 +415,17 @@ void WlDevice::loop() {}
 
 void WlDevice::clear()
 {
-    for (size_t i = 0; i < PARAM_LENGTH; i++)
+    VALUE_HOLD.clear();
+}
+
+// the swap in publish() already gave reads an empty buffer
+void WlDevice::published() {}
+
+void WLSamples::reset()
+{
+    for (size_t i = 0; i < WL_PARAM_SIZE; i++)
     {
-        for (size_t j = 0; j < boots->getMaxVal(); j++)
-        {
-            VALUE_HOLD[i][j] = NO_VALUE;
-        }
+        values[i].reset();
     }
 }
 
@@ -412,10 +433,11 @@ void WlDevice::print()
 {
     for (size_t i = 0; i < PARAM_LENGTH; i++)
     {
-        for (size_t j = 0; j < boots->getMaxVal(); j++)
+        const WLSamples::Ring &samples = VALUE_HOLD.fresh().values[i];
+        for (size_t j = 0; j < samples.count(); j++)
         {
             Log.info("PARAM VALUES FOR %s of iteration %d and value %d",
-                     utils.stringConvert(readParams[i]), (int)j, (int)VALUE_HOLD[i][j]);
+                     utils.stringConvert(readParams[i]), (int)j, samples.newest(j));
         }
     }
 }
@@ -4,6 +4,8 @@
 #include "device.h"
 #include "resources/bootstrap/bootstrap.h"
 #include "resources/utils/utils.h"
+#include "resources/utils/ping_pong.h"
+#include "resources/utils/sample_ring.h"
 #include <stdint.h>
 #include <math.h>
 
@@ -23,6 +25,14 @@ struct WLStruct
     char digital; // 'y' / 'n'
 };
 
+// one interval of readings per parameter; publish reads the median in O(1)
+struct WLSamples
+{
+    typedef hyphen::agg::SampleRing<int, Constants::OVERFLOW_VAL> Ring;
+    Ring values[WL_PARAM_SIZE];
+    void reset();
+};
+
 class WlDevice : public Device
 {
 private:
@@ -47,7 +57,7 @@ private:
     String deviceName = "wl";
     String readParams[WL_PARAM_SIZE] = {"dist"};
     const size_t PARAM_LENGTH = sizeof(readParams) / sizeof(String);
-    int VALUE_HOLD[sizeof(readParams) / sizeof(String)][Constants::OVERFLOW_VAL];
+    hyphen::sample::PingPong<WLSamples> VALUE_HOLD;
 
     // --- internal helpers ---
     int getPin();
@@ -65,6 +75,7 @@ private:
     String uniqueName();
     void setCloudFunctions();
     String getParamName(size_t index);
+    void paramKey(size_t index, char *out, size_t cap);
 
     // config conversion
     char setDigital(bool value);
@@ -92,9 +103,10 @@ public:
     void read();
     void loop();
     void clear();
+    void published();
     void print();
 
-    void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId);
+    void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId);
     uint8_t maintenanceCount();
     uint8_t paramCount();
     size_t buffSize();
@@ -206,7 +218,7 @@ public:
 //     uint8_t maintenanceCount();
 //     uint8_t paramCount();
 //     size_t buffSize();
-//     void publish(JsonObject &writer, uint8_t attempt_count, const String &payloadId);
+//     void publish(PayloadWriter &writer, uint8_t attempt_count, const String &payloadId);
 // };
 
 // #endif
\ No newline at end of file
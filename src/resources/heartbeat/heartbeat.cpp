@@ -35,6 +35,13 @@ void HeartBeat::setSystemDeets(JsonObject &writer)
     // whether the hardware watchdog / brownout is firing in the field.
     writer["rst"] = hyphen::boot::resetReasonStr();
     writer["boots"] = (long)hyphen::boot::bootCount();
+    // SD writer throughput, group-commit sync latency, and appends that
+    // went to the RAM ring because the card was busy
+    const hyphen::sdwriter::WriteStats &sd = Storage.writer().stats();
+    writer["sd_bps"] = Storage.writer().bytesPerSecond();
+    writer["sd_sync"] = sd.syncMeanMs();
+    writer["sd_sync_max"] = sd.syncMaxMs();
+    writer["sd_busy"] = sd.busy();
 }
 void HeartBeat::setPowerDeets(JsonObject &writer)
 {
@@ -46,13 +46,27 @@ String LocalProcessor::getHeartbeatTopic()
  * @return String
  */
 String LocalProcessor::getPublishTopic(bool maintenance)
+{
+    return String(publishTopic(maintenance));
+}
+
+/**
+ * @public
+ *
+ * publishTopic
+ *
+ * Same topic as getPublishTopic without building a String
+ *
+ * @return const char *
+ */
+const char *LocalProcessor::publishTopic(bool maintenance)
 {
     if (maintenance)
     {
-        return String(this->SEND_EVENT_MAINTENANCE);
+        return this->SEND_EVENT_MAINTENANCE;
     }
 
-    return String(this->SEND_EVENT_NAME);
+    return this->SEND_EVENT_NAME;
 }
 
 bool LocalProcessor::compressPublish(String topic, String payload)
@@ -29,6 +29,7 @@ public:
     static void parseMessage(String data, char *topic);
     String getHeartbeatTopic();
     String getPublishTopic(bool maintenance);
+    const char *publishTopic(bool maintenance);
     bool connect();
     void disconnect();
     bool isConnected();
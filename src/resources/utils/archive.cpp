@@ -0,0 +1,412 @@
+#include "archive.h"
+
+PayloadArchive::PayloadArchive()
+{
+    mutex = xSemaphoreCreateMutex();
+}
+
+String PayloadArchive::dataFile(uint32_t segment)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "arc%05lx.dat", (unsigned long)segment);
+    return String(name);
+}
+
+String PayloadArchive::indexFile(uint32_t segment)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "arc%05lx.idx", (unsigned long)segment);
+    return String(name);
+}
+
+/**
+ * Picks up the segments from NVS and the indexer where the newest segment
+ * left off. The first record appended after boot is always indexed.
+ */
+void PayloadArchive::load()
+{
+    if (loaded)
+    {
+        return;
+    }
+    unsigned long first = 0;
+    unsigned long last = 0;
+    Persist.get(firstKey, first);
+    Persist.get(lastKey, last);
+    firstSegment = first;
+    lastSegment = last < first ? first : last;
+    segmentBytes = Storage.fileSize(dataFile(lastSegment));
+
+    hyphen::archive::Entry entry;
+    uint32_t entries = indexEntries(lastSegment);
+    uint32_t newest = entries > 0 && readEntry(lastSegment, entries - 1, entry) ? entry.timestamp : 0;
+    if (segmentBytes == 0 && entries > 0)
+    {
+        // entries of records that never made it to the card
+        Storage.remove(indexFile(lastSegment));
+    }
+    indexer.resume(segmentBytes, newest);
+    loaded = true;
+}
+
+/**
+ * Starts a new segment, dropping the oldest once there are
+ * ARCHIVE_MAX_SEGMENTS.
+ */
+void PayloadArchive::roll()
+{
+    lastSegment++;
+    segmentBytes = 0;
+    indexer.reset(indexer.last());
+    Persist.put(lastKey, (unsigned long)lastSegment);
+    while (lastSegment - firstSegment >= ARCHIVE_MAX_SEGMENTS)
+    {
+        if (reader.isOpen() && readerSegment == firstSegment)
+        {
+            reader.close();
+        }
+        Storage.removeAsync(dataFile(firstSegment));
+        Storage.removeAsync(indexFile(firstSegment));
+        firstSegment++;
+        Persist.put(firstKey, (unsigned long)firstSegment);
+    }
+    if (replayActive && replaySegment < firstSegment)
+    {
+        replaySegment = firstSegment;
+        replayOffset = 0;
+    }
+}
+
+bool PayloadArchive::readEntry(uint32_t segment, uint32_t i, hyphen::archive::Entry &out)
+{
+    uint8_t raw[hyphen::archive::kEntrySize];
+    if (Storage.readBytes(indexFile(segment), (uint64_t)i * sizeof(raw), raw, sizeof(raw)) != sizeof(raw))
+    {
+        return false;
+    }
+    out = hyphen::archive::decodeEntry(raw);
+    return true;
+}
+
+uint32_t PayloadArchive::indexEntries(uint32_t segment)
+{
+    return Storage.fileSize(indexFile(segment)) / hyphen::archive::kEntrySize;
+}
+
+/**
+ * Appends a payload with the current time. Every ARCHIVE_INDEX_STRIDE bytes
+ * the record also gets an index entry, written on the SD worker.
+ *
+ * @return bool - false without a card or when the write failed
+ */
+bool PayloadArchive::append(const String &topic, const String &payload)
+{
+    return append(topic.c_str(), payload.c_str(), payload.length());
+}
+
+/**
+ * Same as above for a payload that lives in the publish buffer. The frame
+ * is built in a scratch buffer that is kept between calls. A packed
+ * (MessagePack) payload is kept as it is and turned into JSON on replay.
+ */
+bool PayloadArchive::append(const char *topic, const void *payload, size_t length, bool packed)
+{
+    using namespace hyphen::records;
+    if (!Storage.sdCardPresent())
+    {
+        return false;
+    }
+    size_t topicLen = strlen(topic);
+    topicLen = topicLen > 0xFF ? 0xFF : topicLen;
+    uint32_t bodyLen = hyphen::archive::kTimestampSize + 1 + topicLen + length;
+    if (bodyLen > kMaxPayload)
+    {
+        Log.errorln("Payload of %d bytes is too big to archive", length);
+        return false;
+    }
+    uint32_t timestamp = Time.now();
+    uint32_t frameLen = kHeaderSize + bodyLen;
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (frameCapacity < frameLen)
+    {
+        delete[] frame;
+        frame = new uint8_t[frameLen];
+        frameCapacity = frameLen;
+    }
+    uint8_t *body = frame + kHeaderSize;
+    putU32(body, timestamp);
+    body[hyphen::archive::kTimestampSize] = (uint8_t)topicLen;
+    memcpy(body + hyphen::archive::kTimestampSize + 1, topic, topicLen);
+    memcpy(body + hyphen::archive::kTimestampSize + 1 + topicLen, payload, length);
+    Header header;
+    header.flags = FLAG_INLINE_TOPIC | (packed ? FLAG_MSGPACK : 0);
+    header.length = bodyLen;
+    encodeHeader(header, body, frame);
+
+    load();
+    if (segmentBytes > 0 && segmentBytes + frameLen > SEGMENT_SIZE)
+    {
+        roll();
+    }
+    uint64_t size = Storage.writer().append(dataFile(lastSegment), frame, frameLen);
+    bool ok = size >= frameLen;
+    if (ok)
+    {
+        segmentBytes = size;
+        uint32_t offset = size - frameLen;
+        if (indexer.due(offset))
+        {
+            uint8_t raw[hyphen::archive::kEntrySize];
+            hyphen::archive::encodeEntry(indexer.index(offset, timestamp), raw);
+            // a missing entry only makes a replay scan further
+            Storage.appendAsync(indexFile(lastSegment), raw, sizeof(raw));
+        }
+    }
+    xSemaphoreGive(mutex);
+    return ok;
+}
+
+/**
+ * Starts streaming the records stamped from..to (unix seconds) to
+ * ARCHIVE_REPLAY_TOPIC, a batch per replayStep(). Replaces a replay that
+ * is still running.
+ */
+bool PayloadArchive::requestReplay(uint32_t from, uint32_t to)
+{
+    if (!Storage.sdCardPresent())
+    {
+        return false;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    load();
+    replayFrom = from;
+    replayTo = to;
+    replayed = 0;
+    seekReplay();
+    replayActive = true;
+    uint32_t segment = replaySegment;
+    unsigned long offset = replayOffset;
+    xSemaphoreGive(mutex);
+    Log.noticeln("Archive replay %l..%l from segment %l at %l", from, to, segment, offset);
+    return true;
+}
+
+/**
+ * Binary searches for the last segment, then the last index entry, stamped
+ * before replayFrom: every record at or after it comes later in the archive.
+ * An unreadable entry counts as older.
+ */
+void PayloadArchive::seekReplay()
+{
+    using namespace hyphen::archive;
+    uint32_t before = replayFrom > 0 ? replayFrom - 1 : 0;
+    size_t segment = floorIndex(
+        [this](size_t i)
+        {
+            Entry entry;
+            return readEntry(firstSegment + i, 0, entry) ? entry.timestamp : 0;
+        },
+        lastSegment - firstSegment + 1, before);
+    replaySegment = firstSegment + segment;
+
+    uint32_t entries = indexEntries(replaySegment);
+    size_t i = floorIndex(
+        [this](size_t i)
+        {
+            Entry entry;
+            return readEntry(replaySegment, i, entry) ? entry.timestamp : 0;
+        },
+        entries, before);
+    Entry entry;
+    replayOffset = entries > 0 && readEntry(replaySegment, i, entry) ? entry.offset : 0;
+}
+
+/**
+ * Reads the next intact record of a segment at or after offset and advances
+ * offset past it. Damaged frames are skipped. Returns false at the end of
+ * the segment or on a short read (offset < its size).
+ */
+bool PayloadArchive::readRecord(uint32_t segment, unsigned long &offset, uint32_t &timestamp, String &topic, String &payload)
+{
+    using namespace hyphen::records;
+    const String file = dataFile(segment);
+    uint64_t end = Storage.fileSize(file);
+    if (!reader.isOpen() || readerSegment != segment)
+    {
+        reader.close();
+        if (!reader.open(file.c_str(), offset))
+        {
+            return false;
+        }
+        readerSegment = segment;
+    }
+    uint8_t raw[kHeaderSize];
+    while (offset + kHeaderSize <= end)
+    {
+        const uint8_t *view = reader.seek(offset) ? reader.take(kHeaderSize) : nullptr;
+        if (!view)
+        {
+            return false;
+        }
+        memcpy(raw, view, kHeaderSize);
+
+        Header header;
+        if (decodeHeader(raw, header) && header.length > hyphen::archive::kTimestampSize &&
+            offset + frameSize(header) <= end)
+        {
+            uint8_t *copy = nullptr;
+            const uint8_t *body = reader.take(header.length);
+            if (!body && header.length > reader.capacity())
+            {
+                copy = new uint8_t[header.length];
+                body = reader.read(copy, header.length) == header.length ? copy : nullptr;
+            }
+            size_t topicEnd = body ? hyphen::archive::kTimestampSize + 1 + body[hyphen::archive::kTimestampSize] : 0;
+            bool intact = body && verify(raw, header, body) && topicEnd <= header.length;
+            if (intact)
+            {
+                timestamp = getU32(body);
+                topic = String((const char *)body + hyphen::archive::kTimestampSize + 1,
+                               topicEnd - hyphen::archive::kTimestampSize - 1);
+                payload = String((const char *)body + topicEnd, header.length - topicEnd);
+                if (header.flags & FLAG_MSGPACK)
+                {
+                    JsonDocument doc;
+                    deserializeMsgPack(doc, (const char *)body + topicEnd, header.length - topicEnd);
+                    payload = "";
+                    serializeJson(doc, payload);
+                }
+                offset += frameSize(header);
+            }
+            delete[] copy;
+            if (intact)
+            {
+                return true;
+            }
+        }
+
+        Log.errorln("Skipping damaged archive record at %l in %s", offset, file.c_str());
+        // on to the next frame magic
+        offset++;
+        long found = -1;
+        while (found < 0 && offset < end)
+        {
+            size_t n = reader.seek(offset) ? reader.fill() : 0;
+            if (n == 0)
+            {
+                return false;
+            }
+            found = findMagic(reader.peek(), n);
+            // the last byte may start a magic split across fills
+            offset += found >= 0 ? found : (n > 1 ? n - 1 : n);
+        }
+    }
+    offset = end;
+    return false;
+}
+
+/**
+ * Publishes the next batch of the running replay as one envelope (see
+ * resources/utils/batch_drain.h) whose ids are the records' positions in
+ * the archive. The cursor only moves once the publish succeeded, so a
+ * failed batch is retried on the next call. Ends the replay at the first
+ * record stamped after the window or at the end of the archive.
+ *
+ * @return uint16_t - the number of records sent
+ */
+uint16_t PayloadArchive::replayStep()
+{
+    if (!Storage.sdCardPresent())
+    {
+        return 0;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    // requestReplay may have replaced the window meanwhile
+    if (!replayActive)
+    {
+        xSemaphoreGive(mutex);
+        return 0;
+    }
+    const size_t budget = MQTT_MAX_PACKET_SIZE - strlen(ARCHIVE_REPLAY_TOPIC) - MQTT_PACKET_OVERHEAD;
+    char *buf = new char[budget];
+    hyphen::batch::EnvelopeBuilder envelope(buf, budget);
+    envelope.begin(Hyphen.deviceID().c_str());
+
+    uint32_t segment = replaySegment;
+    unsigned long offset = replayOffset;
+    bool done = false;
+    uint32_t timestamp;
+    String topic;
+    String payload;
+    while (true)
+    {
+        unsigned long next = offset;
+        if (!readRecord(segment, next, timestamp, topic, payload))
+        {
+            if (next < Storage.fileSize(dataFile(segment)))
+            {
+                // the card failed, try again next time
+                break;
+            }
+            if (segment >= lastSegment)
+            {
+                done = true;
+                offset = next;
+                break;
+            }
+            segment++;
+            offset = 0;
+            continue;
+        }
+        if (timestamp > replayTo)
+        {
+            done = true;
+            break;
+        }
+        if (timestamp >= replayFrom)
+        {
+            uint32_t id = segment * SEGMENT_SIZE + offset;
+            if (!envelope.add(id, topic.c_str(), payload.c_str(), payload.length()))
+            {
+                if (envelope.count() > 0)
+                {
+                    break;
+                }
+                Log.errorln("Archived record of %d bytes does not fit a replay batch", payload.length());
+            }
+        }
+        offset = next;
+    }
+    xSemaphoreGive(mutex);
+
+    uint16_t count = envelope.count();
+    bool sent = true;
+    if (count > 0)
+    {
+        size_t len = envelope.finish();
+        sent = Hyphen.publish(ARCHIVE_REPLAY_TOPIC, (uint8_t *)buf, len);
+        Log.noticeln("Archive replay batch of %d records (%d bytes) sent=%d", count, len, sent);
+    }
+    delete[] buf;
+    if (!sent)
+    {
+        return 0;
+    }
+
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    // the segment may have been dropped while publishing
+    if (segment >= firstSegment)
+    {
+        replaySegment = segment;
+        replayOffset = offset;
+    }
+    replayed += count;
+    if (done)
+    {
+        replayActive = false;
+        Log.noticeln("Archive replay %l..%l done, %l records", replayFrom, replayTo, replayed);
+    }
+    xSemaphoreGive(mutex);
+    return count;
+}
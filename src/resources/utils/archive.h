@@ -0,0 +1,74 @@
+#ifndef _PAYLOAD_ARCHIVE_H
+#define _PAYLOAD_ARCHIVE_H
+#include <Hyphen.h>
+#include "resources/utils/record_log.h"
+#include "resources/utils/archive_index.h"
+#include "resources/utils/batch_drain.h"
+
+// Time-indexed archive of every payload, see resources/utils/archive_index.h
+#ifndef ARCHIVE_SEGMENT_SIZE
+#define ARCHIVE_SEGMENT_SIZE (1024 * 1024)
+#endif
+#ifndef ARCHIVE_MAX_SEGMENTS
+#define ARCHIVE_MAX_SEGMENTS 256
+#endif
+// data bytes between two index entries, i.e. the most a replay scans
+#ifndef ARCHIVE_INDEX_STRIDE
+#define ARCHIVE_INDEX_STRIDE 4096
+#endif
+#ifndef ARCHIVE_REPLAY_TOPIC
+#define ARCHIVE_REPLAY_TOPIC "Hy/Post/Replay"
+#endif
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 2048
+#endif
+
+class PayloadArchive
+{
+private:
+    static constexpr uint32_t SEGMENT_SIZE = ARCHIVE_SEGMENT_SIZE;
+    static_assert(ARCHIVE_SEGMENT_SIZE >= hyphen::records::kHeaderSize + hyphen::records::kMaxPayload,
+                  "an archive segment must hold the largest record");
+    // oldest and newest segment on the card
+    const char *firstKey = "arc_first";
+    const char *lastKey = "arc_last";
+    uint32_t firstSegment = 0;
+    uint32_t lastSegment = 0;
+    uint32_t segmentBytes = 0;
+    bool loaded = false;
+    hyphen::archive::Indexer indexer = hyphen::archive::Indexer(ARCHIVE_INDEX_STRIDE);
+    // append runs on the publisher, replay on the loop
+    SemaphoreHandle_t mutex = nullptr;
+    // frame scratch, grown to the largest payload seen and reused
+    uint8_t *frame = nullptr;
+    size_t frameCapacity = 0;
+    String dataFile(uint32_t);
+    String indexFile(uint32_t);
+    void load();
+    void roll();
+    bool readEntry(uint32_t, uint32_t, hyphen::archive::Entry &);
+    uint32_t indexEntries(uint32_t);
+    // replay cursor
+    bool replayActive = false;
+    uint32_t replayFrom = 0;
+    uint32_t replayTo = 0;
+    uint32_t replaySegment = 0;
+    unsigned long replayOffset = 0;
+    uint32_t replayed = 0;
+    void seekReplay();
+    SDReader reader;
+    uint32_t readerSegment = 0;
+    bool readRecord(uint32_t, unsigned long &, uint32_t &, String &, String &);
+    // MQTT fixed header + topic length field + slack
+    static const size_t MQTT_PACKET_OVERHEAD = 16;
+
+public:
+    PayloadArchive();
+    bool append(const String &, const String &);
+    bool append(const char *, const void *, size_t, bool packed = false);
+    bool requestReplay(uint32_t, uint32_t);
+    bool replaying() const { return replayActive; }
+    uint16_t replayStep();
+};
+
+#endif
@@ -0,0 +1,134 @@
+// archive_index.h — sparse timestamp index of the on-card payload archive.
+//
+// The card used to hold only records that failed to publish, and once they
+// drained they were gone: the cloud could not ask for a window again after a
+// server-side loss. PayloadArchive now appends every payload the device
+// produces to archive segments (arc00000.dat, ...), each a run of record_log.h
+// frames whose body is
+//
+//     [u32 LE timestamp][u8 topic length][topic][payload]
+//
+// Next to each segment, arc00000.idx holds an entry every `stride` bytes of
+// data:
+//
+//     [u32 LE timestamp][u32 LE offset of that record in the segment]
+//
+// Finding the start of a replay window is then a binary search over segments
+// (by their first entry) and within one segment's index — O(log n) small reads
+// — followed by a short scan of at most one stride.
+//
+// The index timestamps never go backwards (index() clamps them) even when the
+// clock is stepped back, so the search stays valid; the scan filters on each
+// record's own timestamp. Pure functions, unit-tested on the host (see
+// test_archive_index).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "resources/utils/record_log.h"
+
+namespace hyphen {
+namespace archive {
+
+const size_t kEntrySize = 8;
+// body bytes in front of the topic and payload
+const size_t kTimestampSize = 4;
+
+struct Entry {
+  uint32_t timestamp = 0;
+  uint32_t offset = 0;
+};
+
+inline void encodeEntry(const Entry &e, uint8_t *out) {
+  records::putU32(out, e.timestamp);
+  records::putU32(out + 4, e.offset);
+}
+
+inline Entry decodeEntry(const uint8_t *in) {
+  Entry e;
+  e.timestamp = records::getU32(in);
+  e.offset = records::getU32(in + 4);
+  return e;
+}
+
+// Decides which records get an index entry: the first of a segment and then
+// the first at or past every `stride` bytes.
+class Indexer {
+ public:
+  explicit Indexer(uint32_t stride) : _stride(stride) {}
+
+  // A new segment starts; `last` is the newest timestamp indexed anywhere.
+  void reset(uint32_t last = 0) {
+    _next = 0;
+    _last = last;
+  }
+
+  // Picks up an existing segment that is `size` bytes long.
+  void resume(uint32_t size, uint32_t last) {
+    _next = size;
+    _last = last;
+  }
+
+  bool due(uint32_t offset) const { return offset >= _next; }
+
+  // The entry for a record at `offset`, its timestamp clamped to stay
+  // monotonic.
+  Entry index(uint32_t offset, uint32_t timestamp) {
+    if (timestamp > _last) {
+      _last = timestamp;
+    }
+    _next = offset + _stride;
+    Entry e;
+    e.timestamp = _last;
+    e.offset = offset;
+    return e;
+  }
+
+  uint32_t last() const { return _last; }
+
+ private:
+  uint32_t _stride;
+  uint32_t _next = 0;
+  uint32_t _last = 0;
+};
+
+// Index of the last of `count` ascending timestamps that is <= t, so a scan
+// from there reaches the first record at or after t. 0 when t precedes them
+// all. `timestampAt(i)` may read the card: it is called O(log count) times.
+template <typename TimestampAt>
+size_t floorIndex(TimestampAt timestampAt, size_t count, uint32_t t) {
+  size_t lo = 0;
+  size_t hi = count;
+  // invariant: everything before lo is <= t, everything from hi on is > t
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (timestampAt(mid) <= t) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo > 0 ? lo - 1 : 0;
+}
+
+// "t1,t2" in unix seconds, t1 <= t2.
+inline bool parseRange(const char *text, uint32_t &from, uint32_t &to) {
+  char *end;
+  unsigned long a = strtoul(text, &end, 10);
+  if (end == text || *end != ',') {
+    return false;
+  }
+  const char *second = end + 1;
+  unsigned long b = strtoul(second, &end, 10);
+  if (end == second || *end != '\0' || a > b || b > UINT32_MAX) {
+    return false;
+  }
+  from = (uint32_t)a;
+  to = (uint32_t)b;
+  return true;
+}
+
+}  // namespace archive
+}  // namespace hyphen
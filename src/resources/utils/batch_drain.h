@@ -0,0 +1,150 @@
+// batch_drain.h — packing stored offline records into one MQTT publish.
+//
+// Draining the offline store used to publish every record as its own message,
+// with a fixed 1 s pause between them and only 10 records per offline-check tick:
+// a 5,000-record backlog took hours on cellular and paid the per-publish round
+// trip and topic overhead every time. The batched drain packs as many records as
+// fit under the MQTT packet limit into a single JSON envelope:
+//
+//     {"device":"<id>","stale":true,"batch":[
+//        {"id":"<payload __id>","t":"<topic>","p":<stored payload>}, ...]}
+//
+// `id` is the payload's own "__id" (see resources/utils/payload_id.h), lifted
+// out of the stored JSON by payloadIdOf() so the server can dedupe a record
+// without parsing it; a record stored without one has no "id". There is no
+// per-record acknowledgement: the batch is delivered, and the store's head
+// moves past all of it, when the publish succeeds. The stored payload is
+// already JSON and is spliced in verbatim — nothing else is parsed on the
+// device. How many records go in one batch adapts to the measured publish
+// latency (BatchSizer: slow start, then AIMD).
+//
+// Pure functions over caller-owned buffers, unit-tested on the host (see
+// test_batch_drain).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hyphen {
+namespace batch {
+
+// The value of the first "__id" string in a JSON payload, without the quotes.
+// False when there is none.
+inline bool payloadIdOf(const char *json, size_t len, const char *&id, size_t &idLen) {
+  static const char kKey[] = "\"__id\":\"";
+  const size_t keyLen = sizeof(kKey) - 1;
+  for (size_t i = 0; i + keyLen <= len; i++) {
+    if (json[i] != '"' || memcmp(json + i, kKey, keyLen) != 0) {
+      continue;
+    }
+    const char *start = json + i + keyLen;
+    const char *end = (const char *)memchr(start, '"', len - (i + keyLen));
+    if (!end) {
+      return false;
+    }
+    id = start;
+    idLen = (size_t)(end - start);
+    return true;
+  }
+  return false;
+}
+
+// Builds the envelope in a fixed buffer. add() is all-or-nothing: a record that
+// would not fit (together with the closing "]}") leaves the buffer untouched, so
+// the caller stops there and the record stays at the head of the store.
+class EnvelopeBuilder {
+ public:
+  EnvelopeBuilder(char *buf, size_t cap) : _buf(buf), _cap(cap) {}
+
+  bool begin(const char *deviceId) {
+    _len = 0;
+    _count = 0;
+    return append("{\"device\":\"") && append(deviceId) &&
+           append("\",\"stale\":true,\"batch\":[");
+  }
+
+  // id may be null (idLen 0): the record goes in without one.
+  bool add(const char *id, size_t idLen, const char *topic, const char *payload, size_t payloadLen) {
+    size_t mark = _len;
+    bool ok = append(_count > 0 ? ",{" : "{");
+    if (ok && id && idLen > 0) {
+      ok = append("\"id\":\"") && append(id, idLen) && append("\",");
+    }
+    ok = ok && append("\"t\":\"") && append(topic) && append("\",\"p\":") && append(payload, payloadLen) &&
+         append("}");
+    // always leave room to close the envelope
+    if (!ok || _len + kCloseLen >= _cap) {
+      _len = mark;
+      return false;
+    }
+    _count++;
+    return true;
+  }
+
+  // Closes the envelope and NUL-terminates it. Returns its length.
+  size_t finish() {
+    append("]}");
+    _buf[_len] = '\0';
+    return _len;
+  }
+
+  size_t count() const { return _count; }
+  size_t length() const { return _len; }
+
+ private:
+  static const size_t kCloseLen = 2;  // "]}"
+  char *_buf;
+  size_t _cap;
+  size_t _len = 0;
+  size_t _count = 0;
+
+  bool append(const char *s) { return append(s, strlen(s)); }
+
+  bool append(const char *s, size_t n) {
+    if (_len + n >= _cap) {
+      return false;
+    }
+    memcpy(_buf + _len, s, n);
+    _len += n;
+    return true;
+  }
+};
+
+// Record limit per batch. It starts at a quarter of the maximum and doubles on
+// every fast publish until the first slow (over the latency target) or failed
+// one, so a boot with a large backlog gets to full batches in a few offline
+// checks. From then on it is additive-increase / multiplicative-decrease: a fast
+// publish grows the batch by one record, a slow or failed one halves it, so a
+// congested cellular link backs off quickly and a good one climbs back without
+// probing too hard.
+class BatchSizer {
+ public:
+  BatchSizer(uint16_t minRecords, uint16_t maxRecords, uint32_t targetLatencyMs)
+      : _min(minRecords),
+        _max(maxRecords),
+        _target(targetLatencyMs),
+        _limit(maxRecords / 4 > minRecords ? maxRecords / 4 : minRecords) {}
+
+  uint16_t limit() const { return _limit; }
+
+  void onPublish(bool success, uint32_t latencyMs) {
+    if (!success || latencyMs > _target) {
+      _slowStart = false;
+      _limit = _limit / 2 < _min ? _min : _limit / 2;
+      return;
+    }
+    uint32_t grown = _slowStart ? (uint32_t)_limit * 2 : (uint32_t)_limit + 1;
+    _limit = grown > _max ? _max : (uint16_t)grown;
+  }
+
+ private:
+  uint16_t _min;
+  uint16_t _max;
+  uint32_t _target;
+  uint16_t _limit;
+  bool _slowStart = true;
+};
+
+}  // namespace batch
+}  // namespace hyphen
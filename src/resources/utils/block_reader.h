@@ -0,0 +1,196 @@
+// block_reader.h — streaming, block-buffered reads for SD files.
+//
+// SDCard::read used to reopen and re-seek the file on every call, then pull one
+// byte per file.read() into a String: popping ten 1 KB records cost ~10,000
+// single-byte SdFat reads plus a String reallocation per byte. BlockReader keeps
+// the file open and reads it a buffer (4 KB by default) at a time, handing out
+// lines and records as views into that buffer:
+//
+//     BlockReader<SdFile> reader;
+//     reader.open("log.txt");
+//     const char *line; size_t len;
+//     while (reader.nextLine(line, len)) { ... }   // valid until the next call
+//
+// Anything bigger than the buffer is copied into a caller buffer instead
+// (read(), readLine()). `File` is anything with SdFile's open/read/seekSet/close;
+// on the device that is SDCard::SharedFile, which holds the SPI mutex only while
+// it touches the card. Unit-tested and benchmarked on the host against the
+// file-backed SdFat shim (see test_block_reader).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <SdFat.h>
+
+namespace hyphen {
+namespace io {
+
+template <typename File, size_t N = 4096>
+class BlockReader {
+ public:
+  ~BlockReader() { close(); }
+
+  bool open(const char *path, uint64_t offset = 0) {
+    close();
+    if (!_file.open(path, O_READ)) {
+      return false;
+    }
+    _open = true;
+    return seek(offset);
+  }
+
+  void close() {
+    if (_open) {
+      _file.close();
+    }
+    _open = false;
+    _start = 0;
+    _len = 0;
+    _pos = 0;
+  }
+
+  bool isOpen() const { return _open; }
+  static size_t capacity() { return N; }
+  uint64_t position() const { return _start + _pos; }
+  size_t available() const { return _len - _pos; }
+  // File reads issued so far (for benchmarks and stats).
+  uint32_t fileReads() const { return _reads; }
+
+  // Moves the cursor. Free when the target is already buffered.
+  bool seek(uint64_t offset) {
+    if (!_open) {
+      return false;
+    }
+    if (offset >= _start && offset <= _start + _len) {
+      _pos = (size_t)(offset - _start);
+      return true;
+    }
+    _start = offset;
+    _len = 0;
+    _pos = 0;
+    return _file.seekSet(offset);
+  }
+
+  // Makes at least n bytes available at the cursor. False at end of file or
+  // when n exceeds the buffer.
+  bool ensure(size_t n) {
+    if (n > N || !_open) {
+      return false;
+    }
+    if (_len - _pos >= n) {
+      return true;
+    }
+    compact();
+    while (_len < n) {
+      int got = _file.read(_buf + _len, N - _len);
+      _reads++;
+      if (got <= 0) {
+        return false;
+      }
+      _len += (size_t)got;
+    }
+    return true;
+  }
+
+  // Tops the buffer up and returns the bytes available at the cursor (0 at
+  // end of file). peek() points at them.
+  size_t fill() {
+    ensure(available() < N ? available() + 1 : N);
+    return available();
+  }
+
+  const uint8_t *peek() const { return _buf + _pos; }
+
+  // View of the next n bytes, moving the cursor past them. nullptr at end of
+  // file or when n exceeds the buffer.
+  const uint8_t *take(size_t n) {
+    if (!ensure(n)) {
+      return nullptr;
+    }
+    const uint8_t *out = _buf + _pos;
+    _pos += n;
+    return out;
+  }
+
+  // Copies up to n bytes into out, for anything bigger than the buffer.
+  size_t read(uint8_t *out, size_t n) {
+    size_t copied = 0;
+    while (copied < n) {
+      size_t ready = fill();
+      if (ready == 0) {
+        break;
+      }
+      size_t chunk = n - copied < ready ? n - copied : ready;
+      memcpy(out + copied, _buf + _pos, chunk);
+      _pos += chunk;
+      copied += chunk;
+    }
+    return copied;
+  }
+
+  // View of the next line without its terminator. A final line without one
+  // still counts; a line longer than the buffer comes out in buffer-sized
+  // pieces. False at end of file.
+  bool nextLine(const char *&data, size_t &len, char term = '\n') {
+    size_t scanned = 0;
+    while (true) {
+      const uint8_t *from = _buf + _pos;
+      const void *hit = memchr(from + scanned, term, available() - scanned);
+      if (hit) {
+        data = (const char *)from;
+        len = (size_t)((const uint8_t *)hit - from);
+        _pos += len + 1;
+        return true;
+      }
+      scanned = available();
+      if (scanned == N || !ensure(scanned + 1)) {
+        if (scanned == 0) {
+          return false;
+        }
+        data = (const char *)_buf + _pos;
+        len = scanned;
+        _pos += scanned;
+        return true;
+      }
+    }
+  }
+
+  // Copies the next line into out (NUL-terminated, cut to cap - 1 bytes).
+  // Returns the line's length, or -1 at end of file.
+  long readLine(char *out, size_t cap, char term = '\n') {
+    const char *data;
+    size_t len;
+    if (!nextLine(data, len, term)) {
+      return -1;
+    }
+    size_t n = len < cap ? len : cap - 1;
+    memcpy(out, data, n);
+    out[n] = '\0';
+    return (long)len;
+  }
+
+ private:
+  File _file;
+  bool _open = false;
+  uint8_t _buf[N];
+  uint64_t _start = 0;  // file offset of _buf[0]; the file is read up to _start + _len
+  size_t _len = 0;
+  size_t _pos = 0;
+  uint32_t _reads = 0;
+
+  // Drops consumed bytes so the unread rest starts the buffer.
+  void compact() {
+    if (_pos == 0) {
+      return;
+    }
+    memmove(_buf, _buf + _pos, _len - _pos);
+    _start += _pos;
+    _len -= _pos;
+    _pos = 0;
+  }
+};
+
+}  // namespace io
+}  // namespace hyphen
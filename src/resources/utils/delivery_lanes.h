@@ -0,0 +1,133 @@
+// delivery_lanes.h — live payloads first, the backlog in the link time left.
+//
+// After an outage the offline drain sent the oldest records first, at a fixed
+// pace, whatever the publisher task was doing. The readings the device took
+// while it was offline (and every live payload whose publish failed since) sat
+// at the end of that queue, so dashboards showed hours-old data long after
+// coverage came back. Delivery now runs in two lanes:
+//
+//     live     the publish outbox, at its normal latency. While it holds a
+//              payload the backlog lane doesn't send at all.
+//     backlog  the offline store, newest-to-oldest (the default) or
+//              oldest-to-newest, at most as many records per offline check
+//              as fit in the lane's share of the check period once the live
+//              lane's publish time is taken off.
+//
+// Every replayed record still carries "stale": true, which is how the cloud
+// tells backfill from live data whatever order it arrives in.
+//
+// The store's records only link forward, so the newest ones are found by
+// scanning a segment from its start and keeping the last few (NewestWindow).
+//
+// Pure functions, unit-tested on the host (see test_delivery_lanes).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace hyphen {
+namespace lanes {
+
+enum Order : uint8_t {
+  NEWEST_FIRST = 0,
+  OLDEST_FIRST = 1,
+};
+
+// "newest" or "oldest", the setBacklogOrder cloud function.
+inline bool parseOrder(const char *cmd, Order &order) {
+  if (strcmp(cmd, "newest") == 0) {
+    order = NEWEST_FIRST;
+    return true;
+  }
+  if (strcmp(cmd, "oldest") == 0) {
+    order = OLDEST_FIRST;
+    return true;
+  }
+  return false;
+}
+
+inline const char *orderName(Order order) {
+  return order == OLDEST_FIRST ? "oldest" : "newest";
+}
+
+// How many backlog records one offline check may send. The live lane reports
+// the link time of its publishes from the publisher task; take() runs on the
+// main loop once per check.
+class BacklogBudget {
+ public:
+  BacklogBudget(uint32_t periodMs, uint8_t sharePercent, uint16_t maxRecords)
+      : _share(periodMs / 100 * sharePercent), _max(maxRecords) {}
+
+  void onLive(uint32_t ms) { _liveMs.fetch_add(ms, std::memory_order_relaxed); }
+
+  // What the last backlog pass sent and how long it took.
+  void onBacklog(uint16_t records, uint32_t ms) {
+    if (records == 0) {
+      return;
+    }
+    uint32_t perRecord = ms / records;
+    if (perRecord == 0) {
+      perRecord = 1;
+    }
+    _recordMs = _recordMs == 0 ? perRecord : (3 * _recordMs + perRecord) / 4;
+  }
+
+  // 0 while live payloads wait or when the live lane used the whole share
+  // since the last check. The first pass probes with a single record.
+  uint16_t take(size_t livePending) {
+    if (livePending > 0) {
+      return 0;
+    }
+    uint32_t live = _liveMs.exchange(0, std::memory_order_relaxed);
+    if (live >= _share) {
+      return 0;
+    }
+    if (_recordMs == 0) {
+      return 1;
+    }
+    uint32_t records = (_share - live) / _recordMs;
+    if (records < 1) {
+      records = 1;
+    }
+    return records > _max ? _max : (uint16_t)records;
+  }
+
+  uint32_t recordMs() const { return _recordMs; }
+
+ private:
+  uint32_t _share;
+  uint16_t _max;
+  uint32_t _recordMs = 0;
+  std::atomic<uint32_t> _liveMs{0};
+};
+
+// The last cap positions added by a forward scan, handed back newest first.
+template <size_t N>
+class NewestWindow {
+ public:
+  explicit NewestWindow(size_t cap) : _cap(cap < N ? cap : N) {}
+
+  void add(uint32_t position) {
+    if (_cap == 0) {
+      return;
+    }
+    _ring[_seen % _cap] = position;
+    _seen++;
+  }
+
+  size_t count() const { return _seen < _cap ? _seen : _cap; }
+
+  // i = 0 is the newest.
+  uint32_t newest(size_t i) const { return _ring[(_seen - 1 - i) % _cap]; }
+
+ private:
+  size_t _cap;
+  size_t _seen = 0;
+  uint32_t _ring[N] = {};
+};
+
+}  // namespace lanes
+}  // namespace hyphen
@@ -0,0 +1,210 @@
+// kv_cache.h — write-back cache in front of the NVS key/value namespace.
+//
+// Persistence used to open and close its Preferences namespace around every
+// put and get, and every put went straight to flash. Boot reads dozens of
+// keys (device configs, metadata, store positions) and some keys are rewritten
+// on every publish or pop, each costing an NVS page write.
+//
+// The cache keeps each key it has seen in RAM: a get is served from there after
+// the first one (including "not there"), a put that stores the same bytes is
+// dropped, and any other put only marks the entry dirty. flush() writes the
+// dirty entries out in one pass; Persistence calls it on a timer and before a
+// restart. flush(key) writes one entry through for values that must be on
+// flash before the caller acts on them. Every write to the backend is counted per key so flash wear can be
+// watched.
+//
+// The backend is a template parameter with
+//
+//     long length(const char *key)                     -1 when absent
+//     size_t read(const char *key, void *out, size_t len)
+//     bool write(const char *key, const void *data, size_t len)
+//
+// so the cache is pure and unit-tested on the host (see test_kv_cache).
+// Not thread-safe: Persistence holds its mutex around it.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hyphen {
+namespace kv {
+
+// NVS keys are at most 15 characters
+const size_t kMaxKey = 15;
+
+template <typename Backend, size_t Entries = 64>
+class WriteBackCache {
+ public:
+  explicit WriteBackCache(Backend &backend) : _backend(backend) {}
+  ~WriteBackCache() { drop(); }
+
+  // Copies key's value into out when it is exactly len bytes long.
+  bool get(const char *key, void *out, size_t len) {
+    Entry *e = find(key);
+    if (!e) {
+      e = load(key);
+    }
+    if (!e) {
+      // no room to cache it: straight from the backend
+      long stored = _backend.length(key);
+      return stored == (long)len && _backend.read(key, out, len) == len;
+    }
+    if (!e->present || e->len != len) {
+      return false;
+    }
+    memcpy(out, e->data, len);
+    return true;
+  }
+
+  // Stores the value, written out by the next flush(). Writes through when the
+  // cache has no room. False only when the value could not be kept.
+  bool put(const char *key, const void *data, size_t len) {
+    if (strlen(key) > kMaxKey) {
+      return false;
+    }
+    Entry *e = find(key);
+    if (!e) {
+      e = load(key);
+    }
+    if (!e) {
+      return writeThrough(key, data, len);
+    }
+    if (e->present && e->len == len && memcmp(e->data, data, len) == 0) {
+      return true;
+    }
+    if (e->len != len) {
+      uint8_t *bytes = new uint8_t[len > 0 ? len : 1];
+      delete[] e->data;
+      e->data = bytes;
+      e->len = len;
+    }
+    memcpy(e->data, data, len);
+    e->present = true;
+    if (!e->dirty) {
+      e->dirty = true;
+      _dirty++;
+    }
+    return true;
+  }
+
+  // Writes every dirty entry. Entries that fail stay dirty for the next
+  // flush. Returns the number written.
+  size_t flush() {
+    size_t written = 0;
+    for (size_t i = 0; i < _used && _dirty > 0; i++) {
+      if (_entries[i].dirty && writeOut(_entries[i])) {
+        written++;
+      }
+    }
+    return written;
+  }
+
+  // Writes key now if it is dirty. True once it is on the backend (a key
+  // the cache doesn't hold was written through by put()).
+  bool flush(const char *key) {
+    Entry *e = find(key);
+    return !e || !e->dirty || writeOut(*e);
+  }
+
+  // Forgets everything, dirty entries included (after the namespace was
+  // cleared). Write counters restart.
+  void drop() {
+    for (size_t i = 0; i < _used; i++) {
+      delete[] _entries[i].data;
+      _entries[i] = Entry();
+    }
+    _used = 0;
+    _dirty = 0;
+  }
+
+  size_t dirty() const { return _dirty; }
+  size_t size() const { return _used; }
+  uint32_t totalWrites() const { return _totalWrites; }
+
+  uint32_t writes(const char *key) const {
+    for (size_t i = 0; i < _used; i++) {
+      if (strcmp(_entries[i].key, key) == 0) {
+        return _entries[i].writes;
+      }
+    }
+    return 0;
+  }
+
+  // Calls f(key, writes) for each cached key.
+  template <typename F>
+  void eachKey(F f) const {
+    for (size_t i = 0; i < _used; i++) {
+      f(_entries[i].key, _entries[i].writes);
+    }
+  }
+
+ private:
+  struct Entry {
+    char key[kMaxKey + 1] = {0};
+    uint8_t *data = nullptr;
+    size_t len = 0;
+    bool present = false;
+    bool dirty = false;
+    uint32_t writes = 0;
+  };
+
+  Backend &_backend;
+  Entry _entries[Entries];
+  size_t _used = 0;
+  size_t _dirty = 0;
+  uint32_t _totalWrites = 0;
+
+  bool writeOut(Entry &e) {
+    if (!_backend.write(e.key, e.data, e.len)) {
+      return false;
+    }
+    e.writes++;
+    _totalWrites++;
+    e.dirty = false;
+    _dirty--;
+    return true;
+  }
+
+  Entry *find(const char *key) {
+    for (size_t i = 0; i < _used; i++) {
+      if (strcmp(_entries[i].key, key) == 0) {
+        return &_entries[i];
+      }
+    }
+    return nullptr;
+  }
+
+  // Reads key from the backend into a new entry. nullptr when full.
+  Entry *load(const char *key) {
+    if (_used >= Entries || strlen(key) > kMaxKey) {
+      return nullptr;
+    }
+    Entry &e = _entries[_used];
+    long stored = _backend.length(key);
+    if (stored > 0) {
+      e.data = new uint8_t[stored];
+      if (_backend.read(key, e.data, stored) != (size_t)stored) {
+        delete[] e.data;
+        e.data = nullptr;
+        return nullptr;
+      }
+      e.len = stored;
+    }
+    e.present = stored >= 0;
+    strcpy(e.key, key);
+    _used++;
+    return &e;
+  }
+
+  bool writeThrough(const char *key, const void *data, size_t len) {
+    if (!_backend.write(key, data, len)) {
+      return false;
+    }
+    _totalWrites++;
+    return true;
+  }
+};
+
+}  // namespace kv
+}  // namespace hyphen
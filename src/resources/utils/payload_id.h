@@ -0,0 +1,162 @@
+// payload_id.h — payload ids from a boot id and a persisted sequence.
+//
+// DeviceSecurity::makePayloadId used to set up an entropy source and seed a
+// fresh CTR-DRBG for every id, once per publish, only to draw 96 random bits
+// and throw the generator away. Seeding pulls from the hardware RNG and runs
+// the DRBG's AES key schedule each time. Now the generator is seeded once per
+// boot and an id is mostly counting:
+//
+//     "p2_" + base64url(seq u32 BE | boot u32 BE | random u32)
+//
+// seq is monotonic across reboots: the device writes how far it may count
+// (a lease of kLease numbers) through to NVS before handing out the first
+// number past the last lease, so at most one NVS write per kLease ids, and a
+// reboot of any kind skips what was left of the lease instead of reusing it.
+// A lease that doesn't reach NVS doesn't hold the id back: the number still
+// goes out, and every following id asks for the write again (unwritten())
+// until it succeeds. boot is drawn from the DRBG at boot, so ids stay unique
+// when seq starts over, because NVS was erased or a lease never reached it.
+// The random tail keeps ids from being guessable. The cloud can dedupe
+// replayed offline records on (device, boot, seq) without keeping every id it
+// has seen.
+//
+// Pure functions, unit-tested and benchmarked on the host (see
+// test_payload_id).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hyphen {
+namespace pid {
+
+const char kPrefix[] = "p2_";
+const size_t kPrefixSize = 3;
+const size_t kIdBytes = 12;
+// "p2_" + 16 base64url characters
+const size_t kIdLength = kPrefixSize + 16;
+const uint32_t kLease = 256;
+
+// base64url without padding, NUL-terminated. Returns the length, 0 when it
+// doesn't fit.
+inline size_t base64url(const uint8_t *in, size_t n, char *out, size_t cap) {
+  static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  size_t len = (n * 4 + 2) / 3;
+  if (len + 1 > cap) {
+    return 0;
+  }
+  size_t o = 0;
+  for (size_t i = 0; i < n; i += 3) {
+    uint32_t v = (uint32_t)in[i] << 16;
+    if (i + 1 < n) {
+      v |= (uint32_t)in[i + 1] << 8;
+    }
+    if (i + 2 < n) {
+      v |= in[i + 2];
+    }
+    for (int k = 0; k < 4 && o < len; k++) {
+      out[o++] = kAlphabet[(v >> (18 - 6 * k)) & 0x3F];
+    }
+  }
+  out[o] = '\0';
+  return o;
+}
+
+inline int base64urlValue(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '-') return 62;
+  if (c == '_') return 63;
+  return -1;
+}
+
+inline void putU32(uint8_t *out, uint32_t v) {
+  out[0] = (uint8_t)(v >> 24);
+  out[1] = (uint8_t)(v >> 16);
+  out[2] = (uint8_t)(v >> 8);
+  out[3] = (uint8_t)v;
+}
+
+inline uint32_t getU32(const uint8_t *in) {
+  return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+// Writes the id into out. Returns its length, 0 when it doesn't fit.
+inline size_t format(uint32_t seq, uint32_t boot, uint32_t random, char *out, size_t cap) {
+  uint8_t raw[kIdBytes];
+  putU32(raw, seq);
+  putU32(raw + 4, boot);
+  putU32(raw + 8, random);
+  if (cap < kPrefixSize) {
+    return 0;
+  }
+  size_t n = base64url(raw, sizeof(raw), out + kPrefixSize, cap - kPrefixSize);
+  if (n == 0) {
+    return 0;
+  }
+  memcpy(out, kPrefix, kPrefixSize);
+  return kPrefixSize + n;
+}
+
+// The sequence and boot id of an id format() wrote; what the cloud does.
+inline bool parse(const char *id, uint32_t &seq, uint32_t &boot) {
+  if (strlen(id) != kIdLength || memcmp(id, kPrefix, kPrefixSize) != 0) {
+    return false;
+  }
+  uint8_t raw[kIdBytes];
+  const char *p = id + kPrefixSize;
+  for (size_t i = 0; i < 4; i++) {
+    uint32_t v = 0;
+    for (size_t k = 0; k < 4; k++) {
+      int d = base64urlValue(p[4 * i + k]);
+      if (d < 0) {
+        return false;
+      }
+      v = (v << 6) | (uint32_t)d;
+    }
+    raw[3 * i] = (uint8_t)(v >> 16);
+    raw[3 * i + 1] = (uint8_t)(v >> 8);
+    raw[3 * i + 2] = (uint8_t)v;
+  }
+  seq = getU32(raw);
+  boot = getU32(raw + 4);
+  return true;
+}
+
+// Hands out the sequence numbers. The value persisted is limit(): the first
+// number the next boot may use.
+class Sequence {
+ public:
+  void restore(uint32_t persisted) {
+    _next = persisted;
+    _limit = persisted;
+    _unwritten = false;
+  }
+
+  // The next number. True when limit() has to be persisted before the number
+  // is used: it moved, or the last write of it failed.
+  bool next(uint32_t &value) {
+    bool lease = _unwritten || _next >= _limit;
+    if (_next >= _limit) {
+      _limit = _next + kLease;
+    }
+    _unwritten = false;
+    value = _next++;
+    return lease;
+  }
+
+  // limit() didn't reach storage; the next call asks for it again.
+  void unwritten() { _unwritten = true; }
+
+  uint32_t limit() const { return _limit; }
+
+ private:
+  uint32_t _next = 0;
+  uint32_t _limit = 0;
+  bool _unwritten = false;
+};
+
+}  // namespace pid
+}  // namespace hyphen
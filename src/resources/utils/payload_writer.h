@@ -0,0 +1,515 @@
+// payload_writer.h — streaming writers for the publish payload.
+//
+// DeviceManager::payloadWriter used to build a JsonDocument on the heap,
+// serialize it into a growing String, and publisher() then copied that String
+// twice more in sanitize(). Every device added its keys through Strings too.
+// With COMPRESSED_PUBLISH, Hyphen::compressPublish then parsed that JSON back
+// into a document just to serialize it as MessagePack. The payload is now
+// written field by field, straight into one fixed buffer that is allocated
+// once at boot (in PSRAM when there is some), through a PayloadSink:
+//
+//     JsonWriter writer(buf, cap);     // or MsgPackWriter
+//     PayloadSink &sink = writer;
+//     sink.beginObject();
+//     sink.add("device", id);
+//     sink.beginObject("payload");
+//     sink.add("temperature", 21.4f);
+//     sink.endObject();
+//     sink.endObject();
+//     publish(sink.data(), sink.length());
+//
+// Devices only see the PayloadSink, so the same code emits JSON (Hy/Post/Black)
+// or MessagePack (Hy/Post/Gold) with no second pass over the payload. Arrays
+// (beginArray/endArray) take their elements through item(), or add() with a
+// key that is ignored.
+//
+// Nothing here allocates. JSON strings are escaped, so the output never holds
+// the raw \r or \n that sanitize() used to strip. A field that doesn't fit
+// marks the sink !ok() and everything after it is ignored, so a payload is
+// never published half-written. Numbers are formatted here rather than by
+// printf, whose float path allocates in newlib. Non-finite numbers are written
+// as null, as ArduinoJson does.
+//
+// MessagePack maps and arrays don't know their size until they are closed:
+// each one reserves a map16/array16 header, and closing narrows it to a
+// fixmap/fixarray (moving the members down two bytes) when it has 15 members
+// or fewer, which is what serializeMsgPack would have written. Integers take their smallest encoding;
+// floats are float32, doubles float64 unless a float32 holds them exactly.
+//
+// Pure functions, unit-tested on the host (see test_payload_writer, which
+// also checks the allocation count and reports throughput).
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hyphen {
+namespace payload {
+
+// digits after the decimal point; sensor floats round-trip at this precision
+const int kDecimals = 6;
+// significant digits a float carries
+const int kFloatDigits = 7;
+
+// Writes v in decimal. Returns the length, 0 if it didn't fit in cap.
+inline size_t formatUnsigned(unsigned long long v, char *out, size_t cap) {
+  char digits[20];
+  size_t n = 0;
+  do {
+    digits[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  if (n > cap) {
+    return 0;
+  }
+  for (size_t i = 0; i < n; i++) {
+    out[i] = digits[n - 1 - i];
+  }
+  return n;
+}
+
+inline size_t formatInteger(long long v, char *out, size_t cap) {
+  if (v >= 0) {
+    return formatUnsigned((unsigned long long)v, out, cap);
+  }
+  if (cap < 2) {
+    return 0;
+  }
+  out[0] = '-';
+  size_t n = formatUnsigned(0ULL - (unsigned long long)v, out + 1, cap - 1);
+  return n ? n + 1 : 0;
+}
+
+// Fixed point up to kDecimals places with trailing zeros trimmed, or
+// m.mmmmmmeN outside 1e-5 .. 1e9. "null" for NaN and infinity. With
+// `significant`, fewer places are kept once the integral part has digits
+// of its own: a float holds about 7, so 1012.8f prints as 1012.8.
+inline size_t formatDouble(double v, char *out, size_t cap, int significant = 0) {
+  if (isnan(v) || isinf(v)) {
+    if (cap < 4) {
+      return 0;
+    }
+    memcpy(out, "null", 4);
+    return 4;
+  }
+  size_t o = 0;
+  if (v < 0) {
+    if (cap < 1) {
+      return 0;
+    }
+    out[o++] = '-';
+    v = -v;
+  }
+  int exponent = 0;
+  if (v >= 1e9 || (v > 0 && v < 1e-5)) {
+    exponent = (int)floor(log10(v));
+    v /= pow(10.0, exponent);
+    if (v >= 10.0) {
+      v /= 10.0;
+      exponent++;
+    }
+  }
+  uint32_t integral = (uint32_t)v;
+  int decimals = kDecimals;
+  if (significant > 0) {
+    int digits = 0;
+    for (uint32_t i = integral; i > 0; i /= 10) {
+      digits++;
+    }
+    decimals = significant - digits;
+    decimals = decimals < 0 ? 0 : (decimals > kDecimals ? kDecimals : decimals);
+  }
+  uint32_t scale = 1;
+  for (int i = 0; i < decimals; i++) {
+    scale *= 10;
+  }
+  uint32_t fraction = (uint32_t)((v - integral) * scale + 0.5);
+  if (fraction >= scale) {
+    fraction -= scale;
+    integral++;
+  }
+  size_t n = formatUnsigned(integral, out + o, cap - o);
+  if (n == 0) {
+    return 0;
+  }
+  o += n;
+  if (fraction > 0) {
+    int width = decimals;
+    while (fraction % 10 == 0) {
+      fraction /= 10;
+      width--;
+    }
+    if (o + 1 + width > cap) {
+      return 0;
+    }
+    out[o++] = '.';
+    for (int i = width - 1; i >= 0; i--) {
+      out[o + i] = (char)('0' + fraction % 10);
+      fraction /= 10;
+    }
+    o += width;
+  }
+  if (exponent != 0) {
+    if (o + 1 > cap) {
+      return 0;
+    }
+    out[o++] = 'e';
+    n = formatInteger(exponent, out + o, cap - o);
+    if (n == 0) {
+      return 0;
+    }
+    o += n;
+  }
+  return o;
+}
+
+// What devices write into. Keeps the buffer and the object nesting; the
+// encoding is up to JsonWriter or MsgPackWriter.
+class PayloadSink {
+ public:
+  static const size_t kMaxDepth = 8;
+
+  PayloadSink(uint8_t *buf, size_t cap) : _buf(buf), _cap(cap) {}
+  virtual ~PayloadSink() {}
+
+  // Starts over on the same buffer.
+  void reset() {
+    _len = 0;
+    _depth = 0;
+    _ok = _cap > 0;
+    _members[0] = 0;
+    terminate();
+  }
+
+  bool beginObject() {
+    if (_depth > 0 || _len > 0) {
+      return fail();  // a second top-level value
+    }
+    return open();
+  }
+  bool beginObject(const char *key) { return member(key) && open(); }
+  bool endObject() { return close(false); }
+
+  // an array member of the current object, or an array inside an array
+  bool beginArray(const char *key = nullptr) { return member(key) && open(true); }
+  bool endArray() { return close(true); }
+
+  bool add(const char *key, const char *value) { return member(key) && writeString(value, strlen(value)); }
+  bool add(const char *key, const char *value, size_t n) { return member(key) && writeString(value, n); }
+  bool add(const char *key, bool value) { return member(key) && writeBool(value); }
+  bool add(const char *key, int value) { return add(key, (long long)value); }
+  bool add(const char *key, long value) { return add(key, (long long)value); }
+  bool add(const char *key, unsigned int value) { return add(key, (unsigned long long)value); }
+  bool add(const char *key, unsigned long value) { return add(key, (unsigned long long)value); }
+  bool add(const char *key, long long value) { return member(key) && writeInteger(value); }
+  bool add(const char *key, unsigned long long value) { return member(key) && writeUnsigned(value); }
+  bool add(const char *key, float value) { return member(key) && writeFloat(value); }
+  bool add(const char *key, double value) { return member(key) && writeDouble(value); }
+
+  // the next element of the current array
+  template <typename T>
+  bool item(T value) {
+    return add(nullptr, value);
+  }
+
+  // False once anything didn't fit or the objects didn't balance.
+  bool ok() const { return _ok; }
+  // True when every object was closed and nothing was lost.
+  bool complete() const { return _ok && _depth == 0 && _len > 0; }
+  size_t length() const { return _len; }
+  const uint8_t *data() const { return _buf; }
+  size_t capacity() const { return _cap; }
+
+ protected:
+  uint8_t *_buf;
+  size_t _cap;
+  size_t _len = 0;
+  size_t _depth = 0;
+  bool _ok = true;
+  // members written so far and where the object started, at each depth
+  uint16_t _members[kMaxDepth + 1];
+  size_t _starts[kMaxDepth + 1];
+  bool _arrays[kMaxDepth + 1];
+
+  // bytes left, keeping one for the terminating NUL of the JSON text
+  size_t room() const { return _len + 1 < _cap ? _cap - _len - 1 : 0; }
+
+  void terminate() {
+    if (_cap > 0) {
+      _buf[_len < _cap ? _len : _cap - 1] = '\0';
+    }
+  }
+
+  bool fail() {
+    _ok = false;
+    return false;
+  }
+
+  bool put(uint8_t c) {
+    if (!_ok || room() < 1) {
+      return fail();
+    }
+    _buf[_len++] = c;
+    terminate();
+    return true;
+  }
+
+  bool put(const void *bytes, size_t n) {
+    if (!_ok || room() < n) {
+      return fail();
+    }
+    memcpy(_buf + _len, bytes, n);
+    _len += n;
+    terminate();
+    return true;
+  }
+
+  // the next member of the current object or array, up to its value
+  bool member(const char *key) {
+    if (!_ok || _depth == 0 || _members[_depth] == UINT16_MAX) {
+      return fail();
+    }
+    bool first = _members[_depth] == 0;
+    if (!(_arrays[_depth] ? writeElement(first) : key && writeKey(key, first))) {
+      return fail();
+    }
+    _members[_depth]++;
+    return true;
+  }
+
+  bool open(bool array = false) {
+    if (!_ok || _depth >= kMaxDepth) {
+      return fail();
+    }
+    _depth++;
+    _members[_depth] = 0;
+    _starts[_depth] = _len;
+    _arrays[_depth] = array;
+    return array ? openArray() : openObject();
+  }
+
+  bool close(bool array) {
+    if (!_ok || _depth == 0 || _arrays[_depth] != array) {
+      return fail();
+    }
+    bool closed = array ? closeArray(_starts[_depth], _members[_depth]) : closeObject(_starts[_depth], _members[_depth]);
+    if (!closed) {
+      return fail();
+    }
+    _depth--;
+    return true;
+  }
+
+  virtual bool openObject() = 0;
+  virtual bool closeObject(size_t start, uint16_t members) = 0;
+  virtual bool openArray() = 0;
+  virtual bool closeArray(size_t start, uint16_t members) = 0;
+  virtual bool writeKey(const char *key, bool first) = 0;
+  virtual bool writeElement(bool first) = 0;
+  virtual bool writeString(const char *value, size_t n) = 0;
+  virtual bool writeBool(bool value) = 0;
+  virtual bool writeInteger(long long value) = 0;
+  virtual bool writeUnsigned(unsigned long long value) = 0;
+  virtual bool writeFloat(float value) = 0;
+  virtual bool writeDouble(double value) = 0;
+};
+
+class JsonWriter : public PayloadSink {
+ public:
+  JsonWriter(char *buf, size_t cap) : PayloadSink((uint8_t *)buf, cap) { reset(); }
+  JsonWriter(uint8_t *buf, size_t cap) : PayloadSink(buf, cap) { reset(); }
+
+  const char *c_str() const { return (const char *)_buf; }
+
+ protected:
+  bool openObject() override { return put('{'); }
+  bool closeObject(size_t, uint16_t) override { return put('}'); }
+  bool openArray() override { return put('['); }
+  bool closeArray(size_t, uint16_t) override { return put(']'); }
+
+  bool writeKey(const char *key, bool first) override {
+    return (first || put(',')) && writeString(key, strlen(key)) && put(':');
+  }
+  bool writeElement(bool first) override { return first || put(','); }
+
+  bool writeString(const char *s, size_t n) override {
+    static const char kHex[] = "0123456789abcdef";
+    put('"');
+    for (size_t i = 0; _ok && i < n; i++) {
+      unsigned char c = (unsigned char)s[i];
+      switch (c) {
+        case '"': put("\\\"", 2); break;
+        case '\\': put("\\\\", 2); break;
+        case '\n': put("\\n", 2); break;
+        case '\r': put("\\r", 2); break;
+        case '\t': put("\\t", 2); break;
+        case '\b': put("\\b", 2); break;
+        case '\f': put("\\f", 2); break;
+        default:
+          if (c < 0x20) {
+            char u[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+            put(u, sizeof(u));
+          } else {
+            put(c);
+          }
+      }
+    }
+    return put('"');
+  }
+
+  bool writeBool(bool value) override { return value ? put("true", 4) : put("false", 5); }
+  bool writeInteger(long long value) override { return number(formatInteger(value, text(), room())); }
+  bool writeUnsigned(unsigned long long value) override {
+    return number(formatUnsigned(value, text(), room()));
+  }
+  bool writeFloat(float value) override { return number(formatDouble(value, text(), room(), kFloatDigits)); }
+  bool writeDouble(double value) override { return number(formatDouble(value, text(), room())); }
+
+ private:
+  char *text() { return (char *)_buf + _len; }
+
+  // takes in a number the format functions wrote at the end
+  bool number(size_t n) {
+    if (!_ok || n == 0) {
+      return fail();
+    }
+    _len += n;
+    terminate();
+    return true;
+  }
+};
+
+class MsgPackWriter : public PayloadSink {
+ public:
+  MsgPackWriter(uint8_t *buf, size_t cap) : PayloadSink(buf, cap) { reset(); }
+
+ protected:
+  // map16 / array16 until we know better
+  bool openObject() override {
+    const uint8_t header[3] = {0xDE, 0, 0};
+    return put(header, sizeof(header));
+  }
+  bool closeObject(size_t start, uint16_t members) override { return narrow(start, members, 0x80); }
+
+  bool openArray() override {
+    const uint8_t header[3] = {0xDC, 0, 0};
+    return put(header, sizeof(header));
+  }
+  bool closeArray(size_t start, uint16_t members) override { return narrow(start, members, 0x90); }
+
+  bool writeKey(const char *key, bool) override { return writeString(key, strlen(key)); }
+  bool writeElement(bool) override { return true; }
+
+  bool writeString(const char *s, size_t n) override {
+    uint8_t header[5];
+    size_t h;
+    if (n < 32) {
+      header[0] = (uint8_t)(0xA0 | n);
+      h = 1;
+    } else if (n <= 0xFF) {
+      header[0] = 0xD9;
+      header[1] = (uint8_t)n;
+      h = 2;
+    } else if (n <= 0xFFFF) {
+      header[0] = 0xDA;
+      h = 1 + be(header + 1, n, 2);
+    } else {
+      header[0] = 0xDB;
+      h = 1 + be(header + 1, n, 4);
+    }
+    return put(header, h) && put(s, n);
+  }
+
+  bool writeBool(bool value) override { return put(value ? 0xC3 : 0xC2); }
+
+  bool writeInteger(long long value) override {
+    if (value >= 0) {
+      return writeUnsigned((unsigned long long)value);
+    }
+    if (value >= -32) {
+      return put((uint8_t)(int8_t)value);
+    }
+    if (value >= INT8_MIN) {
+      return tagged(0xD0, (uint64_t)value, 1);
+    }
+    if (value >= INT16_MIN) {
+      return tagged(0xD1, (uint64_t)value, 2);
+    }
+    if (value >= INT32_MIN) {
+      return tagged(0xD2, (uint64_t)value, 4);
+    }
+    return tagged(0xD3, (uint64_t)value, 8);
+  }
+
+  bool writeUnsigned(unsigned long long value) override {
+    if (value <= 0x7F) {
+      return put((uint8_t)value);
+    }
+    if (value <= 0xFF) {
+      return tagged(0xCC, value, 1);
+    }
+    if (value <= 0xFFFF) {
+      return tagged(0xCD, value, 2);
+    }
+    if (value <= 0xFFFFFFFFULL) {
+      return tagged(0xCE, value, 4);
+    }
+    return tagged(0xCF, value, 8);
+  }
+
+  bool writeFloat(float value) override {
+    if (isnan(value) || isinf(value)) {
+      return put(0xC0);
+    }
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return tagged(0xCA, bits, 4);
+  }
+
+  bool writeDouble(double value) override {
+    if (isnan(value) || isinf(value)) {
+      return put(0xC0);
+    }
+    float narrow = (float)value;
+    if ((double)narrow == value) {
+      return writeFloat(narrow);
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return tagged(0xCB, bits, 8);
+  }
+
+ private:
+  // fills in the reserved 16-bit header, or shrinks it to the fix form
+  bool narrow(size_t start, uint16_t members, uint8_t fixTag) {
+    if (members <= 15) {
+      memmove(_buf + start + 1, _buf + start + 3, _len - start - 3);
+      _buf[start] = (uint8_t)(fixTag | members);
+      _len -= 2;
+      terminate();
+      return true;
+    }
+    _buf[start + 1] = (uint8_t)(members >> 8);
+    _buf[start + 2] = (uint8_t)members;
+    return true;
+  }
+
+  // big-endian, as MessagePack wants it
+  static size_t be(uint8_t *out, uint64_t v, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = (uint8_t)(v >> (8 * (n - 1 - i)));
+    }
+    return n;
+  }
+
+  bool tagged(uint8_t tag, uint64_t v, size_t n) {
+    uint8_t out[9];
+    out[0] = tag;
+    return put(out, 1 + be(out + 1, v, n));
+  }
+};
+
+}  // namespace payload
+}  // namespace hyphen
@@ -0,0 +1,55 @@
+// ping_pong.h — double-buffered sample storage for the devices.
+//
+// A device's samples used to live in one array that read() filled and
+// publish() serialized, and DeviceManager cleared after every publish. So a
+// read had to wait for a publish to finish (and a publish for a read), and a
+// sample taken between the serialization and the clear was wiped unsent.
+// Now there are two sides: read() fills the fresh one, and publish() swaps,
+// which freezes what the interval collected and hands reads the other side.
+//
+// The other side is what the previous swap froze, published by then, so it
+// is reset right before reads get it; nothing has to be cleared after a
+// publish. The active index is atomic so a read on another task sees either
+// side whole, never a half-flipped pair. T provides reset().
+//
+// Pure header, unit-tested on the host (see test_ping_pong).
+#pragma once
+
+#include <atomic>
+
+namespace hyphen {
+namespace sample {
+
+template <typename T>
+class PingPong {
+ public:
+  PingPong() { clear(); }
+
+  // The side read() fills.
+  T &fresh() { return _side[_active.load(std::memory_order_acquire)]; }
+
+  // What the last swap() froze, for publish() and print().
+  T &frozen() { return _side[_active.load(std::memory_order_acquire) ^ 1]; }
+  const T &frozen() const { return _side[_active.load(std::memory_order_acquire) ^ 1]; }
+
+  // Freezes the fresh side and returns it; reads carry on in the other one.
+  T &swap() {
+    unsigned active = _active.load(std::memory_order_relaxed);
+    _side[active ^ 1].reset();
+    _active.store(active ^ 1, std::memory_order_release);
+    return _side[active];
+  }
+
+  // Drops both sides, for when the interval itself changes.
+  void clear() {
+    _side[0].reset();
+    _side[1].reset();
+  }
+
+ private:
+  T _side[2];
+  std::atomic<unsigned> _active{0};
+};
+
+}  // namespace sample
+}  // namespace hyphen
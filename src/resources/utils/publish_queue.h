@@ -0,0 +1,240 @@
+// publish_queue.h — the bounded hand-off between the main loop and the
+// publisher task.
+//
+// DeviceManager::publisher() used to write the payload, publish it and, when
+// that failed, store it on the card, all on the main loop, while read() waited
+// on publishBusy for up to 10 s. Now the main loop only copies the finished
+// payload into a free slot of an Outbox and pushes the slot onto the ready
+// queue. The publisher task pops it, publishes it (retrying with backoff while
+// the connection is up), archives it, spills it to the offline store when it
+// could not be delivered, and hands the slot back through the free queue.
+//
+// Both queues are single-producer single-consumer rings of slot indexes on two
+// atomic counters, so neither side ever takes a lock or waits on the other.
+// With every slot in flight the main loop gets no slot and stores the payload
+// itself. Backoff and Metrics are clock-free like timing.h. Unit-tested on the
+// host (see test_publish_queue).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace hyphen {
+namespace outbound {
+
+// Bounded lock-free ring for one producer and one consumer. N is a power of
+// two so the free-running counters wrap cleanly.
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "the ring size must be a power of two");
+
+ public:
+  bool push(const T &item) {
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) == N) {
+      return false;
+    }
+    _items[head % N] = item;
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = _items[tail % N];
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+  bool empty() const { return size() == 0; }
+
+ private:
+  std::atomic<uint32_t> _head{0};
+  std::atomic<uint32_t> _tail{0};
+  T _items[N];
+};
+
+const size_t kTopicSize = 48;
+
+enum Kind : uint8_t {
+  KIND_PAYLOAD = 0,
+  KIND_ANNOUNCE,  // a schema announcement, see telemetry.h
+};
+
+// One payload on its way out. The buffer belongs to the slot and is reused.
+struct Outbound {
+  char topic[kTopicSize] = {0};
+  uint8_t *data = nullptr;
+  size_t capacity = 0;
+  size_t length = 0;        // bytes published
+  size_t storedOffset = 0;  // where the stored/archived form starts in data
+  size_t storedLength = 0;  // and its length
+  const char *storeTopic = nullptr;  // a static string: the topic it is archived and stored under
+  uint32_t enqueuedMs = 0;
+  uint32_t schema = 0;
+  Kind kind = KIND_PAYLOAD;
+  bool send = true;          // false while the radio is down: store right away
+  bool maintenance = false;  // maintenance payloads are never stored
+  bool packed = false;       // the stored form is MessagePack
+
+  // Fills the slot with what is published and, if it differs, what is stored.
+  bool fill(const char *to, const uint8_t *bytes, size_t n, const uint8_t *stored = nullptr, size_t storedN = 0) {
+    size_t topicLen = strlen(to);
+    if (topicLen >= kTopicSize || n + storedN > capacity) {
+      return false;
+    }
+    memcpy(topic, to, topicLen + 1);
+    memcpy(data, bytes, n);
+    length = n;
+    if (stored) {
+      memcpy(data + n, stored, storedN);
+      storedOffset = n;
+      storedLength = storedN;
+    } else {
+      storedOffset = 0;
+      storedLength = n;
+    }
+    return true;
+  }
+
+  const uint8_t *storedData() const { return data + storedOffset; }
+};
+
+// N slots and the two queues between the producer (main loop) and the
+// consumer (publisher task). Every index is always in exactly one of: the
+// free queue, the ready queue, or the hands of one side, so neither push can
+// fail.
+template <size_t N>
+class Outbox {
+ public:
+  Outbox() {
+    for (size_t i = 0; i < N; i++) {
+      _free.push((uint8_t)i);
+    }
+  }
+
+  void attach(size_t index, uint8_t *buffer, size_t capacity) {
+    _slots[index].data = buffer;
+    _slots[index].capacity = capacity;
+  }
+
+  // producer: a slot to fill, nullptr when all of them are in flight
+  Outbound *acquire() {
+    uint8_t index;
+    return _free.pop(index) ? &_slots[index] : nullptr;
+  }
+
+  // producer: hands a filled slot to the consumer
+  void submit(Outbound *slot, uint32_t now) {
+    slot->enqueuedMs = now;
+    _ready.push(indexOf(slot));
+  }
+
+  // producer: gives back a slot it acquired but did not submit
+  void cancel(Outbound *slot) { _free.push(indexOf(slot)); }
+
+  // consumer: the oldest submitted slot, nullptr when there is none
+  Outbound *next() {
+    uint8_t index;
+    return _ready.pop(index) ? &_slots[index] : nullptr;
+  }
+
+  // consumer: done with a slot
+  void release(Outbound *slot) { _free.push(indexOf(slot)); }
+
+  size_t depth() const { return _ready.size(); }
+  // every slot out of the free queue: being filled, waiting or being delivered
+  size_t pending() const { return N - _free.size(); }
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  Outbound _slots[N];
+  SpscRing<uint8_t, N> _free;
+  SpscRing<uint8_t, N> _ready;
+
+  uint8_t indexOf(const Outbound *slot) const { return (uint8_t)(slot - _slots); }
+};
+
+struct RetryPolicy {
+  uint8_t attempts = 3;  // publishes per payload, the first one included
+  uint32_t baseMs = 2000;
+  uint32_t maxMs = 30000;
+};
+
+// Wait before publish attempt number attempt + 1: base * 2^(attempt - 1),
+// capped at maxMs, plus up to a quarter of that from seed so devices that lost
+// the network together don't all come back in the same second.
+inline uint32_t backoffMs(const RetryPolicy &policy, uint8_t attempt, uint32_t seed = 0) {
+  uint32_t delay = policy.baseMs;
+  for (uint8_t i = 1; i < attempt && delay < policy.maxMs; i++) {
+    delay *= 2;
+  }
+  if (delay > policy.maxMs) {
+    delay = policy.maxMs;
+  }
+  return delay + seed % (delay / 4 + 1);
+}
+
+// Another attempt is only worth it while the link is up; otherwise the
+// payload goes to the store at once and comes back with the backlog.
+inline bool shouldRetry(const RetryPolicy &policy, uint8_t attemptsMade, bool connected) {
+  return connected && attemptsMade < policy.attempts;
+}
+
+// Counters for the cloud variables. Each one is written by one side only
+// (enqueued/overflowed by the producer, the rest by the consumer) and is a
+// 32-bit word, so reading it from the other side never tears. The latency
+// total only feeds meanLatencyMs, where a torn read skews a single report.
+class Metrics {
+ public:
+  void enqueued(size_t depth) {
+    _enqueued++;
+    if (depth > _highWater) {
+      _highWater = (uint32_t)depth;
+    }
+  }
+  void overflowed() { _overflowed++; }
+  void retried() { _retries++; }
+  void spilled() { _spilled++; }
+
+  void acked(uint32_t enqueuedMs, uint32_t now) {
+    uint32_t latency = now - enqueuedMs;  // rollover-safe
+    _delivered++;
+    _lastLatencyMs = latency;
+    if (latency > _maxLatencyMs) {
+      _maxLatencyMs = latency;
+    }
+    _totalLatencyMs += latency;
+  }
+
+  uint32_t enqueuedCount() const { return _enqueued; }
+  uint32_t deliveredCount() const { return _delivered; }
+  uint32_t spilledCount() const { return _spilled; }
+  uint32_t overflowedCount() const { return _overflowed; }
+  uint32_t retryCount() const { return _retries; }
+  uint32_t highWater() const { return _highWater; }
+  uint32_t lastLatencyMs() const { return _lastLatencyMs; }
+  uint32_t maxLatencyMs() const { return _maxLatencyMs; }
+  uint32_t meanLatencyMs() const { return _delivered ? (uint32_t)(_totalLatencyMs / _delivered) : 0; }
+
+ private:
+  uint32_t _enqueued = 0;
+  uint32_t _overflowed = 0;
+  uint32_t _highWater = 0;
+  uint32_t _delivered = 0;
+  uint32_t _retries = 0;
+  uint32_t _spilled = 0;
+  uint32_t _lastLatencyMs = 0;
+  uint32_t _maxLatencyMs = 0;
+  uint64_t _totalLatencyMs = 0;
+};
+
+}  // namespace outbound
+}  // namespace hyphen
@@ -0,0 +1,265 @@
+// record_codec.h — compact on-card encodings for offline records.
+//
+// Stored records used to be the full JSON from DeviceManager::payloadWriter,
+// so "device", "date", "__id" and "payload" were written out again in every
+// record. PayloadStore can now store them smaller (see store.h for the flags
+// that turn this on):
+//
+//   FLAG_MSGPACK  the payload is MessagePack, as Hyphen::compressPublish sends
+//                 it. With COMPRESSED_PUBLISH it is forwarded as-is at drain
+//                 time; addStaleToMap() marks it stale without decoding it.
+//   FLAG_LZ       the payload (JSON or MessagePack) is LZ-compressed against
+//                 the shared dictionary below, which already holds the keys
+//                 every record repeats:
+//
+//     [varint raw length] then tokens
+//     0x00..0x7F  literal run of (t + 1) bytes
+//     0x80..0xFF  match of (t & 0x7F) + 4 bytes, then u16 LE distance back
+//                 into (dictionary || output so far)
+//
+// Records on the card depend on the dictionary byte for byte: it may only ever
+// be appended to, never edited. Pure functions, unit-tested on the host (see
+// test_record_codec).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hyphen {
+namespace codec {
+
+const size_t kMinMatch = 4;
+const size_t kMaxMatch = 0x7F + kMinMatch;
+const size_t kMaxLiteralRun = 0x80;
+const size_t kMaxDistance = 0xFFFF;
+// entries of the scratch table compress() needs
+const size_t kTableSize = 1024;
+// what addStaleToMap() adds at most: a wider map header and "stale": true
+const size_t kStaleExtra = 9;
+
+// Keys and framing of a payloadWriter record, in JSON and MessagePack form.
+// Append-only, see above.
+static const char kDictionary[] =
+    "{\"device\":\"\",\"target\":,\"date\":\"\",\"__id\":\"\",\"payload\":{\"payload-1\":{"
+    "\"stale\":true,\"value\":\"temperature\":\"humidity\":\"pressure\":\"battery\":"
+    "\"soil_moisture\":\"wind_speed\":\"wind_direction\":\"precipitation\":}}"
+    "\xa6" "device" "\xa6" "target" "\xa4" "date" "\xa4" "__id" "\xa7" "payload"
+    "\xa9" "payload-1" "\xa5" "stale" "\xc3" "\xa5" "value" "\xcb" "\xca";
+const size_t kDictionarySize = sizeof(kDictionary) - 1;
+
+inline size_t putVarint(uint8_t *out, size_t cap, uint32_t v) {
+  size_t n = 0;
+  do {
+    if (n >= cap) {
+      return 0;
+    }
+    uint8_t byte = v & 0x7F;
+    v >>= 7;
+    out[n++] = byte | (v ? 0x80 : 0);
+  } while (v);
+  return n;
+}
+
+inline size_t getVarint(const uint8_t *in, size_t len, uint32_t &v) {
+  v = 0;
+  for (size_t n = 0; n < len && n < 5; n++) {
+    v |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+    if (!(in[n] & 0x80)) {
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+inline uint32_t hash4(const uint8_t *p) {
+  uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+  return (v * 2654435761u) >> 22;  // 10 bits: kTableSize
+}
+
+namespace detail {
+
+// (dictionary || input) addressed as one buffer
+struct Window {
+  const uint8_t *dict;
+  size_t dictLen;
+  const uint8_t *data;
+  uint8_t at(size_t pos) const { return pos < dictLen ? dict[pos] : data[pos - dictLen]; }
+};
+
+inline size_t emitLiterals(const uint8_t *from, size_t n, uint8_t *out, size_t o, size_t cap) {
+  while (n > 0) {
+    size_t run = n < kMaxLiteralRun ? n : kMaxLiteralRun;
+    if (o + 1 + run > cap) {
+      return 0;
+    }
+    out[o++] = (uint8_t)(run - 1);
+    memcpy(out + o, from, run);
+    o += run;
+    from += run;
+    n -= run;
+  }
+  return o;
+}
+
+}  // namespace detail
+
+// Compresses in[0..n) into out. Returns the compressed length, or 0 when it
+// would not fit in cap (callers pass cap = n and store the record raw then).
+// `table` is kTableSize entries of scratch.
+inline size_t compress(const uint8_t *in, size_t n, uint8_t *out, size_t cap, uint16_t *table,
+                       const uint8_t *dict = (const uint8_t *)kDictionary,
+                       size_t dictLen = kDictionarySize) {
+  if (dictLen + n >= 0xFFFF) {
+    return 0;
+  }
+  detail::Window window = {dict, dictLen, in};
+  memset(table, 0, kTableSize * sizeof(uint16_t));
+  for (size_t p = 0; p + kMinMatch <= dictLen; p++) {
+    table[hash4(dict + p)] = (uint16_t)(p + 1);
+  }
+
+  size_t o = putVarint(out, cap, (uint32_t)n);
+  if (o == 0) {
+    return 0;
+  }
+  size_t literals = 0;
+  size_t i = 0;
+  while (i < n) {
+    size_t best = 0;
+    size_t distance = 0;
+    size_t here = dictLen + i;
+    if (i + kMinMatch <= n) {
+      uint32_t h = hash4(in + i);
+      size_t candidate = table[h];
+      table[h] = (uint16_t)(here + 1);
+      if (candidate > 0) {
+        size_t from = candidate - 1;
+        size_t limit = n - i < kMaxMatch ? n - i : kMaxMatch;
+        size_t len = 0;
+        while (len < limit && window.at(from + len) == in[i + len]) {
+          len++;
+        }
+        if (len >= kMinMatch && here - from <= kMaxDistance) {
+          best = len;
+          distance = here - from;
+        }
+      }
+    }
+    if (best == 0) {
+      i++;
+      continue;
+    }
+    o = detail::emitLiterals(in + literals, i - literals, out, o, cap);
+    if (o == 0 || o + 3 > cap) {
+      return 0;
+    }
+    out[o++] = (uint8_t)(0x80 | (best - kMinMatch));
+    out[o++] = (uint8_t)distance;
+    out[o++] = (uint8_t)(distance >> 8);
+    for (size_t k = 1; k < best && i + k + kMinMatch <= n; k++) {
+      table[hash4(in + i + k)] = (uint16_t)(here + k + 1);
+    }
+    i += best;
+    literals = i;
+  }
+  o = detail::emitLiterals(in + literals, n - literals, out, o, cap);
+  return o;
+}
+
+// Raw length of a compressed record, 0 if the header is unreadable.
+inline uint32_t rawLength(const uint8_t *in, size_t n) {
+  uint32_t raw = 0;
+  return getVarint(in, n, raw) ? raw : 0;
+}
+
+// Decompresses into out (rawLength() bytes). Returns the raw length, or 0
+// on a malformed stream.
+inline size_t decompress(const uint8_t *in, size_t n, uint8_t *out, size_t cap,
+                         const uint8_t *dict = (const uint8_t *)kDictionary,
+                         size_t dictLen = kDictionarySize) {
+  uint32_t raw = 0;
+  size_t i = getVarint(in, n, raw);
+  if (i == 0 || raw > cap) {
+    return 0;
+  }
+  detail::Window window = {dict, dictLen, out};
+  size_t o = 0;
+  while (i < n) {
+    uint8_t token = in[i++];
+    if (token < 0x80) {
+      size_t run = (size_t)token + 1;
+      if (i + run > n || o + run > raw) {
+        return 0;
+      }
+      memcpy(out + o, in + i, run);
+      i += run;
+      o += run;
+      continue;
+    }
+    if (i + 2 > n) {
+      return 0;
+    }
+    size_t len = (token & 0x7F) + kMinMatch;
+    size_t distance = (size_t)in[i] | ((size_t)in[i + 1] << 8);
+    i += 2;
+    size_t here = dictLen + o;
+    if (distance == 0 || distance > here || o + len > raw) {
+      return 0;
+    }
+    // byte by byte: a match may overlap what it produces
+    for (size_t k = 0; k < len; k++) {
+      out[o + k] = window.at(here - distance + k);
+    }
+    o += len;
+  }
+  return o == raw ? raw : 0;
+}
+
+// Copies a MessagePack map with "stale": true added, without decoding it.
+// out needs len + kStaleExtra bytes. Returns the new length, 0 if `in` is not a map.
+inline size_t addStaleToMap(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+  if (len == 0) {
+    return 0;
+  }
+  uint32_t entries;
+  size_t header;
+  if ((in[0] & 0xF0) == 0x80) {
+    entries = in[0] & 0x0F;
+    header = 1;
+  } else if (in[0] == 0xDE && len >= 3) {
+    entries = ((uint32_t)in[1] << 8) | in[2];
+    header = 3;
+  } else if (in[0] == 0xDF && len >= 5) {
+    entries = ((uint32_t)in[1] << 24) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 8) | in[4];
+    header = 5;
+  } else {
+    return 0;
+  }
+  entries++;
+  static const uint8_t kStale[] = {0xA5, 's', 't', 'a', 'l', 'e', 0xC3};
+  size_t o = 0;
+  if (cap < len + kStaleExtra) {
+    return 0;
+  }
+  if (entries <= 0x0F) {
+    out[o++] = (uint8_t)(0x80 | entries);
+  } else if (entries <= 0xFFFF) {
+    out[o++] = 0xDE;
+    out[o++] = (uint8_t)(entries >> 8);
+    out[o++] = (uint8_t)entries;
+  } else {
+    out[o++] = 0xDF;
+    out[o++] = (uint8_t)(entries >> 24);
+    out[o++] = (uint8_t)(entries >> 16);
+    out[o++] = (uint8_t)(entries >> 8);
+    out[o++] = (uint8_t)entries;
+  }
+  memcpy(out + o, in + header, len - header);
+  o += len - header;
+  memcpy(out + o, kStale, sizeof(kStale));
+  return o + sizeof(kStale);
+}
+
+}  // namespace codec
+}  // namespace hyphen
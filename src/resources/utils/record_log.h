@@ -0,0 +1,166 @@
+// record_log.h — framing for the binary offline record log.
+//
+// The offline queue used to be a text file of `topic|payload\n` lines, read back
+// one byte at a time with '\n' as the only record boundary. A single torn write
+// during a brownout (a line without its newline) silently glued two records
+// together and every record after it was misparsed. Records are now framed:
+//
+//     offset  size  field
+//     0       2     magic   0x48 0x59 ("HY")
+//     2       1     flags   (FLAG_*)
+//     3       1     topicId (0 = inline topic, see FLAG_INLINE_TOPIC)
+//     4       4     length  payload bytes, little-endian
+//     8       4     crc32   over bytes 0..7 + payload, little-endian
+//     12      N     payload
+//
+// A reader jumps straight to the next record with `offset + frameSize(h)` and
+// never scans characters. A frame whose CRC does not match (torn write, bit rot)
+// is skipped by resyncing on the next magic. Pure functions over byte buffers,
+// so the framing is unit-tested on the host (see test_record_log).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hyphen {
+namespace records {
+
+const uint8_t kMagic0 = 0x48;  // 'H'
+const uint8_t kMagic1 = 0x59;  // 'Y'
+const size_t kHeaderSize = 12;
+// Anything bigger than this is a corrupt length field, not a real payload: the
+// largest thing we ever store is a single MQTT packet.
+const uint32_t kMaxPayload = 32768;
+
+// The payload starts with [len u8][topic bytes] instead of using topicId.
+const uint8_t FLAG_INLINE_TOPIC = 0x01;
+// The payload is a single-line JSON object without a "stale" key (see
+// canSpliceStale), so a replay marks it by splicing text in, not by parsing it.
+const uint8_t FLAG_STALE_SPLICE = 0x02;
+// The payload is MessagePack / LZ-compressed, see record_codec.h.
+const uint8_t FLAG_MSGPACK = 0x04;
+const uint8_t FLAG_LZ = 0x08;
+// Sent out of order by the newest-first backlog lane (see delivery_lanes.h).
+// Set in place on the card after the record was written, so the CRC doesn't
+// cover it; readers in order skip the record.
+const uint8_t FLAG_DELIVERED = 0x10;
+
+struct Header {
+  uint8_t flags = 0;
+  uint8_t topicId = 0;
+  uint32_t length = 0;
+  uint32_t crc = 0;
+};
+
+// Standard CRC-32 (IEEE 802.3, reflected 0xEDB88320). Nibble table: 64 bytes of
+// flash instead of 1 KB, still ~8x faster than the bitwise loop. Chain calls by
+// passing the previous result as `crc`.
+inline uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc = 0) {
+  static const uint32_t kTable[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++) {
+    crc = kTable[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = kTable[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+inline void putU32(uint8_t *out, uint32_t v) {
+  out[0] = (uint8_t)(v);
+  out[1] = (uint8_t)(v >> 8);
+  out[2] = (uint8_t)(v >> 16);
+  out[3] = (uint8_t)(v >> 24);
+}
+
+inline uint32_t getU32(const uint8_t *in) {
+  return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) |
+         ((uint32_t)in[3] << 24);
+}
+
+// Bytes a whole record occupies on the card.
+inline size_t frameSize(const Header &h) {
+  return kHeaderSize + h.length;
+}
+
+// Fill `out` (kHeaderSize bytes) for `payload`, computing the CRC. `h.crc` is
+// updated so callers can log/inspect it.
+inline void encodeHeader(Header &h, const uint8_t *payload, uint8_t *out) {
+  out[0] = kMagic0;
+  out[1] = kMagic1;
+  out[2] = h.flags;
+  out[3] = h.topicId;
+  putU32(out + 4, h.length);
+  h.crc = crc32(payload, h.length, crc32(out, 8));
+  putU32(out + 8, h.crc);
+}
+
+// Parse a header. False if the magic is wrong or the length is implausible — in
+// both cases the caller should resync rather than trust the length.
+inline bool decodeHeader(const uint8_t *in, Header &h) {
+  if (in[0] != kMagic0 || in[1] != kMagic1) {
+    return false;
+  }
+  h.flags = in[2];
+  h.topicId = in[3];
+  h.length = getU32(in + 4);
+  h.crc = getU32(in + 8);
+  return h.length <= kMaxPayload;
+}
+
+// True if `payload` (h.length bytes) matches the header CRC. `raw` is the
+// header exactly as read from the card.
+inline bool verify(const uint8_t *raw, const Header &h, const uint8_t *payload) {
+  uint8_t covered[8];
+  memcpy(covered, raw, sizeof(covered));
+  covered[2] &= ~FLAG_DELIVERED;
+  return crc32(payload, h.length, crc32(covered, 8)) == h.crc;
+}
+
+// Offset of the first candidate magic in buf[from..n), or -1. Used to resync
+// past a damaged frame; a false positive just fails its CRC and is skipped too.
+inline long findMagic(const uint8_t *buf, size_t n, size_t from = 0) {
+  for (size_t i = from; i + 1 < n; i++) {
+    if (buf[i] == kMagic0 && buf[i + 1] == kMagic1) {
+      return (long)i;
+    }
+  }
+  return -1;
+}
+
+// Replayed payloads go out with "stale": true. Parsing and re-serializing each
+// one cost most of a long drain's CPU and heap, so push() checks once whether
+// the text can simply be spliced: `{...}` on one line with no "stale" key
+// (any "stale" string at all sends it down the parsing path, to be safe).
+inline bool canSpliceStale(const char *json, size_t len) {
+  if (len < 2 || json[0] != '{' || json[len - 1] != '}') {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (json[i] == '\r' || json[i] == '\n') {
+      return false;
+    }
+    if (json[i] == '"' && len - i >= 7 && memcmp(json + i, "\"stale\"", 7) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Where `insert` goes to mark a spliceable payload stale: just before its
+// closing brace, with a leading comma unless the object is empty.
+inline size_t staleSplicePoint(const char *json, size_t len, const char *&insert) {
+  size_t i = 1;
+  while (i < len - 1 && (json[i] == ' ' || json[i] == '\t')) {
+    i++;
+  }
+  insert = i == len - 1 ? "\"stale\":true" : ",\"stale\":true";
+  return len - 1;
+}
+
+}  // namespace records
+}  // namespace hyphen
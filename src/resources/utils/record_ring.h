@@ -0,0 +1,157 @@
+// record_ring.h — fixed-capacity RAM ring of offline records.
+//
+// PayloadStore::push used to give up the moment the SD card was missing, and
+// the measurement was lost. The store is now tiered: records go to this ring
+// (in PSRAM where the board has it) whenever the card is absent or an append
+// fails, and are spilled to the card, oldest first, as soon as it is back. With
+// no card at all they are drained straight from the ring. A full ring drops its
+// oldest records, so a missing card degrades retention instead of dropping
+// everything.
+//
+// Each entry is a 4-byte little-endian length followed by the bytes (the
+// store keeps whole record_log.h frames here). An entry never wraps: one that
+// doesn't fit before the end of the buffer starts over at the front and the
+// rest of the buffer is skipped. The ring works on a caller-provided buffer,
+// so it is unit-tested on the host (see test_record_ring).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace hyphen {
+namespace ring {
+
+const size_t kEntryHeader = 4;
+
+// What was in the ring when the device rebooted on purpose, written to NVS
+// when there was no card to spill to.
+struct Summary {
+  uint32_t records = 0;
+  uint32_t bytes = 0;
+  uint32_t dropped = 0;
+};
+
+class RecordRing {
+ public:
+  RecordRing() = default;
+  RecordRing(uint8_t *buffer, size_t capacity) { attach(buffer, capacity); }
+
+  void attach(uint8_t *buffer, size_t capacity) {
+    _buf = buffer;
+    _cap = capacity;
+    clear();
+  }
+
+  bool attached() const { return _buf != nullptr; }
+  size_t capacity() const { return _cap; }
+  uint32_t count() const { return _count; }
+  bool empty() const { return _count == 0; }
+  // payload bytes held, excluding entry headers and skipped space
+  size_t bytes() const { return _bytes; }
+  // records evicted to make room since attach()
+  uint32_t dropped() const { return _dropped; }
+
+  void clear() {
+    _head = 0;
+    _tail = 0;
+    _end = 0;
+    _wrapped = false;
+    _count = 0;
+    _bytes = 0;
+    _dropped = 0;
+  }
+
+  // Appends a copy of data, evicting the oldest entries until it fits.
+  // False only when it could never fit.
+  bool push(const uint8_t *data, size_t len) {
+    size_t need = kEntryHeader + len;
+    if (!_buf || need > _cap) {
+      return false;
+    }
+    while (true) {
+      if (_count == 0) {
+        _head = _tail = _end = 0;
+        _wrapped = false;
+      }
+      if (!_wrapped && _cap - _tail >= need) {
+        break;
+      }
+      if (!_wrapped && _head >= need) {
+        _end = _tail;
+        _wrapped = true;
+        _tail = 0;
+        break;
+      }
+      if (_wrapped && _head - _tail >= need) {
+        break;
+      }
+      pop();
+      _dropped++;
+    }
+    putU32(_buf + _tail, (uint32_t)len);
+    memcpy(_buf + _tail + kEntryHeader, data, len);
+    _tail += need;
+    _count++;
+    _bytes += len;
+    return true;
+  }
+
+  // View of the oldest entry, valid until the next push or pop.
+  bool front(const uint8_t *&data, size_t &len) const {
+    if (_count == 0) {
+      return false;
+    }
+    len = getU32(_buf + _head);
+    data = _buf + _head + kEntryHeader;
+    return true;
+  }
+
+  void pop() {
+    if (_count == 0) {
+      return;
+    }
+    size_t len = getU32(_buf + _head);
+    _head += kEntryHeader + len;
+    _bytes -= len;
+    _count--;
+    if (_wrapped && _head == _end) {
+      _head = 0;
+      _wrapped = false;
+    }
+  }
+
+  Summary summary() const {
+    Summary s;
+    s.records = _count;
+    s.bytes = (uint32_t)_bytes;
+    s.dropped = _dropped;
+    return s;
+  }
+
+ private:
+  uint8_t *_buf = nullptr;
+  size_t _cap = 0;
+  size_t _head = 0;  // oldest entry
+  size_t _tail = 0;  // where the next entry goes
+  size_t _end = 0;   // end of the entries behind the head once wrapped
+  bool _wrapped = false;
+  uint32_t _count = 0;
+  size_t _bytes = 0;
+  uint32_t _dropped = 0;
+
+  static void putU32(uint8_t *out, uint32_t v) {
+    out[0] = (uint8_t)(v);
+    out[1] = (uint8_t)(v >> 8);
+    out[2] = (uint8_t)(v >> 16);
+    out[3] = (uint8_t)(v >> 24);
+  }
+
+  static uint32_t getU32(const uint8_t *in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) |
+           ((uint32_t)in[3] << 24);
+  }
+};
+
+}  // namespace ring
+}  // namespace hyphen
@@ -0,0 +1,319 @@
+// report_by_exception.h — publish a parameter only when it moved.
+//
+// Every publish interval used to carry every parameter of every device, also
+// the soil moisture or water level that hasn't changed in hours. With report
+// by exception turned on (the setReportByException cloud function), the
+// devices still write all their values, but through a Filter that passes a
+// number on only when
+//
+//   - it moved by more than the deadband of its key since it was last sent
+//     (a deadband of 0 passes any change), or
+//   - nothing was sent for it for the max silence of its key, or
+//   - the payload is a keyframe: every keyframeSeconds, and the first one
+//     after boot or a settings change, carries everything.
+//
+// A parameter is its key as the device writes it (valueMap / readParams,
+// e.g. "wl_1"); the rule for a key applies in every device slot, and the
+// rule "*" to every key without one. Strings, booleans and array elements
+// always pass. The envelope says "keyframe": true|false, so the cloud knows
+// a missing key means "unchanged". With placeholders (compact frames, whose
+// schema must not change from one interval to the next) an unchanged value
+// is written as null instead of being left out.
+//
+// Settings is a plain struct for Persist, and the commands of the cloud
+// function are parsed here. Pure functions, unit-tested on the host (see
+// test_report_by_exception).
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resources/utils/payload_writer.h"
+#include "resources/utils/record_log.h"
+
+namespace hyphen {
+namespace rbe {
+
+const uint8_t kSettingsVersion = 1;
+const size_t kKeySize = 20;
+const size_t kMaxRules = 16;
+const size_t kMaxTracked = 96;
+
+struct Rule {
+  char key[kKeySize] = {0};
+  float deadband = 0;
+  uint32_t maxSilence = 3600;  // seconds
+};
+
+struct Settings {
+  uint8_t version = kSettingsVersion;
+  bool enabled = false;
+  uint8_t count = 0;
+  uint32_t keyframeSeconds = 6 * 3600;
+  Rule fallback;  // "*"
+  Rule rules[kMaxRules];
+
+  const Rule &rule(const char *key) const {
+    for (uint8_t i = 0; i < count; i++) {
+      if (strncmp(rules[i].key, key, kKeySize) == 0) {
+        return rules[i];
+      }
+    }
+    return fallback;
+  }
+
+  bool set(const Rule &rule) {
+    if (strcmp(rule.key, "*") == 0) {
+      fallback = rule;
+      return true;
+    }
+    uint8_t i = 0;
+    while (i < count && strcmp(rules[i].key, rule.key) != 0) {
+      i++;
+    }
+    if (i == kMaxRules) {
+      return false;
+    }
+    rules[i] = rule;
+    count += i == count;
+    return true;
+  }
+
+  bool remove(const char *key) {
+    for (uint8_t i = 0; i < count; i++) {
+      if (strcmp(rules[i].key, key) == 0) {
+        rules[i] = rules[--count];
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// Applies one command of the cloud function:
+//
+//     on | off | clear             turn it on or off, forget every rule
+//     keyframe,SECONDS             how often everything is sent anyway
+//     KEY,DEADBAND[,MAX_SILENCE]   the rule of a key, "*" for the rest
+//     KEY,-                        drop the rule of a key
+//
+// False for anything else, leaving settings as they were.
+inline bool apply(Settings &settings, const char *command) {
+  if (strcmp(command, "on") == 0 || strcmp(command, "off") == 0) {
+    settings.enabled = command[1] == 'n';
+    return true;
+  }
+  if (strcmp(command, "clear") == 0) {
+    bool enabled = settings.enabled;
+    settings = Settings();
+    settings.enabled = enabled;
+    return true;
+  }
+  const char *comma = strchr(command, ',');
+  size_t keyLen = comma ? (size_t)(comma - command) : 0;
+  if (keyLen == 0 || keyLen >= kKeySize) {
+    return false;
+  }
+  const char *value = comma + 1;
+  char *end = nullptr;
+  if (keyLen == 8 && strncmp(command, "keyframe", 8) == 0) {
+    unsigned long seconds = strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || seconds == 0) {
+      return false;
+    }
+    settings.keyframeSeconds = (uint32_t)seconds;
+    return true;
+  }
+  Rule rule;
+  memcpy(rule.key, command, keyLen);
+  rule.key[keyLen] = '\0';
+  if (strcmp(value, "-") == 0) {
+    return settings.remove(rule.key);
+  }
+  rule.deadband = strtof(value, &end);
+  if (end == value || rule.deadband < 0 || isnan(rule.deadband)) {
+    return false;
+  }
+  rule.maxSilence = settings.fallback.maxSilence;
+  if (*end == ',') {
+    value = end + 1;
+    rule.maxSilence = (uint32_t)strtoul(value, &end, 10);
+    if (end == value) {
+      return false;
+    }
+  }
+  return *end == '\0' && settings.set(rule);
+}
+
+// The value and time each parameter was last sent, by the hash of its slot
+// and key. Full, it lets everything new through.
+class Tracker {
+ public:
+  Tracker() { clear(); }
+
+  void clear() {
+    for (size_t i = 0; i < kMaxTracked; i++) {
+      _entries[i].used = false;
+    }
+    _used = 0;
+  }
+
+  size_t tracked() const { return _used; }
+
+  // Whether this payload is a keyframe; starts over when it is.
+  bool keyframe(uint32_t now, uint32_t period) {
+    if (_lastKeyframe != 0 && now - _lastKeyframe < period) {
+      return false;
+    }
+    _lastKeyframe = now;
+    clear();
+    return true;
+  }
+
+  // after a settings change
+  void forceKeyframe() { _lastKeyframe = 0; }
+
+  // Whether value goes out now; remembers it when it does.
+  bool report(uint32_t id, double value, uint32_t now, const Rule &rule, bool keyframe) {
+    Entry *entry = find(id);
+    if (!entry) {
+      return true;
+    }
+    bool send = keyframe || !entry->used || now - entry->sentAt >= rule.maxSilence || moved(entry->last, value, rule);
+    if (send) {
+      entry->used = true;
+      entry->id = id;
+      entry->last = value;
+      entry->sentAt = now;
+    }
+    return send;
+  }
+
+ private:
+  struct Entry {
+    uint32_t id;
+    uint32_t sentAt;
+    double last;
+    bool used;
+  };
+  Entry _entries[kMaxTracked];
+  size_t _used = 0;
+  uint32_t _lastKeyframe = 0;
+
+  static bool moved(double last, double value, const Rule &rule) {
+    if (isnan(last) || isnan(value)) {
+      return isnan(last) != isnan(value);
+    }
+    return fabs(value - last) > rule.deadband;
+  }
+
+  // open addressing; the slot it takes if it isn't there yet
+  Entry *find(uint32_t id) {
+    for (size_t n = 0, i = id % kMaxTracked; n < kMaxTracked; n++, i = (i + 1) % kMaxTracked) {
+      Entry &entry = _entries[i];
+      if (entry.used && entry.id == id) {
+        return &entry;
+      }
+      if (!entry.used) {
+        if (_used == kMaxTracked) {
+          return nullptr;
+        }
+        _used++;
+        entry.id = id;
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
+};
+
+inline uint32_t hashKey(const char *key, uint32_t parent) {
+  return records::crc32((const uint8_t *)key, strlen(key), parent);
+}
+
+// Sits between a device and the payload writer. Its top-level object is the
+// one the caller already opened in out (a device slot, named by scope);
+// everything else is forwarded, minus the numbers the tracker holds back.
+class Filter : public payload::PayloadSink {
+ public:
+  Filter(payload::PayloadSink &out, Tracker &tracker, const Settings &settings, uint32_t now, bool keyframe,
+         const char *scope, bool placeholders = false)
+      : PayloadSink(_none, sizeof(_none)),
+        _out(out),
+        _tracker(tracker),
+        _settings(settings),
+        _now(now),
+        _keyframe(keyframe),
+        _placeholders(placeholders) {
+    reset();
+    beginObject();
+    _scopes[1] = hashKey(scope, 0);
+  }
+
+  size_t sent() const { return _sent; }
+  size_t held() const { return _held; }
+
+ protected:
+  bool openObject() override {
+    if (_depth == 1) {
+      return true;
+    }
+    // an object in an array shares the array's scope
+    _scopes[_depth] = _arrays[_depth - 1] ? _scopes[_depth - 1] : hashKey(_key, _scopes[_depth - 1]);
+    return forward(_out.beginObject(_key));
+  }
+  bool closeObject(size_t, uint16_t) override { return _depth == 1 || forward(_out.endObject()); }
+  bool openArray() override { return forward(_out.beginArray(_arrays[_depth - 1] ? nullptr : _key)); }
+  bool closeArray(size_t, uint16_t) override { return forward(_out.endArray()); }
+  bool writeKey(const char *key, bool) override {
+    _key = key;
+    return true;
+  }
+  bool writeElement(bool) override {
+    _key = nullptr;
+    return true;
+  }
+  bool writeString(const char *value, size_t n) override { return forward(_out.add(_key, value, n)); }
+  bool writeBool(bool value) override { return forward(_out.add(_key, value)); }
+  bool writeInteger(long long value) override { return report((double)value) ? forward(_out.add(_key, value)) : hold(); }
+  bool writeUnsigned(unsigned long long value) override {
+    return report((double)value) ? forward(_out.add(_key, value)) : hold();
+  }
+  bool writeFloat(float value) override { return report(value) ? forward(_out.add(_key, value)) : hold(); }
+  bool writeDouble(double value) override { return report(value) ? forward(_out.add(_key, value)) : hold(); }
+
+ private:
+  uint8_t _none[1];
+  payload::PayloadSink &_out;
+  Tracker &_tracker;
+  const Settings &_settings;
+  uint32_t _now;
+  bool _keyframe;
+  bool _placeholders;
+  const char *_key = nullptr;
+  uint32_t _scopes[kMaxDepth + 1];
+  size_t _sent = 0;
+  size_t _held = 0;
+
+  bool forward(bool written) { return written || fail(); }
+
+  bool report(double value) {
+    if (_arrays[_depth]) {
+      return true;
+    }
+    bool send = _tracker.report(hashKey(_key, _scopes[_depth]), value, _now, _settings.rule(_key), _keyframe);
+    _sent += send;
+    return send;
+  }
+
+  bool hold() {
+    _held++;
+    return !_placeholders || forward(_out.add(_key, (double)NAN));
+  }
+};
+
+}  // namespace rbe
+}  // namespace hyphen
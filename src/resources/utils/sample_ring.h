@@ -0,0 +1,165 @@
+// sample_ring.h — a fixed-capacity window of samples with running statistics.
+//
+// The devices kept each interval's readings in arrays sized
+// Constants::OVERFLOW_VAL, padded with NO_VALUE and kept sorted by shifting on
+// every insert (Utils::insertValue / shift), with a copy of that code for int,
+// long, uint32_t and float. Publish then walked the padding to find a median,
+// and a reading past the array's end was dropped rather than replacing the
+// oldest one.
+//
+// SampleRing<T, N> holds the last N samples. A push updates the count, the
+// mean and the variance (Welford, with the evicted sample taken back out once
+// the window is full) in O(1), and places the sample in a sorted copy of the
+// window — at most N moves, and N is small. Everything publish reads (count,
+// min, max, mean, variance, median, a quantile) is then O(1) and describes the
+// same window.
+//
+// Pure header, unit-tested on the host (see test_sample_ring).
+#pragma once
+
+#include <stddef.h>
+
+namespace hyphen {
+namespace agg {
+
+template <typename T, size_t N>
+class SampleRing {
+  static_assert(N > 0, "SampleRing needs room for one sample");
+
+ public:
+  SampleRing() { reset(); }
+
+  void reset() {
+    _head = 0;
+    _count = 0;
+    _mean = 0.0;
+    _m2 = 0.0;
+  }
+
+  // Adds a sample; once the window is full the oldest one makes room.
+  void push(T value) {
+    if (_count == N) {
+      T oldest = _ring[_head];
+      unsort(oldest);
+      forget(oldest);
+    }
+    _ring[_head] = value;
+    _head = (_head + 1) % N;
+    remember(value);
+    sort(value);
+  }
+
+  size_t count() const { return _count; }
+  bool empty() const { return _count == 0; }
+  bool full() const { return _count == N; }
+  static constexpr size_t capacity() { return N; }
+
+  // i = 0 is the newest.
+  T newest(size_t i) const { return _ring[(_head + N - 1 - i) % N]; }
+
+  // min() through quantile() return T() for an empty window.
+  T min() const { return _count ? _sorted[0] : T(); }
+  T max() const { return _count ? _sorted[_count - 1] : T(); }
+  double mean() const { return _mean; }
+  double sum() const { return _mean * _count; }
+
+  // Sample variance (n - 1); 0 below two samples.
+  double variance() const {
+    if (_count < 2) {
+      return 0.0;
+    }
+    double v = _m2 / (_count - 1);
+    return v > 0.0 ? v : 0.0;
+  }
+
+  // The middle sample, or halfway between the middle two.
+  T median() const {
+    if (_count == 0) {
+      return T();
+    }
+    T upper = _sorted[_count / 2];
+    if (_count & 1) {
+      return upper;
+    }
+    T lower = _sorted[_count / 2 - 1];
+    return lower + (upper - lower) / 2;
+  }
+
+  // Nearest-rank quantile, q in [0, 1].
+  T quantile(float q) const {
+    if (_count == 0) {
+      return T();
+    }
+    if (q <= 0.0f) {
+      return _sorted[0];
+    }
+    float exact = q * _count;
+    size_t rank = (size_t)exact;
+    if (rank < exact) {
+      rank++;
+    }
+    return _sorted[(rank > _count ? _count : rank) - 1];
+  }
+
+ private:
+  T _ring[N];
+  T _sorted[N];
+  size_t _head;
+  size_t _count;
+  double _mean;
+  double _m2;
+
+  void remember(T value) {
+    _count++;
+    double delta = (double)value - _mean;
+    _mean += delta / _count;
+    _m2 += delta * ((double)value - _mean);
+  }
+
+  void forget(T value) {
+    _count--;
+    if (_count == 0) {
+      _mean = 0.0;
+      _m2 = 0.0;
+      return;
+    }
+    double delta = (double)value - _mean;
+    _mean -= delta / _count;
+    _m2 -= delta * ((double)value - _mean);
+  }
+
+  // first slot of _sorted[0, n) not less than value
+  size_t lowerBound(T value, size_t n) const {
+    size_t lo = 0;
+    while (lo < n) {
+      size_t mid = lo + (n - lo) / 2;
+      if (_sorted[mid] < value) {
+        lo = mid + 1;
+      } else {
+        n = mid;
+      }
+    }
+    return lo;
+  }
+
+  // runs after remember(), so _count already includes value
+  void sort(T value) {
+    size_t last = _count - 1;
+    size_t at = lowerBound(value, last);
+    for (size_t i = last; i > at; i--) {
+      _sorted[i] = _sorted[i - 1];
+    }
+    _sorted[at] = value;
+  }
+
+  // runs before forget(), while _count still includes value
+  void unsort(T value) {
+    size_t at = lowerBound(value, _count);
+    for (size_t i = at; i + 1 < _count; i++) {
+      _sorted[i] = _sorted[i + 1];
+    }
+  }
+};
+
+}  // namespace agg
+}  // namespace hyphen
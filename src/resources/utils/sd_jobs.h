@@ -0,0 +1,217 @@
+// sd_jobs.h — jobs for the asynchronous SD worker.
+//
+// Every Storage call used to run on the calling task and wait on the SPI mutex
+// with portMAX_DELAY, so one slow card write stalled the publisher and the main
+// loop until the watchdog liveness window ran out. SDCard now owns a worker task
+// pinned to core 1 and a bounded FreeRTOS queue of these jobs. Submitting never
+// blocks: a full queue is reported straight back to the caller.
+//
+// A job owns copies of its path and data. When it has run, its callback (if any)
+// sees the Result, then its Future (if any) takes the Result over — including
+// the bytes of a read — otherwise read bytes are freed once the callback
+// returns.
+//
+// execute() and finish() only touch SdFile, so the job logic runs on the host
+// against the file-backed SdFat shim (see test_sd_jobs).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+#include <SdFat.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+namespace hyphen {
+namespace sdjobs {
+
+enum Op : uint8_t {
+  OP_APPEND = 0,
+  OP_READ,
+  OP_OVERWRITE,
+  OP_COMMIT,  // flush the SDWriter's buffers, see system/sd-writer.h
+  OP_REMOVE,
+};
+
+struct Result {
+  bool ok = false;
+  uint64_t size = 0;        // file size after a write
+  uint8_t *data = nullptr;  // bytes read, NUL-terminated
+  size_t length = 0;        // bytes read
+};
+
+typedef void (*Callback)(const Result &result, void *context);
+
+// Completion handle for a submitted job. Owns the bytes of a read result.
+// Must outlive the job it was submitted with.
+class Future {
+ public:
+  Future() = default;
+  ~Future() { delete[] _result.data; }
+
+  bool ready() const { return _done.load(std::memory_order_acquire); }
+  const Result &result() const { return _result; }
+
+  // Polls until the job has run or timeoutMs passes. Only for tasks that
+  // can afford to wait; the main loop should check ready() instead.
+  bool wait(uint32_t timeoutMs) {
+    for (uint32_t waited = 0; !ready(); waited++) {
+      if (waited >= timeoutMs) {
+        return false;
+      }
+      vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return true;
+  }
+
+  void complete(const Result &result) {
+    delete[] _result.data;
+    _result = result;
+    _done.store(true, std::memory_order_release);
+  }
+
+ private:
+  Result _result;
+  std::atomic<bool> _done{false};
+
+  Future(const Future &) = delete;
+  Future &operator=(const Future &) = delete;
+};
+
+struct Job {
+  Op op = OP_APPEND;
+  char *path = nullptr;     // owned
+  uint8_t *data = nullptr;  // owned, the bytes to write
+  size_t len = 0;           // bytes to write, or to read
+  uint64_t offset = 0;      // where to read from
+  uint64_t maxBytes = 0;    // append: start the file over once it would pass this
+  Callback callback = nullptr;
+  void *context = nullptr;
+  Future *future = nullptr;
+};
+
+inline char *copyPath(const char *path) {
+  size_t n = strlen(path);
+  char *out = new char[n + 1];
+  memcpy(out, path, n + 1);
+  return out;
+}
+
+// Builds a job holding its own copies of path and data.
+inline Job make(Op op, const char *path, const uint8_t *data = nullptr, size_t len = 0) {
+  Job job;
+  job.op = op;
+  job.path = path ? copyPath(path) : nullptr;
+  job.len = len;
+  if (data && len > 0) {
+    job.data = new uint8_t[len];
+    memcpy(job.data, data, len);
+  }
+  return job;
+}
+
+inline Result append(const Job &job) {
+  Result result;
+  SdFile file;
+  if (!file.open(job.path, O_RDWR | O_CREAT | O_AT_END)) {
+    return result;
+  }
+  if (job.maxBytes > 0 && file.fileSize() + job.len > job.maxBytes) {
+    // rotate: a log that outgrows its budget starts over
+    file.close();
+    if (!file.open(job.path, O_RDWR | O_CREAT | O_TRUNC)) {
+      return result;
+    }
+  }
+  result.ok = file.write(job.data, job.len) == job.len;
+  result.size = file.fileSize();
+  file.close();
+  return result;
+}
+
+inline Result read(const Job &job) {
+  Result result;
+  SdFile file;
+  if (!file.open(job.path, O_READ)) {
+    return result;
+  }
+  if (!file.seekSet(job.offset)) {
+    file.close();
+    return result;
+  }
+  result.data = new uint8_t[job.len + 1];
+  int n = file.read(result.data, job.len);
+  result.length = n > 0 ? (size_t)n : 0;
+  result.data[result.length] = '\0';
+  result.size = file.fileSize();
+  result.ok = n >= 0;
+  file.close();
+  return result;
+}
+
+inline Result overwrite(const Job &job) {
+  Result result;
+  SdFile file;
+  if (!file.open(job.path, O_WRONLY | O_CREAT | O_TRUNC)) {
+    return result;
+  }
+  result.ok = job.len == 0 || file.write(job.data, job.len) == job.len;
+  result.size = file.fileSize();
+  file.close();
+  return result;
+}
+
+inline Result remove(const Job &job) {
+  Result result;
+  SdFile file;
+  result.ok = file.open(job.path, O_RDWR) && file.remove();
+  return result;
+}
+
+// Runs a file job. The caller holds the SPI bus. OP_COMMIT is handled by
+// SDCard itself since it goes through the SDWriter.
+inline Result execute(const Job &job) {
+  switch (job.op) {
+    case OP_APPEND:
+      return append(job);
+    case OP_READ:
+      return read(job);
+    case OP_OVERWRITE:
+      return overwrite(job);
+    case OP_REMOVE:
+      return remove(job);
+    default:
+      return Result();
+  }
+}
+
+// Hands the result to the callback and future and frees what the job owns.
+inline void finish(Job &job, Result &result) {
+  if (job.callback) {
+    job.callback(result, job.context);
+  }
+  if (job.future) {
+    job.future->complete(result);
+  } else {
+    delete[] result.data;
+  }
+  result.data = nullptr;
+  delete[] job.path;
+  delete[] job.data;
+  job.path = nullptr;
+  job.data = nullptr;
+}
+
+// A job that was never queued (the queue was full).
+inline void discard(Job &job) {
+  delete[] job.path;
+  delete[] job.data;
+  job.path = nullptr;
+  job.data = nullptr;
+}
+
+}  // namespace sdjobs
+}  // namespace hyphen
@@ -132,26 +132,29 @@ void SDI12Device::runSingleSample()
  *
  * @return void
  */
-void SDI12Device::publish(JsonObject &writer, uint8_t attempt_count)
+void SDI12Device::publish(PayloadWriter &writer, uint8_t attempt_count)
 {
     runSingleSample();
+    // reads carry on in the other buffer while this one is written
+    SDISamples &frozen = getElements()->valueHold.swap();
     size_t MAX = readSize();
     String *valuemap = getElements()->getValueMap();
-    Utils::log("PUBLISHING_VALUES", "Param Count: " + String(getElements()->getTotalSize()));
+    char failure[20];
     for (size_t i = 0; i < getElements()->getTotalSize(); i++)
     {
         if (i == getElements()->nullValue())
         {
             continue;
         }
-        String param = valuemap[i];
+        const char *param = valuemap[i].c_str();
         // set the param as having failed
-        if (param.equals(NULL) || param.equals(" ") || param.equals(""))
+        if (param[0] == '\0' || strcmp(param, " ") == 0)
         {
             maintenanceTick++;
-            param = "_FAILURE_" + String(maintenanceTick);
+            snprintf(failure, sizeof(failure), "_FAILURE_%u", (unsigned)maintenanceTick);
+            param = failure;
         }
-        float paramValue = extractValue(getElements()->getMappedValue(i), i, MAX);
+        float paramValue = extractValue(frozen.values[i], i, MAX);
         if (isnan(paramValue))
         {
             paramValue = NO_VALUE;
@@ -161,7 +164,7 @@ void SDI12Device::publish(JsonObject &writer, uint8_t attempt_count)
         {
             maintenanceTick++;
         }
-        writer[param] = paramValue;
+        writer.add(param, paramValue);
     }
 }
 
@@ -356,13 +359,20 @@ void SDI12Device::loop()
  */
 void SDI12Device::clear()
 {
-    for (size_t i = 0; i < getElements()->getTotalSize(); i++)
-    {
-        for (size_t j = 0; j < boots->getMaxVal(); j++)
-        {
-            getElements()->setMappedValue(NO_VALUE, i, j);
-        }
-    }
+    getElements()->valueHold.clear();
+}
+
+/**
+ * @public
+ *
+ * published
+ *
+ * Nothing to drop: the swap in publish already gave reads an empty buffer
+ *
+ * @return void
+ */
+void SDI12Device::published()
+{
 }
 
 /**
@@ -433,7 +443,7 @@ String SDI12Device::replaceSerialResponseItem(String message)
 void SDI12Device::parseSerial(String ourReading)
 {
     readCompile = true;
-    utils.parseSerial(ourReading, getElements()->getTotalSize(), boots->getMaxVal(), getElements()->valueHold);
+    utils.parseSerial(ourReading, getElements()->getTotalSize(), boots->getMaxVal(), getElements()->valueHold.fresh().values);
     readCompile = false;
 }
 
@@ -8,6 +8,7 @@
 #include "resources/bootstrap/bootstrap.h"
 #include "resources/processors/LocalProcessor.h"
 #include "resources/utils/utils.h"
+#include "resources/utils/ping_pong.h"
 #include <stdint.h>
 
 #define SINGLE_SAMPLE true
@@ -86,6 +87,22 @@ enum
     impossible_index = 999
 };
 
+// one interval of readings per parameter, kept sorted for extractValue
+struct SDISamples
+{
+    float values[Constants::OVERFLOW_VAL][Constants::OVERFLOW_VAL];
+    void reset()
+    {
+        for (size_t i = 0; i < Constants::OVERFLOW_VAL; i++)
+        {
+            for (size_t j = 0; j < Constants::OVERFLOW_VAL; j++)
+            {
+                values[i][j] = NO_VALUE;
+            }
+        }
+    }
+};
+
 class SDIParamElements
 {
 private:
@@ -95,7 +112,8 @@ protected:
     Utils utils;
 
 public:
-    float valueHold[Constants::OVERFLOW_VAL][Constants::OVERFLOW_VAL];
+    // reads parse into the fresh side; publish swaps and writes the frozen one
+    hyphen::sample::PingPong<SDISamples> valueHold;
     virtual String getDeviceName()
     {
         return "SDIDevice";
@@ -118,15 +136,15 @@ public:
     }
     float *getMappedValue(uint8_t iteration)
     {
-        return valueHold[iteration];
+        return valueHold.fresh().values[iteration];
     }
     float getMappedValue(uint8_t iteration, uint8_t index)
     {
-        return valueHold[iteration][index];
+        return valueHold.fresh().values[iteration][index];
     }
     void setMappedValue(float value, uint8_t iteration, uint8_t index)
     {
-        valueHold[iteration][index] = value;
+        valueHold.fresh().values[iteration][index] = value;
     }
 
     virtual size_t nullValue()
@@ -188,6 +206,7 @@ public:
     void read();
     void loop();
     void clear();
+    void published();
     void print();
     void init();
     SDIParamElements *getElements();
@@ -198,7 +217,7 @@ public:
     size_t buffSize();
     void restoreDefaults();
     Bootstrap *getBoots();
-    void publish(JsonObject &writer, u_int8_t attempt_count);
+    void publish(PayloadWriter &writer, u_int8_t attempt_count);
     virtual float extractValue(float values[], size_t key);
     virtual float extractValue(float values[], size_t key, size_t max);
 };
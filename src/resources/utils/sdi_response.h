@@ -0,0 +1,151 @@
+// sdi_response.h — parse SDI-12 data responses without touching the heap.
+//
+// A D-command response is the sensor address followed by sign-delimited
+// values, e.g. "0+21.4-3.25+1013\r\n". Utils::parseSerial used to copy it
+// into a String, strip the address into another, build a String per value
+// character by character, check each one with invalidNumber/containsChar and
+// then call toFloat/toInt — dozens of heap Strings per response, on every
+// read of every SDI-12 sensor.
+//
+// ValueTokenizer skips everything up to the first sign (the address, and any
+// CR/LF a read left in the buffer ahead of it), walks the rest in place and
+// hands back each value as a pointer and a length into it, sign included
+// (string_view-style; the firmware's toolchain predates <string_view>). A
+// line ending after a value ends the response. parseNumber reads
+// [+|-]digits[.digits] into a float by itself, so there is no locale and no
+// strtof. parseValues puts both together into a caller-provided array.
+//
+// Two things differ from the String version: the first value keeps its sign
+// (the address strip used to swallow it, so "0-1.5" read as 1.5), and a
+// value with anything but digits and one '.' is rejected whole instead of
+// read up to the stray character.
+//
+// Pure functions, unit-tested and benchmarked on the host (see
+// test_sdi_response).
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace hyphen {
+namespace sdi {
+
+// A value inside the response buffer; not NUL-terminated.
+struct Token {
+  const char *data;
+  size_t length;
+};
+
+inline bool isDelimiter(char c) {
+  return c == '+' || c == '-' || c == '\r' || c == '\n' || c == '\0';
+}
+
+class ValueTokenizer {
+ public:
+  ValueTokenizer(const char *response, size_t length) : _p(response), _end(response + length) {
+    // the address, and any line noise a read left ahead of it, up to the
+    // first sign
+    while (_p < _end && *_p != '+' && *_p != '-') {
+      _p++;
+    }
+  }
+
+  // The next value with its sign; a sign with no digits after it is skipped.
+  bool next(Token &token) {
+    while (_p < _end) {
+      const char *start = _p;
+      if (*_p != '+' && *_p != '-') {
+        // '\r', '\n' or '\0' after a value ends the response
+        _end = _p;
+        return false;
+      }
+      _p++;
+      while (_p < _end && !isDelimiter(*_p)) {
+        _p++;
+      }
+      if (_p - start > 1) {
+        token.data = start;
+        token.length = (size_t)(_p - start);
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  const char *_p;
+  const char *_end;
+};
+
+// [+|-]digits[.digits]. Up to nine significant digits are kept (SDI-12 sends
+// at most seven); further integer digits only scale the value.
+inline bool parseNumber(const char *s, size_t n, float &out) {
+  size_t i = 0;
+  bool negative = false;
+  if (i < n && (s[i] == '+' || s[i] == '-')) {
+    negative = s[i] == '-';
+    i++;
+  }
+  uint32_t mantissa = 0;
+  int scale = 0;
+  size_t digits = 0;
+  bool dot = false;
+  for (; i < n; i++) {
+    char c = s[i];
+    if (c == '.' && !dot) {
+      dot = true;
+      continue;
+    }
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    digits++;
+    if (mantissa < 100000000u) {
+      mantissa = mantissa * 10 + (uint32_t)(c - '0');
+      if (dot) {
+        scale--;
+      }
+    } else if (!dot) {
+      scale++;
+    }
+  }
+  if (digits == 0) {
+    return false;
+  }
+  static const float kPow10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+  float value = (float)mantissa;
+  while (scale < -10) {
+    value /= kPow10[10];
+    scale += 10;
+  }
+  while (scale > 10) {
+    value *= kPow10[10];
+    scale -= 10;
+  }
+  value = scale < 0 ? value / kPow10[-scale] : value * kPow10[scale];
+  out = negative ? -value : value;
+  return true;
+}
+
+// Fills out[0, cap) in response order: the value, `missing` where the
+// response ran out, NAN where a value isn't a number. Returns how many values
+// the response held (it may be more than cap).
+inline size_t parseValues(const char *response, size_t length, float *out, size_t cap, float missing) {
+  ValueTokenizer tokens(response, length);
+  Token token;
+  size_t found = 0;
+  while (tokens.next(token)) {
+    if (found < cap && !parseNumber(token.data, token.length, out[found])) {
+      out[found] = NAN;
+    }
+    found++;
+  }
+  for (size_t i = found; i < cap; i++) {
+    out[i] = missing;
+  }
+  return found;
+}
+
+}  // namespace sdi
+}  // namespace hyphen
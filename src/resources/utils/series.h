@@ -0,0 +1,278 @@
+// series.h — low-power intervals batched into one delta-encoded upload.
+//
+// In low-power mode the publisher used to store every interval's payload on
+// the card and the drain sent them one by one once the radio was back: each
+// reconnection paid the TLS and MQTT handshake for N messages, each repeating
+// the device id, the date, every key and full-width numbers. With
+// -D LOW_POWER_SERIES the intervals are recorded as compact frames
+// (telemetry.h) and collected here instead, and the whole run goes out as one
+// message when the radio comes up:
+//
+//     {"device":…,"__id":…,"target":7,   written by DeviceManager; row i is target 7 + i
+//      "t0":1760688900,                   unix time of the first row
+//      "dt":[600,600,…],                  seconds since the row before, per later row
+//      "schema":{"payload":{"temperature":0,…}},   column of each key
+//      "scale":[1,…],                     decimals of each column
+//      "rows":[[214,…],[-3,…],…]}
+//
+// A cell is its value times 10^scale, as the JSON payload would have shown it
+// (so 21.4f is 214 at scale 1), and every cell but the first non-null one of
+// its column is the difference to the previous non-null one. Readings that
+// move slowly become one-byte integers. A missing value (NaN) is null.
+//
+// A series holds one schema: a row of another shape, one with a string or a
+// boolean, or a full series is refused, and the caller flushes the series
+// (or stores that one payload as it always did). Pure functions over
+// caller-owned buffers, unit-tested on the host (see test_series).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "resources/utils/payload_writer.h"
+#include "resources/utils/telemetry.h"
+
+namespace hyphen {
+namespace series {
+
+const size_t kMaxColumns = 64;
+const size_t kMaxRows = 96;
+const int64_t kNull = INT64_MIN;
+
+// Turns a number into mantissa and decimals by way of the text the JSON
+// writer prints for it, so a cell is exactly what the payload would say.
+// False for text in exponent form.
+inline bool scaled(const char *text, size_t n, int64_t &mantissa, int8_t &decimals) {
+  size_t i = 0;
+  bool negative = n > 0 && text[0] == '-';
+  i += negative;
+  int64_t v = 0;
+  decimals = 0;
+  bool fraction = false;
+  for (; i < n; i++) {
+    char c = text[i];
+    if (c == '.' && !fraction) {
+      fraction = true;
+    } else if (c >= '0' && c <= '9') {
+      v = v * 10 + (c - '0');
+      decimals += fraction;
+    } else {
+      return false;
+    }
+  }
+  mantissa = negative ? -v : v;
+  return true;
+}
+
+inline int64_t pow10(int n) {
+  int64_t p = 1;
+  while (n-- > 0) {
+    p *= 10;
+  }
+  return p;
+}
+
+// The values of one frame, as cells. Keys are ignored: the schema id already
+// says the shape matches.
+class RowSink : public payload::PayloadSink {
+ public:
+  RowSink() : PayloadSink(_none, sizeof(_none)) { reset(); }
+
+  void start() {
+    reset();
+    _count = 0;
+    _batchable = true;
+  }
+
+  size_t count() const { return _count; }
+  bool batchable() const { return _batchable && ok(); }
+  int64_t cell(size_t i) const { return _cells[i]; }
+  int8_t decimals(size_t i) const { return _decimals[i]; }
+
+ protected:
+  bool openObject() override { return true; }
+  bool closeObject(size_t, uint16_t) override { return true; }
+  bool openArray() override { return fail(); }
+  bool closeArray(size_t, uint16_t) override { return fail(); }
+  bool writeKey(const char *, bool) override { return true; }
+  bool writeElement(bool) override { return true; }
+  bool writeString(const char *, size_t) override { return refuse(); }
+  bool writeBool(bool) override { return refuse(); }
+  bool writeInteger(long long value) override { return push(value, 0); }
+  bool writeUnsigned(unsigned long long value) override {
+    return value > (unsigned long long)INT64_MAX ? refuse() : push((int64_t)value, 0);
+  }
+  bool writeFloat(float value) override { return number(value, payload::kFloatDigits); }
+  bool writeDouble(double value) override { return number(value, 0); }
+
+ private:
+  uint8_t _none[1];
+  int64_t _cells[kMaxColumns];
+  int8_t _decimals[kMaxColumns];
+  size_t _count = 0;
+  bool _batchable = true;
+
+  bool refuse() {
+    _batchable = false;
+    return fail();
+  }
+
+  bool push(int64_t value, int8_t decimals) {
+    if (_count >= kMaxColumns) {
+      return refuse();
+    }
+    _cells[_count] = value;
+    _decimals[_count] = decimals;
+    _count++;
+    return true;
+  }
+
+  bool number(double value, int significant) {
+    if (isnan(value) || isinf(value)) {
+      return push(kNull, 0);
+    }
+    char text[32];
+    size_t n = payload::formatDouble(value, text, sizeof(text), significant);
+    int64_t mantissa;
+    int8_t decimals;
+    if (n == 0 || !scaled(text, n, mantissa, decimals)) {
+      return refuse();
+    }
+    return push(mantissa, decimals);
+  }
+};
+
+enum Result : uint8_t {
+  APPENDED = 0,
+  SHAPE_CHANGED,  // flush, then append to the empty series
+  FULL,           // flush, then append to the empty series
+  UNBATCHABLE,    // store this payload the usual way
+};
+
+class Series {
+ public:
+  // cells: room for rows x columns; dict: a copy of the frames' dictionary
+  Series(int64_t *cells, size_t cellCapacity, uint8_t *dict, size_t dictCapacity)
+      : _cells(cells), _cellCap(cellCapacity), _dict(dict), _dictCap(dictCapacity) {}
+
+  void clear() {
+    _rows = 0;
+    _columns = 0;
+    _dictLen = 0;
+    _schema = 0;
+  }
+
+  size_t rows() const { return _rows; }
+  size_t columns() const { return _columns; }
+  bool empty() const { return _rows == 0; }
+  uint32_t schema() const { return _schema; }
+
+  Result append(const telemetry::Frame &frame, const uint8_t *dict, size_t dictLen, uint32_t schema) {
+    if (_rows > 0 && schema != _schema) {
+      return SHAPE_CHANGED;
+    }
+    _row.start();
+    _row.beginObject();
+    telemetry::expand(frame, dict, dictLen, _row);
+    _row.endObject();
+    size_t n = _row.count();
+    if (!_row.batchable() || n == 0 || dictLen > _dictCap || n > _cellCap) {
+      return UNBATCHABLE;
+    }
+    if (_rows == 0) {
+      memcpy(_dict, dict, dictLen);
+      _dictLen = dictLen;
+      _schema = schema;
+      _columns = n;
+      memset(_scale, 0, sizeof(_scale));
+    } else if (_rows >= capacity()) {
+      return FULL;
+    }
+    int64_t *row = _cells + _rows * _columns;
+    for (size_t c = 0; c < _columns; c++) {
+      int64_t v = _row.cell(c);
+      int8_t d = _row.decimals(c);
+      if (v != kNull && d > _scale[c]) {
+        rescale(c, d);
+      }
+      row[c] = v == kNull ? kNull : v * pow10(_scale[c] - d);
+    }
+    _times[_rows++] = frame.timestamp;
+    return APPENDED;
+  }
+
+  // Writes the series as members of an object the caller opened.
+  bool write(payload::PayloadSink &out) const {
+    if (_rows == 0) {
+      return false;
+    }
+    out.add("t0", (unsigned long)_times[0]);
+    out.beginArray("dt");
+    for (size_t r = 1; r < _rows; r++) {
+      out.item((unsigned long)(_times[r] - _times[r - 1]));
+    }
+    out.endArray();
+    out.beginObject("schema");
+    telemetry::describe(_dict, _dictLen, out);
+    out.endObject();
+    out.beginArray("scale");
+    for (size_t c = 0; c < _columns; c++) {
+      out.item((int)_scale[c]);
+    }
+    out.endArray();
+    int64_t last[kMaxColumns];
+    for (size_t c = 0; c < _columns; c++) {
+      last[c] = kNull;
+    }
+    out.beginArray("rows");
+    for (size_t r = 0; r < _rows; r++) {
+      const int64_t *row = _cells + r * _columns;
+      out.beginArray();
+      for (size_t c = 0; c < _columns; c++) {
+        if (row[c] == kNull) {
+          out.item((double)NAN);
+          continue;
+        }
+        out.item((long long)(last[c] == kNull ? row[c] : row[c] - last[c]));
+        last[c] = row[c];
+      }
+      out.endArray();
+    }
+    out.endArray();
+    return out.ok();
+  }
+
+ private:
+  int64_t *_cells;
+  size_t _cellCap;
+  uint8_t *_dict;
+  size_t _dictCap;
+  size_t _dictLen = 0;
+  size_t _rows = 0;
+  size_t _columns = 0;
+  uint32_t _schema = 0;
+  int8_t _scale[kMaxColumns];
+  uint32_t _times[kMaxRows];
+  RowSink _row;
+
+  size_t capacity() const {
+    size_t rows = _columns ? _cellCap / _columns : 0;
+    return rows < kMaxRows ? rows : kMaxRows;
+  }
+
+  // a value with more decimals than the column had so far
+  void rescale(size_t column, int8_t decimals) {
+    int64_t factor = pow10(decimals - _scale[column]);
+    for (size_t r = 0; r < _rows; r++) {
+      int64_t &cell = _cells[r * _columns + column];
+      if (cell != kNull) {
+        cell *= factor;
+      }
+    }
+    _scale[column] = decimals;
+  }
+};
+
+}  // namespace series
+}  // namespace hyphen
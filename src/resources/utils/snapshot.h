@@ -0,0 +1,62 @@
+// snapshot.h — versioned, CRC-checked single-blob snapshots of a POD struct.
+//
+// Bootstrap used to rebuild the device registry at boot from one NVS get per
+// slot: the meta struct, a DeviceStruct per registered device and a
+// DeviceConfig per slot. It now reads the whole registry as one blob
+//
+//     [u32 magic "SNAP"][u16 version][u16 length][u32 crc32 of body][body]
+//
+// and only falls back to the per-slot keys (and writes a fresh snapshot) when
+// the blob is missing, damaged, from another layout version or of another
+// size, e.g. after MAX_DEVICES changed. Pure functions, unit-tested on the host
+// (see test_snapshot).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "resources/utils/record_log.h"
+
+namespace hyphen {
+namespace snapshot {
+
+const uint32_t kMagic = 0x50414E53;  // "SNAP"
+
+// plain data: snapshots are memcpy'd to and from NVS
+struct Header {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t length;
+  uint32_t crc;
+};
+
+template <typename T>
+struct Sealed {
+  Header header;
+  T body;
+};
+
+template <typename T>
+uint32_t bodyCrc(const Sealed<T> &s) {
+  return records::crc32((const uint8_t *)&s.body, sizeof(T));
+}
+
+// Stamps the header for the current body.
+template <typename T>
+void seal(Sealed<T> &s, uint16_t version) {
+  static_assert(sizeof(T) <= 0xFFFF, "a snapshot body must fit the length field");
+  s.header.magic = kMagic;
+  s.header.version = version;
+  s.header.length = (uint16_t)sizeof(T);
+  s.header.crc = bodyCrc(s);
+}
+
+// True when the body was sealed with this version and layout and is intact.
+template <typename T>
+bool valid(const Sealed<T> &s, uint16_t version) {
+  return s.header.magic == kMagic && s.header.version == version && s.header.length == sizeof(T) &&
+         s.header.crc == bodyCrc(s);
+}
+
+}  // namespace snapshot
+}  // namespace hyphen
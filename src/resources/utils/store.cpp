@@ -1,167 +1,841 @@
 #include "store.h"
+#include "resources/utils/timing.h"
+#ifdef BOARD_HAS_PSRAM
+#include <esp_heap_caps.h>
+#endif
+
+PayloadStore *PayloadStore::shutdownOwner = nullptr;
+
+namespace
+{
+// Holds the store's recursive mutex for a scope
+class StoreLock
+{
+public:
+    explicit StoreLock(SemaphoreHandle_t mutex) : mutex(mutex)
+    {
+        xSemaphoreTakeRecursive(mutex, portMAX_DELAY);
+    }
+    ~StoreLock()
+    {
+        xSemaphoreGiveRecursive(mutex);
+    }
+
+private:
+    SemaphoreHandle_t mutex;
+};
+}
 
 PayloadStore::PayloadStore()
 {
     logMutex = xSemaphoreCreateMutex();
+    superblockMutex = xSemaphoreCreateMutex();
+    storeMutex = xSemaphoreCreateRecursiveMutex();
 }
 
-bool PayloadStore::push(String topic, String payload)
+String PayloadStore::segmentFile(uint32_t segment)
 {
-    if (!Storage.sdCardPresent())
+    char name[16];
+    hyphen::segments::name(segment, name, sizeof(name));
+    return String(name);
+}
+
+/**
+ * Loads the superblock (rebuilding it if it is damaged), adopts records
+ * appended after its last commit, queues leftover consumed segments for
+ * deletion and migrates the older single-file stores. Safe to call
+ * again; push/pop call it lazily when the card shows up after boot.
+ */
+void PayloadStore::init()
+{
+    StoreLock lock(storeMutex);
+#ifdef OFFLINE_RING_NVS_SUMMARY
+    reportRingSummary();
+#endif
+    if (superblockLoaded || !Storage.sdCardPresent())
     {
-        return false;
+        return;
     }
-    uint64_t addPosition = Storage.appendln(storeFile, sanitize(topic + "|" + payload));
-    return addPosition > 0;
+    superblockLoaded = true;
+    Storage.writer().onCommit(&PayloadStore::onStorageCommit, this);
+
+    using namespace hyphen::superblock;
+    uint8_t raw[kFileSize];
+    size_t n = Storage.readBytes(superblockFile, 0, raw, kFileSize);
+    Superblock previous;
+    if (!loadSuperblock(raw, n))
+    {
+        // nothing to look for on a fresh card or one from before segments
+        if (n > 0 && !load(raw, n, previous, 1))
+        {
+            rebuildSuperblock();
+        }
+        else
+        {
+            commitSuperblock();
+        }
+    }
+    rollForward();
+
+    reclaimFrom = hyphen::segments::segmentOf(superblock.head, SEGMENT_SIZE);
+    while (reclaimFrom > 0 && Storage.exists(segmentFile(reclaimFrom - 1)))
+    {
+        reclaimFrom--;
+    }
+    reclaimSegments();
+
+    migrateRecordFile(raw, n);
+    migrateLegacyStore();
+    // after the card's own handler, so on a restart this one runs first and
+    // the card commits what it stored
+    registerShutdown();
+    Log.noticeln("Offline store: %d records, head=%l tail=%l", superblock.count, superblock.head, superblock.tail);
 }
 
-void PayloadStore::resetStorageFile()
+bool PayloadStore::loadSuperblock(const uint8_t *raw, size_t len)
 {
-    if (!Storage.sdCardPresent())
+    using namespace hyphen::superblock;
+    using namespace hyphen::segments;
+    if (!load(raw, len, superblock))
     {
-        return;
+        return false;
+    }
+    // the card was swapped or the queue deleted behind our back
+    uint32_t offset = offsetIn(superblock.tail, SEGMENT_SIZE);
+    if (offset > 0 && Storage.fileSize(segmentFile(segmentOf(superblock.tail, SEGMENT_SIZE))) < offset)
+    {
+        superblock = Superblock();
+        return false;
     }
-    setPopPosition(0);
-    Storage.overwrite(storeFile.c_str(), "");
+    backlogGauge = backlog();
+    return true;
 }
 
-String *PayloadStore::pop(uint8_t size)
+/**
+ * The superblock is damaged beyond both slots: find the first segment
+ * still on the card and let rollForward() recount from there.
+ */
+void PayloadStore::rebuildSuperblock()
 {
-    String *result = new String[size];
-    unsigned long position = getPopPosition();
+    using namespace hyphen::segments;
+    const uint32_t lastSegment = segmentOf(kRebaseAt, SEGMENT_SIZE) + OFFLINE_MAX_SEGMENTS;
+    uint32_t first = 0;
+    while (first <= lastSegment && !Storage.exists(segmentFile(first)))
+    {
+        first++;
+    }
+    if (first > lastSegment)
+    {
+        first = 0;
+    }
+    superblock.head = segmentStart(first, SEGMENT_SIZE);
+    superblock.tail = superblock.head;
+    superblock.count = 0;
+    commitSuperblock();
+    Log.errorln("Offline store superblock rebuilt from segment %l", first);
+}
 
-    Serial.println("Pop position: " + String(position));
-    for (uint8_t i = 0; i < size; i++)
+/**
+ * Adopts intact records appended after the last superblock commit, i.e.
+ * a brownout before the SD writer's next group commit, including
+ * segments started since.
+ */
+void PayloadStore::rollForward()
+{
+    using namespace hyphen::segments;
+    bool moved = false;
+    while (true)
     {
-        result[i] = "";
-        if (!Storage.sdCardPresent())
+        uint32_t segment = segmentOf(superblock.tail, SEGMENT_SIZE);
+        uint32_t start = segmentStart(segment, SEGMENT_SIZE);
+        uint64_t size = Storage.fileSize(segmentFile(segment));
+        if (size > superblock.tail - start)
         {
-            continue;
+            unsigned long position = superblock.tail;
+            uint32_t end = start + size;
+            StoredRecord record;
+            while (readRecord(position, end, record))
+            {
+                superblock.tail = position;
+                superblock.count++;
+                moved = true;
+            }
+            if (position < end)
+            {
+                // the card failed mid-scan, keep what we have
+                break;
+            }
+            moved = moved || superblock.tail != end;
+            superblock.tail = end;
         }
-
-        String value = Storage.read(storeFile, position, '\n');
-        // here we have an empty value, we can break the loop.
-        if (position == 0 && value.isEmpty())
+        if (!Storage.exists(segmentFile(segment + 1)))
         {
             break;
-            // we are at the end of file, we need to reset i
         }
-        else if (value.isEmpty())
+        superblock.tail = nextSegment(superblock.tail, SEGMENT_SIZE);
+        moved = true;
+    }
+    if (moved)
+    {
+        commitSuperblock();
+    }
+}
+
+/**
+ * Writes the superblock into the slot its generation owns. The other slot
+ * keeps the previous state, so a torn write here loses nothing.
+ */
+bool PayloadStore::commitSuperblock()
+{
+    using namespace hyphen::superblock;
+    superblock.generation++;
+    uint8_t raw[kSlotSize];
+    encode(superblock, raw);
+    backlogGauge = backlog();
+    return Storage.writeAt(superblockFile, slotOffset(superblock.generation), raw, kSlotSize);
+}
+
+/**
+ * The superblock follows the SD writer's group commits, so it never
+ * points past what is durable on the card. Records appended after the
+ * last commit are adopted by rollForward() at boot.
+ */
+void PayloadStore::onStorageCommit(void *context, const String &path, uint64_t durableSize)
+{
+    using namespace hyphen::segments;
+    PayloadStore *store = static_cast<PayloadStore *>(context);
+    // runs on the SD worker, push/pop may be mid-update
+    xSemaphoreTake(store->superblockMutex, portMAX_DELAY);
+    uint32_t tail = store->superblock.tail;
+    uint32_t last = segmentOf(tail > 0 ? tail - 1 : 0, SEGMENT_SIZE);
+    if (path == store->segmentFile(last) && durableSize >= tail - segmentStart(last, SEGMENT_SIZE))
+    {
+        store->commitSuperblock();
+    }
+    xSemaphoreGive(store->superblockMutex);
+}
+
+/**
+ * Moves the head past delivered (or unreadable) records. Nothing is
+ * rewritten: segments wholly behind the head are deleted by the SD
+ * worker.
+ */
+void PayloadStore::advance(uint32_t position, uint32_t records)
+{
+    xSemaphoreTake(superblockMutex, portMAX_DELAY);
+    superblock.head = min(position, superblock.tail);
+    superblock.count -= min(records, superblock.count);
+    if (superblock.head == superblock.tail)
+    {
+        superblock.count = 0;
+    }
+    if (superblock.count == 0 && superblock.tail >= hyphen::segments::kRebaseAt)
+    {
+        rebase();
+    }
+    else
+    {
+        commitSuperblock();
+    }
+    xSemaphoreGive(superblockMutex);
+    // the reader must be off a segment before it is deleted
+    if (!readerFile.equals(segmentFile(hyphen::segments::segmentOf(superblock.head, SEGMENT_SIZE))))
+    {
+        closeReader();
+    }
+    reclaimSegments();
+}
+
+void PayloadStore::reclaimSegments()
+{
+    uint32_t head = hyphen::segments::segmentOf(superblock.head, SEGMENT_SIZE);
+    while (reclaimFrom < head)
+    {
+        // queue full, the next advance picks it up
+        if (!Storage.removeAsync(segmentFile(reclaimFrom)))
         {
-            position = 0;
-            resetStorageFile();
             break;
         }
+        reclaimFrom++;
+    }
+}
 
-        result[i] = value;
+/**
+ * Starts positions over at 0 while the queue is empty, long before they
+ * could wrap. Called with the superblock mutex held.
+ */
+void PayloadStore::rebase()
+{
+    uint32_t last = hyphen::segments::segmentOf(superblock.tail, SEGMENT_SIZE);
+    closeReader();
+    for (uint32_t segment = reclaimFrom; segment <= last; segment++)
+    {
+        Storage.remove(segmentFile(segment));
     }
-    Serial.println("Pop result POSITION: " + String(position));
-    if (position > 0)
+    superblock.head = 0;
+    superblock.tail = 0;
+    superblock.count = 0;
+    reclaimFrom = 0;
+    commitSuperblock();
+    Log.noticeln("Offline store positions rebased");
+}
+
+/**
+ * Moves the records of the single-file store (offline.rec, before
+ * segments) into the queue, starting at its version 1 superblock's head.
+ */
+void PayloadStore::migrateRecordFile(const uint8_t *raw, size_t len)
+{
+    if (!Storage.exists(recordFile))
     {
-        setPopPosition(position);
+        return;
     }
 
-    return result;
+    uint64_t end = Storage.fileSize(recordFile);
+    hyphen::superblock::Superblock previous;
+    unsigned long position = 0;
+    if (hyphen::superblock::load(raw, len, previous, 1))
+    {
+        position = previous.head;
+    }
+    else
+    {
+        Persist.get(popKey, position);
+    }
+    if (position > end)
+    {
+        position = 0;
+    }
+
+    uint32_t moved = 0;
+    StoredRecord record;
+    while (readFrame(recordFile, position, end, record))
+    {
+        if (push(record.topic, record.payload))
+        {
+            moved++;
+        }
+    }
+    closeReader();
+    Storage.remove(recordFile);
+    Persist.put(popKey, (unsigned long)0);
+    Log.noticeln("Migrated %d offline records into segments", moved);
 }
 
-unsigned long PayloadStore::getPopPosition()
+void PayloadStore::migrateLegacyStore()
 {
-    if (!Storage.sdCardPresent())
+    if (!Storage.exists(legacyStoreFile))
     {
-        return 0;
+        return;
     }
 
     unsigned long position = 0;
-    Persist.get(popKey, position);
-    return position;
-    // String value = Storage.read(positionFile, position, '\n');
+    Persist.get(legacyPopKey, position);
+    uint32_t moved = 0;
+    const char *data;
+    size_t len;
+    while (seekReader(legacyStoreFile, position) && reader.nextLine(data, len))
+    {
+        position = reader.position();
+        // lines were written with println
+        if (len > 0 && data[len - 1] == '\r')
+        {
+            len--;
+        }
+        String line(data, len);
+        int split = line.indexOf("|");
+        if (split > 0 && push(line.substring(0, split), line.substring(split + 1)))
+        {
+            moved++;
+        }
+    }
+    closeReader();
+    Storage.remove(legacyStoreFile);
+    Persist.put(legacyPopKey, (unsigned long)0);
+    Log.noticeln("Migrated %d legacy offline records", moved);
+}
 
-    // if (value.isEmpty())
-    // {
-    //     setPopPosition(0);
-    //     return 0;
-    // }
-    // return value.toInt();
+uint8_t PayloadStore::topicId(const String &topic)
+{
+    for (uint8_t i = 0; i < TOPIC_COUNT; i++)
+    {
+        if (topic.equals(topics[i]))
+        {
+            return i + 1;
+        }
+    }
+    return 0;
 }
 
-bool PayloadStore::setPopPosition(unsigned long position)
+/**
+ * Stores a record: on the card when it is there (after spilling anything
+ * the RAM ring still holds, to keep the order), otherwise in the ring.
+ */
+bool PayloadStore::push(String topic, String payload)
 {
-    if (!Storage.sdCardPresent())
+    StoreLock lock(storeMutex);
+    uint32_t frameLen = 0;
+    uint8_t *frame = encodeFrame(topic, payload, frameLen);
+    return store(frame, frameLen);
+}
+
+/**
+ * Stores a payload that is already MessagePack, as the publisher writes it
+ * with COMPRESSED_PUBLISH. It is kept as it is and only turned into JSON if
+ * it ends up in a batch.
+ */
+bool PayloadStore::pushPacked(const String &topic, const uint8_t *payload, size_t length)
+{
+    StoreLock lock(storeMutex);
+    using namespace hyphen::records;
+    uint32_t frameLen = 0;
+    // addStaleToMap() checks the map itself and falls back when it can't
+    uint8_t *frame = encodeFrame(topic, payload, length, FLAG_MSGPACK | FLAG_STALE_SPLICE, frameLen);
+    return store(frame, frameLen);
+}
+
+// takes ownership of the frame
+bool PayloadStore::store(uint8_t *frame, uint32_t frameLen)
+{
+    if (!frame)
     {
         return false;
     }
 
-    Persist.put(popKey, position);
-    // String value = String(position) + "\n";
-    // Storage.overwrite(positionFile.c_str(), value.c_str());
-    return true;
+    bool stored = false;
+    if (Storage.sdCardPresent())
+    {
+        init();
+        stored = spillRing() && appendFrame(frame, frameLen);
+    }
+    if (!stored)
+    {
+        stored = ringPush(frame, frameLen);
+    }
+    delete[] frame;
+    return stored;
 }
 
-String PayloadStore::setStale(String payload)
+/**
+ * Builds the record_log.h frame for a record. Returns nullptr when it is
+ * too big to store.
+ */
+uint8_t *PayloadStore::encodeFrame(const String &topic, const String &payload, uint32_t &frameLen)
 {
+    using namespace hyphen::records;
+    uint8_t flags = 0;
+    if (canSpliceStale(payload.c_str(), payload.length()))
+    {
+        flags |= FLAG_STALE_SPLICE;
+    }
+
+    // compact encodings, see resources/utils/record_codec.h
+#ifdef OFFLINE_STORE_MSGPACK
     JsonDocument doc;
-    deserializeJson(doc, payload);
-    doc["stale"] = true;
-    String newPayload;
-    serializeJson(doc, newPayload);
-    return newPayload;
+    if (deserializeJson(doc, payload) == DeserializationError::Ok)
+    {
+        size_t n = measureMsgPack(doc);
+        uint8_t *packed = new uint8_t[n];
+        n = serializeMsgPack(doc, packed, n);
+        uint8_t *frame = encodeFrame(topic, packed, n, flags | FLAG_MSGPACK, frameLen);
+        delete[] packed;
+        return frame;
+    }
+#endif
+    return encodeFrame(topic, (const uint8_t *)payload.c_str(), payload.length(), flags, frameLen);
 }
 
-void PayloadStore::addBackOntoStore(uint8_t startIndex, String *result, uint8_t size)
+/**
+ * Frames a payload that is already in its stored encoding (flags says
+ * which), LZ-compressing it first with OFFLINE_STORE_LZ.
+ */
+uint8_t *PayloadStore::encodeFrame(const String &topic, const uint8_t *data, size_t dataLen, uint8_t flags, uint32_t &frameLen)
 {
+    using namespace hyphen::records;
+    uint8_t id = topicId(topic);
+    Header header;
+    header.flags = flags | (id == 0 ? FLAG_INLINE_TOPIC : 0);
+    uint8_t *compressed = nullptr;
+#ifdef OFFLINE_STORE_LZ
+    if (!lzTable)
+    {
+        lzTable = new uint16_t[hyphen::codec::kTableSize];
+    }
+    compressed = new uint8_t[dataLen];
+    size_t n = hyphen::codec::compress(data, dataLen, compressed, dataLen, lzTable);
+    // kept as it is when it doesn't get any smaller
+    if (n > 0)
+    {
+        data = compressed;
+        dataLen = n;
+        header.flags |= FLAG_LZ;
+    }
+#endif
 
-    for (uint8_t i = startIndex; i < size; i++)
+    size_t topicLen = id == 0 ? min((size_t)topic.length(), (size_t)UINT8_MAX) : 0;
+    size_t bodyLen = (id == 0 ? 1 + topicLen : 0) + dataLen;
+    uint8_t *frame = nullptr;
+    if (bodyLen <= kMaxPayload)
     {
-        if (result[i].isEmpty())
+        frame = new uint8_t[kHeaderSize + bodyLen];
+        uint8_t *body = frame + kHeaderSize;
+        size_t offset = 0;
+        if (id == 0)
         {
-            break;
+            body[offset++] = (uint8_t)topicLen;
+            memcpy(body + offset, topic.c_str(), topicLen);
+            offset += topicLen;
+        }
+        memcpy(body + offset, data, dataLen);
+    }
+    delete[] compressed;
+    if (!frame)
+    {
+        return nullptr;
+    }
+
+    header.topicId = id;
+    header.length = bodyLen;
+    encodeHeader(header, frame + kHeaderSize, frame);
+    frameLen = kHeaderSize + bodyLen;
+    return frame;
+}
+
+/**
+ * Appends a frame to the tail segment. False when the card failed or the
+ * queue is at OFFLINE_MAX_SEGMENTS.
+ */
+bool PayloadStore::appendFrame(const uint8_t *frame, uint32_t frameLen)
+{
+    using namespace hyphen::segments;
+    // counted before the append so a group commit it triggers persists it
+    xSemaphoreTake(superblockMutex, portMAX_DELAY);
+    uint32_t at = place(superblock.tail, frameLen, SEGMENT_SIZE);
+    if (at + frameLen < at || segmentsUsed(superblock.head, at + frameLen, SEGMENT_SIZE) > OFFLINE_MAX_SEGMENTS)
+    {
+        xSemaphoreGive(superblockMutex);
+        Log.errorln("Offline store full (%d records)", superblock.count);
+        return false;
+    }
+    uint32_t previousTail = superblock.tail;
+    superblock.tail = at + frameLen;
+    superblock.count++;
+    backlogGauge = backlog();
+    xSemaphoreGive(superblockMutex);
+
+    uint32_t segment = segmentOf(at, SEGMENT_SIZE);
+    // a busy card sends the record to the RAM ring instead of stalling the caller
+    uint64_t size = Storage.writer().append(segmentFile(segment), frame, frameLen, pdMS_TO_TICKS(SD_APPEND_WAIT_MS));
+
+    xSemaphoreTake(superblockMutex, portMAX_DELAY);
+    bool ok = size > 0;
+    if (ok)
+    {
+        superblock.tail = segmentStart(segment, SEGMENT_SIZE) + size;
+    }
+    else
+    {
+        superblock.tail = previousTail;
+        superblock.count--;
+        backlogGauge = backlog();
+    }
+    xSemaphoreGive(superblockMutex);
+    return ok;
+}
+
+/**
+ * Points the reader at offset in file, reopening it only when it was on
+ * another file. Buffered bytes are reused across records and calls.
+ */
+bool PayloadStore::seekReader(const String &file, unsigned long offset)
+{
+    if (reader.isOpen() && readerFile.equals(file))
+    {
+        return reader.seek(offset);
+    }
+    closeReader();
+    if (!reader.open(file.c_str(), offset))
+    {
+        return false;
+    }
+    readerFile = file;
+    return true;
+}
+
+void PayloadStore::closeReader()
+{
+    reader.close();
+    readerFile = "";
+}
+
+/**
+ * Moves offset to the next candidate frame magic in file after a damaged
+ * frame. Returns false (with offset at end) when there is none.
+ */
+bool PayloadStore::resync(const String &file, unsigned long &offset, uint64_t end)
+{
+    offset++;
+    while (offset < end)
+    {
+        size_t n = seekReader(file, offset) ? reader.fill() : 0;
+        if (n == 0)
+        {
+            return false;
         }
-        Log.errorln("Adding back onto store: %s", result[i].c_str());
-        uint32_t addPosition = Storage.appendln(storeFile, sanitize(result[i]));
-        if (addPosition == 0)
+        long found = hyphen::records::findMagic(reader.peek(), n);
+        if (found >= 0)
         {
-            break;
+            offset += found;
+            return true;
         }
+        // keep the last byte, it may be the first half of a magic
+        offset += n > 1 ? n - 1 : 1;
     }
+    offset = end;
+    return false;
 }
 
-uint32_t PayloadStore::countEntries()
+/**
+ * Reads the next intact frame of file at or after offset and advances
+ * offset past it, with start where it began. Damaged frames and frames the
+ * newest-first lane delivered are skipped. Returns false at end or on a
+ * short read (offset < end).
+ */
+bool PayloadStore::readFrame(const String &file, unsigned long &offset, uint64_t end, StoredRecord &out,
+                             unsigned long *start)
 {
-    // No SD, no entries
-    if (!Storage.sdCardPresent())
+    using namespace hyphen::records;
+    uint8_t raw[kHeaderSize];
+    while (offset + kHeaderSize <= end)
     {
-        return 0;
+        const uint8_t *view = seekReader(file, offset) ? reader.take(kHeaderSize) : nullptr;
+        if (!view)
+        {
+            return false;
+        }
+        // taking the body may move the buffer
+        memcpy(raw, view, kHeaderSize);
+
+        Header header;
+        if (decodeHeader(raw, header) && offset + frameSize(header) <= end)
+        {
+            // records that fit the reader's buffer are checked in place,
+            // bigger ones are copied out
+            uint8_t *copy = nullptr;
+            const uint8_t *body = reader.take(header.length);
+            if (!body && header.length > SDReader::capacity())
+            {
+                copy = new uint8_t[header.length];
+                body = reader.read(copy, header.length) == header.length ? copy : nullptr;
+            }
+            bool intact = body && verify(raw, header, body);
+            if (intact && (header.flags & FLAG_DELIVERED))
+            {
+                delete[] copy;
+                offset += frameSize(header);
+                continue;
+            }
+            if (intact && unpack(header, body, out))
+            {
+                delete[] copy;
+                if (start)
+                {
+                    *start = offset;
+                }
+                offset += frameSize(header);
+                return true;
+            }
+            delete[] copy;
+        }
+
+        Log.errorln("Skipping damaged offline record at %l in %s", offset, file.c_str());
+        if (!resync(file, offset, end))
+        {
+            // offset is at end unless the file ended early or the card failed
+            return false;
+        }
     }
-    unsigned long pos = getPopPosition();
-    uint32_t count = Storage.countLines(storeFile, pos);
-    return count;
+    // less than a header left: a torn tail, count it as consumed
+    offset = end;
+    return false;
+}
+
+/**
+ * Fills out from a verified frame body. False when an inline topic runs
+ * past the body.
+ */
+bool PayloadStore::unpack(const hyphen::records::Header &header, const uint8_t *body, StoredRecord &out)
+{
+    size_t topicEnd = 0;
+    if (header.flags & hyphen::records::FLAG_INLINE_TOPIC)
+    {
+        topicEnd = 1 + body[0];
+        if (topicEnd > header.length)
+        {
+            return false;
+        }
+    }
+    out.topic = header.topicId > 0 && header.topicId <= TOPIC_COUNT
+                    ? String(topics[header.topicId - 1])
+                    : String((const char *)body + 1, topicEnd > 0 ? topicEnd - 1 : 0);
+    const uint8_t *data = body + topicEnd;
+    size_t dataLen = header.length - topicEnd;
+    uint8_t *raw = nullptr;
+    if (header.flags & hyphen::records::FLAG_LZ)
+    {
+        uint32_t rawLen = hyphen::codec::rawLength(data, dataLen);
+        raw = rawLen > 0 && rawLen <= hyphen::records::kMaxPayload ? new uint8_t[rawLen] : nullptr;
+        if (!raw || hyphen::codec::decompress(data, dataLen, raw, rawLen) != rawLen)
+        {
+            delete[] raw;
+            return false;
+        }
+        data = raw;
+        dataLen = rawLen;
+    }
+    // MessagePack stays as it is: it may be forwarded without decoding
+    out.payload = String((const char *)data, dataLen);
+    out.flags = header.flags & ~hyphen::records::FLAG_LZ;
+    delete[] raw;
+    return true;
+}
+
+/**
+ * Reads the next intact record at or after the queue position and
+ * advances position past it (from is where it began), hopping to the
+ * next segment where one ends. Returns false at end or on a read error
+ * (position < end).
+ */
+bool PayloadStore::readRecord(unsigned long &position, uint32_t end, StoredRecord &out, unsigned long *from)
+{
+    using namespace hyphen::segments;
+    while (position < end)
+    {
+        uint32_t segment = segmentOf(position, SEGMENT_SIZE);
+        uint32_t start = segmentStart(segment, SEGMENT_SIZE);
+        String file = segmentFile(segment);
+        uint64_t segmentEnd = min((uint64_t)SEGMENT_SIZE, (uint64_t)end - start);
+        unsigned long offset = position - start;
+        unsigned long at = 0;
+        bool found = readFrame(file, offset, segmentEnd, out, &at);
+        position = start + offset;
+        if (found)
+        {
+            if (from)
+            {
+                *from = start + at;
+            }
+            return true;
+        }
+        if (offset >= segmentEnd)
+        {
+            continue;
+        }
+        // the segment file stops short: a record that didn't fit started
+        // the next one. Anything else is the card failing.
+        if (!Storage.sdCardPresent() || Storage.fileSize(file) >= offset + hyphen::records::kHeaderSize)
+        {
+            return false;
+        }
+        position = nextSegment(position, SEGMENT_SIZE);
+    }
+    return false;
+}
+
+/**
+ * Reads up to size records from the head without consuming them. next[i]
+ * is the position just past record i; reached is where reading stopped.
+ */
+uint8_t PayloadStore::peek(uint8_t size, StoredRecord *out, unsigned long *next, unsigned long &reached)
+{
+    unsigned long position = superblock.head;
+    uint8_t found = 0;
+    while (found < size && readRecord(position, superblock.tail, out[found]))
+    {
+        next[found] = position;
+        found++;
+    }
+    reached = position;
+    return found;
+}
+
+/**
+ * The payload as it goes out on replay, marked "stale": true. Records
+ * flagged at push time get the key spliced in; only older records and
+ * payloads that aren't plain objects are parsed.
+ */
+String PayloadStore::replayPayload(const StoredRecord &record)
+{
+    if (record.flags & hyphen::records::FLAG_MSGPACK)
+    {
+        JsonDocument doc;
+        deserializeMsgPack(doc, record.payload.c_str(), record.payload.length());
+        doc["stale"] = true;
+        String out;
+        serializeJson(doc, out);
+        return out;
+    }
+    if (!(record.flags & hyphen::records::FLAG_STALE_SPLICE))
+    {
+        return sanitize(setStale(record.payload));
+    }
+    const char *insert;
+    const char *json = record.payload.c_str();
+    size_t len = record.payload.length();
+    size_t at = hyphen::records::staleSplicePoint(json, len, insert);
+    String out;
+    out.reserve(len + strlen(insert));
+    out.concat(json, at);
+    out += insert;
+    out.concat(json + at, len - at);
+    return out;
 }
 
-void PayloadStore::spawnFlushTask()
+/**
+ * Turns a MessagePack record back into JSON text, for the batch envelope.
+ */
+void PayloadStore::toJson(StoredRecord &record)
 {
-    // If a flush task is already running, do nothing
-    if (flushTaskHandle != nullptr)
+    if (!(record.flags & hyphen::records::FLAG_MSGPACK))
+    {
         return;
+    }
+    JsonDocument doc;
+    deserializeMsgPack(doc, record.payload.c_str(), record.payload.length());
+    record.payload = "";
+    serializeJson(doc, record.payload);
+    record.flags &= ~hyphen::records::FLAG_MSGPACK;
+}
 
-    xTaskCreatePinnedToCore(
-        PayloadStore::flushTask,
-        "LogFlush",
-        4096,
-        this,
-        tskIDLE_PRIORITY + 1,
-        &flushTaskHandle,
-        1 // run on core 1
-    );
+String PayloadStore::setStale(String payload)
+{
+    JsonDocument doc;
+    deserializeJson(doc, payload);
+    doc["stale"] = true;
+    String newPayload;
+    serializeJson(doc, newPayload);
+    return newPayload;
 }
 
-void PayloadStore::flushTask(void *param)
+/**
+ * Backlog size from the superblock and the RAM ring, no card access.
+ */
+uint32_t PayloadStore::countEntries()
 {
-    PayloadStore *store = static_cast<PayloadStore *>(param);
-    store->flushToFile();
-    store->flushTaskHandle = nullptr; // signal it's done
-    vTaskDelete(nullptr);
+    StoreLock lock(storeMutex);
+    // No SD, only what the RAM ring holds
+    if (!Storage.sdCardPresent())
+    {
+        return ring.count();
+    }
+    init();
+    return backlog();
 }
 
+/**
+ * Hands the buffered log lines to the SD worker as one append. The
+ * worker starts the file over once it would pass MAX_LOG_SIZE.
+ */
 void PayloadStore::flushToFile()
 {
     if (!Storage.sdCardPresent())
@@ -177,20 +851,16 @@ void PayloadStore::flushToFile()
     if (localCopy.empty())
         return;
 
-    // Check if file is too large → rotate
-    uint64_t size = Storage.fileSize(logFile);
-    if (size > MAX_LOG_SIZE)
+    String lines;
+    for (auto &line : localCopy)
     {
-        Storage.overwrite(logFile.c_str(), ""); // truncate
+        lines += line;
+        lines += "\r\n";
     }
-
-    // Write all buffered lines to SD
-    for (auto &line : localCopy)
+    if (!Storage.appendAsync(logFile, (const uint8_t *)lines.c_str(), lines.length(), MAX_LOG_SIZE))
     {
-        Storage.appendln(logFile, line);
+        Serial.printf("Log flush dropped, SD queue full: %d lines.\n", (int)localCopy.size());
     }
-
-    Serial.printf("Log flush complete: %d lines written.\n", (int)localCopy.size());
 }
 
 uint32_t PayloadStore::log(String message)
@@ -212,66 +882,678 @@ uint32_t PayloadStore::log(String message)
     // Trigger async flush when buffer grows
     if (current >= MAX_PAYLOADS)
     {
-        spawnFlushTask();
+        flushToFile();
     }
 
     return current;
 }
 
+/**
+ * Publishes up to size records from the head. The head only moves past
+ * what was delivered; a failed send leaves the rest where it is.
+ */
 uint8_t PayloadStore::popOfflineCollection(uint8_t size, unsigned long delay)
 {
-    String *result = pop(size);
+    if (!Storage.sdCardPresent())
+    {
+        return drainRing(size, delay);
+    }
+    init();
+    // a card that refuses the spill may still have its own backlog to give
+    if (!spillRing() && superblock.count == 0)
+    {
+        return drainRing(size, delay);
+    }
+
+    StoredRecord *result = new StoredRecord[size];
+    unsigned long *next = new unsigned long[size];
+    unsigned long reached = superblock.head;
+    uint8_t found = peek(size, result, next, reached);
+    Serial.println("Pop position: " + String(superblock.head));
+
+    uint8_t done = 0;
     uint8_t count = 0;
-    for (uint8_t i = 0; i < size; i++)
+    for (; done < found; done++)
     {
         coreDelay(delay);
-        if (result[i].isEmpty())
+        Serial.printf("Topic: %s, sending offline payload of %d bytes\n", result[done].topic.c_str(),
+                      result[done].payload.length());
+        if (sendRecord(result[done]))
         {
+            Serial.println("Offline payload sent successfully");
+            count++;
+        }
+        else
+        {
+            Serial.println("Failed to send offline payload");
             break;
         }
+    }
+    Serial.println("Count: " + String(count) + " / " + String(size));
+
+    unsigned long position = done > 0 ? next[done - 1] : superblock.head;
+    // only damaged frames were left after the last record
+    if (done == found && reached >= superblock.tail)
+    {
+        position = reached;
+    }
+    if (position > superblock.head)
+    {
+        advance(position, done);
+    }
+
+    delete[] next;
+    delete[] result;
+    return count;
+}
 
-        String topic = result[i].substring(0, result[i].indexOf("|"));
-        String payload = result[i].substring(result[i].indexOf("|") + 1);
-        String send = setStale(payload);
-        if (send.isEmpty())
+bool PayloadStore::sendRecord(const StoredRecord &record)
+{
+#ifdef COMPRESSED_PUBLISH
+    using namespace hyphen::records;
+    if ((record.flags & FLAG_MSGPACK) && (record.flags & FLAG_STALE_SPLICE))
+    {
+        // forwarded as stored: what compressPublish would send, plus "stale"
+        size_t len = record.payload.length();
+        uint8_t *buf = new uint8_t[len + hyphen::codec::kStaleExtra];
+        size_t n = hyphen::codec::addStaleToMap((const uint8_t *)record.payload.c_str(), len, buf,
+                                                len + hyphen::codec::kStaleExtra);
+        bool sent = n > 0 && Hyphen.publish(record.topic.c_str(), buf, n);
+        delete[] buf;
+        if (n > 0)
         {
-            continue;
+            return sent;
         }
-        Serial.printf("Topic: %s \n", topic.c_str());
-        Serial.println("Sending offline payload: " + send);
-        if (
-#ifdef COMPRESSED_PUBLISH
-            Hyphen.compressPublish(sanitize(topic), setStale(payload))
+    }
+    return Hyphen.compressPublish(record.topic, replayPayload(record));
+#else
+    return Hyphen.publish(record.topic, replayPayload(record));
+#endif
+}
+
+/**
+ * Sets up the RAM ring on first use, in PSRAM where the board has it.
+ */
+bool PayloadStore::attachRing()
+{
+    if (ring.attached())
+    {
+        return true;
+    }
+    if (ringUnavailable)
+    {
+        return false;
+    }
+#ifdef BOARD_HAS_PSRAM
+    uint8_t *buffer = (uint8_t *)heap_caps_malloc(OFFLINE_RAM_RING_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
 #else
-            Hyphen.publish(sanitize(topic), setStale(payload))
+    uint8_t *buffer = (uint8_t *)malloc(OFFLINE_RAM_RING_SIZE);
 #endif
-        )
+    if (!buffer)
+    {
+        ringUnavailable = true;
+        Log.errorln("No memory for the %d byte offline RAM ring", OFFLINE_RAM_RING_SIZE);
+        return false;
+    }
+    ring.attach(buffer, OFFLINE_RAM_RING_SIZE);
+    registerShutdown();
+    Log.noticeln("Offline records now held in a %d byte RAM ring", OFFLINE_RAM_RING_SIZE);
+    return true;
+}
+
+bool PayloadStore::ringPush(const uint8_t *frame, uint32_t frameLen)
+{
+    if (!attachRing())
+    {
+        return false;
+    }
+    uint32_t dropped = ring.dropped();
+    bool ok = ring.push(frame, frameLen);
+    if (ring.dropped() > dropped)
+    {
+        Log.warningln("Offline RAM ring full, dropped %d oldest records", ring.dropped() - dropped);
+    }
+    backlogGauge = backlog();
+    return ok;
+}
+
+/**
+ * Moves what the RAM ring holds onto the card, oldest first. True once
+ * the ring is empty.
+ */
+bool PayloadStore::spillRing()
+{
+    const uint8_t *frame;
+    size_t len;
+    uint32_t spilled = 0;
+    while (ring.front(frame, len) && appendFrame(frame, len))
+    {
+        ring.pop();
+        spilled++;
+    }
+    if (spilled > 0)
+    {
+        Log.noticeln("Spilled %d offline records from RAM to the card", spilled);
+    }
+    return ring.empty();
+}
+
+/**
+ * Publishes up to size records straight from the RAM ring, for when
+ * there is no card to spill them to.
+ */
+uint8_t PayloadStore::drainRing(uint8_t size, unsigned long delay)
+{
+    using namespace hyphen::records;
+    uint8_t count = 0;
+    const uint8_t *frame;
+    size_t len;
+    while (count < size && ring.front(frame, len))
+    {
+        Header header;
+        StoredRecord record;
+        if (len < kHeaderSize || !decodeHeader(frame, header) || frameSize(header) != len ||
+            !verify(frame, header, frame + kHeaderSize) || !unpack(header, frame + kHeaderSize, record))
         {
-            Serial.println("Offline payload sent successfully");
-            count++;
+            Log.errorln("Skipping damaged offline record in RAM");
+            ring.pop();
+            continue;
         }
-        else
+        coreDelay(delay);
+        if (!sendRecord(record))
         {
-            Serial.println("Failed to send offline payload");
             break;
         }
+        ring.pop();
+        count++;
     }
-    Serial.println("Count: " + String(count) + " / " + String(size));
-    if (count < size)
+    backlogGauge = backlog();
+    return count;
+}
+
+/**
+ * Registers shutdownHandler once. ESP-IDF keeps only a handful of shutdown
+ * handlers, so the store's work on a planned reboot shares this one.
+ */
+bool PayloadStore::registerShutdown()
+{
+    if (shutdownHandlerSet)
+    {
+        return true;
+    }
+    shutdownOwner = this;
+    shutdownHandlerSet = esp_register_shutdown_handler(&PayloadStore::shutdownHandler) == ESP_OK;
+    if (!shutdownHandlerSet)
     {
-        addBackOntoStore(count, result, size);
+        Log.errorln("Offline store: no room for a shutdown handler, a reboot loses what RAM holds");
     }
+    return shutdownHandlerSet;
+}
 
-    delete[] result; // Deallocate the array
-    return count;
+bool PayloadStore::onShutdown(void (*hook)())
+{
+    StoreLock lock(storeMutex);
+    shutdownHook = hook;
+    return registerShutdown();
+}
+
+/**
+ * Runs on a planned reboot (esp_restart), in this order: the onShutdown
+ * hook, which may push what only RAM holds, then the RAM ring, spilled to
+ * the card or, with -D OFFLINE_RING_NVS_SUMMARY, at least summarized in
+ * NVS so the next boot can report what was lost. When the publisher task
+ * holds the store past SHUTDOWN_WAIT_MS neither runs and the ring is only
+ * summarized.
+ */
+void PayloadStore::shutdownHandler()
+{
+    PayloadStore *store = shutdownOwner;
+    if (!store)
+    {
+        return;
+    }
+    // the publisher task may be mid-store; don't hang the restart on it
+    if (xSemaphoreTakeRecursive(store->storeMutex, pdMS_TO_TICKS(SHUTDOWN_WAIT_MS)) != pdTRUE)
+    {
+        Log.errorln("Offline store busy at shutdown, nothing stored or spilled");
+    }
+    else
+    {
+        if (store->shutdownHook)
+        {
+            store->shutdownHook();
+        }
+        bool spilled = store->ring.empty() ||
+                       (Storage.sdCardPresent() && store->superblockLoaded && store->spillRing());
+        xSemaphoreGiveRecursive(store->storeMutex);
+        if (spilled)
+        {
+            return;
+        }
+    }
+#ifdef OFFLINE_RING_NVS_SUMMARY
+    if (!store->ring.attached())
+    {
+        return;
+    }
+    hyphen::ring::Summary summary = store->ring.summary();
+    Persist.put(store->ringSummaryKey, summary);
+    // Persistence's own shutdown flush may already have run
+    Persist.flush();
+#endif
+}
+
+#ifdef OFFLINE_RING_NVS_SUMMARY
+void PayloadStore::reportRingSummary()
+{
+    if (ringSummaryChecked)
+    {
+        return;
+    }
+    ringSummaryChecked = true;
+    hyphen::ring::Summary summary;
+    if (!Persist.get(ringSummaryKey, summary) || summary.records == 0)
+    {
+        return;
+    }
+    Log.warningln("Lost %d offline records (%d bytes) held in RAM at the last reboot, %d more dropped before it",
+                  summary.records, summary.bytes, summary.dropped);
+    Persist.put(ringSummaryKey, hyphen::ring::Summary());
+}
+#endif
+
+/**
+ * The drains read the card synchronously. Their reads aren't bounded: one
+ * that timed out halfway through a frame would look like damage and resync
+ * past a good record. Instead a drain only starts on an idle card, and an
+ * offline check that finds jobs queued or a sync on the bus skips its turn.
+ */
+bool PayloadStore::cardBusy()
+{
+    return Storage.sdCardPresent() && !Storage.idle(OFFLINE_DRAIN_WAIT_MS);
 }
 
 uint8_t PayloadStore::popOneOffline()
 {
+    StoreLock lock(storeMutex);
+    if (cardBusy())
+    {
+        return 0;
+    }
     return popOfflineCollection(1, 10);
 }
 
 uint8_t PayloadStore::popOfflineCollection()
 {
+    StoreLock lock(storeMutex);
+    if (cardBusy())
+    {
+        return 0;
+    }
     return popOfflineCollection(MAX_PAYLOADS, 1000);
-}
\ No newline at end of file
+}
+
+/**
+ * Adds a record to a batch envelope under its payload's "__id", the id the
+ * server dedupes on; its position in the store is reused once the store
+ * empties.
+ */
+bool PayloadStore::addToEnvelope(hyphen::batch::EnvelopeBuilder &envelope, StoredRecord &record)
+{
+    toJson(record);
+    const char *payload = record.payload.c_str();
+    size_t length = record.payload.length();
+    const char *id = nullptr;
+    size_t idLen = 0;
+    hyphen::batch::payloadIdOf(payload, length, id, idLen);
+    return envelope.add(id, idLen, record.topic.c_str(), payload, length);
+}
+
+/**
+ * Publishes as many stored records as fit in one MQTT packet as a single
+ * envelope (see resources/utils/batch_drain.h). The head only advances
+ * once the publish succeeded, so a failed batch is simply retried.
+ *
+ * @param uint16_t budget - records at most, the batch sizer may take fewer
+ *
+ * @return uint16_t - the number of records delivered
+ */
+uint16_t PayloadStore::drainBatch(uint16_t budget)
+{
+    StoreLock lock(storeMutex);
+    if (cardBusy())
+    {
+        return 0;
+    }
+    // records in the RAM ring go out one by one
+    if (!Storage.sdCardPresent())
+    {
+        return drainRing((uint8_t)min(budget, (uint16_t)MAX_PAYLOADS), 0);
+    }
+    init();
+    if (!spillRing() && superblock.count == 0)
+    {
+        return drainRing((uint8_t)min(budget, (uint16_t)MAX_PAYLOADS), 0);
+    }
+    if (superblock.count == 0)
+    {
+        return 0;
+    }
+
+    const size_t budget = MQTT_MAX_PACKET_SIZE - strlen(OFFLINE_BATCH_TOPIC) - MQTT_PACKET_OVERHEAD;
+    char *buf = new char[budget];
+    hyphen::batch::EnvelopeBuilder envelope(buf, budget);
+    envelope.begin(Hyphen.deviceID().c_str());
+
+    unsigned long position = superblock.head;
+    unsigned long next = position;
+    bool oversized = false;
+    const uint16_t limit = min(budget, batchSizer.limit());
+    StoredRecord record;
+    while (envelope.count() < limit)
+    {
+        if (!readRecord(next, superblock.tail, record))
+        {
+            // only damaged frames left, they are consumed with the batch
+            position = next >= superblock.tail ? next : position;
+            break;
+        }
+        if (!addToEnvelope(envelope, record))
+        {
+            oversized = envelope.count() == 0;
+            break;
+        }
+        position = next;
+    }
+
+    uint16_t delivered = envelope.count();
+    bool sent = false;
+    if (delivered > 0)
+    {
+        size_t len = envelope.finish();
+        uint32_t start = millis();
+        sent = Hyphen.publish(OFFLINE_BATCH_TOPIC, (uint8_t *)buf, len);
+        uint32_t latency = hyphen::timing::elapsed(start, millis());
+        batchSizer.onPublish(sent, latency);
+        Log.noticeln("Offline batch of %d records (%d bytes) sent=%d in %d ms, next limit %d",
+                     delivered, len, sent, latency, batchSizer.limit());
+    }
+    delete[] buf;
+
+    if (oversized)
+    {
+        // a single record bigger than one envelope goes out on its own
+        return popOfflineCollection(1, 0);
+    }
+    if ((delivered > 0 && !sent) || position == superblock.head)
+    {
+        return 0;
+    }
+    advance(position, delivered);
+    return delivered;
+}
+
+/**
+ * Positions of the newest records the lane hasn't sent, newest first.
+ * Records only link forward, so each segment below the lane's cursor is
+ * scanned from its start (or the head) for its last few, newest segment
+ * first. exhausted is set when the scan got down to the head.
+ */
+uint8_t PayloadStore::collectNewest(uint8_t size, uint32_t *positions, bool &exhausted)
+{
+    using namespace hyphen::segments;
+    if (laneTail != superblock.tail || laneEnd > superblock.tail || laneEnd < superblock.head)
+    {
+        // records came in since, or the in-order pop passed the cursor: start
+        // over from the tail, what was sent already is skipped
+        laneTail = superblock.tail;
+        laneEnd = superblock.tail;
+    }
+    uint8_t found = 0;
+    uint32_t end = laneEnd;
+    exhausted = false;
+    while (found < size && end > superblock.head)
+    {
+        uint32_t from = max(segmentStart(segmentOf(end - 1, SEGMENT_SIZE), SEGMENT_SIZE), superblock.head);
+        hyphen::lanes::NewestWindow<LANE_WINDOW> window(size - found);
+        unsigned long position = from;
+        unsigned long start = 0;
+        StoredRecord record;
+        while (readRecord(position, end, record, &start))
+        {
+            window.add(start);
+        }
+        for (size_t i = 0; i < window.count(); i++)
+        {
+            positions[found++] = window.newest(i);
+        }
+        if (position < end)
+        {
+            // the card failed mid-scan
+            return found;
+        }
+        if (found == 0)
+        {
+            // nothing left to send above here
+            laneEnd = from;
+        }
+        end = from;
+    }
+    exhausted = end <= superblock.head;
+    return found;
+}
+
+/**
+ * Sets FLAG_DELIVERED on the records at positions, in place, and takes
+ * them off the count: one pass for a lane turn. The flags go through the
+ * SDWriter, so the segment being appended to stays open; one commit then
+ * makes them durable before the superblock (committed once) counts them
+ * off, since a count that ran ahead of the flags would let the head jump
+ * past records never sent. A record that can't be marked is sent again
+ * later.
+ */
+void PayloadStore::markDelivered(const uint32_t *positions, uint16_t count)
+{
+    using namespace hyphen::segments;
+    uint32_t marked = 0;
+    bool readerStale = false;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        String file = segmentFile(segmentOf(positions[i], SEGMENT_SIZE));
+        uint64_t at = offsetIn(positions[i], SEGMENT_SIZE) + 2;
+        if (!Storage.writer().setBits(file, at, hyphen::records::FLAG_DELIVERED))
+        {
+            Log.errorln("Couldn't mark offline record at %l delivered, it goes out again", positions[i]);
+            continue;
+        }
+        marked++;
+        readerStale = readerStale || readerFile.equals(file);
+    }
+    // its buffer may still hold the old flags
+    if (readerStale)
+    {
+        closeReader();
+    }
+    if (marked == 0)
+    {
+        return;
+    }
+    if (!Storage.writer().commit())
+    {
+        Log.errorln("Couldn't commit %d delivered flags, the backlog still counts them", marked);
+        return;
+    }
+    xSemaphoreTake(superblockMutex, portMAX_DELAY);
+    superblock.count -= min(marked, superblock.count);
+    // the last one: nothing between head and tail is waiting any more
+    uint32_t drainedTo = superblock.count == 0 ? superblock.tail : 0;
+    commitSuperblock();
+    xSemaphoreGive(superblockMutex);
+    if (drainedTo > 0)
+    {
+        advance(drainedTo, 0);
+    }
+}
+
+/**
+ * Moves the lane's cursor down to the last record it sent. Once the lane
+ * went through everything down to the head, the head jumps to where the
+ * lane started: every record below that was delivered.
+ */
+void PayloadStore::laneSent(uint32_t position, bool finished)
+{
+    laneEnd = position;
+    if (finished)
+    {
+        advance(laneTail, 0);
+    }
+}
+
+/**
+ * Publishes up to size records, newest first, marking each one delivered
+ * once it went out. Stops at the first failed send.
+ */
+uint8_t PayloadStore::popNewest(uint8_t size, unsigned long delay)
+{
+    if (!Storage.sdCardPresent())
+    {
+        return drainRing(size, delay);
+    }
+    init();
+    if (!spillRing() && superblock.count == 0)
+    {
+        return drainRing(size, delay);
+    }
+    if (superblock.count == 0)
+    {
+        return 0;
+    }
+
+    uint32_t *positions = new uint32_t[size];
+    bool exhausted = false;
+    uint8_t found = collectNewest(size, positions, exhausted);
+    uint8_t count = 0;
+    for (; count < found; count++)
+    {
+        unsigned long position = positions[count];
+        StoredRecord record;
+        if (!readRecord(position, superblock.tail, record))
+        {
+            break;
+        }
+        coreDelay(delay);
+        Serial.printf("Topic: %s, sending offline payload of %d bytes, newest first\n", record.topic.c_str(),
+                      record.payload.length());
+        if (!sendRecord(record))
+        {
+            Serial.println("Failed to send offline payload");
+            break;
+        }
+    }
+    if (count > 0)
+    {
+        markDelivered(positions, count);
+        laneSent(positions[count - 1], exhausted && count == found);
+    }
+    delete[] positions;
+    return count;
+}
+
+/**
+ * drainBatch, newest first: the envelope takes the newest records and
+ * each is marked delivered once the publish succeeded.
+ *
+ * @param uint16_t budget - records at most, the batch sizer may take fewer
+ *
+ * @return uint16_t - the number of records delivered
+ */
+uint16_t PayloadStore::drainNewestBatch(uint16_t budget)
+{
+    if (!Storage.sdCardPresent())
+    {
+        return drainRing((uint8_t)min(budget, (uint16_t)MAX_PAYLOADS), 0);
+    }
+    init();
+    if (!spillRing() && superblock.count == 0)
+    {
+        return drainRing((uint8_t)min(budget, (uint16_t)MAX_PAYLOADS), 0);
+    }
+    if (superblock.count == 0)
+    {
+        return 0;
+    }
+
+    uint8_t size = min((uint16_t)LANE_WINDOW, min(budget, batchSizer.limit()));
+    uint32_t *positions = new uint32_t[size];
+    bool exhausted = false;
+    uint8_t found = collectNewest(size, positions, exhausted);
+
+    const size_t budget = MQTT_MAX_PACKET_SIZE - strlen(OFFLINE_BATCH_TOPIC) - MQTT_PACKET_OVERHEAD;
+    char *buf = new char[budget];
+    hyphen::batch::EnvelopeBuilder envelope(buf, budget);
+    envelope.begin(Hyphen.deviceID().c_str());
+    StoredRecord record;
+    for (uint8_t i = 0; i < found; i++)
+    {
+        unsigned long position = positions[i];
+        if (!readRecord(position, superblock.tail, record))
+        {
+            break;
+        }
+        if (!addToEnvelope(envelope, record))
+        {
+            break;
+        }
+    }
+
+    uint16_t delivered = envelope.count();
+    bool sent = false;
+    if (delivered > 0)
+    {
+        size_t len = envelope.finish();
+        uint32_t start = millis();
+        sent = Hyphen.publish(OFFLINE_BATCH_TOPIC, (uint8_t *)buf, len);
+        uint32_t latency = hyphen::timing::elapsed(start, millis());
+        batchSizer.onPublish(sent, latency);
+        Log.noticeln("Offline batch of %d records (%d bytes), newest first, sent=%d in %d ms, next limit %d",
+                     delivered, len, sent, latency, batchSizer.limit());
+    }
+    delete[] buf;
+
+    if (found > 0 && delivered == 0)
+    {
+        // a single record bigger than one envelope goes out on its own
+        delete[] positions;
+        return popNewest(1, 0);
+    }
+    if (sent)
+    {
+        markDelivered(positions, delivered);
+        laneSent(positions[delivered - 1], exhausted && delivered == found);
+    }
+    delete[] positions;
+    return sent ? delivered : 0;
+}
+
+/**
+ * The backlog lane's turn in one offline check (see
+ * resources/utils/delivery_lanes.h). budget records at most, one by one;
+ * with OFFLINE_BATCH_DRAIN a single batch of at most that many, fewer when
+ * the batch sizer says so.
+ *
+ * @return uint16_t - the number of records delivered
+ */
+uint16_t PayloadStore::drainLane(uint16_t budget, hyphen::lanes::Order order)
+{
+    StoreLock lock(storeMutex);
+    if (budget == 0 || cardBusy())
+    {
+        return 0;
+    }
+#ifdef OFFLINE_BATCH_DRAIN
+    return order == hyphen::lanes::NEWEST_FIRST ? drainNewestBatch(budget) : drainBatch(budget);
+#else
+    uint8_t size = (uint8_t)min(budget, (uint16_t)OFFLINE_LANE_MAX_RECORDS);
+    return order == hyphen::lanes::NEWEST_FIRST ? popNewest(size, 10) : popOfflineCollection(size, 10);
+#endif
+}
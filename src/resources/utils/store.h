@@ -1,9 +1,68 @@
 #ifndef _PAYLOAD_STORE_H
 #define _PAYLOAD_STORE_H
 #include <Hyphen.h>
+#include "resources/utils/record_log.h"
+#include "resources/utils/store_superblock.h"
+#include "resources/utils/store_segments.h"
+#include "resources/utils/batch_drain.h"
+#include "resources/utils/record_ring.h"
+#include "resources/utils/record_codec.h"
+#include "resources/utils/delivery_lanes.h"
 // #include <vector>
 #define LOG_FILE_NAME "hyphen-logs.txt"
 
+// Batched offline drain (-D OFFLINE_BATCH_DRAIN), see resources/utils/batch_drain.h
+#ifndef OFFLINE_BATCH_TOPIC
+#define OFFLINE_BATCH_TOPIC "Hy/Post/Batch"
+#endif
+#ifndef OFFLINE_BATCH_MAX_RECORDS
+#define OFFLINE_BATCH_MAX_RECORDS 64
+#endif
+#ifndef OFFLINE_BATCH_TARGET_LATENCY_MS
+#define OFFLINE_BATCH_TARGET_LATENCY_MS 3000
+#endif
+// Backlog lane, see resources/utils/delivery_lanes.h: records per offline
+// check at most, and the share of the check period it may keep the link busy
+#ifndef OFFLINE_LANE_MAX_RECORDS
+#define OFFLINE_LANE_MAX_RECORDS 16
+#endif
+#ifndef OFFLINE_LANE_SHARE_PERCENT
+#define OFFLINE_LANE_SHARE_PERCENT 50
+#endif
+// How long an offline check waits for the SD worker to go idle before it
+// skips its drain (see PayloadStore::cardBusy)
+#ifndef OFFLINE_DRAIN_WAIT_MS
+#define OFFLINE_DRAIN_WAIT_MS 50
+#endif
+// Offline queue segments, see resources/utils/store_segments.h
+#ifndef OFFLINE_SEGMENT_SIZE
+#define OFFLINE_SEGMENT_SIZE 65536
+#endif
+#ifndef OFFLINE_MAX_SEGMENTS
+#define OFFLINE_MAX_SEGMENTS 512
+#endif
+// RAM tier for when the card is missing, see resources/utils/record_ring.h.
+// -D OFFLINE_RING_NVS_SUMMARY records what it held in NVS on a planned reboot
+#ifndef OFFLINE_RAM_RING_SIZE
+#ifdef BOARD_HAS_PSRAM
+#define OFFLINE_RAM_RING_SIZE (256 * 1024)
+#else
+#define OFFLINE_RAM_RING_SIZE (16 * 1024)
+#endif
+#endif
+// Compact on-card records (-D OFFLINE_STORE_MSGPACK, -D OFFLINE_STORE_LZ),
+// see resources/utils/record_codec.h
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 2048
+#endif
+
+struct StoredRecord
+{
+    String topic;
+    String payload;
+    uint8_t flags = 0; // hyphen::records::FLAG_*
+};
+
 class PayloadStore
 {
 private:
@@ -13,24 +72,111 @@ private:
     const uint8_t MAX_PAYLOADS = 10;
     std::vector<String> logBuffer;
     SemaphoreHandle_t logMutex = nullptr;
-    TaskHandle_t flushTaskHandle = nullptr;
-    static void flushTask(void *param);
     void flushToFile();
 
     const String positionFile = "position.txt";
-    const String storeFile = "popStorage.txt";
-    const char *popKey = "pop_key";
-    void resetStorageFile();
-    unsigned long getPopPosition();
-    bool setPopPosition(unsigned long);
+    // framed binary records in segment files, see resources/utils/record_log.h
+    // and resources/utils/store_segments.h
+    static constexpr uint32_t SEGMENT_SIZE = OFFLINE_SEGMENT_SIZE;
+    static_assert(OFFLINE_SEGMENT_SIZE >= hyphen::records::kHeaderSize + hyphen::records::kMaxPayload,
+                  "an offline segment must hold the largest record");
+    String segmentFile(uint32_t segment);
+    // head/tail/count of the queue, see resources/utils/store_superblock.h
+    const String superblockFile = "offline.sb";
+    hyphen::superblock::Superblock superblock;
+    // the superblock is also committed from the SD worker, see onStorageCommit
+    SemaphoreHandle_t superblockMutex = nullptr;
+    // push/pushPacked run on the publisher task, init and the drains on the
+    // main loop: every public entry point holds this one (recursive) lock.
+    // A drain holds it across its sends, so a failed live payload waits out
+    // at most one backlog lane's turn before it is stored
+    SemaphoreHandle_t storeMutex = nullptr;
+    unsigned long backlogGauge = 0;
+    bool superblockLoaded = false;
+    // lowest segment that may still be on the card
+    uint32_t reclaimFrom = 0;
+    bool loadSuperblock(const uint8_t *, size_t);
+    void rebuildSuperblock();
+    void rollForward();
+    bool commitSuperblock();
+    static void onStorageCommit(void *, const String &, uint64_t);
+    void advance(uint32_t, uint32_t);
+    void reclaimSegments();
+    void rebase();
+    // the single-file store from before segments, drained by init()
+    const String recordFile = "offline.rec";
+    const char *popKey = "rec_pop";
+    void migrateRecordFile(const uint8_t *, size_t);
+    // the old newline-delimited store, drained by init()
+    const String legacyStoreFile = "popStorage.txt";
+    const char *legacyPopKey = "pop_key";
+    // Topic ids are written to the card, so this table is append-only. Anything
+    // not listed is stored inline (FLAG_INLINE_TOPIC).
+    static const uint8_t TOPIC_COUNT = 4;
+    const char *topics[TOPIC_COUNT] = {"Hy/Post/Black", "Hy/Post/Gold", "Hy/Post/Maintain", "Hy/Post/Heartbeat"};
+    uint8_t topicId(const String &);
+    uint8_t *encodeFrame(const String &, const String &, uint32_t &);
+    uint8_t *encodeFrame(const String &, const uint8_t *, size_t, uint8_t, uint32_t &);
+    bool store(uint8_t *, uint32_t);
+    uint16_t *lzTable = nullptr;
+    bool appendFrame(const uint8_t *, uint32_t);
+    bool unpack(const hyphen::records::Header &, const uint8_t *, StoredRecord &);
+    // first tier while the card is missing or failing
+    hyphen::ring::RecordRing ring;
+    bool ringUnavailable = false;
+    bool attachRing();
+    bool ringPush(const uint8_t *, uint32_t);
+    bool spillRing();
+    uint8_t drainRing(uint8_t, unsigned long);
+    // one esp_restart handler for the store: the onShutdown hook first, then
+    // the RAM ring (see shutdownHandler)
+    static PayloadStore *shutdownOwner;
+    bool shutdownHandlerSet = false;
+    void (*shutdownHook)() = nullptr;
+    bool registerShutdown();
+    static void shutdownHandler();
+    // how long a planned reboot waits for a store in progress
+    static const uint32_t SHUTDOWN_WAIT_MS = 500;
+#ifdef OFFLINE_RING_NVS_SUMMARY
+    const char *ringSummaryKey = "ring_sum";
+    bool ringSummaryChecked = false;
+    void reportRingSummary();
+#endif
+    // stays open on the segment being drained, see utils/block_reader.h
+    SDReader reader;
+    String readerFile;
+    bool seekReader(const String &, unsigned long);
+    void closeReader();
+    bool readFrame(const String &, unsigned long &, uint64_t, StoredRecord &, unsigned long *start = nullptr);
+    bool resync(const String &, unsigned long &, uint64_t);
+    bool readRecord(unsigned long &, uint32_t, StoredRecord &, unsigned long *start = nullptr);
+    uint8_t peek(uint8_t, StoredRecord *, unsigned long *, unsigned long &);
+    bool cardBusy();
+    // newest-first backlog lane: [laneEnd, laneTail) went out already
+    static const uint8_t LANE_WINDOW = OFFLINE_BATCH_MAX_RECORDS > OFFLINE_LANE_MAX_RECORDS ? OFFLINE_BATCH_MAX_RECORDS : OFFLINE_LANE_MAX_RECORDS;
+    uint32_t laneEnd = 0;
+    uint32_t laneTail = 0;
+    uint8_t collectNewest(uint8_t, uint32_t *, bool &);
+    void markDelivered(const uint32_t *, uint16_t);
+    void laneSent(uint32_t, bool);
+    uint8_t popNewest(uint8_t, unsigned long);
+    uint16_t drainNewestBatch(uint16_t);
+    void migrateLegacyStore();
     String setStale(String);
-    void addBackOntoStore(uint8_t, String *, uint8_t);
+    String replayPayload(const StoredRecord &);
+    bool sendRecord(const StoredRecord &);
+    void toJson(StoredRecord &);
+    bool addToEnvelope(hyphen::batch::EnvelopeBuilder &, StoredRecord &);
     uint8_t popOfflineCollection(uint8_t, unsigned long);
+    // MQTT fixed header + topic length field + slack
+    static const size_t MQTT_PACKET_OVERHEAD = 16;
+    hyphen::batch::BatchSizer batchSizer = hyphen::batch::BatchSizer(1, OFFLINE_BATCH_MAX_RECORDS, OFFLINE_BATCH_TARGET_LATENCY_MS);
 
 public:
     PayloadStore();
-    void spawnFlushTask();
+    void init();
     bool push(String, String);
+    bool pushPacked(const String &, const uint8_t *, size_t);
     String sanitize(const String &in)
     {
         String s = in;
@@ -41,8 +187,16 @@ public:
     uint32_t log(String);
     uint8_t popOneOffline();
     uint32_t countEntries();
-    String *pop(uint8_t);
+    uint32_t backlog() const { return superblock.count + ring.count(); }
+    // live backlog gauge for Hyphen.variable
+    unsigned long *backlogVariable() { return &backlogGauge; }
     uint8_t popOfflineCollection();
+    uint16_t drainBatch(uint16_t budget = OFFLINE_BATCH_MAX_RECORDS);
+    // the backlog lane's share of one offline check
+    uint16_t drainLane(uint16_t, hyphen::lanes::Order);
+    // runs on a planned reboot with the store locked, before the RAM ring is
+    // spilled; whatever it pushes is spilled with it
+    bool onShutdown(void (*hook)());
 };
 
 #endif
\ No newline at end of file
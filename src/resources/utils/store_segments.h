@@ -0,0 +1,75 @@
+// store_segments.h — where offline records live across fixed-size segment files.
+//
+// The offline queue used to be one file that only shrank when a drain reached
+// its end, and a failed send re-appended the unsent records to it. On a flaky
+// link the same records were rewritten again and again and the file grew
+// without bound. The queue is now a run of segment files (seg00000.rec,
+// seg00001.rec, ...) addressed by one 32-bit logical position:
+//
+//     segment = position / segmentSize     offset = position % segmentSize
+//
+// head and tail in the superblock are such positions. A record never spans two
+// segments: one that doesn't fit in the rest of the tail segment starts the next
+// one, and readers hop over the unused rest. A failed send just leaves head
+// where it was; segments wholly below head are deleted in the background.
+//
+// Positions only ever grow, so a removed segment's name is never reused while a
+// deletion for it may still be queued. They are rebased to 0 once the queue is
+// empty and past kRebaseAt.
+//
+// Pure functions, unit-tested on the host (see test_store_segments).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace hyphen {
+namespace segments {
+
+const uint32_t kRebaseAt = 0x80000000u;
+
+inline uint32_t segmentOf(uint32_t position, uint32_t segmentSize) {
+  return position / segmentSize;
+}
+
+inline uint32_t offsetIn(uint32_t position, uint32_t segmentSize) {
+  return position % segmentSize;
+}
+
+inline uint32_t segmentStart(uint32_t segment, uint32_t segmentSize) {
+  return segment * segmentSize;
+}
+
+// Position of the next segment after the one holding `position`.
+inline uint32_t nextSegment(uint32_t position, uint32_t segmentSize) {
+  return segmentStart(segmentOf(position, segmentSize) + 1, segmentSize);
+}
+
+// Where a frame of `frameLen` bytes goes when the queue ends at `tail`: right
+// there, or at the start of the next segment when it would not fit.
+inline uint32_t place(uint32_t tail, uint32_t frameLen, uint32_t segmentSize) {
+  uint32_t offset = offsetIn(tail, segmentSize);
+  if (offset > 0 && offset + frameLen > segmentSize) {
+    return nextSegment(tail, segmentSize);
+  }
+  return tail;
+}
+
+// Segments holding [head, tail), counting a partially used tail segment.
+inline uint32_t segmentsUsed(uint32_t head, uint32_t tail, uint32_t segmentSize) {
+  if (tail <= head) {
+    return 0;
+  }
+  return segmentOf(tail - 1, segmentSize) - segmentOf(head, segmentSize) + 1;
+}
+
+// "seg0002a.rec" — 8.3 safe, and five hex digits cover every segment of a
+// 32-bit position space for any segment that can hold a full frame. `out`
+// needs 13 bytes.
+inline void name(uint32_t segment, char *out, size_t cap) {
+  snprintf(out, cap, "seg%05lx.rec", (unsigned long)segment);
+}
+
+}  // namespace segments
+}  // namespace hyphen
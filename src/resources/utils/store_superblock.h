@@ -0,0 +1,105 @@
+// store_superblock.h — persisted head/tail/count for the offline record log.
+//
+// Counting the backlog used to mean reading the whole store file from the pop
+// position at boot (SDCard::countLines) with the SPI mutex held — seconds for a
+// multi-megabyte backlog. The store now keeps a tiny superblock next to the log:
+//
+//     head   position of the next record to pop
+//     tail   position just past the last committed record
+//     count  records between head and tail
+//
+// Positions are logical byte positions across the segment files (see
+// store_segments.h). Version 1 superblocks held byte offsets into the single
+// pre-segment offline.rec; they only get loaded to migrate that file.
+//
+// It lives in two 32-byte slots that are written alternately (slot =
+// generation & 1) and each carry a CRC32. A write torn by a brownout only ever
+// damages the slot being written; the other one still holds the previous state,
+// so loading picks the newest slot whose CRC checks out. Pure functions over byte
+// buffers, unit-tested on the host (see test_store_superblock).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "resources/utils/record_log.h"
+
+namespace hyphen {
+namespace superblock {
+
+const size_t kSlotSize = 32;
+const size_t kFileSize = 2 * kSlotSize;
+const uint32_t kMagic = 0x42535948;  // "HYSB"
+const uint8_t kVersion = 2;
+
+struct Superblock {
+  uint32_t generation = 0;
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  uint32_t count = 0;
+};
+
+// Byte offset of the slot this generation is written to.
+inline size_t slotOffset(uint32_t generation) {
+  return (generation & 1) * kSlotSize;
+}
+
+//     0 magic u32 | 4 version u8 | 5..7 reserved | 8 generation | 12 head |
+//     16 tail | 20 count | 24 reserved u32 | 28 crc32 over bytes 0..27
+inline void encode(const Superblock &sb, uint8_t *out) {
+  using hyphen::records::putU32;
+  for (size_t i = 0; i < kSlotSize; i++) {
+    out[i] = 0;
+  }
+  putU32(out, kMagic);
+  out[4] = kVersion;
+  putU32(out + 8, sb.generation);
+  putU32(out + 12, sb.head);
+  putU32(out + 16, sb.tail);
+  putU32(out + 20, sb.count);
+  putU32(out + 28, hyphen::records::crc32(out, 28));
+}
+
+// False for a blank, torn or foreign slot.
+inline bool decode(const uint8_t *in, Superblock &sb, uint8_t version = kVersion) {
+  using hyphen::records::getU32;
+  if (getU32(in) != kMagic || in[4] != version) {
+    return false;
+  }
+  if (hyphen::records::crc32(in, 28) != getU32(in + 28)) {
+    return false;
+  }
+  sb.generation = getU32(in + 8);
+  sb.head = getU32(in + 12);
+  sb.tail = getU32(in + 16);
+  sb.count = getU32(in + 20);
+  return sb.head <= sb.tail;
+}
+
+// Serial-number comparison so a (very) long-lived device survives the 32-bit
+// generation counter wrapping.
+inline bool newer(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b) > 0;
+}
+
+// Pick the newest valid slot from the raw two-slot file. False when neither
+// slot is valid (fresh card, or a store from an older firmware) — the caller
+// then rebuilds the superblock by walking the log once.
+inline bool load(const uint8_t *file, size_t len, Superblock &out, uint8_t version = kVersion) {
+  Superblock a, b;
+  bool okA = len >= kSlotSize && decode(file, a, version);
+  bool okB = len >= kFileSize && decode(file + kSlotSize, b, version);
+  if (okA && okB) {
+    out = newer(b.generation, a.generation) ? b : a;
+  } else if (okA) {
+    out = a;
+  } else if (okB) {
+    out = b;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace superblock
+}  // namespace hyphen
@@ -0,0 +1,295 @@
+// telemetry.h — dictionary-coded compact telemetry frames.
+//
+// Every publish repeats the same envelope and keys: the device id, an ISO8601
+// date, "__id", "payload" and each device's short parameter names. With
+// -D COMPACT_PUBLISH the publisher writes through a CompactWriter instead,
+// which sends only the values, in the order the devices write them:
+//
+//     [u8 version][u8 flags][u32 LE schema id][varint unix time][values...]
+//
+// Each value is a MessagePack scalar (nil, bool, int, float32/64 or str). The
+// keys and the object nesting go into a separate dictionary as the devices
+// write them:
+//
+//     0x01 key NUL   an object member that opens a nested object
+//     0x02 key NUL   a value member
+//     0x03           end of the nested object
+//
+// The schema id is the CRC-32 of the dictionary, salted with the configured
+// device list, so it changes whenever a device is added or removed (or a
+// firmware update changes what a device writes). The device announces the
+// dictionary (describe(): {"key": value index, ...}) before the first frame
+// that carries a new id; the cloud decodes later frames against it. The
+// device can also turn a frame back into the full payload (expand()), for the
+// offline store and the archive, which keep holding JSON.
+//
+// Pure functions, unit-tested on the host (see test_telemetry).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "resources/utils/payload_writer.h"
+#include "resources/utils/record_codec.h"
+#include "resources/utils/record_log.h"
+
+namespace hyphen {
+namespace telemetry {
+
+const uint8_t kVersion = 1;
+// version, flags, schema id
+const size_t kFixedHeader = 6;
+// frame flags
+const uint8_t FLAG_MAINTENANCE = 0x01;
+
+// dictionary tokens
+const uint8_t kBegin = 0x01;
+const uint8_t kMember = 0x02;
+const uint8_t kEnd = 0x03;
+
+inline void putU32(uint8_t *out, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = (uint8_t)(v >> (8 * i));
+  }
+}
+
+inline uint32_t getU32(const uint8_t *in) {
+  return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// Writes values into the frame and keys into the dictionary. begin() opens the
+// top-level object; once the devices wrote theirs and it was closed, seal()
+// stamps the schema id.
+class CompactWriter : public payload::MsgPackWriter {
+ public:
+  CompactWriter(uint8_t *buf, size_t cap, uint8_t *dict = nullptr, size_t dictCap = 0)
+      : MsgPackWriter(buf, cap), _dict(dict), _dictCap(dict ? dictCap : 0) {}
+
+  bool begin(uint32_t timestamp) {
+    reset();
+    _dictLen = 0;
+    _schema = 0;
+    uint8_t head[kFixedHeader + 5] = {kVersion, 0};
+    size_t n = codec::putVarint(head + kFixedHeader, 5, timestamp);
+    return put(head, kFixedHeader + n) && open();
+  }
+
+  bool seal(uint32_t salt, uint8_t flags) {
+    if (!complete()) {
+      return false;
+    }
+    _schema = records::crc32(_dict, _dictLen, salt);
+    _buf[1] = flags;
+    putU32(_buf + 2, _schema);
+    return true;
+  }
+
+  uint32_t schema() const { return _schema; }
+  const uint8_t *dictionary() const { return _dict; }
+  size_t dictionaryLength() const { return _dictLen; }
+
+ protected:
+  // the top-level object is implied; nested ones only live in the dictionary
+  bool openObject() override {
+    if (_depth > 1) {
+      _dict[_lastKey] = kBegin;
+    }
+    return true;
+  }
+
+  bool closeObject(size_t, uint16_t) override { return _depth == 1 || token(kEnd); }
+  // the dictionary has no way to say "array"
+  bool openArray() override { return fail(); }
+
+  bool writeKey(const char *key, bool) override {
+    size_t n = strlen(key);
+    if (!_ok || _dictLen + n + 2 > _dictCap) {
+      return fail();
+    }
+    _lastKey = _dictLen;
+    _dict[_dictLen++] = kMember;
+    memcpy(_dict + _dictLen, key, n + 1);
+    _dictLen += n + 1;
+    return true;
+  }
+
+ private:
+  uint8_t *_dict;
+  size_t _dictCap;
+  size_t _dictLen = 0;
+  size_t _lastKey = 0;
+  uint32_t _schema = 0;
+
+  bool token(uint8_t t) {
+    if (!_ok || _dictLen + 1 > _dictCap) {
+      return fail();
+    }
+    _dict[_dictLen++] = t;
+    return true;
+  }
+};
+
+struct Frame {
+  uint8_t version = 0;
+  uint8_t flags = 0;
+  uint32_t schema = 0;
+  uint32_t timestamp = 0;
+  const uint8_t *values = nullptr;
+  size_t length = 0;
+};
+
+inline bool parse(const uint8_t *in, size_t len, Frame &out) {
+  if (len < kFixedHeader + 1 || in[0] != kVersion) {
+    return false;
+  }
+  out.version = in[0];
+  out.flags = in[1];
+  out.schema = getU32(in + 2);
+  size_t n = codec::getVarint(in + kFixedHeader, len - kFixedHeader, out.timestamp);
+  if (n == 0) {
+    return false;
+  }
+  out.values = in + kFixedHeader + n;
+  out.length = len - kFixedHeader - n;
+  return true;
+}
+
+namespace detail {
+
+inline uint64_t be(const uint8_t *in, size_t n) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < n; i++) {
+    v = (v << 8) | in[i];
+  }
+  return v;
+}
+
+// Copies the MessagePack scalar at in[at] into out under key. Returns the
+// bytes it took, 0 when it isn't one the writers produce or is cut short.
+inline size_t copyValue(const uint8_t *in, size_t len, size_t at, const char *key, payload::PayloadSink &out) {
+  if (at >= len) {
+    return 0;
+  }
+  uint8_t tag = in[at];
+  const uint8_t *p = in + at + 1;
+  size_t left = len - at - 1;
+  size_t width = 0;
+  size_t strLen = 0;
+  size_t strHead = 0;
+  if (tag <= 0x7F) {
+    return out.add(key, (unsigned int)tag) ? 1 : 0;
+  }
+  if (tag >= 0xE0) {
+    return out.add(key, (int)(int8_t)tag) ? 1 : 0;
+  }
+  if ((tag & 0xE0) == 0xA0) {
+    strLen = tag & 0x1F;
+  } else {
+    switch (tag) {
+      case 0xC0: return out.add(key, (double)NAN) ? 1 : 0;
+      case 0xC2: return out.add(key, false) ? 1 : 0;
+      case 0xC3: return out.add(key, true) ? 1 : 0;
+      case 0xCC: case 0xD0: width = 1; break;
+      case 0xCD: case 0xD1: width = 2; break;
+      case 0xCE: case 0xD2: case 0xCA: width = 4; break;
+      case 0xCF: case 0xD3: case 0xCB: width = 8; break;
+      case 0xD9: strHead = 1; break;
+      case 0xDA: strHead = 2; break;
+      case 0xDB: strHead = 4; break;
+      default: return 0;
+    }
+  }
+  if (width > 0) {
+    if (left < width) {
+      return 0;
+    }
+    uint64_t raw = be(p, width);
+    bool ok;
+    if (tag == 0xCA) {
+      uint32_t bits = (uint32_t)raw;
+      float f;
+      memcpy(&f, &bits, sizeof(f));
+      ok = out.add(key, f);
+    } else if (tag == 0xCB) {
+      double d;
+      memcpy(&d, &raw, sizeof(d));
+      ok = out.add(key, d);
+    } else if (tag >= 0xD0) {
+      // sign-extend from width bytes
+      int shift = 64 - 8 * (int)width;
+      ok = out.add(key, (long long)((int64_t)(raw << shift) >> shift));
+    } else {
+      ok = out.add(key, (unsigned long long)raw);
+    }
+    return ok ? 1 + width : 0;
+  }
+  if (strHead > 0) {
+    if (left < strHead) {
+      return 0;
+    }
+    strLen = (size_t)be(p, strHead);
+  }
+  if (left - strHead < strLen) {
+    return 0;
+  }
+  return out.add(key, (const char *)p + strHead, strLen) ? 1 + strHead + strLen : 0;
+}
+
+}  // namespace detail
+
+// Writes the members of a frame into out (an object the caller opened),
+// nested as the dictionary says. False when frame and dictionary disagree.
+inline bool expand(const Frame &frame, const uint8_t *dict, size_t dictLen, payload::PayloadSink &out) {
+  size_t at = 0;
+  for (size_t d = 0; d < dictLen;) {
+    uint8_t t = dict[d++];
+    if (t == kEnd) {
+      if (!out.endObject()) {
+        return false;
+      }
+      continue;
+    }
+    const char *key = (const char *)dict + d;
+    d += strnlen(key, dictLen - d) + 1;
+    if (d > dictLen) {
+      return false;
+    }
+    if (t == kBegin) {
+      if (!out.beginObject(key)) {
+        return false;
+      }
+      continue;
+    }
+    size_t n = detail::copyValue(frame.values, frame.length, at, key, out);
+    if (t != kMember || n == 0) {
+      return false;
+    }
+    at += n;
+  }
+  return at == frame.length && out.ok();
+}
+
+// The dictionary as it is announced: every member with the index of its value
+// in the frame, nested like the payload.
+inline bool describe(const uint8_t *dict, size_t dictLen, payload::PayloadSink &out) {
+  unsigned int index = 0;
+  for (size_t d = 0; d < dictLen;) {
+    uint8_t t = dict[d++];
+    if (t == kEnd) {
+      out.endObject();
+      continue;
+    }
+    const char *key = (const char *)dict + d;
+    d += strnlen(key, dictLen - d) + 1;
+    if (t == kBegin) {
+      out.beginObject(key);
+    } else {
+      out.add(key, index++);
+    }
+  }
+  return out.ok();
+}
+
+}  // namespace telemetry
+}  // namespace hyphen
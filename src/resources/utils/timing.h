@@ -30,5 +30,30 @@ inline bool timedOut(uint32_t start, uint32_t now, uint32_t timeout) {
   return elapsed(start, now) >= timeout;
 }
 
+// Last, worst and mean of a repeated duration (a signature, a verify), for
+// the cloud variables. The caller measures, in whatever unit it likes.
+class Latency {
+ public:
+  void record(uint32_t duration) {
+    _count++;
+    _last = duration;
+    if (duration > _max) {
+      _max = duration;
+    }
+    _total += duration;
+  }
+
+  uint32_t count() const { return _count; }
+  uint32_t last() const { return _last; }
+  uint32_t max() const { return _max; }
+  uint32_t mean() const { return _count ? (uint32_t)(_total / _count) : 0; }
+
+ private:
+  uint32_t _count = 0;
+  uint32_t _last = 0;
+  uint32_t _max = 0;
+  uint64_t _total = 0;
+};
+
 }  // namespace timing
 }  // namespace hyphen
@@ -249,6 +249,7 @@ void Utils::log(String event, String message)
 }
 
 PayloadStore Utils::storage;
+PayloadArchive Utils::archive;
 
 /**
  * @public
@@ -491,101 +492,14 @@ void Utils::parseSplitReadSerial(String ourReading, size_t paramLength, size_t m
     }
 }
 
-/**
- * @brief
- *
- * Strips the ID from the payload
- *
- * @param String ourReading
- * @return String
- */
-String Utils::removeSensorIdFromPayload(String ourReading)
-{
-    String value = "";
-    boolean progress = false;
-    for (size_t i = 0; i < ourReading.length(); i++)
-    {
-        char c = ourReading.charAt(i);
-        if ((c == '+' || c == '-') && !progress)
-        {
-            progress = true;
-            continue;
-        }
-        else if (!progress)
-        {
-            continue;
-        }
-        value += String(c);
-    }
-    return value;
-}
-
-/**
- * @brief
- *
- * checks the character to determine if it is a valid non-stop character
- *
- * @param char d
- * @return true if this isn't a control character
- */
-bool Utils::notStopCheckChar(char d)
-{
-    return d != '+' && d != '-' && d != '\n' && d != '\0' && d != 13;
-}
-
-/**
- * @brief
- *
- * parses the string from the SDI-12 interface sensors
- *
- * @param String ourReading our string for parsing
- * @param String * values - the array to fill
- * @param size_t maxLength  the max length of the array
- */
-void Utils::splitStringToValues(String ourReading, String *values, size_t maxLength)
-{
-    String cleanedReading = removeSensorIdFromPayload(ourReading);
-    size_t length = cleanedReading.length();
-    size_t index = 0;
-    size_t storageIndex = 0;
-    while (index < length && storageIndex < maxLength)
-    {
-        char c = cleanedReading.charAt(index);
-        if (!notStopCheckChar(c))
-        {
-            index++;
-            continue;
-        }
-        char scale = cleanedReading.charAt(index - 1);
-        String startChar = scale == '+' ? "" : String(scale);
-        String build = startChar;
-        size_t valueLength = 0;
-        while (notStopCheckChar(c))
-        {
-            build += String(c);
-            valueLength++;
-            c = cleanedReading.charAt(index + valueLength);
-        }
-        index += valueLength;
-        values[storageIndex] = build.equals("-") || build.equals("") ? String(FAILED_VALUE) : build;
-        storageIndex++;
-    }
-}
-
-void Utils::fillStringifiedFailedDefaults(String *values, size_t length)
-{
-    for (size_t i = 0; i < length; i++)
-    {
-        values[i] = String(FAILED_VALUE);
-    }
-}
-
 /**
  * @public
  *
  * parseSerial
  *
- * Parses serial strings sent over the serial bus for Meter SDI-12 devices
+ * Parses serial strings sent over the serial bus for Meter SDI-12 devices.
+ * Values the response doesn't carry are stored as FAILED_VALUE; ones that
+ * aren't numbers are skipped.
  *
  * @param String ourReading - the serial details
  * @param size_t paramLength - the number of parameters to parse
@@ -595,33 +509,22 @@ void Utils::fillStringifiedFailedDefaults(String *values, size_t length)
  * @return void
  *
  */
-void Utils::parseSerial(String ourReading, size_t paramLength, size_t max, float value_hold[][Constants::OVERFLOW_VAL])
+void Utils::parseSerial(const String &ourReading, size_t paramLength, size_t max, float value_hold[][Constants::OVERFLOW_VAL])
 {
-    String stringifiedValues[paramLength];
-    fillStringifiedFailedDefaults(stringifiedValues, paramLength);
-    splitStringToValues(ourReading, stringifiedValues, paramLength);
+    float values[Constants::OVERFLOW_VAL];
+    if (paramLength > Constants::OVERFLOW_VAL)
+    {
+        paramLength = Constants::OVERFLOW_VAL;
+    }
+    hyphen::sdi::parseValues(ourReading.c_str(), ourReading.length(), values, paramLength, FAILED_VALUE);
     for (size_t i = 0; i < paramLength; i++)
     {
-        String value = stringifiedValues[i];
-        if (this->invalidNumber(value))
-        {
-            continue;
-        }
-        float storedValue = NO_VALUE;
-        if (this->containsChar('.', value))
-        {
-            storedValue = value.toFloat();
-        }
-        else
-        {
-            storedValue = value.toInt();
-        }
-
-        if (isnan(storedValue))
+        // not a number
+        if (isnan(values[i]))
         {
             continue;
         }
-        insertValue(storedValue, value_hold[i], max);
+        insertValue(values[i], value_hold[i], max);
     }
 }
 
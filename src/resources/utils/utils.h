@@ -9,12 +9,12 @@
 
 #include "resources/utils/constants.h"
 #include "resources/utils/store.h"
+#include "resources/utils/archive.h"
+#include "resources/utils/sdi_response.h"
 class Utils
 {
 private:
-    String removeSensorIdFromPayload(String);
 
-    bool notStopCheckChar(char);
     const static int FAILED_VALUE = NO_VALUE;
     void fillParseSplitReadSerial(String ourReading, size_t paramLength, size_t max, String nameMap[], float value_hold[][Constants::OVERFLOW_VAL]);
 
@@ -22,8 +22,8 @@ public:
     ~Utils();
     Utils();
     static PayloadStore storage;
+    static PayloadArchive archive;
     static void reboot();
-    void splitStringToValues(String, String *, size_t);
     static double parseCloudFunctionDouble(String value, String name);
     static int parseCloudFunctionInteger(String value, String name);
     static void setDebug(bool debug);
@@ -34,7 +34,7 @@ public:
     String requestDeviceId(int identity, String cmd);
     bool serialMessageHasError(String message, int identity);
     String receiveDeviceId(int identity);
-    void parseSerial(String ourReading, size_t paramLength, size_t max, float value_hold[][Constants::OVERFLOW_VAL]);
+    void parseSerial(const String &ourReading, size_t paramLength, size_t max, float value_hold[][Constants::OVERFLOW_VAL]);
     void parseSplitReadSerial(String, size_t, size_t, String[], float value_hold[][Constants::OVERFLOW_VAL]);
     bool invalidNumber(String value);
     bool containsChar(char c, String readFrom);
@@ -53,7 +53,6 @@ public:
     float getMedian(float arr[], size_t max);
     long getMedian(long readparam, long arr[]);
     uint32_t getMedian(int readparam, uint32_t arr[]);
-    void fillStringifiedFailedDefaults(String *, size_t);
     static bool connected();
     static void machineNameDirect(String name, byte *save);
     static String machineToReadableName(byte *restore);
@@ -0,0 +1,146 @@
+// write_policy.h — group commit policy and throughput stats for the SD writer.
+//
+// Every SD append used to open the file (a FAT directory lookup), seek to the
+// end (a cluster-chain walk), write one line or frame and close it again, so a
+// flush of ten log lines cost ten full open/close cycles. SDWriter
+// (system/sd-writer.h) keeps hot files open and gathers appends in
+// sector-aligned buffers instead. How often those buffers are committed (written
+// out and synced) is decided here:
+//
+//     maxRecords  commit once this many appends are pending (0 = no limit)
+//     maxAgeMs    commit once the oldest pending append is this old (0 = no limit)
+//
+// plus an explicit commit on a power-fail warning, which the caller issues.
+// Setting both limits to 1/0 gives the old write-through behaviour.
+//
+// Pure and clock-free like timing.h, unit-tested on the host (see
+// test_write_policy).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "resources/utils/timing.h"
+
+namespace hyphen {
+namespace sdwriter {
+
+const size_t kSectorSize = 512;
+
+// Buffer capacity rounded up to whole sectors (at least one).
+inline size_t alignedCapacity(size_t bytes) {
+  size_t sectors = (bytes + kSectorSize - 1) / kSectorSize;
+  return (sectors == 0 ? 1 : sectors) * kSectorSize;
+}
+
+struct CommitPolicy {
+  uint16_t maxRecords = 16;
+  uint32_t maxAgeMs = 5000;
+};
+
+// Tracks the appends waiting for a commit.
+class GroupCommit {
+ public:
+  explicit GroupCommit(const CommitPolicy &policy) : _policy(policy) {}
+
+  void onAppend(uint32_t now) {
+    if (_pending == 0) {
+      _oldest = now;
+    }
+    if (_pending < UINT16_MAX) {
+      _pending++;
+    }
+  }
+
+  bool due(uint32_t now) const {
+    if (_pending == 0) {
+      return false;
+    }
+    if (_policy.maxRecords > 0 && _pending >= _policy.maxRecords) {
+      return true;
+    }
+    return _policy.maxAgeMs > 0 && timing::timedOut(_oldest, now, _policy.maxAgeMs);
+  }
+
+  void onCommit() { _pending = 0; }
+  uint16_t pending() const { return _pending; }
+
+ private:
+  CommitPolicy _policy;
+  uint16_t _pending = 0;
+  uint32_t _oldest = 0;
+};
+
+// Bytes written, sync latency and appends that found the bus busy. Throughput is measured over a rolling
+// window so a burst after a long idle period doesn't read as 0 B/s.
+class WriteStats {
+ public:
+  explicit WriteStats(uint32_t windowMs = 10000) : _windowMs(windowMs) {}
+
+  void onWrite(size_t bytes, uint32_t now) {
+    if (!_started) {
+      _started = true;
+      _windowStart = now;
+    }
+    rollWindow(now);
+    _totalBytes += bytes;
+    _windowBytes += bytes;
+  }
+
+  void onSync(uint32_t latencyMs) {
+    _syncs++;
+    _syncTotalMs += latencyMs;
+    if (_syncs == 1 || latencyMs < _syncMinMs) {
+      _syncMinMs = latencyMs;
+    }
+    if (latencyMs > _syncMaxMs) {
+      _syncMaxMs = latencyMs;
+    }
+  }
+
+  // An append that gave up waiting for the bus.
+  void onBusy() { _busy++; }
+
+  // Bytes per second over the current window (the last full one when the
+  // current window has barely started).
+  uint32_t bytesPerSecond(uint32_t now) const {
+    uint32_t span = timing::elapsed(_windowStart, now);
+    if (!_started || span < 1000) {
+      return _lastRate;
+    }
+    return (uint32_t)((uint64_t)_windowBytes * 1000 / span);
+  }
+
+  uint64_t totalBytes() const { return _totalBytes; }
+  uint32_t syncs() const { return _syncs; }
+  uint32_t syncMinMs() const { return _syncMinMs; }
+  uint32_t syncMaxMs() const { return _syncMaxMs; }
+  uint32_t syncMeanMs() const { return _syncs == 0 ? 0 : (uint32_t)(_syncTotalMs / _syncs); }
+  uint32_t busy() const { return _busy; }
+
+ private:
+  uint32_t _windowMs;
+  bool _started = false;
+  uint32_t _windowStart = 0;
+  uint64_t _windowBytes = 0;
+  uint32_t _lastRate = 0;
+  uint64_t _totalBytes = 0;
+  uint32_t _syncs = 0;
+  uint64_t _syncTotalMs = 0;
+  uint32_t _syncMinMs = 0;
+  uint32_t _syncMaxMs = 0;
+  uint32_t _busy = 0;
+
+  void rollWindow(uint32_t now) {
+    uint32_t span = timing::elapsed(_windowStart, now);
+    if (span < _windowMs) {
+      return;
+    }
+    _lastRate = (uint32_t)((uint64_t)_windowBytes * 1000 / span);
+    _windowStart = now;
+    _windowBytes = 0;
+  }
+};
+
+}  // namespace sdwriter
+}  // namespace hyphen
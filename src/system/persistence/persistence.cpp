@@ -1,21 +1,62 @@
 #include "system/persistence.h"
+#include "resources/utils/timing.h"
+#include <esp_system.h>
+
+Persistence *Persistence::instances = nullptr;
+bool Persistence::shutdownHandlerSet = false;
+
 Persistence::Persistence(const char *namespaceName)
-    : namespaceName(namespaceName) {}
+    : namespaceName(namespaceName), nvs(*this), cache(nvs)
+{
+    mutex = xSemaphoreCreateMutex();
+    nextInstance = instances;
+    instances = this;
+}
+
+Persistence::~Persistence()
+{
+    end();
+    for (Persistence **p = &instances; *p; p = &(*p)->nextInstance)
+    {
+        if (*p == this)
+        {
+            *p = nextInstance;
+            break;
+        }
+    }
+}
 
 bool Persistence::begin()
 {
-    return preferences.begin(namespaceName, false);
+    return begin(namespaceName);
 }
 
+/**
+ * Opens (or switches to) a namespace and keeps it open. Keys cached for
+ * another namespace are written out first.
+ */
 bool Persistence::begin(const char *namespaceName)
 {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (isOpen && strcmp(this->namespaceName, namespaceName) != 0)
+    {
+        flushLocked();
+        cache.drop();
+        closePreferences();
+    }
     this->namespaceName = namespaceName;
-    return preferences.begin(namespaceName, false);
+    openPreferences();
+    bool open = isOpen;
+    xSemaphoreGive(mutex);
+    return open;
 }
 
 void Persistence::end()
 {
-    preferences.end();
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    flushLocked();
+    closePreferences();
+    xSemaphoreGive(mutex);
 }
 
 void Persistence::openPreferences()
@@ -24,8 +65,7 @@ void Persistence::openPreferences()
     {
         return;
     }
-    preferences.begin(namespaceName, false);
-    isOpen = true;
+    isOpen = preferences.begin(namespaceName, false);
 }
 
 void Persistence::closePreferences()
@@ -40,12 +80,136 @@ void Persistence::closePreferences()
 
 void Persistence::clear()
 {
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    cache.drop();
     openPreferences();
     preferences.clear();
-    closePreferences();
+    xSemaphoreGive(mutex);
 }
 
 String Persistence::keyToString(uint16_t key)
 {
     return String(key);
-}
\ No newline at end of file
+}
+
+bool Persistence::putBytes(const char *key, const void *data, size_t len, bool now)
+{
+    if (!shutdownHandlerSet)
+    {
+        shutdownHandlerSet = esp_register_shutdown_handler(&Persistence::shutdownHandler) == ESP_OK;
+    }
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool clean = cache.dirty() == 0;
+    bool stored = cache.put(key, data, len);
+    if (stored && now)
+    {
+        stored = cache.flush(key);
+    }
+    if (clean && cache.dirty() > 0)
+    {
+        dirtySince = millis();
+    }
+    writeGauge = cache.totalWrites();
+    xSemaphoreGive(mutex);
+    return stored;
+}
+
+bool Persistence::getBytes(const char *key, void *out, size_t len)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    bool found = cache.get(key, out, len);
+    xSemaphoreGive(mutex);
+    return found;
+}
+
+size_t Persistence::flushLocked()
+{
+    if (cache.dirty() == 0)
+    {
+        return 0;
+    }
+    size_t written = cache.flush();
+    writeGauge = cache.totalWrites();
+    // whatever failed gets another interval
+    dirtySince = millis();
+    return written;
+}
+
+size_t Persistence::flush()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    size_t written = flushLocked();
+    xSemaphoreGive(mutex);
+    return written;
+}
+
+/**
+ * Called from the main loop: writes out each instance's dirty keys once
+ * PERSIST_FLUSH_INTERVAL_MS passed since the first of them was put.
+ */
+void Persistence::loop()
+{
+    for (Persistence *p = instances; p; p = p->nextInstance)
+    {
+        if (p->cache.dirty() > 0 && hyphen::timing::timedOut(p->dirtySince, millis(), PERSIST_FLUSH_INTERVAL_MS))
+        {
+            p->flush();
+        }
+    }
+}
+
+/**
+ * Runs on esp_restart(): nothing put before a planned reboot is lost. A
+ * power cut or a panic loses at most one flush interval.
+ */
+void Persistence::shutdownHandler()
+{
+    for (Persistence *p = instances; p; p = p->nextInstance)
+    {
+        // never block the restart on a task that died holding the lock
+        if (xSemaphoreTake(p->mutex, pdMS_TO_TICKS(100)) == pdTRUE)
+        {
+            p->flushLocked();
+            xSemaphoreGive(p->mutex);
+        }
+    }
+}
+
+uint32_t Persistence::writes(const char *key)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t count = cache.writes(key);
+    xSemaphoreGive(mutex);
+    return count;
+}
+
+void Persistence::printWrites()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    Serial.printf("NVS writes in %s: %lu, %u dirty\n", namespaceName, (unsigned long)cache.totalWrites(), (unsigned)cache.dirty());
+    cache.eachKey([](const char *key, uint32_t writes)
+                  { Serial.printf("  %s: %lu\n", key, (unsigned long)writes); });
+    xSemaphoreGive(mutex);
+}
+
+long Persistence::Nvs::length(const char *key)
+{
+    owner.openPreferences();
+    if (!owner.isOpen || !owner.preferences.isKey(key))
+    {
+        return -1;
+    }
+    return owner.preferences.getBytesLength(key);
+}
+
+size_t Persistence::Nvs::read(const char *key, void *out, size_t len)
+{
+    owner.openPreferences();
+    return owner.isOpen ? owner.preferences.getBytes(key, out, len) : 0;
+}
+
+bool Persistence::Nvs::write(const char *key, const void *data, size_t len)
+{
+    owner.openPreferences();
+    return owner.isOpen && owner.preferences.putBytes(key, data, len) == len;
+}
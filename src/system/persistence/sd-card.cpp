@@ -1,11 +1,15 @@
 // SDCard.cpp
 #include "system/sd-card.h"
+#include <esp_system.h>
 
 SemaphoreHandle_t SDCard::spiMutex = nullptr;
+QueueHandle_t SDCard::jobQueue = nullptr;
+TaskHandle_t SDCard::workerHandle = nullptr;
 SDCard *g_sdcardInstance = nullptr; // For ISR to reference
 
 SDCard::SDCard()
-    : _cardPresent(false),
+    : sdWriter(*this),
+      _cardPresent(false),
       _lastDebounce(0),
       _pendingEvent(false)
 {
@@ -39,12 +43,25 @@ bool SDCard::exists(const String &path)
     return ok;
 }
 
+bool SDCard::remove(const String &path)
+{
+    if (!init())
+        return false;
+
+    xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.release(path);
+    bool ok = !sd.exists(path.c_str()) || sd.remove(path.c_str());
+    xSemaphoreGive(spiMutex);
+    return ok;
+}
+
 uint64_t SDCard::fileSize(const String &path)
 {
     if (!init())
         return 0;
 
     xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.settle(path);
 
     SdFile file;
     uint64_t size = 0;
@@ -90,9 +107,21 @@ bool SDCard::init()
     }
 
     initialized = true;
+    if (!shutdownHandlerSet)
+    {
+        shutdownHandlerSet = esp_register_shutdown_handler(SDCard::shutdownHandler) == ESP_OK;
+    }
     return true;
 }
 
+void SDCard::shutdownHandler()
+{
+    if (g_sdcardInstance)
+    {
+        g_sdcardInstance->sdWriter.powerFail();
+    }
+}
+
 bool SDCard::ready()
 {
     // True if card is inserted AND we have successfully called init()
@@ -105,6 +134,7 @@ uint32_t SDCard::countLines(const String &path, unsigned long startPos)
         return 0;
 
     xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.settle(path);
 
     SdFile file;
     uint32_t count = 0;
@@ -144,16 +174,23 @@ String SDCard::read(const String &path, unsigned long &startPoint, char terminat
         return result;
 
     xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.settle(path);
     SdFile file;
-    if (file.open(path.c_str(), O_READ) && file.seekSet(startPoint))
+    if (file.open(path.c_str(), O_READ))
     {
-        int c;
-        while ((c = file.read()) >= 0)
+        if (file.seekSet(startPoint))
         {
-            startPoint++;
-            if (c == terminatingChar)
-                break;
-            result += char(c);
+            char buf[128];
+            int n;
+            while ((n = file.read(buf, sizeof(buf))) > 0)
+            {
+                const char *hit = (const char *)memchr(buf, terminatingChar, n);
+                size_t take = hit ? hit - buf : n;
+                result.concat(buf, take);
+                startPoint += hit ? take + 1 : take;
+                if (hit)
+                    break;
+            }
         }
         file.close();
     }
@@ -161,12 +198,63 @@ String SDCard::read(const String &path, unsigned long &startPoint, char terminat
     return result;
 }
 
+// -------------------------------------------------------------
+//  SharedFile: the handle behind SDReader
+// -------------------------------------------------------------
+bool SDCard::SharedFile::open(const char *name, int flags)
+{
+    if (!g_sdcardInstance || !g_sdcardInstance->init())
+        return false;
+
+    xSemaphoreTake(spiMutex, portMAX_DELAY);
+    path = name;
+    g_sdcardInstance->sdWriter.settle(path);
+    bool ok = file.open(name, flags);
+    xSemaphoreGive(spiMutex);
+    return ok;
+}
+
+int SDCard::SharedFile::read(void *buf, size_t len)
+{
+    xSemaphoreTake(spiMutex, portMAX_DELAY);
+    g_sdcardInstance->sdWriter.settle(path);
+    int n = file.read(buf, len);
+    if (n == 0)
+    {
+        // SdFat caches the size at open, so bytes appended through another
+        // handle since then only show up once the file is reopened
+        uint64_t pos = file.curPosition();
+        file.close();
+        if (file.open(path.c_str(), O_READ) && file.seekSet(pos))
+            n = file.read(buf, len);
+    }
+    xSemaphoreGive(spiMutex);
+    return n;
+}
+
+bool SDCard::SharedFile::seekSet(uint64_t pos)
+{
+    xSemaphoreTake(spiMutex, portMAX_DELAY);
+    bool ok = file.seekSet(pos);
+    xSemaphoreGive(spiMutex);
+    return ok;
+}
+
+bool SDCard::SharedFile::close()
+{
+    xSemaphoreTake(spiMutex, portMAX_DELAY);
+    bool ok = file.close();
+    xSemaphoreGive(spiMutex);
+    return ok;
+}
+
 bool SDCard::overwrite(const char *path, const char *newContent)
 {
     if (!init())
         return false;
 
     xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.release(path);
     SdFile file;
     bool ok = file.open(path, O_WRONLY | O_CREAT | O_TRUNC);
     if (ok)
@@ -184,6 +272,7 @@ uint64_t SDCard::appendln(const String &path, const String &message)
         return 0;
 
     xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.release(path);
     SdFile file;
     uint64_t size = 0;
     if (file.open(path.c_str(), O_RDWR | O_CREAT | O_AT_END))
@@ -196,6 +285,69 @@ uint64_t SDCard::appendln(const String &path, const String &message)
     return size;
 }
 
+uint64_t SDCard::append(const String &path, const uint8_t *data, size_t len)
+{
+    if (!init())
+        return 0;
+
+    xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.release(path);
+    SdFile file;
+    uint64_t size = 0;
+    if (file.open(path.c_str(), O_RDWR | O_CREAT | O_AT_END))
+    {
+        // a short write leaves a torn frame behind; report failure so the
+        // caller doesn't count it, the reader will skip it by its CRC
+        if (file.write(data, len) == len)
+        {
+            size = file.fileSize();
+        }
+        file.close();
+    }
+    xSemaphoreGive(spiMutex);
+    return size;
+}
+
+bool SDCard::writeAt(const String &path, uint64_t offset, const uint8_t *data, size_t len)
+{
+    if (!init())
+        return false;
+
+    xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.release(path);
+    SdFile file;
+    bool ok = false;
+    if (file.open(path.c_str(), O_RDWR | O_CREAT))
+    {
+        ok = file.seekSet(offset) && file.write(data, len) == len;
+        file.close();
+    }
+    xSemaphoreGive(spiMutex);
+    return ok;
+}
+
+size_t SDCard::readBytes(const String &path, uint64_t offset, uint8_t *buf, size_t len)
+{
+    if (!init())
+        return 0;
+
+    xSemaphoreTake(spiMutex, portMAX_DELAY);
+    sdWriter.settle(path);
+    SdFile file;
+    size_t read = 0;
+    if (file.open(path.c_str(), O_READ))
+    {
+        if (file.seekSet(offset))
+        {
+            int n = file.read(buf, len);
+            read = n > 0 ? (size_t)n : 0;
+        }
+        file.close();
+    }
+    xSemaphoreGive(spiMutex);
+    return read;
+}
+
 void SDCard::bridgeSpi()
 {
     if (!spiMutex)
@@ -260,359 +412,168 @@ void SDCard::handleCardDetectEvent()
     {
         // Card was just removed
         Serial.println("SD: Card Removed → deinitializing...");
-        // If you want to clean up, close any open files:
-        // sd.closeAll();
+        xSemaphoreTake(spiMutex, portMAX_DELAY);
+        sdWriter.drop();
+        xSemaphoreGive(spiMutex);
         initialized = false;
     }
 }
-// // Static members
-// SemaphoreHandle_t SDCard::spiMutex = nullptr;
-// QueueHandle_t SDCard::jobQueue = nullptr;
-
-// SDCard::SDCard()
-// {
-//     // Create SPI mutex once
-//     if (!spiMutex)
-//     {
-//         spiMutex = xSemaphoreCreateMutex();
-//     }
-//     // Create job queue and worker task once
-//     if (!jobQueue)
-//     {
-//         jobQueue = xQueueCreate(JOB_QUEUE_LENGTH, sizeof(SDJob));
-//         // xTaskCreatePinnedToCore(
-//         //     workerTask, "SDWorker", 4096, nullptr, tskIDLE_PRIORITY + 1, nullptr, 1);
-//     }
-//     pinMode(cdPin, INPUT_PULLUP);
-// }
-
-// SDCard::~SDCard()
-// {
-//     // Nothing to clean up (tasks/queues live for app lifetime)
-// }
-
-// bool SDCard::guardedBegin()
-// {
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SPI.begin();
-//     bool ok = sd.begin(chipSelect, SD_SCK_MHZ(18));
-//     xSemaphoreGive(spiMutex);
-//     return ok;
-// }
-
-// bool SDCard::sdCardPresent()
-// {
-//     return digitalRead(cdPin) == LOW;
-// }
-
-// bool SDCard::init()
-// {
-//     if (initialized)
-//         return true;
-//     if (!sdCardPresent())
-//         return false;
-//     initialized = guardedBegin();
-//     return initialized;
-// }
-
-// bool SDCard::ready() const
-// {
-//     return digitalRead(cdPin) == LOW && initialized;
-// }
-
-// String SDCard::read(const String &path, unsigned long &startPoint, char terminatingChar)
-// {
-//     String result;
-//     if (!init())
-//         return result;
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SdFile file;
-//     if (file.open(path.c_str(), O_READ) && file.seekSet(startPoint))
-//     {
-//         int c;
-//         while ((c = file.read()) >= 0)
-//         {
-//             startPoint++;
-//             if (c == terminatingChar)
-//                 break;
-//             result += char(c);
-//         }
-//         file.close();
-//     }
-//     xSemaphoreGive(spiMutex);
-//     return result;
-// }
-
-// bool SDCard::overwrite(const char *path, const char *newContent)
-// {
-//     if (!init())
-//         return false;
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SdFile file;
-//     bool ok = file.open(path, O_WRONLY | O_CREAT | O_TRUNC);
-//     if (ok)
-//     {
-//         file.print(newContent);
-//         file.close();
-//     }
-//     xSemaphoreGive(spiMutex);
-//     return ok;
-// }
-
-// uint64_t SDCard::appendln(const String &path, const String &message)
-// {
-//     if (!init())
-//         return 0;
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SdFile file;
-//     uint64_t size = 0;
-//     if (file.open(path.c_str(), O_RDWR | O_CREAT | O_AT_END))
-//     {
-//         file.println(message);
-//         size = file.fileSize();
-//         file.close();
-//     }
-//     xSemaphoreGive(spiMutex);
-//     return size;
-// }
-
-// bool SDCard::appendlnAsync(const String &path, const String &message, uint64_t maxBytes)
-// {
-//     if (!init())
-//         return false;
-//     // Allocate job
-//     SDJob job;
-//     job.path = strdup(path.c_str());
-//     job.message = strdup(message.c_str());
-//     job.maxBytes = maxBytes;
-//     // Enqueue (fail if full)
-//     return xQueueSend(jobQueue, &job, 0) == pdTRUE;
-// }
-
-// void SDCard::bridgeSpi()
-// {
-//     if (!spiMutex)
-//         return;
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SPI.begin();
-//     SPI.beginTransaction(SPISettings(4'000'000, MSBFIRST, SPI_MODE0));
-//     SPI.endTransaction();
-//     xSemaphoreGive(spiMutex);
-// }
-
-// void SDCard::workerTask(void *pv)
-// {
-//     SDJob job;
-//     SDCard sd; // local helper
-//     while (true)
-//     {
-//         if (xQueueReceive(jobQueue, &job, portMAX_DELAY) == pdTRUE)
-//         {
-//             // Perform appendln
-//             if (sd.init())
-//             {
-//                 uint32_t length = sd.appendln(job.path, job.message);
-//                 if (job.maxBytes && length > job.maxBytes)
-//                 {
-//                     sd.overwrite(job.path, job.message); // or trim logic
-//                 }
-//             }
-//             // Free job memory
-//             free(job.path);
-//             free(job.message);
-//         }
-//         // vTaskDelay(pdMS_TO_TICKS(10)); // Yield to other tasks
-//         taskYIELD();
-//     }
-// }
-// #include "system/sd-card.h"
-
-// // static mutex instance
-// SemaphoreHandle_t SDCard::spiMutex = nullptr;
-
-// SDCard::SDCard()
-// {
-//     // create the mutex once
-//     if (!spiMutex)
-//     {
-//         spiMutex = xSemaphoreCreateMutex();
-//     }
-//     pinMode(cdPin, INPUT_PULLUP);
-// }
-
-// SDCard::~SDCard()
-// {
-//     // no cleanup needed
-// }
-
-// bool SDCard::guardedBegin()
-// {
-//     // lock SPI bus
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     // ensure SPI peripheral is up
-//     SPI.begin();
-//     // initialize at 18 MHz
-//     bool ok = sd.begin(chipSelect, SD_SCK_MHZ(18));
-//     xSemaphoreGive(spiMutex);
-//     return ok;
-// }
-
-// bool SDCard::init()
-// {
-//     initialized = false;
-//     if (!sdCardPresent())
-//     {
-//         return false;
-//     }
-//     initialized = guardedBegin();
-//     if (!initialized)
-//     {
-//         Serial.println("SD card initialization failed!");
-//     }
-//     return initialized;
-// }
-
-// bool SDCard::ready()
-// {
-//     // card present && (already init OR init now)
-//     return sdCardPresent() && (initialized || init());
-// }
-
-// bool SDCard::sdCardPresent()
-// {
-//     return digitalRead(cdPin) == LOW;
-// }
-
-// void SDCard::bridgeSpi()
-// {
-//     // quick SPI wake-up
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SPI.begin();
-//     SPI.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
-//     SPI.endTransaction();
-//     xSemaphoreGive(spiMutex);
-// }
-
-// String SDCard::read(String path, unsigned long &startPoint, char term)
-// {
-//     String result;
-//     if (!ready())
-//         return result;
-
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SdFile file;
-//     if (!file.open(path.c_str(), O_READ) || !file.seekSet(startPoint))
-//     {
-//         initialized = false;
-//         file.close();
-//         xSemaphoreGive(spiMutex);
-//         return result;
-//     }
-
-//     int c;
-//     while ((c = file.read()) >= 0)
-//     {
-//         startPoint++;
-//         if (c == term)
-//             break;
-//         result += char(c);
-//     }
-//     file.close();
-//     xSemaphoreGive(spiMutex);
-//     return result;
-// }
-
-// void SDCard::overwrite(const char *path, const char *newContent)
-// {
-//     if (!ready())
-//         return;
-
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SdFile file;
-//     if (!file.open(path, O_WRONLY | O_CREAT | O_TRUNC))
-//     {
-//         initialized = false;
-//         Serial.println("Failed to open file for overwriting");
-//         xSemaphoreGive(spiMutex);
-//         return;
-//     }
-//     file.print(newContent);
-//     file.close();
-//     xSemaphoreGive(spiMutex);
-// }
-
-// uint32_t SDCard::append(String path, String message, bool appendNewLine)
-// {
-//     if (!ready())
-//         return 0;
-
-//     xSemaphoreTake(spiMutex, portMAX_DELAY);
-//     SdFile file;
-//     if (!file.open(path.c_str(), O_RDWR | O_CREAT | O_AT_END))
-//     {
-//         initialized = false;
-//         Serial.println("Failed to open file for writing");
-//         xSemaphoreGive(spiMutex);
-//         return 0;
-//     }
-//     size_t written = appendNewLine ? file.println(message) : file.print(message);
-//     uint32_t size = file.fileSize();
-//     file.close();
-//     xSemaphoreGive(spiMutex);
-//     return size;
-// }
-
-// uint32_t SDCard::append(String path, String message)
-// {
-//     return append(path, message, true);
-// }
-
-// uint32_t SDCard::appendln(String path, String message)
-// {
-//     return append(path, message, true);
-// }
-
-// // Background append task
-
-// void SDCard::appendlnTask(void *parameter)
-// {
-
-//     auto params = static_cast<char **>(parameter);
-//     SDCard sd;
-//     if (sd.init())
-//     {
-//         // Serial.printf("Appending to %s: %s\n", params[0], params[1]);
-//         uint32_t length = sd.appendln(params[0], params[1]);
-//         if (!String(params[2]).equals("0"))
-//         {
-//             uint32_t maxBytes = atoi(params[2]);
-//             if (length > maxBytes)
-//                 sd.overwrite(params[0], params[2]);
-//         }
-//     }
-//     // clean up malloc’d memory
-//     free(params[0]);
-//     free(params[1]);
-//     free(params[2]);
-//     delete[] params;
-//     vTaskDelete(NULL);
-// }
-
-// void SDCard::appendlnAsync(String path, String message, uint32_t maxBytes)
-// {
-//     // allocate C-strings array
-//     const char **params = new const char *[3];
-//     params[0] = strdup(path.c_str());
-//     params[1] = strdup(message.c_str());
-//     params[2] = strdup(maxBytes ? String(maxBytes).c_str() : "0");
-
-//     xTaskCreatePinnedToCore(
-//         SDCard::appendlnTask,
-//         "AppendlnTask",
-//         4096,
-//         params,
-//         tskIDLE_PRIORITY + 1,
-//         nullptr,
-//         1 // run on core 1
-//     );
-// }
\ No newline at end of file
+
+// -------------------------------------------------------------
+//  SD worker task
+// -------------------------------------------------------------
+
+bool SDCard::startWorker()
+{
+    if (jobQueue)
+        return true;
+
+    jobQueue = xQueueCreate(SD_JOB_QUEUE_LENGTH, sizeof(SDJob));
+    if (!jobQueue)
+        return false;
+
+    if (xTaskCreatePinnedToCore(
+            SDCard::workerTask,
+            "SDWorker",
+            4096,
+            this,
+            tskIDLE_PRIORITY + 1,
+            &workerHandle,
+            1 // run on core 1
+            ) != pdPASS)
+    {
+        vQueueDelete(jobQueue);
+        jobQueue = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool SDCard::enqueue(SDJob &job)
+{
+    if (!startWorker() || xQueueSend(jobQueue, &job, 0) != pdTRUE)
+    {
+        jobsDropped++;
+        hyphen::sdjobs::discard(job);
+        return false;
+    }
+    return true;
+}
+
+uint32_t SDCard::pendingJobs()
+{
+    return jobQueue ? uxQueueMessagesWaiting(jobQueue) : 0;
+}
+
+bool SDCard::idle(uint32_t waitMs)
+{
+    if (pendingJobs() > 0)
+        return false;
+    if (!spiMutex)
+        return true;
+    // a job or another task is on the bus, a sync may take a while
+    if (xSemaphoreTake(spiMutex, pdMS_TO_TICKS(waitMs)) != pdTRUE)
+        return false;
+    xSemaphoreGive(spiMutex);
+    return true;
+}
+
+void SDCard::runJob(SDJob &job)
+{
+    SDResult result;
+    if (job.op == hyphen::sdjobs::OP_COMMIT)
+    {
+        commitQueued = false;
+        result.ok = sdWriter.commit();
+    }
+    else if (init())
+    {
+        xSemaphoreTake(spiMutex, portMAX_DELAY);
+        // a job sees (and never races) the writer's buffered appends
+        if (job.op == hyphen::sdjobs::OP_READ)
+        {
+            sdWriter.settle(job.path);
+        }
+        else
+        {
+            sdWriter.release(job.path);
+        }
+        result = hyphen::sdjobs::execute(job);
+        xSemaphoreGive(spiMutex);
+    }
+    hyphen::sdjobs::finish(job, result);
+}
+
+void SDCard::workerTask(void *param)
+{
+    SDCard *card = static_cast<SDCard *>(param);
+    SDJob job;
+    while (true)
+    {
+        if (xQueueReceive(jobQueue, &job, portMAX_DELAY) == pdTRUE)
+        {
+            card->runJob(job);
+        }
+    }
+}
+
+bool SDCard::appendAsync(const String &path, const uint8_t *data, size_t len, uint64_t maxBytes,
+                         SDCallback callback, void *context, SDFuture *future)
+{
+    SDJob job = hyphen::sdjobs::make(hyphen::sdjobs::OP_APPEND, path.c_str(), data, len);
+    job.maxBytes = maxBytes;
+    job.callback = callback;
+    job.context = context;
+    job.future = future;
+    return enqueue(job);
+}
+
+bool SDCard::appendlnAsync(const String &path, const String &message, uint64_t maxBytes)
+{
+    String line = message + "\r\n";
+    return appendAsync(path, (const uint8_t *)line.c_str(), line.length(), maxBytes);
+}
+
+bool SDCard::readAsync(const String &path, uint64_t offset, size_t len,
+                       SDCallback callback, void *context, SDFuture *future)
+{
+    SDJob job = hyphen::sdjobs::make(hyphen::sdjobs::OP_READ, path.c_str());
+    job.len = len;
+    job.offset = offset;
+    job.callback = callback;
+    job.context = context;
+    job.future = future;
+    return enqueue(job);
+}
+
+bool SDCard::overwriteAsync(const String &path, const String &content,
+                            SDCallback callback, void *context, SDFuture *future)
+{
+    SDJob job = hyphen::sdjobs::make(hyphen::sdjobs::OP_OVERWRITE, path.c_str(),
+                                     (const uint8_t *)content.c_str(), content.length());
+    job.callback = callback;
+    job.context = context;
+    job.future = future;
+    return enqueue(job);
+}
+
+bool SDCard::removeAsync(const String &path)
+{
+    SDJob job = hyphen::sdjobs::make(hyphen::sdjobs::OP_REMOVE, path.c_str());
+    return enqueue(job);
+}
+
+bool SDCard::commitAsync()
+{
+    // one pending commit covers every append before it
+    if (commitQueued.exchange(true))
+        return true;
+
+    SDJob job = hyphen::sdjobs::make(hyphen::sdjobs::OP_COMMIT, nullptr);
+    if (!enqueue(job))
+    {
+        commitQueued = false;
+        return false;
+    }
+    return true;
+}
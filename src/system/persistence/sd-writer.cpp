@@ -0,0 +1,379 @@
+// SDWriter.cpp
+#include "system/sd-writer.h"
+#include "system/sd-card.h"
+#include <ArduinoLog.h>
+
+SDWriter::SDWriter(SDCard &card)
+    : card(card)
+{
+    policy.maxRecords = SD_COMMIT_MAX_RECORDS;
+    policy.maxAgeMs = SD_COMMIT_MAX_AGE_MS;
+    group = hyphen::sdwriter::GroupCommit(policy);
+}
+
+SDWriter::~SDWriter()
+{
+    for (uint8_t i = 0; i < MAX_HOT_FILES; i++)
+    {
+        delete[] hot[i].buffer;
+    }
+}
+
+void SDWriter::setPolicy(const hyphen::sdwriter::CommitPolicy &policy)
+{
+    this->policy = policy;
+    group = hyphen::sdwriter::GroupCommit(policy);
+}
+
+void SDWriter::onCommit(CommitHook hook, void *context)
+{
+    for (uint8_t i = 0; i < MAX_HOOKS; i++)
+    {
+        if (hooks[i] == nullptr || (hooks[i] == hook && hookContext[i] == context))
+        {
+            hooks[i] = hook;
+            hookContext[i] = context;
+            return;
+        }
+    }
+    Log.errorln("SDWriter: no room for another commit hook");
+}
+
+uint64_t SDWriter::append(const String &path, const uint8_t *data, size_t len, TickType_t wait)
+{
+    if (!card.init())
+        return 0;
+
+    if (xSemaphoreTake(SDCard::spiMutex, wait) != pdTRUE)
+    {
+        writeStats.onBusy();
+        return 0;
+    }
+    uint64_t size = 0;
+    bool due = false;
+    HotFile *file = acquire(path);
+    if (file)
+    {
+        bool ok = true;
+        if (file->used + len > bufferSize)
+        {
+            ok = writeBuffer(*file);
+        }
+        if (ok && len >= bufferSize)
+        {
+            // bigger than the buffer, straight through
+            size_t written = file->file.write(data, len);
+            ok = written == len;
+            writeStats.onWrite(ok ? len : 0, millis());
+            file->size = ok ? file->size + len : file->file.fileSize();
+        }
+        else if (ok)
+        {
+            memcpy(file->buffer + file->used, data, len);
+            file->used += len;
+        }
+        if (ok)
+        {
+            file->dirty = true;
+            size = file->size + file->used;
+            group.onAppend(millis());
+            due = group.due(millis());
+        }
+    }
+    xSemaphoreGive(SDCard::spiMutex);
+    // the sync runs on the SD worker; with its queue full, loop() queues it
+    // again rather than syncing on the caller's task
+    if (due)
+    {
+        card.commitAsync();
+    }
+    notify();
+    return size;
+}
+
+uint64_t SDWriter::appendln(const String &path, const String &line)
+{
+    String out = line + "\r\n";
+    return append(path, (const uint8_t *)out.c_str(), out.length());
+}
+
+bool SDWriter::setBits(const String &path, uint64_t offset, uint8_t bits)
+{
+    if (!card.init())
+        return false;
+
+    xSemaphoreTake(SDCard::spiMutex, portMAX_DELAY);
+    bool ok = false;
+    HotFile *file = find(path);
+    if (file && offset >= file->size && offset < file->size + file->used)
+    {
+        file->buffer[offset - file->size] |= bits;
+        ok = true;
+    }
+    else if (file)
+    {
+        // the handle appends from file->size on, put it back there
+        uint8_t byte = 0;
+        ok = file->file.seekSet(offset) && file->file.read(&byte, 1) == 1;
+        byte |= bits;
+        ok = ok && file->file.seekSet(offset) && file->file.write(&byte, 1) == 1;
+        ok = file->file.seekSet(file->size) && ok;
+        if (ok)
+        {
+            file->dirty = true;
+            group.onAppend(millis());
+        }
+    }
+    else
+    {
+        SdFile cold;
+        if (cold.open(path.c_str(), O_RDWR))
+        {
+            uint8_t byte = 0;
+            ok = cold.seekSet(offset) && cold.read(&byte, 1) == 1;
+            byte |= bits;
+            ok = ok && cold.seekSet(offset) && cold.write(&byte, 1) == 1;
+            cold.close();
+        }
+    }
+    xSemaphoreGive(SDCard::spiMutex);
+    return ok;
+}
+
+void SDWriter::loop()
+{
+    if (!group.due(millis()))
+        return;
+    card.commitAsync();
+}
+
+bool SDWriter::commit()
+{
+    xSemaphoreTake(SDCard::spiMutex, portMAX_DELAY);
+    bool ok = commitLocked();
+    xSemaphoreGive(SDCard::spiMutex);
+    notify();
+    return ok;
+}
+
+void SDWriter::powerFail()
+{
+    // don't hang a shutdown on a wedged bus
+    if (xSemaphoreTake(SDCard::spiMutex, pdMS_TO_TICKS(1000)) != pdTRUE)
+        return;
+    for (uint8_t i = 0; i < MAX_HOT_FILES; i++)
+    {
+        if (hot[i].open)
+        {
+            syncFile(hot[i]);
+            closeFile(hot[i]);
+        }
+    }
+    group.onCommit();
+    xSemaphoreGive(SDCard::spiMutex);
+    notify();
+}
+
+uint32_t SDWriter::bytesPerSecond()
+{
+    return writeStats.bytesPerSecond(millis());
+}
+
+SDWriter::HotFile *SDWriter::find(const String &path)
+{
+    for (uint8_t i = 0; i < MAX_HOT_FILES; i++)
+    {
+        if (hot[i].open && hot[i].path == path)
+        {
+            return &hot[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Returns the open handle for path, opening it in a free slot or in place
+ * of the least recently used file.
+ */
+SDWriter::HotFile *SDWriter::acquire(const String &path)
+{
+    HotFile *file = find(path);
+    if (!file)
+    {
+        for (uint8_t i = 0; i < MAX_HOT_FILES; i++)
+        {
+            if (!hot[i].open)
+            {
+                file = &hot[i];
+                break;
+            }
+            if (!file || hot[i].lastUse < file->lastUse)
+            {
+                file = &hot[i];
+            }
+        }
+        if (file->open)
+        {
+            syncFile(*file);
+            closeFile(*file);
+        }
+        if (!file->buffer)
+        {
+            file->buffer = new uint8_t[bufferSize];
+        }
+        if (!file->file.open(path.c_str(), O_RDWR | O_CREAT | O_AT_END))
+        {
+            Log.errorln("SDWriter: failed to open %s", path.c_str());
+            return nullptr;
+        }
+        file->path = path;
+        file->size = file->file.fileSize();
+        file->used = 0;
+        file->dirty = false;
+        file->open = true;
+    }
+    file->lastUse = millis();
+    return file;
+}
+
+bool SDWriter::writeBuffer(HotFile &file)
+{
+    if (file.used == 0)
+        return true;
+
+    size_t written = file.file.write(file.buffer, file.used);
+    bool ok = written == file.used;
+    if (!ok)
+    {
+        // a short write leaves a torn frame, readers skip it by its CRC
+        Log.errorln("SDWriter: short write on %s", file.path.c_str());
+        file.size = file.file.fileSize();
+    }
+    else
+    {
+        file.size += written;
+    }
+    writeStats.onWrite(ok ? written : 0, millis());
+    file.used = 0;
+    return ok;
+}
+
+bool SDWriter::syncFile(HotFile &file)
+{
+    if (!file.dirty)
+        return true;
+
+    bool ok = writeBuffer(file);
+    uint32_t start = millis();
+    ok = file.file.sync() && ok;
+    writeStats.onSync(hyphen::timing::elapsed(start, millis()));
+    file.dirty = false;
+    queueNotify(file.path, file.size);
+    return ok;
+}
+
+void SDWriter::closeFile(HotFile &file)
+{
+    file.file.close();
+    file.open = false;
+    file.dirty = false;
+    file.used = 0;
+    file.path = "";
+}
+
+bool SDWriter::commitLocked()
+{
+    bool ok = true;
+    for (uint8_t i = 0; i < MAX_HOT_FILES; i++)
+    {
+        if (hot[i].open)
+        {
+            ok = syncFile(hot[i]) && ok;
+        }
+    }
+    group.onCommit();
+    return ok;
+}
+
+void SDWriter::settle(const String &path)
+{
+    HotFile *file = find(path);
+    if (file)
+    {
+        syncFile(*file);
+    }
+}
+
+void SDWriter::release(const String &path)
+{
+    HotFile *file = find(path);
+    if (file)
+    {
+        syncFile(*file);
+        closeFile(*file);
+    }
+}
+
+void SDWriter::drop()
+{
+    for (uint8_t i = 0; i < MAX_HOT_FILES; i++)
+    {
+        if (hot[i].open)
+        {
+            Log.errorln("SDWriter: card removed, %d buffered bytes of %s lost", hot[i].used, hot[i].path.c_str());
+            hot[i].file.close();
+        }
+        hot[i].open = false;
+        hot[i].dirty = false;
+        hot[i].used = 0;
+        hot[i].path = "";
+    }
+    group.onCommit();
+}
+
+void SDWriter::queueNotify(const String &path, uint64_t size)
+{
+    for (uint8_t i = 0; i < notifyCount; i++)
+    {
+        if (notifyPath[i] == path)
+        {
+            notifySize[i] = size;
+            return;
+        }
+    }
+    if (notifyCount < MAX_NOTIFY)
+    {
+        notifyPath[notifyCount] = path;
+        notifySize[notifyCount] = size;
+        notifyCount++;
+    }
+}
+
+void SDWriter::notify()
+{
+    if (notifyCount == 0)
+        return;
+
+    String paths[MAX_NOTIFY];
+    uint64_t sizes[MAX_NOTIFY];
+    xSemaphoreTake(SDCard::spiMutex, portMAX_DELAY);
+    uint8_t count = notifyCount;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        paths[i] = notifyPath[i];
+        sizes[i] = notifySize[i];
+    }
+    notifyCount = 0;
+    xSemaphoreGive(SDCard::spiMutex);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        for (uint8_t h = 0; h < MAX_HOOKS; h++)
+        {
+            if (hooks[h])
+            {
+                hooks[h](hookContext[h], paths[i], sizes[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,208 @@
+#include "system/crypto-cache.h"
+#include "system/device-security.h"
+#include <mbedtls/error.h>
+#ifdef BOARD_HAS_PSRAM
+#include <esp_heap_caps.h>
+#endif
+
+hyphen::timing::Latency CryptoCache::signLatency;
+hyphen::timing::Latency CryptoCache::verifyLatency;
+unsigned long CryptoCache::signLatencyUs = 0;
+unsigned long CryptoCache::verifyLatencyUs = 0;
+
+static SemaphoreHandle_t s_mutex = nullptr;
+static mbedtls_entropy_context *s_entropy = nullptr;
+static mbedtls_ctr_drbg_context *s_drbg = nullptr;
+static mbedtls_x509_crt *s_cert = nullptr;
+static mbedtls_pk_context *s_key = nullptr;
+static char *s_ca = nullptr;
+
+static void *cacheAlloc_(size_t size)
+{
+#ifdef BOARD_HAS_PSRAM
+    void *p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (p)
+        return p;
+#endif
+    return malloc(size);
+}
+
+static void logMbedError_(const char *what, int ret)
+{
+    char buf[128];
+    mbedtls_strerror(ret, buf, sizeof(buf));
+    Serial.printf("❌ CryptoCache %s failed: %s\n", what, buf);
+}
+
+bool CryptoCache::lock_()
+{
+    static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    s_mutex = mutex;
+    return s_mutex && xSemaphoreTake(s_mutex, portMAX_DELAY) == pdTRUE;
+}
+
+void CryptoCache::unlock_()
+{
+    xSemaphoreGive(s_mutex);
+}
+
+bool CryptoCache::drbgReady_()
+{
+    if (s_drbg)
+        return true;
+
+    mbedtls_entropy_context *entropy = (mbedtls_entropy_context *)cacheAlloc_(sizeof(mbedtls_entropy_context));
+    mbedtls_ctr_drbg_context *drbg = (mbedtls_ctr_drbg_context *)cacheAlloc_(sizeof(mbedtls_ctr_drbg_context));
+    if (!entropy || !drbg)
+    {
+        free(entropy);
+        free(drbg);
+        return false;
+    }
+    mbedtls_entropy_init(entropy);
+    mbedtls_ctr_drbg_init(drbg);
+    const char *pers = "hyphen_device";
+    // the entropy context stays, so the DRBG reseeds itself on schedule
+    int ret = mbedtls_ctr_drbg_seed(drbg, mbedtls_entropy_func, entropy, (const unsigned char *)pers, strlen(pers));
+    if (ret != 0)
+    {
+        logMbedError_("ctr_drbg_seed", ret);
+        mbedtls_ctr_drbg_free(drbg);
+        mbedtls_entropy_free(entropy);
+        free(drbg);
+        free(entropy);
+        return false;
+    }
+    s_entropy = entropy;
+    s_drbg = drbg;
+    return true;
+}
+
+bool CryptoCache::certReady_()
+{
+    if (s_cert)
+        return true;
+
+    mbedtls_x509_crt *cert = (mbedtls_x509_crt *)cacheAlloc_(sizeof(mbedtls_x509_crt));
+    if (!cert)
+        return false;
+    mbedtls_x509_crt_init(cert);
+    const size_t len = (size_t)(_binary_src_certs_device_cert_pem_end - _binary_src_certs_device_cert_pem_start);
+    int ret = mbedtls_x509_crt_parse(cert, _binary_src_certs_device_cert_pem_start, len);
+    if (ret != 0)
+    {
+        logMbedError_("x509_crt_parse", ret);
+        mbedtls_x509_crt_free(cert);
+        free(cert);
+        return false;
+    }
+    s_cert = cert;
+    return true;
+}
+
+bool CryptoCache::keyReady_()
+{
+    if (s_key)
+        return true;
+
+    mbedtls_pk_context *key = (mbedtls_pk_context *)cacheAlloc_(sizeof(mbedtls_pk_context));
+    if (!key)
+        return false;
+    mbedtls_pk_init(key);
+    // the embedded PEM usually carries its NUL; mbedtls parses it either way
+    const size_t len = (size_t)(_binary_src_certs_private_key_pem_end - _binary_src_certs_private_key_pem_start);
+    int ret = mbedtls_pk_parse_key(key, _binary_src_certs_private_key_pem_start, len, nullptr, 0);
+    if (ret != 0)
+    {
+        logMbedError_("pk_parse_key", ret);
+        mbedtls_pk_free(key);
+        free(key);
+        return false;
+    }
+    s_key = key;
+    return true;
+}
+
+bool CryptoCache::verify(const uint8_t *hash, size_t hashLen, const uint8_t *sig, size_t sigLen)
+{
+    if (!lock_())
+        return false;
+    const uint32_t start = micros();
+    bool ok = certReady_();
+    if (ok)
+    {
+        int ret = mbedtls_pk_verify(&s_cert->pk, MBEDTLS_MD_SHA256, hash, hashLen, sig, sigLen);
+        ok = ret == 0;
+        if (!ok)
+            logMbedError_("pk_verify", ret);
+    }
+    verifyLatency.record(micros() - start);
+    verifyLatencyUs = verifyLatency.last();
+    unlock_();
+    return ok;
+}
+
+bool CryptoCache::sign(const uint8_t *hash, size_t hashLen, uint8_t *sig, size_t cap, size_t &sigLen)
+{
+    if (!lock_())
+        return false;
+    const uint32_t start = micros();
+    bool ok = keyReady_() && drbgReady_() && cap >= mbedtls_pk_get_len(s_key);
+    if (ok)
+    {
+        int ret = mbedtls_pk_sign(s_key, MBEDTLS_MD_SHA256, hash, hashLen, sig, &sigLen,
+                                  mbedtls_ctr_drbg_random, s_drbg);
+        ok = ret == 0;
+        if (!ok)
+            logMbedError_("pk_sign", ret);
+    }
+    signLatency.record(micros() - start);
+    signLatencyUs = signLatency.last();
+    unlock_();
+    return ok;
+}
+
+bool CryptoCache::decrypt(const uint8_t *in, size_t inLen, uint8_t *out, size_t cap, size_t &outLen)
+{
+    if (!lock_())
+        return false;
+    bool ok = keyReady_() && drbgReady_();
+    if (ok)
+    {
+        // the DRBG blinds the private key operation
+        int ret = mbedtls_pk_decrypt(s_key, in, inLen, out, &outLen, cap, mbedtls_ctr_drbg_random, s_drbg);
+        ok = ret == 0;
+        if (!ok)
+            logMbedError_("pk_decrypt", ret);
+    }
+    unlock_();
+    return ok;
+}
+
+bool CryptoCache::random(uint8_t *out, size_t n)
+{
+    if (!lock_())
+        return false;
+    bool ok = drbgReady_() && mbedtls_ctr_drbg_random(s_drbg, out, n) == 0;
+    unlock_();
+    return ok;
+}
+
+const char *CryptoCache::caCertificate()
+{
+    if (!lock_())
+        return nullptr;
+    if (!s_ca)
+    {
+        const size_t len = (size_t)(_binary_src_certs_isrgrootx1_pem_end - _binary_src_certs_isrgrootx1_pem_start);
+        char *ca = (char *)cacheAlloc_(len + 1);
+        if (ca)
+        {
+            memcpy(ca, _binary_src_certs_isrgrootx1_pem_start, len);
+            ca[len] = '\0'; // ensure PEM is NUL-terminated
+            s_ca = ca;
+        }
+    }
+    unlock_();
+    return s_ca;
+}
@@ -1,38 +1,15 @@
 #include "system/device-security.h"
-
-static String base64UrlEncode_(const uint8_t *data, size_t len)
-{
-    size_t olen = 0;
-    const size_t maxOut = 4 * ((len + 2) / 3) + 1;
-    unsigned char *tmp = (unsigned char *)malloc(maxOut);
-    if (!tmp)
-        return "";
-
-    if (mbedtls_base64_encode(tmp, maxOut, &olen, data, len) != 0)
-    {
-        free(tmp);
-        return "";
-    }
-
-    String out;
-    out.reserve(olen);
-
-    for (size_t i = 0; i < olen; i++)
-    {
-        char c = (char)tmp[i];
-        if (c == '+')
-            out += '-';
-        else if (c == '/')
-            out += '_';
-        else if (c == '=')
-            break; // strip padding
-        else
-            out += c;
-    }
-
-    free(tmp);
-    return out;
-}
+#include "system/crypto-cache.h"
+#include "system/modules.h"
+#include "resources/utils/payload_id.h"
+
+// Payload ids count up from a sequence persisted in leases and a boot id
+// (see resources/utils/payload_id.h); the randomness comes from the DRBG
+// CryptoCache seeds once per boot
+static hyphen::pid::Sequence s_idSequence;
+static uint32_t s_idBoot = 0;
+static bool s_idReady = false;
+static const char *s_idSequenceKey = "pid_seq";
 
 static void sha256_(const uint8_t *data, size_t len, uint8_t out[32])
 {
@@ -48,66 +25,59 @@ static void sha256_(const uint8_t *data, size_t len, uint8_t out[32])
 String DeviceSecurity::makePayloadId(const String &deviceId)
 {
     (void)deviceId; // not needed anymore, but kept for API stability
-
-    uint8_t rnd[12]; // 96 bits
-
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr;
-    mbedtls_entropy_init(&entropy);
-    mbedtls_ctr_drbg_init(&ctr);
-
-    const char *pers = "hyphen_payload_id";
-    if (mbedtls_ctr_drbg_seed(
-            &ctr,
-            mbedtls_entropy_func,
-            &entropy,
-            (const unsigned char *)pers,
-            strlen(pers)) != 0)
-    {
-        mbedtls_ctr_drbg_free(&ctr);
-        mbedtls_entropy_free(&entropy);
-        return "";
-    }
-
-    if (mbedtls_ctr_drbg_random(&ctr, rnd, sizeof(rnd)) != 0)
-    {
-        mbedtls_ctr_drbg_free(&ctr);
-        mbedtls_entropy_free(&entropy);
-        return "";
-    }
-
-    mbedtls_ctr_drbg_free(&ctr);
-    mbedtls_entropy_free(&entropy);
-
-    return String("p1_") + base64UrlEncode_(rnd, sizeof(rnd));
+    char id[PAYLOAD_ID_SIZE];
+    return makePayloadId(id, sizeof(id)) ? String(id) : String();
 }
 
-static void mbedErrToString(int ret, char *out, size_t outLen)
+static bool payloadIdsReady_()
 {
-    if (!out || outLen == 0)
-        return;
-    mbedtls_strerror(ret, out, outLen);
-}
+    if (s_idReady)
+        return true;
 
-static bool initPkFromEmbedded_(mbedtls_pk_context &pk)
-{
-    mbedtls_pk_init(&pk);
+    uint8_t boot[4];
+    if (!CryptoCache::random(boot, sizeof(boot)))
+        return false;
+    s_idBoot = hyphen::pid::getU32(boot);
 
-    const uint8_t *priv_start = _binary_src_certs_private_key_pem_start;
-    const size_t priv_len = (size_t)(_binary_src_certs_private_key_pem_end - _binary_src_certs_private_key_pem_start);
+    unsigned long persisted = 0;
+    Persist.get(s_idSequenceKey, persisted);
+    s_idSequence.restore((uint32_t)persisted);
+    s_idReady = true;
+    return true;
+}
 
-    // Note: parse_key expects the PEM buffer to include null terminator in some builds.
-    // Many embedded linkers include it; if not, mbedtls still usually parses fine.
-    const int ret = mbedtls_pk_parse_key(&pk, priv_start, priv_len, nullptr, 0);
-    if (ret != 0)
+/**
+ * Writes "p2_" and the sequence number, boot id and 32 random bits,
+ * base64url without padding, into out. Returns the length, 0 on failure
+ * with out left empty. A sequence lease NVS refused doesn't fail the id,
+ * the next one writes it again.
+ * Nothing is allocated, so the publish cycle can stamp its payload straight
+ * into the publish buffer.
+ */
+size_t DeviceSecurity::makePayloadId(char *out, size_t cap)
+{
+    // callers stamp out as it is, so a failure leaves it empty
+    if (cap > 0)
+        out[0] = '\0';
+    static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    if (!mutex || xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+        return 0;
+
+    size_t n = 0;
+    uint8_t rnd[4];
+    if (payloadIdsReady_() && CryptoCache::random(rnd, sizeof(rnd)))
     {
-        char buf[128];
-        mbedErrToString(ret, buf, sizeof(buf));
-        Serial.printf("❌ DeviceSecurity pk_parse_key failed: %s\n", buf);
-        mbedtls_pk_free(&pk);
-        return false;
+        uint32_t seq;
+        // on flash before the first number of the new lease goes out: a put
+        // only reaches NVS on the next flush, and a crash before it would
+        // hand the same numbers out again. When NVS refuses it the boot id
+        // still keeps the id unique, and the next id tries the lease again
+        if (s_idSequence.next(seq) && !Persist.putNow(s_idSequenceKey, (unsigned long)s_idSequence.limit()))
+            s_idSequence.unwritten();
+        n = hyphen::pid::format(seq, s_idBoot, hyphen::pid::getU32(rnd), out, cap);
     }
-    return true;
+    xSemaphoreGive(mutex);
+    return n;
 }
 
 static bool base64Encode_(const uint8_t *in, size_t inLen, String &outB64)
@@ -137,15 +107,7 @@ static bool base64Encode_(const uint8_t *in, size_t inLen, String &outB64)
 // ota.cpp
 const char *DeviceSecurity::getCaCertificate()
 {
-    static char *s_ca = nullptr;
-    if (!s_ca)
-    {
-        size_t ca_len = _binary_src_certs_isrgrootx1_pem_end - _binary_src_certs_isrgrootx1_pem_start;
-        s_ca = (char *)malloc(ca_len + 1);
-        memcpy(s_ca, _binary_src_certs_isrgrootx1_pem_start, ca_len);
-        s_ca[ca_len] = '\0'; // ensure PEM is NUL-terminated
-    }
-    return s_ca;
+    return CryptoCache::caCertificate();
 }
 
 bool DeviceSecurity::signSha256ToBase64(const String &message, String &outSigB64)
@@ -154,70 +116,16 @@ bool DeviceSecurity::signSha256ToBase64(const String &message, String &outSigB64
 
     // SHA-256 hash of message
     uint8_t hash[32];
-    mbedtls_sha256_context sha;
-    mbedtls_sha256_init(&sha);
-    mbedtls_sha256_starts_ret(&sha, 0);
-    mbedtls_sha256_update_ret(&sha, (const unsigned char *)message.c_str(), message.length());
-    mbedtls_sha256_finish_ret(&sha, hash);
-    mbedtls_sha256_free(&sha);
-
-    // Load private key
-    mbedtls_pk_context pk;
-    if (!initPkFromEmbedded_(pk))
-        return false;
-
-    // RNG (required for many sign operations)
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr;
-    mbedtls_entropy_init(&entropy);
-    mbedtls_ctr_drbg_init(&ctr);
-
-    const char *pers = "hyphen_wss_sign";
-    int ret = mbedtls_ctr_drbg_seed(&ctr, mbedtls_entropy_func, &entropy,
-                                    (const unsigned char *)pers, strlen(pers));
-    if (ret != 0)
-    {
-        char buf[128];
-        mbedErrToString(ret, buf, sizeof(buf));
-        Serial.printf("❌ DeviceSecurity ctr_drbg_seed failed: %s\n", buf);
-        mbedtls_pk_free(&pk);
-        mbedtls_ctr_drbg_free(&ctr);
-        mbedtls_entropy_free(&entropy);
-        return false;
-    }
+    sha256_((const uint8_t *)message.c_str(), message.length(), hash);
 
-    // Sign hash with key
+    // Sign hash with the cached device key
     uint8_t sig[512];
     size_t sigLen = 0;
-
-    ret = mbedtls_pk_sign(&pk,
-                          MBEDTLS_MD_SHA256,
-                          hash,
-                          0,
-                          sig,
-                          &sigLen,
-                          mbedtls_ctr_drbg_random,
-                          &ctr);
-
-    if (ret != 0)
-    {
-        char buf[128];
-        mbedErrToString(ret, buf, sizeof(buf));
-        Serial.printf("❌ DeviceSecurity pk_sign failed: %s\n", buf);
-        mbedtls_pk_free(&pk);
-        mbedtls_ctr_drbg_free(&ctr);
-        mbedtls_entropy_free(&entropy);
+    if (!CryptoCache::sign(hash, sizeof(hash), sig, sizeof(sig), sigLen))
         return false;
-    }
 
     // Base64 signature
-    const bool ok = base64Encode_(sig, sigLen, outSigB64);
-
-    mbedtls_pk_free(&pk);
-    mbedtls_ctr_drbg_free(&ctr);
-    mbedtls_entropy_free(&entropy);
-
-    return ok;
+    return base64Encode_(sig, sigLen, outSigB64);
 }
 
 bool DeviceSecurity::signToBase64(const String &message, String &outSigB64)
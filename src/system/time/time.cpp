@@ -138,6 +138,23 @@ String TimeClass::format(unsigned long unixTime, const char *format)
     return String(buffer);
 }
 
+/**
+ * Formats into a caller's buffer instead of a String. Returns the length
+ * written, 0 when the time couldn't be converted or didn't fit.
+ */
+size_t TimeClass::format(unsigned long unixTime, const char *format, char *out, size_t cap)
+{
+    time_t rawTime = static_cast<time_t>(unixTime);
+    struct tm timeinfo;
+    if (cap == 0 || localtime_r(&rawTime, &timeinfo) == nullptr)
+    {
+        return 0;
+    }
+    size_t len = strftime(out, cap, format, &timeinfo);
+    out[len] = '\0';
+    return len;
+}
+
 String TimeClass::format(const char *formatString)
 {
     return format(now(), formatString); // Returns empty string if time retrieval fails
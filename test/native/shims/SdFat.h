@@ -0,0 +1,179 @@
+// SdFat.h — native shim. A file-backed stand-in for the subset of SdFat that
+// HyphenOS uses (SdFat volume calls + SdFile), so SD code paths run on the host
+// against real files.
+//
+// Paths resolve under hyphen_test_sd::root() (a fresh temp directory per
+// process). hyphen_test_sd::failWritesAfter(n) lets a test simulate a full or
+// failing card: writes succeed for n more bytes, then come up short.
+// hyphen_test_sd::readCalls() counts SdFile::read() calls, for benchmarks.
+#pragma once
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+#include "Arduino.h"
+
+#ifndef O_READ
+#define O_READ O_RDONLY
+#endif
+#ifndef O_AT_END
+#define O_AT_END 0x40000000
+#endif
+#ifndef SD_SCK_MHZ
+#define SD_SCK_MHZ(mhz) (mhz)
+#endif
+
+namespace hyphen_test_sd {
+
+inline std::string &root() {
+  static std::string dir;
+  if (dir.empty()) {
+    char tmpl[] = "/tmp/hyphen-sd-XXXXXX";
+    const char *made = mkdtemp(tmpl);
+    dir = made ? made : "/tmp";
+  }
+  return dir;
+}
+
+inline std::string pathOf(const char *path) {
+  return root() + "/" + (path && path[0] == '/' ? path + 1 : path);
+}
+
+inline long &writeBudget() {
+  static long budget = -1;  // -1: unlimited
+  return budget;
+}
+
+inline void failWritesAfter(long bytes) { writeBudget() = bytes; }
+inline void restoreWrites() { writeBudget() = -1; }
+
+inline unsigned long &readCalls() {
+  static unsigned long calls = 0;
+  return calls;
+}
+
+inline void reset(const char *path) { ::remove(pathOf(path).c_str()); }
+
+}  // namespace hyphen_test_sd
+
+class SdFile {
+ public:
+  ~SdFile() { close(); }
+
+  bool open(const char *path, int flags) {
+    close();
+    std::string p = hyphen_test_sd::pathOf(path);
+    bool exists = access(p.c_str(), F_OK) == 0;
+    const char *mode;
+    if ((flags & O_ACCMODE) == O_RDONLY) {
+      mode = "rb";
+    } else if ((flags & O_TRUNC) || (!exists && (flags & O_CREAT))) {
+      mode = "w+b";
+    } else {
+      mode = "r+b";
+    }
+    if (!exists && !(flags & O_CREAT)) {
+      return false;
+    }
+    _f = fopen(p.c_str(), mode);
+    _path = p;
+    if (_f && (flags & O_AT_END)) {
+      fseek(_f, 0, SEEK_END);
+    }
+    return _f != nullptr;
+  }
+
+  bool isOpen() const { return _f != nullptr; }
+
+  bool close() {
+    if (!_f) {
+      return false;
+    }
+    fclose(_f);
+    _f = nullptr;
+    return true;
+  }
+
+  bool sync() { return _f && fflush(_f) == 0; }
+
+  // Deletes the open file (SdFat's FatFile::remove)
+  bool remove() {
+    if (!_f) {
+      return false;
+    }
+    close();
+    return ::remove(_path.c_str()) == 0;
+  }
+
+  bool seekSet(uint64_t pos) { return _f && fseek(_f, (long)pos, SEEK_SET) == 0; }
+
+  uint64_t curPosition() { return _f ? (uint64_t)ftell(_f) : 0; }
+
+  uint64_t fileSize() {
+    if (!_f) {
+      return 0;
+    }
+    long here = ftell(_f);
+    fseek(_f, 0, SEEK_END);
+    long size = ftell(_f);
+    fseek(_f, here, SEEK_SET);
+    return (uint64_t)size;
+  }
+
+  int read() {
+    hyphen_test_sd::readCalls()++;
+    if (!_f) {
+      return -1;
+    }
+    int c = fgetc(_f);
+    return c == EOF ? -1 : c;
+  }
+
+  int read(void *buf, size_t n) {
+    hyphen_test_sd::readCalls()++;
+    if (!_f) {
+      return -1;
+    }
+    fseek(_f, 0, SEEK_CUR);  // switching from write to read
+    return (int)fread(buf, 1, n, _f);
+  }
+
+  size_t write(const void *data, size_t n) {
+    if (!_f) {
+      return 0;
+    }
+    long &budget = hyphen_test_sd::writeBudget();
+    size_t allowed = n;
+    if (budget >= 0) {
+      allowed = (size_t)budget < n ? (size_t)budget : n;
+      budget -= (long)allowed;
+    }
+    fseek(_f, 0, SEEK_CUR);  // switching from read to write
+    return fwrite(data, 1, allowed, _f);
+  }
+
+  size_t print(const char *s) { return write(s, strlen(s)); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t println(const char *s) { return print(s) + write("\r\n", 2); }
+  size_t println(const String &s) { return print(s) + write("\r\n", 2); }
+
+ private:
+  FILE *_f = nullptr;
+  std::string _path;
+};
+
+class SdFat {
+ public:
+  bool begin(uint8_t, uint32_t) { return true; }
+  bool exists(const char *path) {
+    return access(hyphen_test_sd::pathOf(path).c_str(), F_OK) == 0;
+  }
+  bool remove(const char *path) {
+    return ::remove(hyphen_test_sd::pathOf(path).c_str()) == 0;
+  }
+};
@@ -0,0 +1,103 @@
+// Native tests for the payload archive index (src/resources/utils/archive_index.h).
+//
+// A replay request used to have nothing to search: drained records were gone.
+// These lock in the sparse index — when entries are written, that their
+// timestamps stay monotonic across a clock step back — and the O(log n) floor
+// search that finds where a replay window starts.
+#include <unity.h>
+
+#include <vector>
+
+#include "resources/utils/archive_index.h"
+
+using namespace hyphen::archive;
+
+void setUp() {}
+void tearDown() {}
+
+void test_entry_round_trip() {
+  Entry e;
+  e.timestamp = 1760688000;
+  e.offset = 123456;
+  uint8_t raw[kEntrySize];
+  encodeEntry(e, raw);
+  Entry back = decodeEntry(raw);
+  TEST_ASSERT_EQUAL_UINT32(e.timestamp, back.timestamp);
+  TEST_ASSERT_EQUAL_UINT32(e.offset, back.offset);
+}
+
+void test_indexer_writes_every_stride() {
+  Indexer indexer(100);
+  TEST_ASSERT_TRUE(indexer.due(0));
+  indexer.index(0, 10);
+  TEST_ASSERT_FALSE(indexer.due(60));
+  TEST_ASSERT_TRUE(indexer.due(120));
+  indexer.index(120, 20);
+  TEST_ASSERT_FALSE(indexer.due(200));
+  TEST_ASSERT_TRUE(indexer.due(220));
+  indexer.reset(indexer.last());
+  TEST_ASSERT_TRUE(indexer.due(0));
+  indexer.resume(500, 30);
+  TEST_ASSERT_TRUE(indexer.due(500));
+  TEST_ASSERT_FALSE(indexer.due(499));
+}
+
+void test_index_timestamps_stay_monotonic() {
+  Indexer indexer(1);
+  TEST_ASSERT_EQUAL_UINT32(1000, indexer.index(0, 1000).timestamp);
+  // clock stepped back by a sync
+  TEST_ASSERT_EQUAL_UINT32(1000, indexer.index(10, 900).timestamp);
+  TEST_ASSERT_EQUAL_UINT32(1100, indexer.index(20, 1100).timestamp);
+}
+
+void test_floor_index() {
+  std::vector<uint32_t> ts = {10, 20, 20, 30, 40};
+  int reads = 0;
+  auto at = [&](size_t i) {
+    reads++;
+    return ts[i];
+  };
+  TEST_ASSERT_EQUAL(0, floorIndex(at, ts.size(), 5));
+  TEST_ASSERT_EQUAL(0, floorIndex(at, ts.size(), 10));
+  TEST_ASSERT_EQUAL(0, floorIndex(at, ts.size(), 15));
+  TEST_ASSERT_EQUAL(2, floorIndex(at, ts.size(), 20));
+  TEST_ASSERT_EQUAL(3, floorIndex(at, ts.size(), 35));
+  TEST_ASSERT_EQUAL(4, floorIndex(at, ts.size(), 99));
+  TEST_ASSERT_EQUAL(0, floorIndex(at, 0, 99));
+}
+
+void test_floor_index_is_logarithmic() {
+  std::vector<uint32_t> ts;
+  for (uint32_t i = 0; i < 100000; i++) {
+    ts.push_back(i * 60);
+  }
+  int reads = 0;
+  auto at = [&](size_t i) {
+    reads++;
+    return ts[i];
+  };
+  TEST_ASSERT_EQUAL(5000, floorIndex(at, ts.size(), 5000 * 60 + 30));
+  TEST_ASSERT_TRUE(reads <= 17);
+}
+
+void test_parse_range() {
+  uint32_t from, to;
+  TEST_ASSERT_TRUE(parseRange("1760688000,1760691600", from, to));
+  TEST_ASSERT_EQUAL_UINT32(1760688000, from);
+  TEST_ASSERT_EQUAL_UINT32(1760691600, to);
+  TEST_ASSERT_FALSE(parseRange("20,10", from, to));
+  TEST_ASSERT_FALSE(parseRange("10", from, to));
+  TEST_ASSERT_FALSE(parseRange("10,x", from, to));
+  TEST_ASSERT_FALSE(parseRange(",10", from, to));
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_entry_round_trip);
+  RUN_TEST(test_indexer_writes_every_stride);
+  RUN_TEST(test_index_timestamps_stay_monotonic);
+  RUN_TEST(test_floor_index);
+  RUN_TEST(test_floor_index_is_logarithmic);
+  RUN_TEST(test_parse_range);
+  return UNITY_END();
+}
@@ -0,0 +1,147 @@
+// Native tests for the batched offline drain (src/resources/utils/batch_drain.h).
+//
+// The drain used to publish one stored record per MQTT message. These lock in
+// the envelope the server parses, with each record under its payload's own
+// "__id", that the builder never overruns the MQTT packet budget (a record
+// that doesn't fit stays for the next batch), and the latency-driven batch
+// sizing: slow start, then AIMD.
+#include <unity.h>
+
+#include <string.h>
+#include <string>
+
+#include "resources/utils/batch_drain.h"
+
+using hyphen::batch::BatchSizer;
+using hyphen::batch::EnvelopeBuilder;
+using hyphen::batch::payloadIdOf;
+
+void setUp() {}
+void tearDown() {}
+
+static bool add(EnvelopeBuilder &b, const char *id, const char *payload) {
+  return b.add(id, id ? strlen(id) : 0, "Hy/Post/Black", payload, strlen(payload));
+}
+
+void test_envelope_format() {
+  char buf[256];
+  EnvelopeBuilder b(buf, sizeof(buf));
+  TEST_ASSERT_TRUE(b.begin("dev1"));
+  TEST_ASSERT_TRUE(add(b, "p2_AAAB", "{\"a\":1}"));
+  TEST_ASSERT_TRUE(b.add(nullptr, 0, "Hy/Post/Maintain", "{\"b\":2}", 7));
+  b.finish();
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"device\":\"dev1\",\"stale\":true,\"batch\":["
+      "{\"id\":\"p2_AAAB\",\"t\":\"Hy/Post/Black\",\"p\":{\"a\":1}},"
+      "{\"t\":\"Hy/Post/Maintain\",\"p\":{\"b\":2}}]}",
+      buf);
+  TEST_ASSERT_EQUAL_size_t(2, b.count());
+}
+
+void test_payload_id_is_lifted_from_the_json() {
+  const char *id = nullptr;
+  size_t idLen = 0;
+  const char *json = "{\"device\":\"d\",\"__id\":\"p2_xyz-_\",\"payload\":{\"a\":\"__id\"}}";
+  TEST_ASSERT_TRUE(payloadIdOf(json, strlen(json), id, idLen));
+  TEST_ASSERT_EQUAL_size_t(8, idLen);
+  TEST_ASSERT_EQUAL_STRING_LEN("p2_xyz-_", id, idLen);
+  // none, or one cut off by the length
+  const char *none = "{\"device\":\"d\",\"payload\":{}}";
+  TEST_ASSERT_FALSE(payloadIdOf(none, strlen(none), id, idLen));
+  TEST_ASSERT_FALSE(payloadIdOf(json, 24, id, idLen));
+}
+
+void test_empty_batch_is_valid_json() {
+  char buf[64];
+  EnvelopeBuilder b(buf, sizeof(buf));
+  TEST_ASSERT_TRUE(b.begin("d"));
+  size_t len = b.finish();
+  TEST_ASSERT_EQUAL_STRING("{\"device\":\"d\",\"stale\":true,\"batch\":[]}", buf);
+  TEST_ASSERT_EQUAL_size_t(strlen(buf), len);
+}
+
+void test_record_that_does_not_fit_is_rejected_whole() {
+  char buf[96];
+  EnvelopeBuilder b(buf, sizeof(buf));
+  TEST_ASSERT_TRUE(b.begin("dev1"));
+  TEST_ASSERT_TRUE(add(b, "1", "{\"a\":1}"));
+  size_t before = b.length();
+  TEST_ASSERT_FALSE(add(b, "2", "{\"a\":11111111111111111111}"));
+  TEST_ASSERT_EQUAL_size_t(before, b.length());
+  TEST_ASSERT_EQUAL_size_t(1, b.count());
+  size_t len = b.finish();
+  TEST_ASSERT_TRUE(len < sizeof(buf));
+  TEST_ASSERT_EQUAL_STRING("]}", buf + len - 2);
+}
+
+void test_never_exceeds_capacity() {
+  for (size_t cap = 40; cap < 400; cap += 7) {
+    std::string buf(cap, '#');
+    EnvelopeBuilder b(&buf[0], cap);
+    if (!b.begin("dev1")) {
+      continue;
+    }
+    while (add(b, "p2_AAAAAAAAAAAAAAAA", "{\"v\":123}")) {
+    }
+    size_t len = b.finish();
+    TEST_ASSERT_TRUE(len < cap);
+    TEST_ASSERT_EQUAL_UINT8('\0', buf[len]);
+  }
+}
+
+void test_sizer_grows_on_fast_publishes() {
+  BatchSizer s(1, 4, 2000);
+  TEST_ASSERT_EQUAL_UINT16(1, s.limit());
+  for (int i = 0; i < 10; i++) {
+    s.onPublish(true, 300);
+  }
+  TEST_ASSERT_EQUAL_UINT16(4, s.limit());
+}
+
+void test_sizer_slow_starts_then_grows_by_one() {
+  // a quarter of the maximum after a boot, doubling while publishes are fast
+  BatchSizer s(1, 64, 2000);
+  TEST_ASSERT_EQUAL_UINT16(16, s.limit());
+  s.onPublish(true, 300);
+  TEST_ASSERT_EQUAL_UINT16(32, s.limit());
+  s.onPublish(true, 300);
+  TEST_ASSERT_EQUAL_UINT16(64, s.limit());
+  s.onPublish(true, 300);
+  TEST_ASSERT_EQUAL_UINT16(64, s.limit());
+  // the first miss ends the slow start
+  s.onPublish(true, 2500);
+  TEST_ASSERT_EQUAL_UINT16(32, s.limit());
+  s.onPublish(true, 300);
+  TEST_ASSERT_EQUAL_UINT16(33, s.limit());
+  s.onPublish(true, 300);
+  TEST_ASSERT_EQUAL_UINT16(34, s.limit());
+}
+
+void test_sizer_halves_on_slow_or_failed_publish() {
+  BatchSizer s(1, 32, 2000);
+  for (int i = 0; i < 40; i++) {
+    s.onPublish(true, 100);
+  }
+  TEST_ASSERT_EQUAL_UINT16(32, s.limit());
+  s.onPublish(true, 5000);
+  TEST_ASSERT_EQUAL_UINT16(16, s.limit());
+  s.onPublish(false, 100);
+  TEST_ASSERT_EQUAL_UINT16(8, s.limit());
+  for (int i = 0; i < 10; i++) {
+    s.onPublish(false, 0);
+  }
+  TEST_ASSERT_EQUAL_UINT16(1, s.limit());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_envelope_format);
+  RUN_TEST(test_payload_id_is_lifted_from_the_json);
+  RUN_TEST(test_empty_batch_is_valid_json);
+  RUN_TEST(test_record_that_does_not_fit_is_rejected_whole);
+  RUN_TEST(test_never_exceeds_capacity);
+  RUN_TEST(test_sizer_grows_on_fast_publishes);
+  RUN_TEST(test_sizer_slow_starts_then_grows_by_one);
+  RUN_TEST(test_sizer_halves_on_slow_or_failed_publish);
+  return UNITY_END();
+}
@@ -0,0 +1,213 @@
+// Native tests and benchmark for the block-buffered SD reader
+// (src/resources/utils/block_reader.h), run against the file-backed SdFat shim.
+//
+// SDCard::read pulled one byte per SdFile::read() into a String and reopened
+// the file for every line. These lock in how lines and records come out of the
+// buffer — across refills, past its size, at the end of the file — and
+// test_benchmark_against_per_byte_reads measures both paths over ten 1 KB
+// records, printing the timings and checking the read-call reduction.
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "resources/utils/block_reader.h"
+
+using hyphen::io::BlockReader;
+
+static const char *kPath = "reader.txt";
+
+void setUp() { hyphen_test_sd::reset(kPath); }
+void tearDown() {}
+
+static void writeFile(const std::string &text) {
+  SdFile file;
+  TEST_ASSERT_TRUE(file.open(kPath, O_RDWR | O_CREAT | O_TRUNC));
+  TEST_ASSERT_EQUAL(text.size(), file.write(text.data(), text.size()));
+  file.close();
+}
+
+static std::string next(BlockReader<SdFile, 16> &reader) {
+  const char *data;
+  size_t len;
+  if (!reader.nextLine(data, len)) {
+    return "<eof>";
+  }
+  return std::string(data, len);
+}
+
+void test_lines_come_out_as_views() {
+  writeFile("one\ntwo\n\nlast");
+  BlockReader<SdFile, 16> reader;
+  TEST_ASSERT_TRUE(reader.open(kPath));
+  TEST_ASSERT_EQUAL_STRING("one", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("two", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("last", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("<eof>", next(reader).c_str());
+  TEST_ASSERT_EQUAL_UINT64(13, reader.position());
+}
+
+void test_lines_span_refills() {
+  writeFile("abcdefghij\nklmnopqrstu\nvwxyz\n");
+  BlockReader<SdFile, 16> reader;
+  TEST_ASSERT_TRUE(reader.open(kPath));
+  TEST_ASSERT_EQUAL_STRING("abcdefghij", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("klmnopqrstu", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("vwxyz", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("<eof>", next(reader).c_str());
+}
+
+void test_line_longer_than_buffer_comes_in_pieces() {
+  writeFile("0123456789abcdefXYZ\nend\n");
+  BlockReader<SdFile, 16> reader;
+  TEST_ASSERT_TRUE(reader.open(kPath));
+  TEST_ASSERT_EQUAL_STRING("0123456789abcdef", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("XYZ", next(reader).c_str());
+  TEST_ASSERT_EQUAL_STRING("end", next(reader).c_str());
+}
+
+void test_take_views_and_limits() {
+  writeFile("HEADERbodybody");
+  BlockReader<SdFile, 16> reader;
+  TEST_ASSERT_TRUE(reader.open(kPath));
+  const uint8_t *head = reader.take(6);
+  TEST_ASSERT_NOT_NULL(head);
+  TEST_ASSERT_EQUAL_MEMORY("HEADER", head, 6);
+  TEST_ASSERT_NULL(reader.take(17));  // bigger than the buffer
+  TEST_ASSERT_NULL(reader.take(9));   // past the end of the file
+  TEST_ASSERT_EQUAL_UINT64(6, reader.position());
+  const uint8_t *body = reader.take(8);
+  TEST_ASSERT_NOT_NULL(body);
+  TEST_ASSERT_EQUAL_MEMORY("bodybody", body, 8);
+}
+
+void test_read_copies_past_the_buffer() {
+  std::string text;
+  for (int i = 0; i < 50; i++) {
+    text += (char)('a' + i % 26);
+  }
+  writeFile(text);
+  BlockReader<SdFile, 16> reader;
+  TEST_ASSERT_TRUE(reader.open(kPath, 5));
+  uint8_t out[64];
+  TEST_ASSERT_EQUAL(40, reader.read(out, 40));
+  TEST_ASSERT_EQUAL_MEMORY(text.data() + 5, out, 40);
+  TEST_ASSERT_EQUAL(5, reader.read(out, 40));  // only 5 left
+  TEST_ASSERT_EQUAL(0, reader.read(out, 40));
+}
+
+void test_seek_within_buffer_skips_the_card() {
+  writeFile("0123456789");
+  BlockReader<SdFile, 16> reader;
+  TEST_ASSERT_TRUE(reader.open(kPath));
+  TEST_ASSERT_NOT_NULL(reader.take(8));
+  uint32_t reads = reader.fileReads();
+  TEST_ASSERT_TRUE(reader.seek(2));
+  TEST_ASSERT_EQUAL_MEMORY("23", reader.take(2), 2);
+  TEST_ASSERT_EQUAL_UINT32(reads, reader.fileReads());
+  TEST_ASSERT_EQUAL(6, reader.fill());
+  TEST_ASSERT_EQUAL_MEMORY("456789", reader.peek(), 6);
+}
+
+void test_read_line_copies_and_cuts() {
+  writeFile("a long line\nx\n");
+  BlockReader<SdFile, 16> reader;
+  TEST_ASSERT_TRUE(reader.open(kPath));
+  char out[5];
+  TEST_ASSERT_EQUAL(11, reader.readLine(out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("a lo", out);
+  TEST_ASSERT_EQUAL(1, reader.readLine(out, sizeof(out)));
+  TEST_ASSERT_EQUAL_STRING("x", out);
+  TEST_ASSERT_EQUAL(-1, reader.readLine(out, sizeof(out)));
+}
+
+void test_missing_file_does_not_open() {
+  BlockReader<SdFile, 16> reader;
+  TEST_ASSERT_FALSE(reader.open("nothere.txt"));
+  TEST_ASSERT_FALSE(reader.isOpen());
+  TEST_ASSERT_NULL(reader.take(1));
+}
+
+// SDCard::read as it was: reopen, seek, one byte at a time into a String.
+static String perByteRead(const char *path, unsigned long &startPoint) {
+  String result;
+  SdFile file;
+  if (file.open(path, O_READ) && file.seekSet(startPoint)) {
+    int c;
+    while ((c = file.read()) >= 0) {
+      startPoint++;
+      if (c == '\n') {
+        break;
+      }
+      result += char(c);
+    }
+    file.close();
+  }
+  return result;
+}
+
+void test_benchmark_against_per_byte_reads() {
+  const int kRecords = 10;
+  const int kRounds = 50;
+  std::string text;
+  for (int i = 0; i < kRecords; i++) {
+    text += "Hy/Post/Black|{\"i\":" + std::to_string(i) + ",\"p\":\"" + std::string(1000, 'x') + "\"}\n";
+  }
+  writeFile(text);
+
+  typedef std::chrono::steady_clock Clock;
+  unsigned long perByteCalls = hyphen_test_sd::readCalls();
+  size_t perByteBytes = 0;
+  Clock::time_point start = Clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    unsigned long position = 0;
+    for (int i = 0; i < kRecords; i++) {
+      perByteBytes += perByteRead(kPath, position).length();
+    }
+  }
+  double perByteUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  perByteCalls = hyphen_test_sd::readCalls() - perByteCalls;
+
+  unsigned long blockCalls = hyphen_test_sd::readCalls();
+  size_t blockBytes = 0;
+  start = Clock::now();
+  for (int round = 0; round < kRounds; round++) {
+    BlockReader<SdFile> reader;
+    TEST_ASSERT_TRUE(reader.open(kPath));
+    const char *data;
+    size_t len;
+    for (int i = 0; i < kRecords; i++) {
+      TEST_ASSERT_TRUE(reader.nextLine(data, len));
+      blockBytes += len;
+    }
+  }
+  double blockUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  blockCalls = hyphen_test_sd::readCalls() - blockCalls;
+
+  printf("per-byte: %lu reads, %.1f us per %d records\n", perByteCalls / kRounds, perByteUs / kRounds,
+         kRecords);
+  printf("block:    %lu reads, %.1f us per %d records\n", blockCalls / kRounds, blockUs / kRounds, kRecords);
+
+  TEST_ASSERT_EQUAL(perByteBytes, blockBytes);
+  // ~10,000 single-byte reads against a handful of 4 KB ones
+  TEST_ASSERT_TRUE(perByteCalls / kRounds >= (unsigned long)text.size());
+  TEST_ASSERT_TRUE(blockCalls / kRounds <= 4);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_lines_come_out_as_views);
+  RUN_TEST(test_lines_span_refills);
+  RUN_TEST(test_line_longer_than_buffer_comes_in_pieces);
+  RUN_TEST(test_take_views_and_limits);
+  RUN_TEST(test_read_copies_past_the_buffer);
+  RUN_TEST(test_seek_within_buffer_skips_the_card);
+  RUN_TEST(test_read_line_copies_and_cuts);
+  RUN_TEST(test_missing_file_does_not_open);
+  RUN_TEST(test_benchmark_against_per_byte_reads);
+  return UNITY_END();
+}
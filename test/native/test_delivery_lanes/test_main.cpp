@@ -0,0 +1,99 @@
+// Native tests for the delivery lanes (src/resources/utils/delivery_lanes.h).
+//
+// Live payloads go first and the backlog gets the link time they leave.
+// These lock in that the backlog lane yields while live payloads wait, that
+// it is sized to the spare share of the check period from the measured time
+// per record, that the newest-first scan hands back the newest records of a
+// segment in order, and the commands of the cloud function.
+#include <unity.h>
+
+#include "resources/utils/delivery_lanes.h"
+
+using namespace hyphen::lanes;
+
+void setUp() {}
+void tearDown() {}
+
+void test_live_payloads_go_first() {
+  BacklogBudget budget(10000, 50, 20);
+  TEST_ASSERT_EQUAL(0, budget.take(1));
+  // the first pass probes with one record
+  TEST_ASSERT_EQUAL(1, budget.take(0));
+}
+
+void test_sized_to_the_spare_share() {
+  // half of a 10 s check period is the lane's
+  BacklogBudget budget(10000, 50, 20);
+  budget.onBacklog(4, 1600);
+  TEST_ASSERT_EQUAL_UINT32(400, budget.recordMs());
+  TEST_ASSERT_EQUAL(12, budget.take(0));
+  // live publishes took 3.4 s of it
+  budget.onLive(1400);
+  budget.onLive(2000);
+  TEST_ASSERT_EQUAL(4, budget.take(0));
+  // the window starts over every check
+  TEST_ASSERT_EQUAL(12, budget.take(0));
+  // all of it
+  budget.onLive(6000);
+  TEST_ASSERT_EQUAL(0, budget.take(0));
+  // a fast link is capped
+  budget.onBacklog(10, 100);
+  budget.onBacklog(10, 100);
+  budget.onBacklog(10, 100);
+  budget.onBacklog(10, 100);
+  TEST_ASSERT_EQUAL(20, budget.take(0));
+}
+
+void test_slow_records_still_trickle() {
+  BacklogBudget budget(10000, 50, 20);
+  budget.onBacklog(1, 8000);
+  TEST_ASSERT_EQUAL(1, budget.take(0));
+}
+
+void test_newest_window() {
+  NewestWindow<8> window(3);
+  TEST_ASSERT_EQUAL(0, window.count());
+  window.add(10);
+  window.add(20);
+  TEST_ASSERT_EQUAL(2, window.count());
+  TEST_ASSERT_EQUAL_UINT32(20, window.newest(0));
+  TEST_ASSERT_EQUAL_UINT32(10, window.newest(1));
+  for (uint32_t position = 30; position <= 90; position += 10) {
+    window.add(position);
+  }
+  TEST_ASSERT_EQUAL(3, window.count());
+  TEST_ASSERT_EQUAL_UINT32(90, window.newest(0));
+  TEST_ASSERT_EQUAL_UINT32(80, window.newest(1));
+  TEST_ASSERT_EQUAL_UINT32(70, window.newest(2));
+  // capped to its storage
+  NewestWindow<2> small(5);
+  small.add(1);
+  small.add(2);
+  small.add(3);
+  TEST_ASSERT_EQUAL(2, small.count());
+  TEST_ASSERT_EQUAL_UINT32(3, small.newest(0));
+  NewestWindow<2> none(0);
+  none.add(1);
+  TEST_ASSERT_EQUAL(0, none.count());
+}
+
+void test_order_commands() {
+  Order order = OLDEST_FIRST;
+  TEST_ASSERT_TRUE(parseOrder("newest", order));
+  TEST_ASSERT_EQUAL(NEWEST_FIRST, order);
+  TEST_ASSERT_TRUE(parseOrder("oldest", order));
+  TEST_ASSERT_EQUAL(OLDEST_FIRST, order);
+  TEST_ASSERT_FALSE(parseOrder("latest", order));
+  TEST_ASSERT_EQUAL(OLDEST_FIRST, order);
+  TEST_ASSERT_EQUAL_STRING("newest", orderName(NEWEST_FIRST));
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_live_payloads_go_first);
+  RUN_TEST(test_sized_to_the_spare_share);
+  RUN_TEST(test_slow_records_still_trickle);
+  RUN_TEST(test_newest_window);
+  RUN_TEST(test_order_commands);
+  return UNITY_END();
+}
@@ -0,0 +1,184 @@
+// Native tests for the NVS write-back cache (src/resources/utils/kv_cache.h).
+//
+// Every Persistence put used to be a flash write. These lock in that reads are
+// served from RAM after the first one, that unchanged and repeated puts cost
+// nothing until flush(), that a single key can be written through, that failed
+// writes are retried, that a full cache falls back to the backend, and the
+// per-key write counters.
+#include <unity.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "resources/utils/kv_cache.h"
+
+using namespace hyphen::kv;
+
+struct FakeNvs {
+  std::map<std::string, std::vector<uint8_t>> keys;
+  int lengths = 0;
+  int reads = 0;
+  int writes = 0;
+  bool failing = false;
+
+  long length(const char *key) {
+    lengths++;
+    auto it = keys.find(key);
+    return it == keys.end() ? -1 : (long)it->second.size();
+  }
+  size_t read(const char *key, void *out, size_t len) {
+    reads++;
+    auto it = keys.find(key);
+    if (it == keys.end() || it->second.size() < len) {
+      return 0;
+    }
+    memcpy(out, it->second.data(), len);
+    return len;
+  }
+  bool write(const char *key, const void *data, size_t len) {
+    if (failing) {
+      return false;
+    }
+    writes++;
+    keys[key] = std::vector<uint8_t>((const uint8_t *)data, (const uint8_t *)data + len);
+    return true;
+  }
+};
+
+static FakeNvs nvs;
+
+void setUp() { nvs = FakeNvs(); }
+void tearDown() {}
+
+void test_reads_are_cached() {
+  unsigned long v = 42;
+  nvs.write("pos", &v, sizeof(v));
+  WriteBackCache<FakeNvs> cache(nvs);
+  for (int i = 0; i < 10; i++) {
+    unsigned long got = 0;
+    TEST_ASSERT_TRUE(cache.get("pos", &got, sizeof(got)));
+    TEST_ASSERT_EQUAL_UINT32(42, got);
+  }
+  TEST_ASSERT_EQUAL(1, nvs.lengths);
+  TEST_ASSERT_EQUAL(1, nvs.reads);
+}
+
+void test_missing_and_mismatched_keys() {
+  WriteBackCache<FakeNvs> cache(nvs);
+  unsigned long got = 7;
+  TEST_ASSERT_FALSE(cache.get("none", &got, sizeof(got)));
+  TEST_ASSERT_FALSE(cache.get("none", &got, sizeof(got)));
+  TEST_ASSERT_EQUAL(1, nvs.lengths);  // "not there" is cached too
+  TEST_ASSERT_EQUAL_UINT32(7, got);
+  uint8_t small = 1;
+  cache.put("size", &small, sizeof(small));
+  TEST_ASSERT_FALSE(cache.get("size", &got, sizeof(got)));
+}
+
+void test_puts_are_written_back() {
+  WriteBackCache<FakeNvs> cache(nvs);
+  for (unsigned long i = 0; i < 100; i++) {
+    TEST_ASSERT_TRUE(cache.put("pos", &i, sizeof(i)));
+  }
+  TEST_ASSERT_EQUAL(0, nvs.writes);
+  TEST_ASSERT_EQUAL(1, cache.dirty());
+  unsigned long got = 0;
+  TEST_ASSERT_TRUE(cache.get("pos", &got, sizeof(got)));
+  TEST_ASSERT_EQUAL_UINT32(99, got);
+
+  TEST_ASSERT_EQUAL(1, cache.flush());
+  TEST_ASSERT_EQUAL(1, nvs.writes);
+  TEST_ASSERT_EQUAL(0, cache.dirty());
+  TEST_ASSERT_EQUAL(0, cache.flush());
+  TEST_ASSERT_EQUAL_UINT32(1, cache.writes("pos"));
+  TEST_ASSERT_EQUAL_UINT32(1, cache.totalWrites());
+}
+
+void test_unchanged_put_is_free() {
+  unsigned long v = 5;
+  nvs.write("cfg", &v, sizeof(v));
+  nvs.writes = 0;
+  WriteBackCache<FakeNvs> cache(nvs);
+  TEST_ASSERT_TRUE(cache.put("cfg", &v, sizeof(v)));
+  TEST_ASSERT_EQUAL(0, cache.dirty());
+  TEST_ASSERT_EQUAL(0, cache.flush());
+  TEST_ASSERT_EQUAL(0, nvs.writes);
+}
+
+void test_failed_flush_stays_dirty() {
+  WriteBackCache<FakeNvs> cache(nvs);
+  unsigned long v = 1;
+  cache.put("a", &v, sizeof(v));
+  nvs.failing = true;
+  TEST_ASSERT_EQUAL(0, cache.flush());
+  TEST_ASSERT_EQUAL(1, cache.dirty());
+  nvs.failing = false;
+  TEST_ASSERT_EQUAL(1, cache.flush());
+  TEST_ASSERT_EQUAL(1, nvs.keys.count("a"));
+}
+
+void test_flush_one_key() {
+  WriteBackCache<FakeNvs> cache(nvs);
+  unsigned long a = 1;
+  unsigned long b = 2;
+  cache.put("a", &a, sizeof(a));
+  cache.put("b", &b, sizeof(b));
+  TEST_ASSERT_TRUE(cache.flush("b"));
+  TEST_ASSERT_EQUAL(1, nvs.writes);
+  TEST_ASSERT_EQUAL(1, nvs.keys.count("b"));
+  TEST_ASSERT_EQUAL(0, nvs.keys.count("a"));
+  TEST_ASSERT_EQUAL(1, cache.dirty());
+  // already clean
+  TEST_ASSERT_TRUE(cache.flush("b"));
+  TEST_ASSERT_EQUAL(1, nvs.writes);
+  nvs.failing = true;
+  TEST_ASSERT_FALSE(cache.flush("a"));
+  TEST_ASSERT_EQUAL(1, cache.dirty());
+  nvs.failing = false;
+  TEST_ASSERT_EQUAL(1, cache.flush());
+}
+
+void test_full_cache_writes_through() {
+  WriteBackCache<FakeNvs, 2> cache(nvs);
+  unsigned long v = 3;
+  cache.put("a", &v, sizeof(v));
+  cache.put("b", &v, sizeof(v));
+  TEST_ASSERT_EQUAL(0, nvs.writes);
+  TEST_ASSERT_TRUE(cache.put("c", &v, sizeof(v)));
+  TEST_ASSERT_EQUAL(1, nvs.writes);
+  unsigned long got = 0;
+  TEST_ASSERT_TRUE(cache.get("c", &got, sizeof(got)));
+  TEST_ASSERT_EQUAL_UINT32(3, got);
+  TEST_ASSERT_EQUAL(2, cache.size());
+}
+
+void test_long_keys_are_refused() {
+  WriteBackCache<FakeNvs> cache(nvs);
+  unsigned long v = 3;
+  TEST_ASSERT_FALSE(cache.put("a_key_that_is_too_long", &v, sizeof(v)));
+  TEST_ASSERT_EQUAL(0, cache.size());
+}
+
+void test_drop_forgets() {
+  WriteBackCache<FakeNvs> cache(nvs);
+  unsigned long v = 3;
+  cache.put("a", &v, sizeof(v));
+  cache.drop();
+  TEST_ASSERT_EQUAL(0, cache.dirty());
+  TEST_ASSERT_FALSE(cache.get("a", &v, sizeof(v)));
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_reads_are_cached);
+  RUN_TEST(test_missing_and_mismatched_keys);
+  RUN_TEST(test_puts_are_written_back);
+  RUN_TEST(test_unchanged_put_is_free);
+  RUN_TEST(test_failed_flush_stays_dirty);
+  RUN_TEST(test_flush_one_key);
+  RUN_TEST(test_full_cache_writes_through);
+  RUN_TEST(test_long_keys_are_refused);
+  RUN_TEST(test_drop_forgets);
+  return UNITY_END();
+}
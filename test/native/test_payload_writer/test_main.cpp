@@ -0,0 +1,344 @@
+// Native tests for the streaming payload writers (src/resources/utils/payload_writer.h).
+//
+// The publish payload is written straight into one buffer allocated at boot.
+// These lock in the JSON and the MessagePack it produces (nesting, escaping,
+// number formatting, map and array headers), that a field that doesn't fit fails the
+// whole payload instead of truncating it, and that building a full envelope
+// makes no heap allocation at all. The benchmark reports serializer throughput
+// in bytes per microsecond for both encodings.
+#include <unity.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <new>
+#include <string>
+
+#include "resources/utils/payload_writer.h"
+
+using namespace hyphen::payload;
+
+// every operator new in this process is counted
+static size_t allocations = 0;
+void *operator new(size_t n) {
+  allocations++;
+  void *p = malloc(n ? n : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+void setUp() {}
+void tearDown() {}
+
+static char buf[2048];
+static uint8_t packed[2048];
+
+static std::string hex(const PayloadSink &sink) {
+  std::string out;
+  char byte[3];
+  for (size_t i = 0; i < sink.length(); i++) {
+    snprintf(byte, sizeof(byte), "%02x", sink.data()[i]);
+    out += byte;
+  }
+  return out;
+}
+
+static std::string number(double v, int significant = 0) {
+  char out[32];
+  size_t n = formatDouble(v, out, sizeof(out), significant);
+  return std::string(out, n);
+}
+
+// a DeviceManager::payloadWriter cycle with three devices
+static size_t writeEnvelope(PayloadSink &writer) {
+  writer.reset();
+  writer.beginObject();
+  writer.add("device", "2e11908790c75fb5915953d7");
+  writer.add("target", 15u);
+  writer.add("date", "2026-10-17T08:15:00+0000");
+  writer.add("__id", "p1_Zq3k9c0bX2l1vT8w");
+  writer.beginObject("payload");
+  writer.add("temperature", 21.4f);
+  writer.add("humidity", 63.2f);
+  writer.add("pressure", 1012.8f);
+  writer.add("precipitation", 0.0);
+  writer.add("bat", 98.0);
+  writer.add("b_v", 3.98f);
+  writer.add("wl_1", 1843);
+  writer.add("wl_2", 1851);
+  writer.add("flow", 12.5f);
+  writer.add("total_flow", 90210L);
+  writer.endObject();
+  writer.endObject();
+  return writer.length();
+}
+
+void test_envelope() {
+  JsonWriter writer(buf, sizeof(buf));
+  TEST_ASSERT_TRUE(writer.beginObject());
+  writer.add("device", "abc");
+  writer.add("target", 3);
+  writer.beginObject("payload");
+  writer.add("t", 21.4f);
+  writer.add("ok", true);
+  writer.endObject();
+  writer.beginObject("payload-1");
+  writer.endObject();
+  writer.endObject();
+  TEST_ASSERT_TRUE(writer.complete());
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"device\":\"abc\",\"target\":3,\"payload\":{\"t\":21.4,\"ok\":true},\"payload-1\":{}}",
+      writer.c_str());
+  TEST_ASSERT_EQUAL(strlen(writer.c_str()), writer.length());
+}
+
+void test_numbers() {
+  TEST_ASSERT_EQUAL_STRING("0", number(0).c_str());
+  TEST_ASSERT_EQUAL_STRING("-3", number(-3).c_str());
+  TEST_ASSERT_EQUAL_STRING("0.5", number(0.5).c_str());
+  TEST_ASSERT_EQUAL_STRING("21.4", number(21.4f, kFloatDigits).c_str());
+  TEST_ASSERT_EQUAL_STRING("1012.8", number(1012.8f, kFloatDigits).c_str());
+  TEST_ASSERT_EQUAL_STRING("1012.799988", number(1012.8f).c_str());
+  TEST_ASSERT_EQUAL_STRING("3.98", number(3.98f, kFloatDigits).c_str());
+  TEST_ASSERT_EQUAL_STRING("-99", number(-99.0).c_str());
+  TEST_ASSERT_EQUAL_STRING("0.000123", number(0.000123).c_str());
+  TEST_ASSERT_EQUAL_STRING("2", number(1.9999999).c_str());
+  TEST_ASSERT_EQUAL_STRING("1.5e12", number(1.5e12).c_str());
+  TEST_ASSERT_EQUAL_STRING("2.5e-7", number(2.5e-7).c_str());
+  TEST_ASSERT_EQUAL_STRING("null", number(NAN).c_str());
+  TEST_ASSERT_EQUAL_STRING("null", number(INFINITY).c_str());
+
+  char out[24];
+  TEST_ASSERT_EQUAL(20, formatUnsigned(18446744073709551615ULL, out, sizeof(out)));
+  TEST_ASSERT_EQUAL(2, formatInteger(-7, out, sizeof(out)));
+  TEST_ASSERT_EQUAL(0, formatInteger(-700, out, 3));
+}
+
+void test_strings_are_escaped() {
+  JsonWriter writer(buf, sizeof(buf));
+  writer.beginObject();
+  writer.add("k\"ey", "a\r\nb\t\\\x01");
+  writer.endObject();
+  TEST_ASSERT_EQUAL_STRING("{\"k\\\"ey\":\"a\\r\\nb\\t\\\\\\u0001\"}", writer.c_str());
+}
+
+void test_overflow_fails_the_payload() {
+  char small[24];
+  JsonWriter writer(small, sizeof(small));
+  writer.beginObject();
+  TEST_ASSERT_TRUE(writer.add("a", 1));
+  TEST_ASSERT_FALSE(writer.add("long_key_name", "long value"));
+  TEST_ASSERT_FALSE(writer.ok());
+  // later fields don't sneak in after the failed one
+  TEST_ASSERT_FALSE(writer.add("b", 2));
+  TEST_ASSERT_FALSE(writer.complete());
+  TEST_ASSERT_TRUE(strlen(small) < sizeof(small));
+}
+
+void test_unbalanced_objects_fail() {
+  JsonWriter writer(buf, sizeof(buf));
+  TEST_ASSERT_FALSE(writer.add("a", 1));  // no object open
+  writer.reset();
+  writer.beginObject();
+  TEST_ASSERT_FALSE(writer.complete());
+  writer.endObject();
+  TEST_ASSERT_TRUE(writer.complete());
+  TEST_ASSERT_FALSE(writer.endObject());
+  writer.reset();
+  writer.beginObject();
+  writer.endObject();
+  TEST_ASSERT_FALSE(writer.beginObject());  // a second top-level value
+}
+
+void test_arrays() {
+  JsonWriter writer(buf, sizeof(buf));
+  writer.beginObject();
+  writer.beginArray("dt");
+  writer.item(600);
+  writer.item(-3L);
+  writer.item((double)NAN);
+  writer.endArray();
+  writer.beginArray("rows");
+  writer.beginArray();
+  writer.item(1);
+  writer.endArray();
+  writer.beginArray();
+  writer.endArray();
+  writer.endArray();
+  writer.endObject();
+  TEST_ASSERT_TRUE(writer.complete());
+  TEST_ASSERT_EQUAL_STRING("{\"dt\":[600,-3,null],\"rows\":[[1],[]]}", writer.c_str());
+  // the kinds have to match
+  writer.reset();
+  writer.beginObject();
+  writer.beginArray("a");
+  TEST_ASSERT_FALSE(writer.endObject());
+
+  MsgPackWriter packer(packed, sizeof(packed));
+  packer.beginObject();
+  packer.beginArray("a");
+  for (int i = 0; i < 16; i++) {
+    packer.item(i);
+  }
+  packer.endArray();
+  packer.beginArray("b");
+  packer.item(-1);
+  packer.endArray();
+  packer.endObject();
+  TEST_ASSERT_TRUE(packer.complete());
+  // an array16 of 16, a fixarray of 1
+  TEST_ASSERT_EQUAL_STRING(
+      "82"
+      "a161" "dc0010" "000102030405060708090a0b0c0d0e0f"
+      "a162" "91" "ff",
+      hex(packer).c_str());
+}
+
+void test_msgpack_envelope() {
+  MsgPackWriter writer(packed, sizeof(packed));
+  writer.beginObject();
+  writer.add("device", "abc");
+  writer.add("target", 3);
+  writer.beginObject("payload");
+  writer.add("t", 21.5f);
+  writer.add("ok", true);
+  writer.endObject();
+  writer.beginObject("payload-1");
+  writer.endObject();
+  writer.endObject();
+  TEST_ASSERT_TRUE(writer.complete());
+  // fixmaps of 4, 2 and 0 members, as serializeMsgPack writes them
+  TEST_ASSERT_EQUAL_STRING(
+      "84"
+      "a6646576696365" "a3616263"
+      "a6746172676574" "03"
+      "a77061796c6f6164" "82" "a174" "ca41ac0000" "a26f6b" "c3"
+      "a97061796c6f61642d31" "80",
+      hex(writer).c_str());
+}
+
+void test_msgpack_numbers() {
+  MsgPackWriter writer(packed, sizeof(packed));
+  writer.beginObject();
+  writer.add("a", -1);
+  writer.add("b", -33);
+  writer.add("c", 200);
+  writer.add("d", 70000L);
+  writer.add("e", -40000L);
+  writer.add("f", 0.5);
+  writer.add("g", 0.1);
+  writer.add("h", (double)NAN);
+  writer.endObject();
+  TEST_ASSERT_EQUAL_STRING(
+      "88"
+      "a161" "ff"
+      "a162" "d0df"
+      "a163" "ccc8"
+      "a164" "ce00011170"
+      "a165" "d2ffff63c0"
+      "a166" "ca3f000000"
+      "a167" "cb3fb999999999999a"
+      "a168" "c0",
+      hex(writer).c_str());
+}
+
+void test_msgpack_large_maps_and_strings() {
+  MsgPackWriter writer(packed, sizeof(packed));
+  writer.beginObject();
+  char key[4];
+  for (int i = 0; i < 16; i++) {
+    snprintf(key, sizeof(key), "k%d", i);
+    writer.add(key, i);
+  }
+  writer.endObject();
+  TEST_ASSERT_TRUE(writer.complete());
+  // too many members for a fixmap: the reserved map16 header stays
+  TEST_ASSERT_EQUAL_HEX8(0xDE, writer.data()[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x00, writer.data()[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x10, writer.data()[2]);
+
+  std::string text(40, 'x');
+  writer.reset();
+  writer.beginObject();
+  writer.add("s", text.c_str());
+  writer.endObject();
+  TEST_ASSERT_EQUAL_HEX8(0x81, writer.data()[0]);
+  TEST_ASSERT_EQUAL_HEX8(0xD9, writer.data()[3]);
+  TEST_ASSERT_EQUAL(40, writer.data()[4]);
+  TEST_ASSERT_EQUAL(5 + 40, writer.length());
+}
+
+void test_msgpack_overflow_fails_the_payload() {
+  uint8_t small[16];
+  MsgPackWriter writer(small, sizeof(small));
+  writer.beginObject();
+  TEST_ASSERT_TRUE(writer.add("a", 1));
+  TEST_ASSERT_FALSE(writer.add("long_key_name", "long value"));
+  TEST_ASSERT_FALSE(writer.add("b", 2));
+  TEST_ASSERT_FALSE(writer.endObject());
+  TEST_ASSERT_FALSE(writer.complete());
+}
+
+void test_no_allocations_per_cycle() {
+  JsonWriter writer(buf, sizeof(buf));
+  size_t before = allocations;
+  for (int i = 0; i < 100; i++) {
+    writeEnvelope(writer);
+  }
+  TEST_ASSERT_EQUAL(0, allocations - before);
+  TEST_ASSERT_TRUE(writer.complete());
+
+  MsgPackWriter packer(packed, sizeof(packed));
+  before = allocations;
+  for (int i = 0; i < 100; i++) {
+    writeEnvelope(packer);
+  }
+  TEST_ASSERT_EQUAL(0, allocations - before);
+  TEST_ASSERT_TRUE(packer.complete());
+  TEST_ASSERT_TRUE(packer.length() < writer.length());
+}
+
+static void benchmark(const char *name, PayloadSink &writer) {
+  const int cycles = 20000;
+  size_t bytes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < cycles; i++) {
+    bytes += writeEnvelope(writer);
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  printf("%s writer: %d payloads of %zu bytes, %.1f bytes/us, %.2f us each\n", name, cycles, writer.length(),
+         bytes / us, us / cycles);
+  TEST_ASSERT_TRUE(bytes > 0);
+}
+
+void test_benchmark() {
+  JsonWriter writer(buf, sizeof(buf));
+  benchmark("json", writer);
+  MsgPackWriter packer(packed, sizeof(packed));
+  benchmark("msgpack", packer);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_envelope);
+  RUN_TEST(test_numbers);
+  RUN_TEST(test_strings_are_escaped);
+  RUN_TEST(test_overflow_fails_the_payload);
+  RUN_TEST(test_unbalanced_objects_fail);
+  RUN_TEST(test_arrays);
+  RUN_TEST(test_msgpack_envelope);
+  RUN_TEST(test_msgpack_numbers);
+  RUN_TEST(test_msgpack_large_maps_and_strings);
+  RUN_TEST(test_msgpack_overflow_fails_the_payload);
+  RUN_TEST(test_no_allocations_per_cycle);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,98 @@
+// Native tests for the double-buffered sample storage (src/resources/utils/ping_pong.h).
+//
+// read() fills one side while publish() serializes the other. These lock in
+// that a swap freezes exactly what was read before it, that reads after it
+// land in a side that was reset, that no sample is lost at an interval
+// boundary (the old clear-after-publish dropped what came in between), and
+// that clear() empties both sides.
+#include <unity.h>
+
+#include "resources/utils/ping_pong.h"
+
+using hyphen::sample::PingPong;
+
+void setUp() {}
+void tearDown() {}
+
+// the shape of Accelerometer's buffer
+struct Samples {
+  int values[16];
+  size_t count;
+  void reset() { count = 0; }
+  void add(int value) {
+    if (count < 16) {
+      values[count++] = value;
+    }
+  }
+  int sum() const {
+    int total = 0;
+    for (size_t i = 0; i < count; i++) {
+      total += values[i];
+    }
+    return total;
+  }
+};
+
+void test_swap_freezes_what_was_read() {
+  PingPong<Samples> hold;
+  TEST_ASSERT_EQUAL(0, hold.fresh().count);
+  TEST_ASSERT_EQUAL(0, hold.frozen().count);
+  hold.fresh().add(1);
+  hold.fresh().add(2);
+  Samples &frozen = hold.swap();
+  TEST_ASSERT_TRUE(&frozen == &hold.frozen());
+  TEST_ASSERT_EQUAL(2, frozen.count);
+  TEST_ASSERT_EQUAL(0, hold.fresh().count);
+  // reads go on while the frozen side is serialized
+  hold.fresh().add(7);
+  TEST_ASSERT_EQUAL(3, frozen.sum());
+  TEST_ASSERT_EQUAL(7, hold.fresh().sum());
+}
+
+void test_the_other_side_is_reset_before_reads_get_it() {
+  PingPong<Samples> hold;
+  hold.fresh().add(1);
+  hold.swap();
+  hold.fresh().add(2);
+  // the side holding 1 was published; it comes back empty
+  TEST_ASSERT_EQUAL(2, hold.swap().sum());
+  TEST_ASSERT_EQUAL(0, hold.fresh().count);
+}
+
+void test_no_sample_is_lost_at_the_boundary() {
+  PingPong<Samples> hold;
+  int read = 0;
+  int published = 0;
+  for (int interval = 0; interval < 10; interval++) {
+    for (int i = 0; i < 5; i++) {
+      hold.fresh().add(1);
+      read++;
+    }
+    Samples &frozen = hold.swap();
+    // a read comes in while the payload is being written
+    hold.fresh().add(1);
+    read++;
+    published += frozen.sum();
+  }
+  published += hold.swap().sum();
+  TEST_ASSERT_EQUAL(read, published);
+}
+
+void test_clear_empties_both_sides() {
+  PingPong<Samples> hold;
+  hold.fresh().add(1);
+  hold.swap();
+  hold.fresh().add(2);
+  hold.clear();
+  TEST_ASSERT_EQUAL(0, hold.fresh().count);
+  TEST_ASSERT_EQUAL(0, hold.frozen().count);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_swap_freezes_what_was_read);
+  RUN_TEST(test_the_other_side_is_reset_before_reads_get_it);
+  RUN_TEST(test_no_sample_is_lost_at_the_boundary);
+  RUN_TEST(test_clear_empties_both_sides);
+  return UNITY_END();
+}
@@ -0,0 +1,186 @@
+// Native tests for the publisher's outbound queue (src/resources/utils/publish_queue.h).
+//
+// The main loop hands finished payloads to the publisher task through two
+// lock-free rings of slot indexes. These lock in FIFO order and the bounds of
+// the rings, that a slot is never handed out twice (also with a real producer
+// and consumer thread racing each other), how a slot holds the published and
+// the stored form of a payload, the backoff schedule, and the enqueue-to-ack
+// latency the metrics report.
+#include <unity.h>
+
+#include <thread>
+
+#include "resources/utils/publish_queue.h"
+
+using namespace hyphen::outbound;
+
+void setUp() {}
+void tearDown() {}
+
+void test_ring_is_fifo_and_bounded() {
+  SpscRing<int, 4> ring;
+  int v = 0;
+  TEST_ASSERT_FALSE(ring.pop(v));
+  for (int i = 1; i <= 4; i++) {
+    TEST_ASSERT_TRUE(ring.push(i));
+  }
+  TEST_ASSERT_FALSE(ring.push(5));
+  TEST_ASSERT_EQUAL(4, ring.size());
+  for (int i = 1; i <= 4; i++) {
+    TEST_ASSERT_TRUE(ring.pop(v));
+    TEST_ASSERT_EQUAL(i, v);
+  }
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_ring_survives_counter_wrap() {
+  SpscRing<int, 2> ring;
+  int v = 0;
+  // enough round trips to go past the point where head % N first repeats
+  for (int i = 0; i < 1000; i++) {
+    TEST_ASSERT_TRUE(ring.push(i));
+    TEST_ASSERT_TRUE(ring.pop(v));
+    TEST_ASSERT_EQUAL(i, v);
+  }
+}
+
+void test_outbox_hands_out_every_slot_once() {
+  static uint8_t buffers[4][64];
+  Outbox<4> outbox;
+  for (size_t i = 0; i < 4; i++) {
+    outbox.attach(i, buffers[i], sizeof(buffers[i]));
+  }
+  Outbound *taken[4];
+  for (int i = 0; i < 4; i++) {
+    taken[i] = outbox.acquire();
+    TEST_ASSERT_NOT_NULL(taken[i]);
+    for (int j = 0; j < i; j++) {
+      TEST_ASSERT_TRUE(taken[i] != taken[j]);
+    }
+  }
+  // all in flight: the main loop has to store this one itself
+  TEST_ASSERT_NULL(outbox.acquire());
+
+  outbox.submit(taken[2], 100);
+  outbox.submit(taken[0], 200);
+  outbox.cancel(taken[1]);
+  TEST_ASSERT_EQUAL(2, outbox.depth());
+  TEST_ASSERT_TRUE(outbox.next() == taken[2]);
+  TEST_ASSERT_EQUAL_UINT32(100, taken[2]->enqueuedMs);
+  outbox.release(taken[2]);
+  TEST_ASSERT_TRUE(outbox.next() == taken[0]);
+  TEST_ASSERT_NULL(outbox.next());
+  // one being delivered, one still with the producer
+  TEST_ASSERT_EQUAL(0, outbox.depth());
+  TEST_ASSERT_EQUAL(2, outbox.pending());
+  TEST_ASSERT_NOT_NULL(outbox.acquire());
+  TEST_ASSERT_NOT_NULL(outbox.acquire());
+  TEST_ASSERT_NULL(outbox.acquire());
+}
+
+void test_slot_holds_the_published_and_the_stored_form() {
+  uint8_t buffer[32];
+  Outbound slot;
+  slot.data = buffer;
+  slot.capacity = sizeof(buffer);
+  TEST_ASSERT_TRUE(slot.fill("Hy/Post/Black", (const uint8_t *)"{\"a\":1}", 7));
+  TEST_ASSERT_EQUAL_STRING("Hy/Post/Black", slot.topic);
+  TEST_ASSERT_EQUAL(7, slot.storedLength);
+  TEST_ASSERT_TRUE(slot.storedData() == buffer);
+
+  // a compact frame goes out, its expansion is stored
+  TEST_ASSERT_TRUE(slot.fill("Hy/Post/Compact", (const uint8_t *)"\x01\x00", 2, (const uint8_t *)"{\"a\":1}", 7));
+  TEST_ASSERT_EQUAL(2, slot.length);
+  TEST_ASSERT_EQUAL_MEMORY("{\"a\":1}", slot.storedData(), 7);
+
+  TEST_ASSERT_FALSE(slot.fill("Hy/Post/Black", buffer, 30, buffer, 3));
+  char longTopic[kTopicSize + 1];
+  memset(longTopic, 'x', kTopicSize);
+  longTopic[kTopicSize] = '\0';
+  TEST_ASSERT_FALSE(slot.fill(longTopic, buffer, 1));
+}
+
+void test_backoff_doubles_up_to_the_cap() {
+  RetryPolicy policy;
+  policy.baseMs = 1000;
+  policy.maxMs = 5000;
+  TEST_ASSERT_EQUAL_UINT32(1000, backoffMs(policy, 1));
+  TEST_ASSERT_EQUAL_UINT32(2000, backoffMs(policy, 2));
+  TEST_ASSERT_EQUAL_UINT32(4000, backoffMs(policy, 3));
+  TEST_ASSERT_EQUAL_UINT32(5000, backoffMs(policy, 4));
+  TEST_ASSERT_EQUAL_UINT32(5000, backoffMs(policy, 200));
+  // jitter stays within a quarter of the delay
+  TEST_ASSERT_EQUAL_UINT32(1000 + 250, backoffMs(policy, 1, 250));
+  TEST_ASSERT_TRUE(backoffMs(policy, 1, 0xFFFFFFFF) <= 1250);
+
+  TEST_ASSERT_TRUE(shouldRetry(policy, 1, true));
+  TEST_ASSERT_FALSE(shouldRetry(policy, 3, true));
+  TEST_ASSERT_FALSE(shouldRetry(policy, 1, false));
+}
+
+void test_metrics_measure_enqueue_to_ack() {
+  Metrics metrics;
+  metrics.enqueued(1);
+  metrics.enqueued(3);
+  metrics.enqueued(2);
+  TEST_ASSERT_EQUAL_UINT32(3, metrics.highWater());
+  metrics.acked(1000, 1200);
+  metrics.acked(0xFFFFFF00, 0x00000064);  // across the millis() rollover
+  TEST_ASSERT_EQUAL_UINT32(2, metrics.deliveredCount());
+  TEST_ASSERT_EQUAL_UINT32(356, metrics.lastLatencyMs());
+  TEST_ASSERT_EQUAL_UINT32(356, metrics.maxLatencyMs());
+  TEST_ASSERT_EQUAL_UINT32(278, metrics.meanLatencyMs());
+}
+
+void test_producer_and_consumer_threads() {
+  static uint8_t buffers[8][8];
+  static Outbox<8> outbox;
+  for (size_t i = 0; i < 8; i++) {
+    outbox.attach(i, buffers[i], sizeof(buffers[i]));
+  }
+  const uint32_t total = 200000;
+  uint32_t received = 0;
+  bool inOrder = true;
+
+  std::thread consumer([&]() {
+    while (received < total) {
+      Outbound *slot = outbox.next();
+      if (!slot) {
+        std::this_thread::yield();
+        continue;
+      }
+      uint32_t seq;
+      memcpy(&seq, slot->data, sizeof(seq));
+      inOrder = inOrder && seq == received;
+      received++;
+      outbox.release(slot);
+    }
+  });
+
+  for (uint32_t seq = 0; seq < total;) {
+    Outbound *slot = outbox.acquire();
+    if (!slot) {
+      std::this_thread::yield();
+      continue;
+    }
+    slot->fill("t", (const uint8_t *)&seq, sizeof(seq));
+    outbox.submit(slot, seq);
+    seq++;
+  }
+  consumer.join();
+  TEST_ASSERT_EQUAL_UINT32(total, received);
+  TEST_ASSERT_TRUE(inOrder);
+  TEST_ASSERT_EQUAL(0, outbox.depth());
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_is_fifo_and_bounded);
+  RUN_TEST(test_ring_survives_counter_wrap);
+  RUN_TEST(test_outbox_hands_out_every_slot_once);
+  RUN_TEST(test_slot_holds_the_published_and_the_stored_form);
+  RUN_TEST(test_backoff_doubles_up_to_the_cap);
+  RUN_TEST(test_metrics_measure_enqueue_to_ack);
+  RUN_TEST(test_producer_and_consumer_threads);
+  return UNITY_END();
+}
@@ -0,0 +1,136 @@
+// Native tests for the compact offline record encodings
+// (src/resources/utils/record_codec.h).
+//
+// Records on the card depend on these formats byte for byte. These lock in the
+// LZ round trip (including matches into the shared dictionary and overlapping
+// matches), rejection of malformed streams, the compression a typical
+// payloadWriter record gets, and marking a MessagePack map stale in place.
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "resources/utils/record_codec.h"
+
+using namespace hyphen::codec;
+
+void setUp() {}
+void tearDown() {}
+
+static uint16_t table[kTableSize];
+
+static std::vector<uint8_t> pack(const std::string &text) {
+  std::vector<uint8_t> out(text.size() + 8);
+  size_t n = compress((const uint8_t *)text.data(), text.size(), out.data(), out.size(), table);
+  out.resize(n);
+  return out;
+}
+
+static std::string unpack(const std::vector<uint8_t> &packed) {
+  std::vector<uint8_t> out(rawLength(packed.data(), packed.size()));
+  size_t n = decompress(packed.data(), packed.size(), out.data(), out.size());
+  return std::string((const char *)out.data(), n);
+}
+
+static const char *kRecord =
+    "{\"device\":\"2e11908790c75fb5915953d7\",\"target\":15,\"date\":\"2026-10-17T08:15:00Z\","
+    "\"__id\":\"8f2a4c1e-0007-00001234\",\"payload\":{\"temperature\":21.4,\"humidity\":63.2,"
+    "\"pressure\":1012.8,\"battery\":3.98}}";
+
+void test_round_trip() {
+  std::string texts[] = {kRecord, "x", "abcabcabcabcabcabcabcabcabcabc", std::string(500, 'z'),
+                         "{\"payload\":{}}"};
+  for (const std::string &text : texts) {
+    std::vector<uint8_t> packed = pack(text);
+    TEST_ASSERT_TRUE(packed.size() > 0);
+    TEST_ASSERT_EQUAL_STRING(text.c_str(), unpack(packed).c_str());
+  }
+}
+
+void test_typical_record_shrinks() {
+  std::vector<uint8_t> packed = pack(kRecord);
+  printf("record: %zu -> %zu bytes\n", strlen(kRecord), packed.size());
+  TEST_ASSERT_TRUE(packed.size() * 10 < strlen(kRecord) * 8);
+}
+
+void test_incompressible_input_does_not_fit() {
+  std::string noise;
+  for (int i = 0; i < 64; i++) {
+    noise += (char)((i * 73 + 11) & 0xFF);
+  }
+  std::vector<uint8_t> out(noise.size());
+  TEST_ASSERT_EQUAL(0, compress((const uint8_t *)noise.data(), noise.size(), out.data(), out.size(), table));
+}
+
+void test_malformed_streams_are_rejected() {
+  std::vector<uint8_t> packed = pack(kRecord);
+  uint8_t out[512];
+  // truncated
+  TEST_ASSERT_EQUAL(0, decompress(packed.data(), packed.size() - 1, out, sizeof(out)));
+  // distance before the dictionary
+  const uint8_t far[] = {5, 0x81, 0xFF, 0xFF};
+  TEST_ASSERT_EQUAL(0, decompress(far, sizeof(far), out, sizeof(out)));
+  // longer than it claims
+  const uint8_t longer[] = {1, 0x01, 'a', 'b'};
+  TEST_ASSERT_EQUAL(0, decompress(longer, sizeof(longer), out, sizeof(out)));
+  // raw length bigger than the output
+  TEST_ASSERT_EQUAL(0, decompress(packed.data(), packed.size(), out, 10));
+}
+
+void test_varint() {
+  uint8_t buf[5];
+  uint32_t v;
+  TEST_ASSERT_EQUAL(1, putVarint(buf, sizeof(buf), 127));
+  TEST_ASSERT_EQUAL(2, putVarint(buf, sizeof(buf), 300));
+  TEST_ASSERT_EQUAL(2, getVarint(buf, 2, v));
+  TEST_ASSERT_EQUAL_UINT32(300, v);
+  TEST_ASSERT_EQUAL(0, getVarint(buf, 1, v));  // cut short
+}
+
+void test_stale_added_to_fixmap() {
+  // {"a": 1}
+  const uint8_t in[] = {0x81, 0xA1, 'a', 0x01};
+  uint8_t out[sizeof(in) + kStaleExtra];
+  size_t n = addStaleToMap(in, sizeof(in), out, sizeof(out));
+  const uint8_t expected[] = {0x82, 0xA1, 'a', 0x01, 0xA5, 's', 't', 'a', 'l', 'e', 0xC3};
+  TEST_ASSERT_EQUAL(sizeof(expected), n);
+  TEST_ASSERT_EQUAL_MEMORY(expected, out, n);
+}
+
+void test_stale_widens_a_full_fixmap() {
+  std::vector<uint8_t> in = {0x8F};
+  for (int i = 0; i < 15; i++) {
+    in.push_back(0xA1);
+    in.push_back((uint8_t)('a' + i));
+    in.push_back((uint8_t)i);
+  }
+  std::vector<uint8_t> out(in.size() + kStaleExtra);
+  size_t n = addStaleToMap(in.data(), in.size(), out.data(), out.size());
+  TEST_ASSERT_EQUAL(in.size() + 2 + 7, n);
+  TEST_ASSERT_EQUAL_UINT8(0xDE, out[0]);
+  TEST_ASSERT_EQUAL_UINT8(0x00, out[1]);
+  TEST_ASSERT_EQUAL_UINT8(0x10, out[2]);
+  TEST_ASSERT_EQUAL_UINT8(0xC3, out[n - 1]);
+}
+
+void test_stale_needs_a_map() {
+  const uint8_t array[] = {0x91, 0x01};
+  uint8_t out[16];
+  TEST_ASSERT_EQUAL(0, addStaleToMap(array, sizeof(array), out, sizeof(out)));
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_typical_record_shrinks);
+  RUN_TEST(test_incompressible_input_does_not_fit);
+  RUN_TEST(test_malformed_streams_are_rejected);
+  RUN_TEST(test_varint);
+  RUN_TEST(test_stale_added_to_fixmap);
+  RUN_TEST(test_stale_widens_a_full_fixmap);
+  RUN_TEST(test_stale_needs_a_map);
+  return UNITY_END();
+}
@@ -0,0 +1,173 @@
+// Native tests for the offline record framing (src/resources/utils/record_log.h).
+//
+// The old text log used '\n' as its only record boundary, so one torn write
+// corrupted every record after it. These lock in the framed format: header
+// round-trip, CRC rejection of damaged frames, resyncing on the next magic so
+// a torn record costs exactly one record, and that marking a record delivered
+// in place doesn't break its CRC.
+#include <unity.h>
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "resources/utils/record_log.h"
+
+using namespace hyphen::records;
+
+void setUp() {}
+void tearDown() {}
+
+static void appendFrame(std::vector<uint8_t> &log, const char *payload, uint8_t topicId) {
+  Header h;
+  h.topicId = topicId;
+  h.length = (uint32_t)strlen(payload);
+  uint8_t raw[kHeaderSize];
+  encodeHeader(h, (const uint8_t *)payload, raw);
+  log.insert(log.end(), raw, raw + kHeaderSize);
+  log.insert(log.end(), payload, payload + h.length);
+}
+
+// Walk the log the way PayloadStore::pop does: header, verify, jump.
+static int countValid(const std::vector<uint8_t> &log) {
+  size_t pos = 0;
+  int valid = 0;
+  while (pos + kHeaderSize <= log.size()) {
+    Header h;
+    if (!decodeHeader(&log[pos], h) || pos + frameSize(h) > log.size() ||
+        !verify(&log[pos], h, &log[pos + kHeaderSize])) {
+      long next = findMagic(log.data(), log.size(), pos + 1);
+      if (next < 0) {
+        break;
+      }
+      pos = (size_t)next;
+      continue;
+    }
+    valid++;
+    pos += frameSize(h);
+  }
+  return valid;
+}
+
+void test_crc32_known_vector() {
+  const char *s = "123456789";
+  TEST_ASSERT_EQUAL_HEX32(0xCBF43926, crc32((const uint8_t *)s, 9));
+}
+
+void test_crc32_chains() {
+  const uint8_t *s = (const uint8_t *)"123456789";
+  TEST_ASSERT_EQUAL_HEX32(crc32(s, 9), crc32(s + 4, 5, crc32(s, 4)));
+}
+
+void test_header_round_trip() {
+  const char *payload = "{\"device\":\"abc\"}";
+  Header in;
+  in.flags = FLAG_INLINE_TOPIC;
+  in.topicId = 3;
+  in.length = (uint32_t)strlen(payload);
+  uint8_t raw[kHeaderSize];
+  encodeHeader(in, (const uint8_t *)payload, raw);
+
+  Header out;
+  TEST_ASSERT_TRUE(decodeHeader(raw, out));
+  TEST_ASSERT_EQUAL_UINT8(FLAG_INLINE_TOPIC, out.flags);
+  TEST_ASSERT_EQUAL_UINT8(3, out.topicId);
+  TEST_ASSERT_EQUAL_UINT32(in.length, out.length);
+  TEST_ASSERT_EQUAL_HEX32(in.crc, out.crc);
+  TEST_ASSERT_TRUE(verify(raw, out, (const uint8_t *)payload));
+}
+
+void test_bad_magic_and_absurd_length_rejected() {
+  uint8_t raw[kHeaderSize] = {0};
+  Header h;
+  TEST_ASSERT_FALSE(decodeHeader(raw, h));
+  raw[0] = kMagic0;
+  raw[1] = kMagic1;
+  putU32(raw + 4, kMaxPayload + 1);
+  TEST_ASSERT_FALSE(decodeHeader(raw, h));
+}
+
+void test_flipped_payload_bit_fails_crc() {
+  std::vector<uint8_t> log;
+  appendFrame(log, "{\"v\":1}", 1);
+  log[kHeaderSize + 2] ^= 0x01;
+  Header h;
+  TEST_ASSERT_TRUE(decodeHeader(log.data(), h));
+  TEST_ASSERT_FALSE(verify(log.data(), h, log.data() + kHeaderSize));
+}
+
+void test_delivered_mark_keeps_the_crc() {
+  std::vector<uint8_t> log;
+  appendFrame(log, "{\"v\":1}", 1);
+  // the backlog lane sets the bit in place after sending the record
+  log[2] |= FLAG_DELIVERED;
+  Header h;
+  TEST_ASSERT_TRUE(decodeHeader(log.data(), h));
+  TEST_ASSERT_TRUE(h.flags & FLAG_DELIVERED);
+  TEST_ASSERT_TRUE(verify(log.data(), h, log.data() + kHeaderSize));
+  // any other flag still has to match
+  log[2] |= FLAG_LZ;
+  TEST_ASSERT_FALSE(verify(log.data(), h, log.data() + kHeaderSize));
+}
+
+void test_torn_record_costs_only_itself() {
+  std::vector<uint8_t> log;
+  appendFrame(log, "{\"a\":1}", 1);
+  // brownout: header + half the payload made it to the card
+  std::vector<uint8_t> torn;
+  appendFrame(torn, "{\"b\":2222222}", 1);
+  log.insert(log.end(), torn.begin(), torn.begin() + kHeaderSize + 4);
+  appendFrame(log, "{\"c\":3}", 1);
+  appendFrame(log, "{\"d\":4}", 2);
+  TEST_ASSERT_EQUAL_INT(3, countValid(log));
+}
+
+void test_garbage_prefix_is_skipped() {
+  std::vector<uint8_t> log = {'x', 'y', 'H', 'z'};
+  appendFrame(log, "{\"a\":1}", 1);
+  TEST_ASSERT_EQUAL_INT(1, countValid(log));
+}
+
+void test_empty_payload_is_a_valid_frame() {
+  std::vector<uint8_t> log;
+  appendFrame(log, "", 4);
+  TEST_ASSERT_EQUAL_size_t(kHeaderSize, log.size());
+  TEST_ASSERT_EQUAL_INT(1, countValid(log));
+}
+
+static std::string spliced(const char *json) {
+  const char *insert;
+  size_t len = strlen(json);
+  size_t at = staleSplicePoint(json, len, insert);
+  return std::string(json, at) + insert + std::string(json + at, len - at);
+}
+
+void test_stale_is_spliced_without_parsing() {
+  TEST_ASSERT_TRUE(canSpliceStale("{\"a\":1}", 7));
+  TEST_ASSERT_EQUAL_STRING("{\"a\":1,\"stale\":true}", spliced("{\"a\":1}").c_str());
+  TEST_ASSERT_EQUAL_STRING("{\"stale\":true}", spliced("{}").c_str());
+  TEST_ASSERT_EQUAL_STRING("{ \"stale\":true}", spliced("{ }").c_str());
+}
+
+void test_only_plain_objects_are_spliced() {
+  const char *cases[] = {"[1,2]", "{\"a\":1", "{\"stale\":false}", "{\"a\":\n1}", "", "}"};
+  for (const char *json : cases) {
+    TEST_ASSERT_FALSE_MESSAGE(canSpliceStale(json, strlen(json)), json);
+  }
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_crc32_known_vector);
+  RUN_TEST(test_crc32_chains);
+  RUN_TEST(test_header_round_trip);
+  RUN_TEST(test_bad_magic_and_absurd_length_rejected);
+  RUN_TEST(test_flipped_payload_bit_fails_crc);
+  RUN_TEST(test_delivered_mark_keeps_the_crc);
+  RUN_TEST(test_torn_record_costs_only_itself);
+  RUN_TEST(test_garbage_prefix_is_skipped);
+  RUN_TEST(test_empty_payload_is_a_valid_frame);
+  RUN_TEST(test_stale_is_spliced_without_parsing);
+  RUN_TEST(test_only_plain_objects_are_spliced);
+  return UNITY_END();
+}
@@ -0,0 +1,116 @@
+// Native tests for the offline RAM ring (src/resources/utils/record_ring.h).
+//
+// Without an SD card the offline store holds records here until the card is
+// back. These lock in FIFO order across the wrap, eviction of the oldest
+// records when full (never a torn one), and the counters behind the NVS
+// summary written before a planned reboot.
+#include <unity.h>
+
+#include <string.h>
+#include <string>
+
+#include "resources/utils/record_ring.h"
+
+using namespace hyphen::ring;
+
+static uint8_t buffer[64];
+static RecordRing ring;
+
+void setUp() {
+  memset(buffer, 0xEE, sizeof(buffer));
+  ring.attach(buffer, sizeof(buffer));
+}
+void tearDown() {}
+
+static bool pushText(const std::string &text) {
+  return ring.push((const uint8_t *)text.data(), text.size());
+}
+
+static std::string popText() {
+  const uint8_t *data;
+  size_t len;
+  if (!ring.front(data, len)) {
+    return "<empty>";
+  }
+  std::string out((const char *)data, len);
+  ring.pop();
+  return out;
+}
+
+void test_fifo_order() {
+  TEST_ASSERT_TRUE(pushText("one"));
+  TEST_ASSERT_TRUE(pushText("two"));
+  TEST_ASSERT_TRUE(pushText(""));
+  TEST_ASSERT_EQUAL_UINT32(3, ring.count());
+  TEST_ASSERT_EQUAL(6, ring.bytes());
+  TEST_ASSERT_EQUAL_STRING("one", popText().c_str());
+  TEST_ASSERT_EQUAL_STRING("two", popText().c_str());
+  TEST_ASSERT_EQUAL_STRING("", popText().c_str());
+  TEST_ASSERT_EQUAL_STRING("<empty>", popText().c_str());
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_entries_wrap_whole() {
+  // 3 x (4 + 16) = 60 of 64 bytes
+  TEST_ASSERT_TRUE(pushText("aaaaaaaaaaaaaaaa"));
+  TEST_ASSERT_TRUE(pushText("bbbbbbbbbbbbbbbb"));
+  TEST_ASSERT_TRUE(pushText("cccccccccccccccc"));
+  TEST_ASSERT_EQUAL_STRING("aaaaaaaaaaaaaaaa", popText().c_str());
+  // doesn't fit in the last 4 bytes: starts over at the front
+  TEST_ASSERT_TRUE(pushText("dddddddddddddddd"));
+  TEST_ASSERT_EQUAL_UINT32(0, ring.dropped());
+  TEST_ASSERT_EQUAL_STRING("bbbbbbbbbbbbbbbb", popText().c_str());
+  TEST_ASSERT_EQUAL_STRING("cccccccccccccccc", popText().c_str());
+  TEST_ASSERT_EQUAL_STRING("dddddddddddddddd", popText().c_str());
+  TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_full_ring_drops_oldest() {
+  for (int i = 0; i < 10; i++) {
+    TEST_ASSERT_TRUE(pushText("record-" + std::to_string(i) + "-xxxxxxxx"));
+  }
+  TEST_ASSERT_TRUE(ring.dropped() > 0);
+  TEST_ASSERT_EQUAL_UINT32(10, ring.count() + ring.dropped());
+  std::string last;
+  uint32_t left = ring.count();
+  for (uint32_t i = 0; i < left; i++) {
+    last = popText();
+    int n = 10 - (int)left + (int)i;
+    TEST_ASSERT_EQUAL_STRING(("record-" + std::to_string(n) + "-xxxxxxxx").c_str(), last.c_str());
+  }
+}
+
+void test_too_big_is_refused_without_evicting() {
+  TEST_ASSERT_TRUE(pushText("keep"));
+  std::string big(61, 'x');
+  TEST_ASSERT_FALSE(pushText(big));
+  TEST_ASSERT_EQUAL_UINT32(1, ring.count());
+  TEST_ASSERT_TRUE(pushText(std::string(53, 'y')));  // evicts "keep" to fit
+  TEST_ASSERT_EQUAL_UINT32(1, ring.dropped());
+}
+
+void test_detached_ring_refuses() {
+  RecordRing none;
+  TEST_ASSERT_FALSE(none.attached());
+  TEST_ASSERT_FALSE(none.push((const uint8_t *)"x", 1));
+}
+
+void test_summary_counts() {
+  pushText("12345");
+  pushText("678");
+  Summary s = ring.summary();
+  TEST_ASSERT_EQUAL_UINT32(2, s.records);
+  TEST_ASSERT_EQUAL_UINT32(8, s.bytes);
+  TEST_ASSERT_EQUAL_UINT32(0, s.dropped);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_order);
+  RUN_TEST(test_entries_wrap_whole);
+  RUN_TEST(test_full_ring_drops_oldest);
+  RUN_TEST(test_too_big_is_refused_without_evicting);
+  RUN_TEST(test_detached_ring_refuses);
+  RUN_TEST(test_summary_counts);
+  return UNITY_END();
+}
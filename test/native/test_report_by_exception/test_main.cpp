@@ -0,0 +1,178 @@
+// Native tests for report by exception (src/resources/utils/report_by_exception.h).
+//
+// A number goes into the payload only when it moved past the deadband of its
+// key, was silent for too long, or the payload is a keyframe. These lock in
+// those three rules, that the same key in two device slots is tracked
+// separately, that everything but numbers passes, the null placeholders for
+// compact frames, the commands of the cloud function, and how much of a day
+// of stable readings is left on the wire.
+#include <unity.h>
+
+#include <stdio.h>
+
+#include "resources/utils/report_by_exception.h"
+
+using namespace hyphen::rbe;
+using hyphen::payload::JsonWriter;
+
+void setUp() {}
+void tearDown() {}
+
+static char out[512];
+
+// DeviceManager::writeDevices for one slot: the slot object, then the device
+static const char *publish(Tracker &tracker, const Settings &settings, uint32_t now, bool keyframe, float level,
+                           int moisture, bool placeholders = false) {
+  JsonWriter writer(out, sizeof(out));
+  writer.beginObject();
+  writer.beginObject("payload");
+  Filter filter(writer, tracker, settings, now, keyframe, "payload", placeholders);
+  filter.add("wl_1", level);
+  filter.add("sm_1", moisture);
+  filter.add("status", "ok");
+  filter.endObject();
+  writer.endObject();
+  writer.endObject();
+  return writer.complete() && filter.ok() ? writer.c_str() : "";
+}
+
+void test_deadband_and_max_silence() {
+  Settings settings;
+  TEST_ASSERT_TRUE(apply(settings, "wl_1,0.5,600"));
+  Tracker tracker;
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"wl_1\":10,\"sm_1\":30,\"status\":\"ok\"}}",
+                           publish(tracker, settings, 1000, false, 10.0f, 30));
+  // within the deadband, and sm_1 didn't change at all
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"status\":\"ok\"}}", publish(tracker, settings, 1300, false, 10.4f, 30));
+  // past it, measured from the value last sent
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"wl_1\":10.6,\"status\":\"ok\"}}",
+                           publish(tracker, settings, 1400, false, 10.6f, 30));
+  // sm_1 takes the default: any change
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"sm_1\":31,\"status\":\"ok\"}}",
+                           publish(tracker, settings, 1500, false, 10.6f, 31));
+  // silent for 600 s
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"wl_1\":10.6,\"status\":\"ok\"}}",
+                           publish(tracker, settings, 2000, false, 10.6f, 31));
+}
+
+void test_keyframes_carry_everything() {
+  Settings settings;
+  settings.keyframeSeconds = 3600;
+  Tracker tracker;
+  TEST_ASSERT_TRUE(tracker.keyframe(1000, settings.keyframeSeconds));
+  publish(tracker, settings, 1000, true, 10.0f, 30);
+  TEST_ASSERT_FALSE(tracker.keyframe(2000, settings.keyframeSeconds));
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"status\":\"ok\"}}", publish(tracker, settings, 2000, false, 10.0f, 30));
+  TEST_ASSERT_TRUE(tracker.keyframe(4600, settings.keyframeSeconds));
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"wl_1\":10,\"sm_1\":30,\"status\":\"ok\"}}",
+                           publish(tracker, settings, 4600, true, 10.0f, 30));
+  tracker.forceKeyframe();
+  TEST_ASSERT_TRUE(tracker.keyframe(4700, settings.keyframeSeconds));
+}
+
+void test_slots_are_tracked_apart() {
+  Settings settings;
+  Tracker tracker;
+  JsonWriter writer(out, sizeof(out));
+  writer.beginObject();
+  const char *slots[] = {"payload", "payload-1"};
+  for (int round = 0; round < 2; round++) {
+    writer.reset();
+    writer.beginObject();
+    for (const char *slot : slots) {
+      writer.beginObject(slot);
+      Filter filter(writer, tracker, settings, 100 + round, false, slot);
+      filter.add("wl_1", 5);
+      filter.beginObject("nested");
+      filter.add("wl_1", 7);
+      filter.endObject();
+      filter.endObject();
+      writer.endObject();
+    }
+    writer.endObject();
+  }
+  // the second round held all four back
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"nested\":{}},\"payload-1\":{\"nested\":{}}}", writer.c_str());
+  TEST_ASSERT_EQUAL(4, tracker.tracked());
+}
+
+void test_placeholders_keep_the_shape() {
+  Settings settings;
+  Tracker tracker;
+  publish(tracker, settings, 100, false, 10.0f, 30, true);
+  TEST_ASSERT_EQUAL_STRING("{\"payload\":{\"wl_1\":null,\"sm_1\":31,\"status\":\"ok\"}}",
+                           publish(tracker, settings, 200, false, 10.0f, 31, true));
+}
+
+void test_commands() {
+  Settings settings;
+  TEST_ASSERT_FALSE(settings.enabled);
+  TEST_ASSERT_TRUE(apply(settings, "on"));
+  TEST_ASSERT_TRUE(settings.enabled);
+  TEST_ASSERT_TRUE(apply(settings, "keyframe,86400"));
+  TEST_ASSERT_EQUAL_UINT32(86400, settings.keyframeSeconds);
+  TEST_ASSERT_TRUE(apply(settings, "*,0.1,7200"));
+  TEST_ASSERT_EQUAL_UINT32(7200, settings.rule("anything").maxSilence);
+  // a rule without a max silence takes the default one
+  TEST_ASSERT_TRUE(apply(settings, "wl_1,5"));
+  TEST_ASSERT_EQUAL_FLOAT(5.0f, settings.rule("wl_1").deadband);
+  TEST_ASSERT_EQUAL_UINT32(7200, settings.rule("wl_1").maxSilence);
+  TEST_ASSERT_TRUE(apply(settings, "wl_1,2,60"));
+  TEST_ASSERT_EQUAL(1, settings.count);
+  TEST_ASSERT_EQUAL_UINT32(60, settings.rule("wl_1").maxSilence);
+  TEST_ASSERT_TRUE(apply(settings, "wl_1,-"));
+  TEST_ASSERT_EQUAL_FLOAT(0.1f, settings.rule("wl_1").deadband);
+
+  TEST_ASSERT_FALSE(apply(settings, "wl_1"));
+  TEST_ASSERT_FALSE(apply(settings, "wl_1,abc"));
+  TEST_ASSERT_FALSE(apply(settings, "wl_1,-3"));
+  TEST_ASSERT_FALSE(apply(settings, "wl_1,1,60x"));
+  TEST_ASSERT_FALSE(apply(settings, "keyframe,0"));
+  TEST_ASSERT_FALSE(apply(settings, "a_key_that_is_far_too_long,1"));
+  char key[8];
+  for (size_t i = 0; i < kMaxRules; i++) {
+    snprintf(key, sizeof(key), "k%u,1", (unsigned)i);
+    TEST_ASSERT_TRUE(apply(settings, key));
+  }
+  TEST_ASSERT_FALSE(apply(settings, "one_more,1"));
+
+  TEST_ASSERT_TRUE(apply(settings, "clear"));
+  TEST_ASSERT_TRUE(settings.enabled);
+  TEST_ASSERT_EQUAL(0, settings.count);
+}
+
+void test_a_stable_day() {
+  // a water level wobbling by a few millimetres, 10 minute intervals
+  Settings settings;
+  apply(settings, "wl_1,0.01,3600");
+  apply(settings, "sm_1,1,3600");
+  Tracker tracker;
+  size_t sent = 0;
+  size_t held = 0;
+  for (uint32_t i = 0; i < 144; i++) {
+    uint32_t now = 1760688000 + 600 * i;
+    JsonWriter writer(out, sizeof(out));
+    writer.beginObject();
+    writer.beginObject("payload");
+    Filter filter(writer, tracker, settings, now, tracker.keyframe(now, settings.keyframeSeconds), "payload");
+    filter.add("wl_1", 1.843f + 0.003f * (float)(i % 3));
+    filter.add("sm_1", 30 + (int)(i / 72));
+    filter.endObject();
+    sent += filter.sent();
+    held += filter.held();
+  }
+  printf("a stable day: %zu of %zu readings sent\n", sent, sent + held);
+  TEST_ASSERT_EQUAL(288, sent + held);
+  TEST_ASSERT_TRUE(sent * 4 < held);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_deadband_and_max_silence);
+  RUN_TEST(test_keyframes_carry_everything);
+  RUN_TEST(test_slots_are_tracked_apart);
+  RUN_TEST(test_placeholders_keep_the_shape);
+  RUN_TEST(test_commands);
+  RUN_TEST(test_a_stable_day);
+  return UNITY_END();
+}
@@ -0,0 +1,119 @@
+// Native tests for the sample window (src/resources/utils/sample_ring.h).
+//
+// Publish reads a device's interval statistics without sorting. These lock in
+// that the running count, mean and variance match a two-pass computation, that
+// min, max, median and quantiles come from the sorted window, that a full
+// window evicts its oldest sample (and takes it out of every statistic), and
+// that reset() starts over.
+#include <unity.h>
+
+#include <math.h>
+
+#include "resources/utils/sample_ring.h"
+
+using hyphen::agg::SampleRing;
+
+void setUp() {}
+void tearDown() {}
+
+void test_empty_window() {
+  SampleRing<int, 4> ring;
+  TEST_ASSERT_TRUE(ring.empty());
+  TEST_ASSERT_EQUAL(0, ring.count());
+  TEST_ASSERT_EQUAL(0, ring.median());
+  TEST_ASSERT_EQUAL(0, ring.min());
+  TEST_ASSERT_EQUAL(0, ring.max());
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, (float)ring.variance());
+}
+
+void test_running_stats_match_two_pass() {
+  const float samples[] = {12.5f, 3.0f, 7.25f, 9.0f, 3.0f, 15.5f, 1.0f};
+  const size_t n = sizeof(samples) / sizeof(samples[0]);
+  SampleRing<float, 8> ring;
+  double total = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    ring.push(samples[i]);
+    total += samples[i];
+  }
+  double mean = total / n;
+  double squares = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    squares += (samples[i] - mean) * (samples[i] - mean);
+  }
+  TEST_ASSERT_EQUAL(n, ring.count());
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, (float)mean, (float)ring.mean());
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, (float)(squares / (n - 1)), (float)ring.variance());
+  TEST_ASSERT_FLOAT_WITHIN(1e-4f, (float)total, (float)ring.sum());
+  TEST_ASSERT_EQUAL_FLOAT(1.0f, ring.min());
+  TEST_ASSERT_EQUAL_FLOAT(15.5f, ring.max());
+  TEST_ASSERT_EQUAL_FLOAT(7.25f, ring.median());
+}
+
+void test_median_and_quantiles() {
+  SampleRing<int, 8> ring;
+  ring.push(40);
+  ring.push(10);
+  ring.push(30);
+  ring.push(20);
+  // halfway between the middle two
+  TEST_ASSERT_EQUAL(25, ring.median());
+  TEST_ASSERT_EQUAL(10, ring.quantile(0.0f));
+  TEST_ASSERT_EQUAL(10, ring.quantile(0.25f));
+  TEST_ASSERT_EQUAL(30, ring.quantile(0.6f));
+  TEST_ASSERT_EQUAL(40, ring.quantile(1.0f));
+  ring.push(20);
+  TEST_ASSERT_EQUAL(20, ring.median());
+  // unsigned values don't wrap
+  SampleRing<uint32_t, 4> wide;
+  wide.push(4000000000u);
+  wide.push(4000000010u);
+  TEST_ASSERT_EQUAL_UINT32(4000000005u, wide.median());
+}
+
+void test_full_window_evicts_the_oldest() {
+  SampleRing<int, 3> ring;
+  ring.push(100);
+  ring.push(1);
+  ring.push(2);
+  TEST_ASSERT_TRUE(ring.full());
+  TEST_ASSERT_EQUAL(100, ring.max());
+  ring.push(3);
+  // 100 left the window and every statistic
+  TEST_ASSERT_EQUAL(3, ring.count());
+  TEST_ASSERT_EQUAL(3, ring.max());
+  TEST_ASSERT_EQUAL(1, ring.min());
+  TEST_ASSERT_EQUAL(2, ring.median());
+  TEST_ASSERT_FLOAT_WITHIN(1e-9f, 2.0f, (float)ring.mean());
+  TEST_ASSERT_FLOAT_WITHIN(1e-9f, 1.0f, (float)ring.variance());
+  TEST_ASSERT_EQUAL(3, ring.newest(0));
+  TEST_ASSERT_EQUAL(1, ring.newest(2));
+  // a long run stays exact
+  for (int i = 0; i < 1000; i++) {
+    ring.push(i % 7);
+  }
+  int a = 999 % 7, b = 998 % 7, c = 997 % 7;
+  TEST_ASSERT_FLOAT_WITHIN(1e-6f, (a + b + c) / 3.0f, (float)ring.mean());
+  TEST_ASSERT_EQUAL(a > b ? (a > c ? a : c) : (b > c ? b : c), ring.max());
+}
+
+void test_reset_starts_over() {
+  SampleRing<int, 4> ring;
+  ring.push(5);
+  ring.push(9);
+  ring.reset();
+  TEST_ASSERT_TRUE(ring.empty());
+  ring.push(7);
+  TEST_ASSERT_EQUAL(7, ring.median());
+  TEST_ASSERT_EQUAL(7, ring.min());
+  TEST_ASSERT_FLOAT_WITHIN(1e-9f, 7.0f, (float)ring.mean());
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_window);
+  RUN_TEST(test_running_stats_match_two_pass);
+  RUN_TEST(test_median_and_quantiles);
+  RUN_TEST(test_full_window_evicts_the_oldest);
+  RUN_TEST(test_reset_starts_over);
+  return UNITY_END();
+}
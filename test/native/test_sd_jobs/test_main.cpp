@@ -0,0 +1,172 @@
+// Native tests for the SD worker's jobs (src/resources/utils/sd_jobs.h), run
+// against the file-backed SdFat shim.
+//
+// Storage calls used to block the caller on the SPI mutex for the whole card
+// operation; they now queue a job for the SD worker. These lock in what a job
+// does to the file, that it owns copies of what it was given, and how results
+// reach callbacks and futures (who frees the bytes of a read).
+#include <unity.h>
+
+#include <string.h>
+#include <string>
+
+#include "resources/utils/sd_jobs.h"
+
+using namespace hyphen::sdjobs;
+
+static const char *kPath = "jobs.txt";
+
+void setUp() {
+  hyphen_test_sd::reset(kPath);
+  hyphen_test_sd::restoreWrites();
+}
+void tearDown() {}
+
+static Result run(Job job) {
+  Result result = execute(job);
+  Result copy = result;
+  copy.data = nullptr;
+  finish(job, result);
+  return copy;
+}
+
+static Job appendJob(const char *text, uint64_t maxBytes = 0) {
+  Job job = make(OP_APPEND, kPath, (const uint8_t *)text, strlen(text));
+  job.maxBytes = maxBytes;
+  return job;
+}
+
+static std::string contents() {
+  Future future;
+  Job job = make(OP_READ, kPath);
+  job.len = 256;
+  job.future = &future;
+  Result result = execute(job);
+  finish(job, result);
+  return future.ready() && future.result().ok ? std::string((const char *)future.result().data) : "";
+}
+
+void test_append_creates_and_grows_file() {
+  Result r = run(appendJob("abc"));
+  TEST_ASSERT_TRUE(r.ok);
+  TEST_ASSERT_EQUAL_UINT64(3, r.size);
+  r = run(appendJob("defg"));
+  TEST_ASSERT_EQUAL_UINT64(7, r.size);
+  TEST_ASSERT_EQUAL_STRING("abcdefg", contents().c_str());
+}
+
+void test_append_rotates_past_max_bytes() {
+  run(appendJob("0123456789", 16));
+  Result r = run(appendJob("abcdefghij", 16));
+  TEST_ASSERT_TRUE(r.ok);
+  TEST_ASSERT_EQUAL_UINT64(10, r.size);
+  TEST_ASSERT_EQUAL_STRING("abcdefghij", contents().c_str());
+}
+
+void test_short_write_is_reported() {
+  hyphen_test_sd::failWritesAfter(2);
+  Result r = run(appendJob("abcdef"));
+  TEST_ASSERT_FALSE(r.ok);
+  TEST_ASSERT_EQUAL_UINT64(2, r.size);
+}
+
+void test_read_at_offset() {
+  run(appendJob("hello world"));
+  Future future;
+  Job job = make(OP_READ, kPath);
+  job.offset = 6;
+  job.len = 64;
+  job.future = &future;
+  Result result = execute(job);
+  finish(job, result);
+  TEST_ASSERT_TRUE(future.ready());
+  TEST_ASSERT_TRUE(future.result().ok);
+  TEST_ASSERT_EQUAL_size_t(5, future.result().length);
+  TEST_ASSERT_EQUAL_STRING("world", (const char *)future.result().data);
+}
+
+void test_read_of_missing_file_fails() {
+  Job job = make(OP_READ, "missing.txt");
+  job.len = 8;
+  Result r = run(job);
+  TEST_ASSERT_FALSE(r.ok);
+}
+
+void test_overwrite_replaces_contents() {
+  run(appendJob("old contents"));
+  const char *text = "new";
+  Result r = run(make(OP_OVERWRITE, kPath, (const uint8_t *)text, 3));
+  TEST_ASSERT_TRUE(r.ok);
+  TEST_ASSERT_EQUAL_STRING("new", contents().c_str());
+  r = run(make(OP_OVERWRITE, kPath));
+  TEST_ASSERT_TRUE(r.ok);
+  TEST_ASSERT_EQUAL_UINT64(0, r.size);
+}
+
+void test_job_owns_copies() {
+  char text[] = "copy";
+  char path[] = "jobs.txt";
+  Job job = make(OP_APPEND, path, (const uint8_t *)text, 4);
+  text[0] = 'X';
+  path[0] = 'X';
+  run(job);
+  TEST_ASSERT_EQUAL_STRING("copy", contents().c_str());
+}
+
+void test_remove_deletes_file() {
+  run(appendJob("gone"));
+  SdFat sd;
+  TEST_ASSERT_TRUE(sd.exists(kPath));
+  TEST_ASSERT_TRUE(run(make(OP_REMOVE, kPath)).ok);
+  TEST_ASSERT_FALSE(sd.exists(kPath));
+  TEST_ASSERT_FALSE(run(make(OP_REMOVE, kPath)).ok);
+}
+
+struct Seen {
+  int calls = 0;
+  bool ok = false;
+  std::string data;
+};
+
+static void remember(const Result &result, void *context) {
+  Seen *seen = static_cast<Seen *>(context);
+  seen->calls++;
+  seen->ok = result.ok;
+  seen->data = result.data ? (const char *)result.data : "";
+}
+
+void test_callback_then_future() {
+  run(appendJob("payload"));
+  Seen seen;
+  Future future;
+  Job job = make(OP_READ, kPath);
+  job.len = 3;
+  job.callback = remember;
+  job.context = &seen;
+  job.future = &future;
+  TEST_ASSERT_FALSE(future.ready());
+  TEST_ASSERT_FALSE(future.wait(5));
+  Result result = execute(job);
+  finish(job, result);
+  TEST_ASSERT_EQUAL_INT(1, seen.calls);
+  TEST_ASSERT_TRUE(seen.ok);
+  TEST_ASSERT_EQUAL_STRING("pay", seen.data.c_str());
+  TEST_ASSERT_TRUE(future.wait(0));
+  TEST_ASSERT_EQUAL_STRING("pay", (const char *)future.result().data);
+  TEST_ASSERT_NULL(job.path);
+  TEST_ASSERT_NULL(job.data);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_append_creates_and_grows_file);
+  RUN_TEST(test_append_rotates_past_max_bytes);
+  RUN_TEST(test_short_write_is_reported);
+  RUN_TEST(test_read_at_offset);
+  RUN_TEST(test_read_of_missing_file_fails);
+  RUN_TEST(test_overwrite_replaces_contents);
+  RUN_TEST(test_job_owns_copies);
+  RUN_TEST(test_remove_deletes_file);
+  RUN_TEST(test_callback_then_future);
+  return UNITY_END();
+}
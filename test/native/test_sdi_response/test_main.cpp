@@ -0,0 +1,215 @@
+// Native tests and benchmark for the SDI-12 response parser
+// (src/resources/utils/sdi_response.h).
+//
+// Every SDI-12 read parses one response. These lock in how a response splits
+// into values (address and leading line noise stripped, signs kept, a line
+// ending after a value stops it), the numbers the locale-free parser reads
+// and the ones it rejects, how the caller's array is filled when the response
+// holds fewer or more values than expected, and that none of it allocates.
+// The benchmark reports responses per millisecond against strtof on the same
+// tokens.
+#include <unity.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <new>
+
+#include "resources/utils/sdi_response.h"
+
+using namespace hyphen::sdi;
+
+// every operator new in this process is counted
+static size_t allocations = 0;
+void *operator new(size_t n) {
+  allocations++;
+  void *p = malloc(n ? n : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+void setUp() {}
+void tearDown() {}
+
+static const char *kResponse = "0+21.4-3.25+1013+0.000\r\n";
+
+static bool tokenIs(const Token &token, const char *text) {
+  return token.length == strlen(text) && memcmp(token.data, text, token.length) == 0;
+}
+
+void test_tokens_keep_their_signs() {
+  ValueTokenizer tokens(kResponse, strlen(kResponse));
+  Token token;
+  TEST_ASSERT_TRUE(tokens.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+21.4"));
+  TEST_ASSERT_TRUE(tokens.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "-3.25"));
+  TEST_ASSERT_TRUE(tokens.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+1013"));
+  TEST_ASSERT_TRUE(tokens.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+0.000"));
+  TEST_ASSERT_FALSE(tokens.next(token));
+  TEST_ASSERT_FALSE(tokens.next(token));
+}
+
+void test_tokenizer_edges() {
+  Token token;
+  // the first value is negative
+  const char *negative = "0-1.5+2";
+  ValueTokenizer first(negative, strlen(negative));
+  TEST_ASSERT_TRUE(first.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "-1.5"));
+  // a bare sign is skipped
+  const char *bare = "1+4-+5-";
+  ValueTokenizer skip(bare, strlen(bare));
+  TEST_ASSERT_TRUE(skip.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+4"));
+  TEST_ASSERT_TRUE(skip.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+5"));
+  TEST_ASSERT_FALSE(skip.next(token));
+  // no values at all, and nothing after the line ending
+  const char *none = "0\r\n";
+  ValueTokenizer empty(none, strlen(none));
+  TEST_ASSERT_FALSE(empty.next(token));
+  const char *after = "0+1\r\n+7";
+  ValueTokenizer ended(after, strlen(after));
+  TEST_ASSERT_TRUE(ended.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+1"));
+  TEST_ASSERT_FALSE(ended.next(token));
+  // line noise ahead of the address, as readSDI leaves it
+  const char *noisy = "\r\n0+1.2+3.4\r\n";
+  ValueTokenizer noise(noisy, strlen(noisy));
+  TEST_ASSERT_TRUE(noise.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+1.2"));
+  TEST_ASSERT_TRUE(noise.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+3.4"));
+  TEST_ASSERT_FALSE(noise.next(token));
+  const char *split = "0\r\n+7";
+  ValueTokenizer late(split, strlen(split));
+  TEST_ASSERT_TRUE(late.next(token));
+  TEST_ASSERT_TRUE(tokenIs(token, "+7"));
+  ValueTokenizer nothing("", 0);
+  TEST_ASSERT_FALSE(nothing.next(token));
+}
+
+// NAN when rejected
+static float parsed(const char *text) {
+  float value = 12345.0f;
+  return parseNumber(text, strlen(text), value) ? value : NAN;
+}
+
+static bool rejects(const char *text) {
+  float value = 0.0f;
+  return !parseNumber(text, strlen(text), value);
+}
+
+void test_numbers() {
+  TEST_ASSERT_EQUAL_FLOAT(21.4f, parsed("+21.4"));
+  TEST_ASSERT_EQUAL_FLOAT(-3.25f, parsed("-3.25"));
+  TEST_ASSERT_EQUAL_FLOAT(1013.0f, parsed("1013"));
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, parsed("+0.000"));
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, parsed(".5"));
+  TEST_ASSERT_EQUAL_FLOAT(7.0f, parsed("7."));
+  TEST_ASSERT_EQUAL_FLOAT(-9999.0f, parsed("-9999"));
+  TEST_ASSERT_EQUAL_FLOAT(0.0000012f, parsed("0.0000012"));
+  TEST_ASSERT_EQUAL_FLOAT(1.23456789e12f, parsed("1234567890000"));
+  TEST_ASSERT_EQUAL_FLOAT(strtof("3.14159265358979", nullptr), parsed("3.14159265358979"));
+  TEST_ASSERT_TRUE(rejects(""));
+  TEST_ASSERT_TRUE(rejects("-"));
+  TEST_ASSERT_TRUE(rejects("."));
+  TEST_ASSERT_TRUE(rejects("1.2.3"));
+  TEST_ASSERT_TRUE(rejects("1/2"));
+  TEST_ASSERT_TRUE(rejects("1e3"));
+  TEST_ASSERT_TRUE(rejects("12 "));
+  TEST_ASSERT_TRUE(rejects("nan"));
+}
+
+void test_values_fill_the_callers_array() {
+  float out[6];
+  TEST_ASSERT_EQUAL(4, parseValues(kResponse, strlen(kResponse), out, 6, -9999.0f));
+  TEST_ASSERT_EQUAL_FLOAT(21.4f, out[0]);
+  TEST_ASSERT_EQUAL_FLOAT(-3.25f, out[1]);
+  TEST_ASSERT_EQUAL_FLOAT(1013.0f, out[2]);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, out[3]);
+  // the sensor sent fewer values than the device expects
+  TEST_ASSERT_EQUAL_FLOAT(-9999.0f, out[4]);
+  TEST_ASSERT_EQUAL_FLOAT(-9999.0f, out[5]);
+  // more than expected: the rest is counted, not written
+  float two[3] = {0.0f, 0.0f, 42.0f};
+  TEST_ASSERT_EQUAL(4, parseValues(kResponse, strlen(kResponse), two, 2, -9999.0f));
+  TEST_ASSERT_EQUAL_FLOAT(-3.25f, two[1]);
+  TEST_ASSERT_EQUAL_FLOAT(42.0f, two[2]);
+  // a garbled value is marked, its neighbours still read
+  const char *garbled = "0+1.5+2x+3";
+  TEST_ASSERT_EQUAL(3, parseValues(garbled, strlen(garbled), out, 3, -9999.0f));
+  TEST_ASSERT_EQUAL_FLOAT(1.5f, out[0]);
+  TEST_ASSERT_TRUE(isnan(out[1]));
+  TEST_ASSERT_EQUAL_FLOAT(3.0f, out[2]);
+}
+
+void test_no_allocations() {
+  float out[8];
+  size_t before = allocations;
+  for (int i = 0; i < 100; i++) {
+    parseValues(kResponse, strlen(kResponse), out, 8, -9999.0f);
+  }
+  TEST_ASSERT_EQUAL(0, allocations - before);
+}
+
+void test_benchmark() {
+  // an all-weather station's worth of values
+  const char *response = "0+12.3+180+4.7+270+9.8+0.00+1013.2+21.45-1.50+88.1+0+0+35.7+2.4+1.25\r\n";
+  const size_t length = strlen(response);
+  const int cycles = 200000;
+  float out[16];
+  float check = 0.0f;
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < cycles; i++) {
+    parseValues(response, length, out, 16, -9999.0f);
+    check += out[i % 15];
+  }
+  double ownUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+  float reference = 0.0f;
+  char scratch[32];
+  start = Clock::now();
+  for (int i = 0; i < cycles; i++) {
+    ValueTokenizer tokens(response, length);
+    Token token;
+    size_t n = 0;
+    while (tokens.next(token) && n < 16) {
+      memcpy(scratch, token.data, token.length);
+      scratch[token.length] = '\0';
+      out[n++] = strtof(scratch, nullptr);
+    }
+    reference += out[i % 15];
+  }
+  double strtofUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+  printf("parseValues: %.0f responses/ms, %.3f us each\n", cycles / ownUs * 1000.0, ownUs / cycles);
+  printf("strtof:      %.0f responses/ms, %.3f us each\n", cycles / strtofUs * 1000.0, strtofUs / cycles);
+  TEST_ASSERT_FLOAT_WITHIN(fabsf(reference) * 1e-4f, reference, check);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_tokens_keep_their_signs);
+  RUN_TEST(test_tokenizer_edges);
+  RUN_TEST(test_numbers);
+  RUN_TEST(test_values_fill_the_callers_array);
+  RUN_TEST(test_no_allocations);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
@@ -0,0 +1,186 @@
+// Native tests for the low-power series (src/resources/utils/series.h).
+//
+// While the radio is down every interval is recorded as a compact frame and
+// added to one series, uploaded as a single message when the radio is back.
+// These lock in the delta encoding of timestamps and cells (nulls included),
+// that a column takes the decimals of its most precise value, which rows a
+// series refuses (another shape, strings, a full series), and how many bytes
+// a measurement costs in a series against one JSON payload per interval.
+#include <unity.h>
+
+#include <stdio.h>
+
+#include <string>
+
+#include "resources/utils/series.h"
+
+using namespace hyphen::series;
+using hyphen::payload::JsonWriter;
+using hyphen::payload::MsgPackWriter;
+using hyphen::payload::PayloadSink;
+using hyphen::telemetry::CompactWriter;
+using hyphen::telemetry::Frame;
+
+void setUp() {}
+void tearDown() {}
+
+static uint8_t frameBuf[512];
+static uint8_t dictBuf[256];
+static int64_t cells[kMaxColumns * 16];
+static uint8_t seriesDict[256];
+static char out[4096];
+
+struct Reading {
+  float temperature;
+  double precipitation;
+  int level;
+};
+
+// one interval as DeviceManager::recordInterval records it
+static void writeInterval(PayloadSink &sink, const Reading &r) {
+  sink.beginObject("payload");
+  sink.add("temperature", r.temperature);
+  sink.add("pre", r.precipitation);
+  sink.add("wl_1", r.level);
+  sink.endObject();
+}
+
+static Result record(Series &series, CompactWriter &writer, uint32_t time, const Reading &r) {
+  writer.begin(time);
+  writeInterval(writer, r);
+  writer.endObject();
+  writer.seal(0, 0);
+  Frame frame;
+  hyphen::telemetry::parse(writer.data(), writer.length(), frame);
+  return series.append(frame, writer.dictionary(), writer.dictionaryLength(), writer.schema());
+}
+
+static std::string render(const Series &series) {
+  JsonWriter writer(out, sizeof(out));
+  writer.beginObject();
+  series.write(writer);
+  writer.endObject();
+  return writer.complete() ? writer.c_str() : "";
+}
+
+void test_scaled_follows_the_json_text() {
+  int64_t m;
+  int8_t d;
+  TEST_ASSERT_TRUE(scaled("21.4", 4, m, d));
+  TEST_ASSERT_EQUAL_INT64(214, m);
+  TEST_ASSERT_EQUAL(1, d);
+  TEST_ASSERT_TRUE(scaled("-0.05", 5, m, d));
+  TEST_ASSERT_EQUAL_INT64(-5, m);
+  TEST_ASSERT_EQUAL(2, d);
+  TEST_ASSERT_TRUE(scaled("1843", 4, m, d));
+  TEST_ASSERT_EQUAL(0, d);
+  TEST_ASSERT_FALSE(scaled("1.5e12", 6, m, d));
+}
+
+void test_rows_are_delta_encoded() {
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  Series series(cells, sizeof(cells) / sizeof(cells[0]), seriesDict, sizeof(seriesDict));
+  TEST_ASSERT_EQUAL(APPENDED, record(series, writer, 1760688000, {21.4f, 0.0, 1843}));
+  TEST_ASSERT_EQUAL(APPENDED, record(series, writer, 1760688600, {21.1f, NAN, 1840}));
+  TEST_ASSERT_EQUAL(APPENDED, record(series, writer, 1760689200, {20.95f, 0.25, 1840}));
+  TEST_ASSERT_EQUAL(3, series.rows());
+  // 20.95 takes the temperature column to two decimals; the null doesn't
+  // break the precipitation deltas
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"t0\":1760688000,\"dt\":[600,600],"
+      "\"schema\":{\"payload\":{\"temperature\":0,\"pre\":1,\"wl_1\":2}},"
+      "\"scale\":[2,2,0],"
+      "\"rows\":[[2140,0,1843],[-30,null,-3],[-15,25,0]]}",
+      render(series).c_str());
+}
+
+void test_other_rows_are_refused() {
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  Series series(cells, 3 * 3, seriesDict, sizeof(seriesDict));
+  record(series, writer, 100, {1.0f, 0.0, 1});
+
+  // another shape
+  writer.begin(200);
+  writer.add("target", 2u);
+  writer.endObject();
+  writer.seal(0, 0);
+  Frame frame;
+  hyphen::telemetry::parse(writer.data(), writer.length(), frame);
+  TEST_ASSERT_EQUAL(SHAPE_CHANGED, series.append(frame, writer.dictionary(), writer.dictionaryLength(), writer.schema()));
+
+  // a string can't be a cell
+  Series fresh(cells, 3 * 3, seriesDict, sizeof(seriesDict));
+  writer.begin(200);
+  writer.add("note", "x");
+  writer.endObject();
+  writer.seal(0, 0);
+  hyphen::telemetry::parse(writer.data(), writer.length(), frame);
+  TEST_ASSERT_EQUAL(UNBATCHABLE, fresh.append(frame, writer.dictionary(), writer.dictionaryLength(), writer.schema()));
+  TEST_ASSERT_TRUE(fresh.empty());
+
+  // room for three rows of three cells
+  TEST_ASSERT_EQUAL(APPENDED, record(series, writer, 200, {1.0f, 0.0, 1}));
+  TEST_ASSERT_EQUAL(APPENDED, record(series, writer, 300, {1.0f, 0.0, 1}));
+  TEST_ASSERT_EQUAL(FULL, record(series, writer, 400, {1.0f, 0.0, 1}));
+  series.clear();
+  TEST_ASSERT_EQUAL(APPENDED, record(series, writer, 400, {1.0f, 0.0, 1}));
+  TEST_ASSERT_EQUAL(1, series.rows());
+}
+
+void test_series_encodes_as_msgpack() {
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  Series series(cells, sizeof(cells) / sizeof(cells[0]), seriesDict, sizeof(seriesDict));
+  record(series, writer, 1000, {20.5f, 0.0, 10});
+  record(series, writer, 1600, {20.5f, 0.0, 11});
+  static uint8_t packed[1024];
+  MsgPackWriter packer(packed, sizeof(packed));
+  packer.beginObject();
+  TEST_ASSERT_TRUE(series.write(packer));
+  packer.endObject();
+  TEST_ASSERT_TRUE(packer.complete());
+  // the second row is three one-byte deltas
+  const uint8_t tail[] = {0x93, 0x00, 0x00, 0x01};
+  TEST_ASSERT_EQUAL_MEMORY(tail, packer.data() + packer.length() - sizeof(tail), sizeof(tail));
+}
+
+void test_bytes_per_measurement() {
+  const int intervals = 12;
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  Series series(cells, sizeof(cells) / sizeof(cells[0]), seriesDict, sizeof(seriesDict));
+  size_t separate = 0;
+  for (int i = 0; i < intervals; i++) {
+    Reading r = {18.0f + 0.1f * i, i % 3 ? 0.0 : 0.25, 1840 + i % 4};
+    record(series, writer, 1760688000 + 600 * i, r);
+    static char one[512];
+    JsonWriter json(one, sizeof(one));
+    json.beginObject();
+    json.add("device", "2e11908790c75fb5915953d7");
+    json.add("date", "2026-10-17T08:15:00+0000");
+    json.add("__id", "p1_Zq3k9c0bX2l1vT8w");
+    json.add("target", i);
+    writeInterval(json, r);
+    json.endObject();
+    separate += json.length();
+  }
+  JsonWriter batch(out, sizeof(out));
+  batch.beginObject();
+  batch.add("device", "2e11908790c75fb5915953d7");
+  batch.add("__id", "p1_Zq3k9c0bX2l1vT8w");
+  batch.add("target", 0);
+  series.write(batch);
+  batch.endObject();
+  TEST_ASSERT_TRUE(batch.complete());
+  printf("%d intervals: %zu bytes as separate payloads, %zu as one series (%.1f bytes per interval)\n", intervals,
+         separate, batch.length(), (double)batch.length() / intervals);
+  TEST_ASSERT_TRUE(batch.length() * 3 < separate);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_scaled_follows_the_json_text);
+  RUN_TEST(test_rows_are_delta_encoded);
+  RUN_TEST(test_other_rows_are_refused);
+  RUN_TEST(test_series_encodes_as_msgpack);
+  RUN_TEST(test_bytes_per_measurement);
+  return UNITY_END();
+}
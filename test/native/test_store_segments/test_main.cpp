@@ -0,0 +1,75 @@
+// Native tests for the offline queue's segment addressing
+// (src/resources/utils/store_segments.h).
+//
+// A failed drain used to re-append its unsent records to the one store file.
+// The queue now lives in fixed-size segments addressed by logical positions, so
+// a failed send leaves the head where it is. These lock in the position
+// arithmetic, that a frame never straddles two segments, and the segment names
+// written to the card.
+#include <unity.h>
+
+#include <string.h>
+
+#include "resources/utils/store_segments.h"
+
+using namespace hyphen::segments;
+
+static const uint32_t kSeg = 65536;
+
+void setUp() {}
+void tearDown() {}
+
+void test_position_splits_into_segment_and_offset() {
+  TEST_ASSERT_EQUAL_UINT32(0, segmentOf(0, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(0, segmentOf(kSeg - 1, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(1, segmentOf(kSeg, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(12, offsetIn(3 * kSeg + 12, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(3 * kSeg, segmentStart(3, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(4 * kSeg, nextSegment(3 * kSeg + 12, kSeg));
+}
+
+void test_frame_that_fits_stays_in_segment() {
+  TEST_ASSERT_EQUAL_UINT32(100, place(100, 200, kSeg));
+  // exactly filling the segment is fine
+  TEST_ASSERT_EQUAL_UINT32(kSeg - 200, place(kSeg - 200, 200, kSeg));
+}
+
+void test_frame_that_does_not_fit_starts_next_segment() {
+  TEST_ASSERT_EQUAL_UINT32(kSeg, place(kSeg - 100, 200, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(6 * kSeg, place(5 * kSeg + 65500, 100, kSeg));
+}
+
+void test_empty_segment_takes_any_frame() {
+  // a new segment never skips ahead, even for a frame as big as a segment
+  TEST_ASSERT_EQUAL_UINT32(2 * kSeg, place(2 * kSeg, kSeg, kSeg));
+}
+
+void test_segments_used() {
+  TEST_ASSERT_EQUAL_UINT32(0, segmentsUsed(500, 500, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(1, segmentsUsed(0, 1, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(1, segmentsUsed(0, kSeg, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(2, segmentsUsed(kSeg - 1, kSeg + 1, kSeg));
+  TEST_ASSERT_EQUAL_UINT32(3, segmentsUsed(kSeg + 10, 3 * kSeg + 10, kSeg));
+}
+
+void test_segment_names_are_8_3() {
+  char buf[16];
+  name(0, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_STRING("seg00000.rec", buf);
+  name(42, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_STRING("seg0002a.rec", buf);
+  // the highest segment of a 32-bit position space at the smallest segment
+  name(0xFFFFFFFFu / 32780, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_size_t(12, strlen(buf));
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_position_splits_into_segment_and_offset);
+  RUN_TEST(test_frame_that_fits_stays_in_segment);
+  RUN_TEST(test_frame_that_does_not_fit_starts_next_segment);
+  RUN_TEST(test_empty_segment_takes_any_frame);
+  RUN_TEST(test_segments_used);
+  RUN_TEST(test_segment_names_are_8_3);
+  return UNITY_END();
+}
@@ -0,0 +1,121 @@
+// Native tests for the offline store superblock
+// (src/resources/utils/store_superblock.h).
+//
+// The backlog count used to come from rescanning the whole store file at boot.
+// It now lives in an A/B superblock; these lock in the round trip, that a torn
+// slot write falls back to the previous state instead of losing the queue, and
+// that the generation counter survives wrapping.
+#include <unity.h>
+
+#include <string.h>
+
+#include "resources/utils/store_superblock.h"
+
+using namespace hyphen::superblock;
+
+void setUp() {}
+void tearDown() {}
+
+static Superblock make(uint32_t gen, uint32_t head, uint32_t tail, uint32_t count) {
+  Superblock sb;
+  sb.generation = gen;
+  sb.head = head;
+  sb.tail = tail;
+  sb.count = count;
+  return sb;
+}
+
+// Write `sb` into its slot the way PayloadStore::commitSuperblock does.
+static void commit(uint8_t *file, const Superblock &sb) {
+  encode(sb, file + slotOffset(sb.generation));
+}
+
+void test_round_trip() {
+  uint8_t slot[kSlotSize];
+  encode(make(7, 100, 4096, 42), slot);
+  Superblock out;
+  TEST_ASSERT_TRUE(decode(slot, out));
+  TEST_ASSERT_EQUAL_UINT32(7, out.generation);
+  TEST_ASSERT_EQUAL_UINT32(100, out.head);
+  TEST_ASSERT_EQUAL_UINT32(4096, out.tail);
+  TEST_ASSERT_EQUAL_UINT32(42, out.count);
+}
+
+void test_blank_file_is_not_a_superblock() {
+  uint8_t file[kFileSize];
+  memset(file, 0, sizeof(file));
+  Superblock out;
+  TEST_ASSERT_FALSE(load(file, sizeof(file), out));
+  TEST_ASSERT_FALSE(load(file, 0, out));
+}
+
+void test_newest_slot_wins() {
+  uint8_t file[kFileSize];
+  commit(file, make(10, 0, 100, 1));
+  commit(file, make(11, 0, 200, 2));
+  Superblock out;
+  TEST_ASSERT_TRUE(load(file, sizeof(file), out));
+  TEST_ASSERT_EQUAL_UINT32(11, out.generation);
+  TEST_ASSERT_EQUAL_UINT32(2, out.count);
+
+  commit(file, make(12, 50, 200, 1));  // overwrites gen 10's slot
+  TEST_ASSERT_TRUE(load(file, sizeof(file), out));
+  TEST_ASSERT_EQUAL_UINT32(12, out.generation);
+  TEST_ASSERT_EQUAL_UINT32(50, out.head);
+}
+
+void test_torn_write_falls_back_to_previous_state() {
+  uint8_t file[kFileSize];
+  commit(file, make(20, 0, 300, 3));
+  commit(file, make(21, 0, 400, 4));
+  // brownout halfway through writing generation 22 (slot 0)
+  uint8_t next[kSlotSize];
+  encode(make(22, 0, 500, 5), next);
+  memcpy(file + slotOffset(22), next, kSlotSize / 2);
+
+  Superblock out;
+  TEST_ASSERT_TRUE(load(file, sizeof(file), out));
+  TEST_ASSERT_EQUAL_UINT32(21, out.generation);
+  TEST_ASSERT_EQUAL_UINT32(4, out.count);
+}
+
+void test_generation_wraps() {
+  uint8_t file[kFileSize];
+  commit(file, make(0xFFFFFFFFu, 0, 10, 1));
+  commit(file, make(0u, 0, 20, 2));
+  Superblock out;
+  TEST_ASSERT_TRUE(load(file, sizeof(file), out));
+  TEST_ASSERT_EQUAL_UINT32(0u, out.generation);
+  TEST_ASSERT_EQUAL_UINT32(2, out.count);
+}
+
+void test_head_past_tail_is_rejected() {
+  uint8_t slot[kSlotSize];
+  encode(make(1, 500, 100, 0), slot);
+  Superblock out;
+  TEST_ASSERT_FALSE(decode(slot, out));
+}
+
+void test_older_version_only_loads_on_request() {
+  uint8_t file[kFileSize];
+  memset(file, 0, sizeof(file));
+  encode(make(3, 10, 90, 2), file + slotOffset(3));
+  file[slotOffset(3) + 4] = 1;  // a version 1 slot, CRC fixed up below
+  hyphen::records::putU32(file + slotOffset(3) + 28, hyphen::records::crc32(file + slotOffset(3), 28));
+  Superblock out;
+  TEST_ASSERT_FALSE(load(file, sizeof(file), out));
+  TEST_ASSERT_TRUE(load(file, sizeof(file), out, 1));
+  TEST_ASSERT_EQUAL_UINT32(90, out.tail);
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_blank_file_is_not_a_superblock);
+  RUN_TEST(test_newest_slot_wins);
+  RUN_TEST(test_torn_write_falls_back_to_previous_state);
+  RUN_TEST(test_generation_wraps);
+  RUN_TEST(test_head_past_tail_is_rejected);
+  RUN_TEST(test_older_version_only_loads_on_request);
+  return UNITY_END();
+}
@@ -0,0 +1,160 @@
+// Native tests for the compact telemetry frames (src/resources/utils/telemetry.h).
+//
+// A compact frame carries only the values; the cloud decodes it against the
+// dictionary the device announced. These lock in that a frame expands back to
+// exactly the JSON the devices would have written, that the schema id stays
+// put from cycle to cycle and moves when the keys or the device list change,
+// that a frame and a dictionary that disagree are refused, and how much
+// smaller the frame is than the JSON payload.
+#include <unity.h>
+
+#include <stdio.h>
+
+#include <string>
+
+#include "resources/utils/telemetry.h"
+
+using namespace hyphen::telemetry;
+using hyphen::payload::JsonWriter;
+using hyphen::payload::PayloadSink;
+
+void setUp() {}
+void tearDown() {}
+
+static uint8_t frameBuf[1024];
+static uint8_t dictBuf[512];
+static char jsonBuf[2048];
+
+// what DeviceManager::payloadWriter writes in one cycle, minus the envelope
+// keys the frame header replaces
+static void writeDevices(PayloadSink &sink, float temperature, int level, bool extra = false) {
+  sink.add("target", 7u);
+  sink.add("__id", "p1_Zq3k9c0bX2l1vT8w");
+  sink.beginObject("payload");
+  sink.add("sol", 412.5f);
+  sink.add("pre", 0.0);
+  sink.add("temperature", temperature);
+  sink.add("ws", -3);
+  sink.add("wl_1", level);
+  sink.add("strike", 70000L);
+  sink.add("ok", true);
+  sink.add("note", "a\"b");
+  if (extra) {
+    sink.add("hum", 63.2f);
+  }
+  sink.endObject();
+  sink.beginObject("payload-1");
+  sink.add("bat", 98.0);
+  sink.endObject();
+}
+
+static size_t compact(CompactWriter &writer, uint32_t salt, float temperature, int level, bool extra = false) {
+  writer.begin(1760688900);
+  writeDevices(writer, temperature, level, extra);
+  writer.endObject();
+  return writer.seal(salt, 0) ? writer.length() : 0;
+}
+
+static std::string json(float temperature, int level) {
+  JsonWriter writer(jsonBuf, sizeof(jsonBuf));
+  writer.beginObject();
+  writeDevices(writer, temperature, level);
+  writer.endObject();
+  return writer.c_str();
+}
+
+void test_frame_expands_to_the_payload() {
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  TEST_ASSERT_TRUE(compact(writer, 0x1234, 21.4f, 1843) > 0);
+
+  Frame frame;
+  TEST_ASSERT_TRUE(parse(writer.data(), writer.length(), frame));
+  TEST_ASSERT_EQUAL_UINT32(1760688900, frame.timestamp);
+  TEST_ASSERT_EQUAL_UINT32(writer.schema(), frame.schema);
+
+  static char out[2048];
+  JsonWriter expanded(out, sizeof(out));
+  expanded.beginObject();
+  TEST_ASSERT_TRUE(expand(frame, writer.dictionary(), writer.dictionaryLength(), expanded));
+  expanded.endObject();
+  TEST_ASSERT_TRUE(expanded.complete());
+  TEST_ASSERT_EQUAL_STRING(json(21.4f, 1843).c_str(), expanded.c_str());
+}
+
+void test_schema_is_stable_across_cycles() {
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  compact(writer, 0x1234, 21.4f, 1843);
+  uint32_t first = writer.schema();
+  compact(writer, 0x1234, -8.25f, 12);
+  TEST_ASSERT_EQUAL_UINT32(first, writer.schema());
+  // another device list, or another parameter, is another schema
+  compact(writer, 0x9999, -8.25f, 12);
+  TEST_ASSERT_NOT_EQUAL(first, writer.schema());
+  compact(writer, 0x1234, -8.25f, 12, true);
+  TEST_ASSERT_NOT_EQUAL(first, writer.schema());
+}
+
+void test_mismatched_dictionary_is_refused() {
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  compact(writer, 0x1234, 21.4f, 1843, true);
+  static uint8_t longer[512];
+  size_t longerLen = writer.dictionaryLength();
+  memcpy(longer, writer.dictionary(), longerLen);
+
+  compact(writer, 0x1234, 21.4f, 1843);
+  Frame frame;
+  parse(writer.data(), writer.length(), frame);
+  JsonWriter out(jsonBuf, sizeof(jsonBuf));
+  out.beginObject();
+  // the dictionary has one value more than the frame
+  TEST_ASSERT_FALSE(expand(frame, longer, longerLen, out));
+
+  uint8_t bad[16] = {kVersion + 1, 0, 0, 0, 0, 0, 1};
+  TEST_ASSERT_FALSE(parse(bad, sizeof(bad), frame));
+  TEST_ASSERT_FALSE(parse(writer.data(), 5, frame));
+}
+
+void test_describe_numbers_the_values() {
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  compact(writer, 0, 21.4f, 1843);
+  JsonWriter out(jsonBuf, sizeof(jsonBuf));
+  out.beginObject();
+  TEST_ASSERT_TRUE(describe(writer.dictionary(), writer.dictionaryLength(), out));
+  out.endObject();
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"target\":0,\"__id\":1,\"payload\":{\"sol\":2,\"pre\":3,\"temperature\":4,\"ws\":5,\"wl_1\":6,"
+      "\"strike\":7,\"ok\":8,\"note\":9},\"payload-1\":{\"bat\":10}}",
+      out.c_str());
+}
+
+void test_full_dictionary_fails_the_frame() {
+  uint8_t small[20];
+  CompactWriter writer(frameBuf, sizeof(frameBuf), small, sizeof(small));
+  writer.begin(1);
+  writeDevices(writer, 1.0f, 1);
+  writer.endObject();
+  TEST_ASSERT_FALSE(writer.ok());
+  TEST_ASSERT_FALSE(writer.seal(0, 0));
+}
+
+void test_frame_is_smaller_than_json() {
+  CompactWriter writer(frameBuf, sizeof(frameBuf), dictBuf, sizeof(dictBuf));
+  size_t frameLen = compact(writer, 0x1234, 21.4f, 1843);
+  // the JSON also carries the device id and the date the header replaces
+  size_t jsonLen = json(21.4f, 1843).size() + strlen(",\"device\":\"2e11908790c75fb5915953d7\"") +
+                   strlen(",\"date\":\"2026-10-17T08:15:00+0000\"");
+  printf("compact frame: %zu bytes, JSON payload: %zu bytes (%.1fx)\n", frameLen, jsonLen,
+         (double)jsonLen / frameLen);
+  TEST_ASSERT_TRUE(frameLen * 3 < jsonLen);
+}
+
+int main(int, char **) {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_expands_to_the_payload);
+  RUN_TEST(test_schema_is_stable_across_cycles);
+  RUN_TEST(test_mismatched_dictionary_is_refused);
+  RUN_TEST(test_describe_numbers_the_values);
+  RUN_TEST(test_full_dictionary_fails_the_frame);
+  RUN_TEST(test_frame_is_smaller_than_json);
+  return UNITY_END();
+}
@@ -4,7 +4,8 @@
 // (device-manager.cpp), whose `(millis() - timeout) < start` math underflowed
 // and returned the wrong answer during the first `timeout` ms after boot and
 // across the ~49.7-day millis() rollover. The helper is a pure function of plain
-// integers, so these tests need no Arduino/clock shim at all.
+// integers, so these tests need no Arduino/clock shim at all. The Latency
+// stat behind the signing and verify metrics is checked here too.
 #include <unity.h>
 
 #include "resources/utils/timing.h"
@@ -69,6 +70,18 @@ void test_rollover_window_not_falsely_timed_out() {
   TEST_ASSERT_TRUE(timedOut(start, now, /*timeout=*/10000));
 }
 
+void test_latency_keeps_last_max_and_mean() {
+  hyphen::timing::Latency latency;
+  TEST_ASSERT_EQUAL_UINT32(0, latency.mean());
+  latency.record(30000);
+  latency.record(1200);
+  latency.record(1500);
+  TEST_ASSERT_EQUAL_UINT32(3, latency.count());
+  TEST_ASSERT_EQUAL_UINT32(1500, latency.last());
+  TEST_ASSERT_EQUAL_UINT32(30000, latency.max());
+  TEST_ASSERT_EQUAL_UINT32(10900, latency.mean());
+}
+
 int main(int, char**) {
   UNITY_BEGIN();
   RUN_TEST(test_elapsed_basic);
@@ -79,5 +92,6 @@ int main(int, char**) {
   RUN_TEST(test_zero_timeout_is_always_elapsed);
   RUN_TEST(test_boot_window_not_prematurely_timed_out);
   RUN_TEST(test_rollover_window_not_falsely_timed_out);
+  RUN_TEST(test_latency_keeps_last_max_and_mean);
   return UNITY_END();
 }
@@ -0,0 +1,104 @@
+// Native tests for the SD writer's group commit policy and stats
+// (src/resources/utils/write_policy.h).
+//
+// Appends are no longer written through one open/close per record; they wait in
+// a buffer until the policy says commit. These lock in when that happens (record
+// count, age, rollover), sector alignment of the buffers, and the throughput and
+// sync latency figures reported in the heartbeat, with the count of appends
+// that found the bus busy.
+#include <unity.h>
+
+#include "resources/utils/write_policy.h"
+
+using namespace hyphen::sdwriter;
+
+void setUp() {}
+void tearDown() {}
+
+static CommitPolicy policy(uint16_t records, uint32_t ageMs) {
+  CommitPolicy p;
+  p.maxRecords = records;
+  p.maxAgeMs = ageMs;
+  return p;
+}
+
+void test_capacity_is_sector_aligned() {
+  TEST_ASSERT_EQUAL_size_t(512, alignedCapacity(0));
+  TEST_ASSERT_EQUAL_size_t(512, alignedCapacity(1));
+  TEST_ASSERT_EQUAL_size_t(512, alignedCapacity(512));
+  TEST_ASSERT_EQUAL_size_t(1024, alignedCapacity(513));
+  TEST_ASSERT_EQUAL_size_t(2048, alignedCapacity(2000));
+}
+
+void test_commit_after_n_records() {
+  GroupCommit g(policy(3, 0));
+  TEST_ASSERT_FALSE(g.due(0));
+  g.onAppend(0);
+  g.onAppend(0);
+  TEST_ASSERT_FALSE(g.due(1000000));
+  g.onAppend(0);
+  TEST_ASSERT_TRUE(g.due(0));
+  g.onCommit();
+  TEST_ASSERT_FALSE(g.due(0));
+  TEST_ASSERT_EQUAL_UINT16(0, g.pending());
+}
+
+void test_commit_after_oldest_append_ages_out() {
+  GroupCommit g(policy(0, 5000));
+  g.onAppend(1000);
+  g.onAppend(5000);  // doesn't restart the clock
+  TEST_ASSERT_FALSE(g.due(5999));
+  TEST_ASSERT_TRUE(g.due(6000));
+}
+
+void test_age_survives_millis_rollover() {
+  GroupCommit g(policy(0, 100));
+  g.onAppend(0xFFFFFFF0u);
+  TEST_ASSERT_FALSE(g.due(0x00000010u));
+  TEST_ASSERT_TRUE(g.due(0x00000060u));
+}
+
+void test_write_through_policy() {
+  GroupCommit g(policy(1, 0));
+  g.onAppend(42);
+  TEST_ASSERT_TRUE(g.due(42));
+}
+
+void test_sync_latency_stats() {
+  WriteStats s;
+  TEST_ASSERT_EQUAL_UINT32(0, s.syncMeanMs());
+  s.onSync(10);
+  s.onSync(30);
+  s.onSync(2);
+  TEST_ASSERT_EQUAL_UINT32(3, s.syncs());
+  TEST_ASSERT_EQUAL_UINT32(2, s.syncMinMs());
+  TEST_ASSERT_EQUAL_UINT32(30, s.syncMaxMs());
+  TEST_ASSERT_EQUAL_UINT32(14, s.syncMeanMs());
+  TEST_ASSERT_EQUAL_UINT32(0, s.busy());
+  s.onBusy();
+  TEST_ASSERT_EQUAL_UINT32(1, s.busy());
+}
+
+void test_bytes_per_second_over_window() {
+  WriteStats s(10000);
+  TEST_ASSERT_EQUAL_UINT32(0, s.bytesPerSecond(0));
+  s.onWrite(4096, 1000);
+  s.onWrite(4096, 3000);
+  TEST_ASSERT_EQUAL_UINT32(4096, s.bytesPerSecond(3000));
+  // a new window starts, the last one's rate is reported until it fills
+  s.onWrite(512, 12000);
+  TEST_ASSERT_EQUAL_UINT32(8192 * 1000 / 11000, s.bytesPerSecond(12100));
+  TEST_ASSERT_EQUAL_UINT64(8704, s.totalBytes());
+}
+
+int main(int, char**) {
+  UNITY_BEGIN();
+  RUN_TEST(test_capacity_is_sector_aligned);
+  RUN_TEST(test_commit_after_n_records);
+  RUN_TEST(test_commit_after_oldest_append_ages_out);
+  RUN_TEST(test_age_survives_millis_rollover);
+  RUN_TEST(test_write_through_policy);
+  RUN_TEST(test_sync_latency_stats);
+  RUN_TEST(test_bytes_per_second_over_window);
+  return UNITY_END();
+}